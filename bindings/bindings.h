@@ -111,6 +111,7 @@ uint64_t platform_mem_size(void);
 void platform_exit(int status, void *cookie) __attribute__((noreturn));
 int platform_puts(const char *buf, int n);
 int platform_set_tls_base(uint64_t base);
+int platform_mem_release(uintptr_t addr, size_t size);
 
 /* platform_intr.c: platform-specific interrupt handling */
 void platform_intr_init(void);
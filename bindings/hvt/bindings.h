@@ -35,6 +35,38 @@ void time_init(const struct hvt_boot_info *bi);
 void console_init(void);
 void net_init(const struct hvt_boot_info *bi);
 void block_init(const struct hvt_boot_info *bi);
+void multicall_init(const struct hvt_boot_info *bi);
+
+/*
+ * multicall.c: Batching of hypercalls. (done), if not NULL, is called with
+ * (arg) once a deferred hypercall has been performed, and must not itself
+ * make hypercalls.
+ */
+typedef void (*hvt_deferred_fn_t)(volatile void *arg);
+extern size_t hvt_hypercall_ndeferred;
+void hvt_hypercall_defer(int nr, volatile void *arg, hvt_deferred_fn_t done);
+void hvt_hypercall_batched(int nr, volatile void *arg);
+void hvt_hypercall_flush(void);
+
+/*
+ * Perform hypercall (nr) with each of the (count) arguments in (args), in
+ * order, after any deferred hypercalls. Stops at the first hypercall setting
+ * a non-zero (ret), leaving those following it unperformed. (count) may only
+ * be more than 1 if hvt_multicall_supported().
+ */
+void hvt_hypercall_many(int nr, volatile void *const args[], size_t count);
+
+/*
+ * Perform hypercall (nr), together with any deferred hypercalls.
+ */
+static inline void hvt_hypercall(int nr, volatile void *arg)
+{
+    if (hvt_hypercall_ndeferred == 0)
+        hvt_do_hypercall(nr, arg);
+    else
+        hvt_hypercall_batched(nr, arg);
+}
+bool hvt_multicall_supported(void);
 
 /* tscclock.c: TSC-based clock */
 uint64_t tscclock_monotonic(void);
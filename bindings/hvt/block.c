@@ -21,6 +21,29 @@
 #include "bindings.h"
 
 static const struct mft *mft;
+static bool async_supported;
+
+/*
+ * If the tender supports HVT_HYPERCALL_MULTICALL, requests queued with
+ * solo5_block_submit() are deferred and submitted together with the next
+ * hypercall, typically the HVT_HYPERCALL_POLL of solo5_yield() or the
+ * HVT_HYPERCALL_BLOCK_REAP of solo5_block_reap(). So that the result of
+ * solo5_block_submit() can still be returned straight away, the checks made
+ * by the tender are repeated here, and the number of outstanding requests on
+ * each device is tracked.
+ */
+static bool submit_deferred;
+static struct hvt_hc_block_submit submits[HVT_MULTICALL_MAX];
+static size_t nsubmits;
+static unsigned outstanding[MFT_MAX_ENTRIES];
+
+static void submit_done(volatile void *arg)
+{
+    volatile struct hvt_hc_block_submit *sb = arg;
+
+    assert(sb->ret == SOLO5_R_OK);
+    nsubmits--;
+}
 
 solo5_result_t solo5_block_write(solo5_handle_t handle, solo5_off_t offset,
                                  const uint8_t *buf, size_t size)
@@ -43,14 +66,14 @@ solo5_result_t solo5_block_write(solo5_handle_t handle, solo5_off_t offset,
     if (size != e->u.block_basic.block_size)
         return SOLO5_R_EINVAL;
 
-    volatile struct hvt_hc_block_write wr;
+    static volatile struct hvt_hc_block_write wr;
     wr.handle = handle;
     wr.offset = offset;
     wr.data = buf;
     wr.len = size;
     wr.ret = 0;
 
-    hvt_do_hypercall(HVT_HYPERCALL_BLOCK_WRITE, &wr);
+    hvt_hypercall(HVT_HYPERCALL_BLOCK_WRITE, &wr);
 
     return wr.ret;
 }
@@ -76,18 +99,108 @@ solo5_result_t solo5_block_read(solo5_handle_t handle, solo5_off_t offset,
     if (size != e->u.block_basic.block_size)
         return SOLO5_R_EINVAL;
 
-    volatile struct hvt_hc_block_read rd;
+    static volatile struct hvt_hc_block_read rd;
     rd.handle = handle;
     rd.offset = offset;
     rd.data = buf;
     rd.len = size;
     rd.ret = 0;
 
-    hvt_do_hypercall(HVT_HYPERCALL_BLOCK_READ, &rd);
+    hvt_hypercall(HVT_HYPERCALL_BLOCK_READ, &rd);
 
     return rd.ret;
 }
 
+solo5_result_t solo5_block_submit(solo5_handle_t handle, solo5_block_op_t op,
+                                  solo5_off_t offset, uint8_t *buf,
+                                  size_t size, uint64_t tag)
+{
+    if (!async_supported)
+        return SOLO5_R_EUNSPEC;
+
+    const struct mft_entry *e =
+        mft_get_by_index(mft, handle, MFT_DEV_BLOCK_BASIC);
+    if (e == NULL)
+        return SOLO5_R_EINVAL;
+    if (offset & (e->u.block_basic.block_size - 1))
+        return SOLO5_R_EINVAL;
+    /*
+     * See solo5_block_write(); capacity checks are enforced by the tender.
+     */
+    if (size != e->u.block_basic.block_size)
+        return SOLO5_R_EINVAL;
+    if (op != SOLO5_BLOCK_OP_READ && op != SOLO5_BLOCK_OP_WRITE)
+        return SOLO5_R_EINVAL;
+
+    /*
+     * The request is only submitted together with the next hypercall, at the
+     * latest that made by solo5_yield() or solo5_block_reap(); see solo5.h.
+     */
+    if (submit_deferred) {
+        if (!e->attached || offset >= e->u.block_basic.capacity ||
+            size > e->u.block_basic.capacity - offset)
+            return SOLO5_R_EINVAL;
+        if (outstanding[handle] == HVT_BLOCK_QUEUE_DEPTH)
+            return SOLO5_R_AGAIN;
+        if (nsubmits == HVT_MULTICALL_MAX - 1)
+            hvt_hypercall_flush();
+
+        struct hvt_hc_block_submit *sb = &submits[nsubmits++];
+        sb->handle = handle;
+        sb->op = (op == SOLO5_BLOCK_OP_WRITE) ? HVT_BLOCK_OP_WRITE
+                                              : HVT_BLOCK_OP_READ;
+        sb->offset = offset;
+        sb->data = buf;
+        sb->len = size;
+        sb->tag = tag;
+        sb->ret = 0;
+        hvt_hypercall_defer(HVT_HYPERCALL_BLOCK_SUBMIT, sb, submit_done);
+        outstanding[handle]++;
+        return SOLO5_R_OK;
+    }
+
+    static volatile struct hvt_hc_block_submit sb;
+    sb.handle = handle;
+    sb.op = (op == SOLO5_BLOCK_OP_WRITE) ? HVT_BLOCK_OP_WRITE
+                                         : HVT_BLOCK_OP_READ;
+    sb.offset = offset;
+    sb.data = buf;
+    sb.len = size;
+    sb.tag = tag;
+    sb.ret = 0;
+
+    hvt_hypercall(HVT_HYPERCALL_BLOCK_SUBMIT, &sb);
+
+    return sb.ret;
+}
+
+solo5_result_t solo5_block_reap(solo5_handle_t handle,
+                                struct solo5_block_completion *completions,
+                                size_t count, size_t *reaped)
+{
+    if (!async_supported)
+        return SOLO5_R_EUNSPEC;
+
+    struct hvt_block_completion hc[HVT_BLOCK_QUEUE_DEPTH];
+    static volatile struct hvt_hc_block_reap rp;
+    rp.handle = handle;
+    rp.completions = hc;
+    rp.count = (count < HVT_BLOCK_QUEUE_DEPTH) ? count : HVT_BLOCK_QUEUE_DEPTH;
+    rp.reaped = 0;
+    rp.ret = 0;
+
+    hvt_hypercall(HVT_HYPERCALL_BLOCK_REAP, &rp);
+
+    for (size_t i = 0; i < rp.reaped; i++) {
+        completions[i].tag = hc[i].tag;
+        completions[i].result = (solo5_result_t)hc[i].ret;
+    }
+    if (submit_deferred && rp.ret == SOLO5_R_OK)
+        outstanding[handle] -= rp.reaped;
+    *reaped = rp.reaped;
+    return rp.ret;
+}
+
 solo5_result_t solo5_block_acquire(const char *name, solo5_handle_t *handle,
                                    struct solo5_block_info *info)
 {
@@ -107,4 +220,6 @@ solo5_result_t solo5_block_acquire(const char *name, solo5_handle_t *handle,
 void block_init(const struct hvt_boot_info *bi)
 {
     mft = bi->mft;
+    async_supported = bi->host_features & HVT_FEATURE_BLOCK_ASYNC;
+    submit_deferred = async_supported && hvt_multicall_supported();
 }
@@ -22,12 +22,12 @@
 
 int platform_puts(const char *buf, int n)
 {
-    struct hvt_hc_puts str;
+    static struct hvt_hc_puts str;
 
     str.data = (const char *)buf;
     str.len = n;
 
-    hvt_do_hypercall(HVT_HYPERCALL_PUTS, &str);
+    hvt_hypercall(HVT_HYPERCALL_PUTS, &str);
 
     return str.len;
 }
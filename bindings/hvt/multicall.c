@@ -0,0 +1,113 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * multicall.c: Batching of hypercalls.
+ *
+ * Hypercalls whose results are not needed right away may be deferred with
+ * hvt_hypercall_defer(). They are performed, in order, together with the next
+ * hypercall made with hvt_hypercall(), in a single VM exit if the tender
+ * supports HVT_HYPERCALL_MULTICALL, or one at a time otherwise.
+ */
+
+#include "bindings.h"
+
+static bool multicall_supported;
+static struct hvt_multicall_entry calls[HVT_MULTICALL_MAX];
+static hvt_deferred_fn_t done_fns[HVT_MULTICALL_MAX];
+size_t hvt_hypercall_ndeferred;
+
+static void perform(size_t count, uint64_t flags)
+{
+    if (count > 1 && multicall_supported) {
+        static volatile struct hvt_hc_multicall mc;
+
+        mc.calls = calls;
+        mc.count = count;
+        mc.flags = flags;
+        mc.ret = 0;
+        hvt_do_hypercall(HVT_HYPERCALL_MULTICALL, &mc);
+        /*
+         * Only hypercalls offered by the tender are made, so this would have
+         * been fatal had they been made directly.
+         */
+        assert(mc.ret == 0 || (flags & HVT_MULTICALL_STOP_ON_ERROR));
+    } else {
+        for (size_t i = 0; i < count; i++)
+            hvt_do_hypercall((int)calls[i].nr, calls[i].arg);
+    }
+
+    size_t n = hvt_hypercall_ndeferred;
+    hvt_hypercall_ndeferred = 0;
+    for (size_t i = 0; i < n; i++)
+        if (done_fns[i] != NULL)
+            done_fns[i](calls[i].arg);
+}
+
+void hvt_hypercall_defer(int nr, volatile void *arg, hvt_deferred_fn_t done)
+{
+    if (hvt_hypercall_ndeferred == HVT_MULTICALL_MAX - 1)
+        hvt_hypercall_flush();
+
+    size_t i = hvt_hypercall_ndeferred++;
+    calls[i].nr = nr;
+    calls[i].arg = arg;
+    calls[i].ret = 0;
+    done_fns[i] = done;
+}
+
+void hvt_hypercall_batched(int nr, volatile void *arg)
+{
+    size_t i = hvt_hypercall_ndeferred;
+    calls[i].nr = nr;
+    calls[i].arg = arg;
+    calls[i].ret = 0;
+    perform(i + 1, 0);
+}
+
+void hvt_hypercall_flush(void)
+{
+    if (hvt_hypercall_ndeferred > 0)
+        perform(hvt_hypercall_ndeferred, 0);
+}
+
+void hvt_hypercall_many(int nr, volatile void *const args[], size_t count)
+{
+    assert(count <= HVT_MULTICALL_MAX);
+    assert(count == 1 || multicall_supported);
+
+    hvt_hypercall_flush();
+    for (size_t i = 0; i < count; i++) {
+        calls[i].nr = nr;
+        calls[i].arg = args[i];
+        calls[i].ret = 0;
+    }
+    perform(count, HVT_MULTICALL_STOP_ON_ERROR);
+}
+
+bool hvt_multicall_supported(void)
+{
+    return multicall_supported;
+}
+
+void multicall_init(const struct hvt_boot_info *bi)
+{
+    multicall_supported = bi->host_features & HVT_FEATURE_MULTICALL;
+}
@@ -23,6 +23,7 @@
 
 static const struct mft *mft;
 static struct hvt_ring *net_ring;
+static bool net_ring_tx_blocked; /* Host offers HVT_FEATURE_NET_TX_BLOCKED */
 static uint32_t ring_req_id;
 /* Here, we’re doing things differently from VirtIO, which allocates buffers
  * using `malloc()`. Our buffers will be in the .bss section! */
@@ -38,14 +39,14 @@ static inline void cpu_relax(void)
 }
 
 /*
- * Submit a request to the ring and kick if needed.
+ * Submit (n) requests to the ring and kick if needed.
  * Does NOT wait for completion, caller decides whether to wait.
  */
-static inline void ring_submit(struct hvt_ring *ring)
+static inline void ring_submit_n(struct hvt_ring *ring, uint32_t n)
 {
     /* as VirtIO, we add wmb() here to add a new entry. */
     hvt_wmb();
-    ring->ent_tail++;
+    ring->ent_tail += n;
 
     /* Kick suppression: only signal the I/O thread via ioeventfd if it has
      * indicated it is about to sleep (needs_kick == 1). When the thread is
@@ -66,16 +67,40 @@ static inline void ring_submit(struct hvt_ring *ring)
         hvt_ring_kick(0);
 }
 
+static inline void ring_submit(struct hvt_ring *ring)
+{
+    ring_submit_n(ring, 1);
+}
+
+/*
+ * True if the host has stopped consuming the ring until it can transmit the
+ * frame at its head (the TAP queue is full, or a rate limit applies).
+ */
+static inline bool ring_tx_blocked(const struct hvt_ring *ring)
+{
+    return net_ring_tx_blocked && ring->tx_blocked;
+}
+
+static inline bool ring_full(const struct hvt_ring *ring, uint32_t tail)
+{
+    return (tail - ring->ent_head) >= (HVT_RING_SIZE - 1);
+}
+
 solo5_result_t solo5_net_write(solo5_handle_t handle, const uint8_t *buf,
                                size_t size)
 {
     if (net_ring) {
         /*
          * Flow control: wait if the ring is full. The host advances ent_head
-         * after processing each write, freeing slots.
+         * after processing each write, freeing slots. If the host is
+         * unable to transmit (full TAP queue, rate limit), the ring will not
+         * drain any time soon, so report backpressure to the caller instead.
          */
-        while ((net_ring->ent_tail - net_ring->ent_head) >= (HVT_RING_SIZE - 1))
+        while (ring_full(net_ring, net_ring->ent_tail)) {
+            if (ring_tx_blocked(net_ring))
+                return SOLO5_R_AGAIN;
             cpu_relax();
+        }
 
         uint32_t idx = net_ring->ent_tail & HVT_RING_MASK;
         struct hvt_ring_entry *ent = &net_ring->entries[idx];
@@ -104,18 +129,141 @@ solo5_result_t solo5_net_write(solo5_handle_t handle, const uint8_t *buf,
     }
 
 hypercall_write:;
-    volatile struct hvt_hc_net_write wr;
+    static volatile struct hvt_hc_net_write wr;
 
     wr.handle = handle;
     wr.data = buf;
     wr.len = size;
     wr.ret = 0;
 
-    hvt_do_hypercall(HVT_HYPERCALL_NET_WRITE, &wr);
+    hvt_hypercall(HVT_HYPERCALL_NET_WRITE, &wr);
 
     return wr.ret;
 }
 
+/*
+ * Write the (count) frames in (bufs) with HVT_HYPERCALL_NET_WRITE, as many as
+ * possible in a single VM exit. Stores the number of frames written before
+ * the first which could not be in (*written), and returns its result. Frames
+ * following it are not written, so that retrying them does not send them
+ * twice or out of order.
+ */
+static solo5_result_t hypercall_write_many(solo5_handle_t handle,
+                                           const uint8_t *const bufs[],
+                                           const size_t sizes[], size_t count,
+                                           size_t *written)
+{
+    static volatile struct hvt_hc_net_write wr[HVT_MULTICALL_MAX];
+    volatile void *args[HVT_MULTICALL_MAX];
+    size_t max = hvt_multicall_supported() ? HVT_MULTICALL_MAX : 1;
+    size_t n = (count < max) ? count : max;
+
+    for (size_t i = 0; i < n; i++) {
+        wr[i].handle = handle;
+        wr[i].data = bufs[i];
+        wr[i].len = sizes[i];
+        wr[i].ret = SOLO5_R_EUNSPEC;
+        args[i] = &wr[i];
+    }
+    hvt_hypercall_many(HVT_HYPERCALL_NET_WRITE, args, n);
+    for (size_t i = 0; i < n; i++) {
+        if (wr[i].ret != SOLO5_R_OK) {
+            *written = i;
+            return wr[i].ret;
+        }
+    }
+    *written = n;
+    return SOLO5_R_OK;
+}
+
+solo5_result_t solo5_net_write_many(solo5_handle_t handle,
+                                    const uint8_t *const bufs[],
+                                    const size_t sizes[], size_t count,
+                                    size_t *written)
+{
+    size_t i = 0;
+    solo5_result_t ret = SOLO5_R_OK;
+
+    if (!net_ring) {
+        while (i < count) {
+            size_t n;
+            ret = hypercall_write_many(handle, bufs + i, sizes + i, count - i,
+                                       &n);
+            i += n;
+            if (ret != SOLO5_R_OK)
+                break;
+        }
+        *written = i;
+        return ret;
+    }
+
+    /*
+     * Fill as many ring slots as are available and publish them with a
+     * single ring_submit_n(), so that the barrier and any kick are paid
+     * once per batch rather than once per packet.
+     */
+    uint32_t tail = net_ring->ent_tail;
+    uint32_t pending = 0;
+
+    while (i < count) {
+        if (sizes[i] > HVT_RING_BUF_SIZE) {
+            /*
+             * Jumbo frames; see solo5_net_write(). Consecutive ones are
+             * written together.
+             */
+            if (pending > 0) {
+                ring_submit_n(net_ring, pending);
+                pending = 0;
+            }
+            size_t njumbo = 1, n;
+            while (i + njumbo < count && sizes[i + njumbo] > HVT_RING_BUF_SIZE)
+                njumbo++;
+            ret = hypercall_write_many(handle, bufs + i, sizes + i, njumbo,
+                                       &n);
+            i += n;
+            if (ret != SOLO5_R_OK)
+                break;
+            tail = net_ring->ent_tail;
+            continue;
+        }
+        if (ring_full(net_ring, tail)) {
+            /*
+             * Ring is full. Publish what we have so the host can make
+             * progress, then apply the same flow control as
+             * solo5_net_write().
+             */
+            if (pending > 0) {
+                ring_submit_n(net_ring, pending);
+                pending = 0;
+            }
+            if (ring_tx_blocked(net_ring)) {
+                ret = SOLO5_R_AGAIN;
+                break;
+            }
+            cpu_relax();
+            continue;
+        }
+
+        uint32_t idx = tail & HVT_RING_MASK;
+        struct hvt_ring_entry *ent = &net_ring->entries[idx];
+
+        memcpy(write_bufs[idx], bufs[i], sizes[i]);
+        ent->operation = HVT_RING_NET_WRITE;
+        ent->handle = handle;
+        ent->data = write_bufs[idx];
+        ent->len = sizes[i];
+        ent->id = ring_req_id++;
+        tail++;
+        pending++;
+        i++;
+    }
+    if (pending > 0)
+        ring_submit_n(net_ring, pending);
+
+    *written = i;
+    return ret;
+}
+
 /*
  * Wait for the host to post a completion entry.
  */
@@ -131,11 +279,14 @@ solo5_result_t solo5_net_read(solo5_handle_t handle, uint8_t *buf, size_t size,
 {
     if (net_ring) {
         /*
-         * Each read is synchronous (submit + wait_commit), so ent_head
-         * has advanced before the next read. The ring cannot be full here
-         * unless there is a bug in the write batching logic.
+         * Reads are synchronous (submit + wait_commit), so none of ours are
+         * in the ring, but it may be full of writes which the host cannot
+         * transmit yet. A read queued behind those would not complete until
+         * they do, so read directly instead.
          */
-        assert((net_ring->ent_tail - net_ring->ent_head) < (HVT_RING_SIZE - 1));
+        if (ring_tx_blocked(net_ring) ||
+            ring_full(net_ring, net_ring->ent_tail))
+            goto hypercall_read;
 
         uint32_t idx = net_ring->ent_tail & HVT_RING_MASK;
         struct hvt_ring_entry *ent = &net_ring->entries[idx];
@@ -168,19 +319,104 @@ solo5_result_t solo5_net_read(solo5_handle_t handle, uint8_t *buf, size_t size,
         return ret;
     }
 
-    volatile struct hvt_hc_net_read rd;
+hypercall_read:;
+    static volatile struct hvt_hc_net_read rd;
 
     rd.handle = handle;
     rd.data = buf;
     rd.len = size;
     rd.ret = 0;
 
-    hvt_do_hypercall(HVT_HYPERCALL_NET_READ, &rd);
+    hvt_hypercall(HVT_HYPERCALL_NET_READ, &rd);
 
     *read_size = rd.len;
     return rd.ret;
 }
 
+solo5_result_t solo5_net_read_many(solo5_handle_t handle, uint8_t *const bufs[],
+                                   size_t size, size_t read_sizes[],
+                                   size_t count, size_t *read_count)
+{
+    size_t nread = 0;
+    solo5_result_t ret = SOLO5_R_AGAIN;
+
+    const struct mft_entry *e =
+        mft_get_by_index(mft, handle, MFT_DEV_NET_BASIC);
+    if (e == NULL || size < (size_t)e->u.net_basic.mtu + SOLO5_NET_HLEN)
+        return SOLO5_R_EINVAL;
+
+    /*
+     * As in solo5_net_read(), do not queue reads behind writes which the
+     * host cannot transmit yet, or wait for a free slot.
+     */
+    if (!net_ring || ring_tx_blocked(net_ring) ||
+        ring_full(net_ring, net_ring->ent_tail)) {
+        for (size_t i = 0; i < count; i++) {
+            solo5_result_t rc =
+                solo5_net_read(handle, bufs[nread], size, &read_sizes[nread]);
+            if (rc != SOLO5_R_OK) {
+                if (nread == 0)
+                    ret = rc;
+                break;
+            }
+            nread++;
+            ret = SOLO5_R_OK;
+        }
+        *read_count = nread;
+        return ret;
+    }
+
+    /*
+     * Submit one NET_READ per buffer with a single ring_submit_n(), then
+     * collect the completions in order. Writes may still be queued ahead of
+     * us, so only use the slots which are currently free.
+     */
+    uint32_t n =
+        (HVT_RING_SIZE - 1) - (net_ring->ent_tail - net_ring->ent_head);
+    if (n > count)
+        n = count;
+
+    uint32_t tail = net_ring->ent_tail;
+    for (uint32_t i = 0; i < n; i++) {
+        struct hvt_ring_entry *ent = &net_ring->entries[tail & HVT_RING_MASK];
+
+        ent->operation = HVT_RING_NET_READ;
+        ent->handle = handle;
+        ent->data = bufs[i];
+        ent->len = size;
+        ent->id = ring_req_id++;
+        tail++;
+    }
+    ring_submit_n(net_ring, n);
+
+    for (uint32_t i = 0; i < n; i++) {
+        ring_wait_commit(net_ring);
+
+        uint32_t commit_idx = net_ring->com_head & HVT_RING_MASK;
+        struct hvt_ring_commit *commit = &net_ring->commits[commit_idx];
+        solo5_result_t rc = (solo5_result_t)commit->ret;
+        uint32_t len = commit->len;
+        net_ring->com_head++;
+
+        if (rc != SOLO5_R_OK) {
+            if (nread == 0 && rc != SOLO5_R_AGAIN)
+                ret = rc;
+            continue;
+        }
+        /*
+         * A packet may arrive after an earlier read in the same batch found
+         * none. Keep the received packets contiguous at the front of bufs[].
+         */
+        if (nread != i)
+            memcpy(bufs[nread], bufs[i], len);
+        read_sizes[nread++] = len;
+        ret = SOLO5_R_OK;
+    }
+
+    *read_count = nread;
+    return ret;
+}
+
 solo5_result_t solo5_net_acquire(const char *name, solo5_handle_t *handle,
                                  struct solo5_net_info *info)
 {
@@ -205,5 +441,6 @@ void net_init(const struct hvt_boot_info *bi)
 
     if ((bi->host_features & HVT_FEATURE_RING_IO) && bi->net_ring != 0) {
         net_ring = (struct hvt_ring *)(uintptr_t)bi->net_ring;
+        net_ring_tx_blocked = bi->host_features & HVT_FEATURE_NET_TX_BLOCKED;
     }
 }
@@ -20,19 +20,48 @@
 
 #include "bindings.h"
 
+static bool mem_release_supported;
+
 void platform_init(const void *arg)
 {
+    const struct hvt_boot_info *bi = arg;
+
     process_bootinfo(arg);
+    mem_release_supported = bi->host_features & HVT_FEATURE_MEM_RELEASE;
 }
 
 void platform_exit(int status, void *cookie)
 {
-    struct hvt_hc_halt h;
+    static struct hvt_hc_halt h;
 
     h.exit_status = status;
     h.cookie = cookie;
 
+    /*
+     * HVT_HYPERCALL_HALT cannot be batched, perform any deferred hypercalls
+     * first.
+     */
+    hvt_hypercall_flush();
     hvt_do_hypercall(HVT_HYPERCALL_HALT, &h);
     for (;;)
         ;
 }
+
+int platform_mem_release(uintptr_t addr, size_t size)
+{
+    static volatile struct hvt_hc_mem_release r;
+
+    /*
+     * Releasing memory is advisory, so without support from the tender the
+     * memory is simply kept.
+     */
+    if (!mem_release_supported)
+        return 0;
+
+    r.addr = (void *)addr;
+    r.len = size;
+    r.ret = 0;
+
+    hvt_hypercall(HVT_HYPERCALL_MEM_RELEASE, &r);
+    return r.ret;
+}
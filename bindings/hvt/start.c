@@ -22,12 +22,29 @@
 #include "../crt_init.h"
 #include "version.h"
 
+/*
+ * If the tender offers a boot trace area, the CPU cycle counter is recorded
+ * there on entry to each startup phase.
+ */
+static uint64_t *boot_trace;
+
+static void boot_trace_mark(enum hvt_boot_phase phase)
+{
+    if (boot_trace)
+        boot_trace[phase] = READ_CPU_TICKS();
+}
+
 void _start(const void *arg)
 {
     crt_init_ssp();
     crt_init_tls();
 
     static struct solo5_start_info si;
+    const struct hvt_boot_info *bi = arg;
+
+    if (bi->host_features & HVT_FEATURE_BOOT_TRACE)
+        boot_trace = bi->boot_trace;
+    boot_trace_mark(HVT_BOOT_START);
 
     console_init();
     cpu_init();
@@ -40,12 +57,16 @@ void _start(const void *arg)
     log(INFO, "____/\\___/ _|\\___/____/\n");
     log(INFO, "Solo5: Bindings version %s\n", SOLO5_VERSION);
 
+    boot_trace_mark(HVT_BOOT_MEM_INIT);
     mem_init();
     time_init(arg);
+    multicall_init(arg);
     block_init(arg);
+    boot_trace_mark(HVT_BOOT_NET_INIT);
     net_init(arg);
 
     mem_lock_heap(&si.heap_start, &si.heap_size);
+    boot_trace_mark(HVT_BOOT_APP_MAIN);
     solo5_exit(solo5_app_main(&si));
 }
 
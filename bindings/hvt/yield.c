@@ -22,7 +22,7 @@
 
 void solo5_yield(solo5_time_t deadline, solo5_handle_set_t *ready_set)
 {
-    struct hvt_hc_poll t;
+    static struct hvt_hc_poll t;
     uint64_t now;
 
     now = solo5_clock_monotonic();
@@ -30,7 +30,7 @@ void solo5_yield(solo5_time_t deadline, solo5_handle_set_t *ready_set)
         t.timeout_nsecs = 0;
     else
         t.timeout_nsecs = deadline - now;
-    hvt_do_hypercall(HVT_HYPERCALL_POLL, &t);
+    hvt_hypercall(HVT_HYPERCALL_POLL, &t);
     if (ready_set != NULL)
         *ready_set = t.ready_set;
 }
@@ -81,3 +81,17 @@ void *mem_ialloc_pages(size_t num)
 
     return (void *)prev;
 }
+
+solo5_result_t solo5_mem_release(uintptr_t addr, size_t size)
+{
+    uint64_t mem_size = platform_mem_size();
+
+    if (!mem_locked || (addr & ~PAGE_MASK) || (size & ~PAGE_MASK) ||
+        addr < heap_start || addr > mem_size || size > mem_size - addr)
+        return SOLO5_R_EINVAL;
+    if (size == 0)
+        return SOLO5_R_OK;
+
+    return platform_mem_release(addr, size) == 0 ? SOLO5_R_OK
+                                                 : SOLO5_R_EUNSPEC;
+}
@@ -45,6 +45,25 @@ solo5_result_t solo5_block_read(solo5_handle_t handle __attribute__((unused)),
     return SOLO5_R_EUNSPEC;
 }
 
+solo5_result_t solo5_block_submit(solo5_handle_t handle __attribute__((unused)),
+                                  solo5_block_op_t op __attribute__((unused)),
+                                  solo5_off_t offset __attribute__((unused)),
+                                  uint8_t *buf __attribute__((unused)),
+                                  size_t size __attribute__((unused)),
+                                  uint64_t tag __attribute__((unused)))
+{
+    return SOLO5_R_EUNSPEC;
+}
+
+solo5_result_t solo5_block_reap(solo5_handle_t handle __attribute__((unused)),
+                                struct solo5_block_completion *completions
+                                __attribute__((unused)),
+                                size_t count __attribute__((unused)),
+                                size_t *reaped __attribute__((unused)))
+{
+    return SOLO5_R_EUNSPEC;
+}
+
 void block_init(const struct hvt_boot_info *bi __attribute__((unused)))
 {
 }
@@ -92,6 +92,44 @@ solo5_result_t solo5_net_read(solo5_handle_t handle, uint8_t *buf, size_t size,
     }
 }
 
+solo5_result_t solo5_net_write_many(solo5_handle_t handle,
+                                    const uint8_t *const bufs[],
+                                    const size_t sizes[], size_t count,
+                                    size_t *written)
+{
+    size_t i;
+    solo5_result_t ret = SOLO5_R_OK;
+
+    for (i = 0; i < count; i++) {
+        ret = solo5_net_write(handle, bufs[i], sizes[i]);
+        if (ret != SOLO5_R_OK)
+            break;
+    }
+    *written = i;
+    return ret;
+}
+
+solo5_result_t solo5_net_read_many(solo5_handle_t handle, uint8_t *const bufs[],
+                                   size_t size, size_t read_sizes[],
+                                   size_t count, size_t *read_count)
+{
+    size_t i;
+    solo5_result_t ret = SOLO5_R_AGAIN;
+
+    for (i = 0; i < count; i++) {
+        solo5_result_t rc =
+            solo5_net_read(handle, bufs[i], size, &read_sizes[i]);
+        if (rc != SOLO5_R_OK) {
+            if (i == 0)
+                ret = rc;
+            break;
+        }
+        ret = SOLO5_R_OK;
+    }
+    *read_count = i;
+    return ret;
+}
+
 solo5_result_t solo5_net_acquire(const char *name, solo5_handle_t *h,
                                  struct solo5_net_info *info)
 {
@@ -65,3 +65,10 @@ void platform_exit(int status __attribute__((unused)),
     for (;;)
         ;
 }
+
+int platform_mem_release(uintptr_t addr __attribute__((unused)),
+                         size_t size __attribute__((unused)))
+{
+    /* Guest memory is fixed by the system policy, ignore the hint. */
+    return 0;
+}
@@ -29,22 +29,6 @@ void solo5_console_write(const char *buf, size_t size)
 
 /* solo5_abort is in abort.c */
 
-solo5_time_t solo5_clock_monotonic(void)
-{
-    struct sys_timespec ts;
-
-    int rc = sys_clock_gettime(SYS_CLOCK_MONOTONIC, &ts);
-    assert(rc == 0);
-    return (ts.tv_sec * NSEC_PER_SEC) + ts.tv_nsec;
-}
-
-solo5_time_t solo5_clock_wall(void)
-{
-    struct sys_timespec ts;
-
-    int rc = sys_clock_gettime(SYS_CLOCK_REALTIME, &ts);
-    assert(rc == 0);
-    return (ts.tv_sec * NSEC_PER_SEC) + ts.tv_nsec;
-}
+/* solo5_clock_monotonic and solo5_clock_wall are in time.c */
 
 /* solo5_set_tls_base is in tls.c */
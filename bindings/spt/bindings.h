@@ -55,8 +55,11 @@ struct sys_itimerspec {
 
 long sys_clock_gettime(const long which, void *ts);
 
-#define SYS_EINTR  -4
-#define SYS_EAGAIN -11
+#define SYS_EINTR   -4
+#define SYS_EAGAIN  -11
+#define SYS_EINVAL  -22
+#define SYS_ETIME   -62
+#define SYS_ENOBUFS -105
 
 /*
  * Ah, the wonders of Linux ABIs...
@@ -75,6 +78,9 @@ struct sys_epoll_event {
 long sys_epoll_pwait(long epfd, void *events, long maxevents, long timeout,
                      void *sigmask, long sigsetsize);
 
+long sys_epoll_pwait2(long epfd, void *events, long maxevents,
+                      const void *timeout, void *sigmask, long sigsetsize);
+
 #define SYS_TFD_TIMER_ABSTIME (1 << 0)
 
 long sys_timerfd_settime(long fd, long flags, const void *utmr, void *otmr);
@@ -83,7 +89,80 @@ long sys_timerfd_settime(long fd, long flags, const void *utmr, void *otmr);
 
 long sys_arch_prctl(long code, long addr);
 
+#define SYS_MADV_DONTNEED 4
+
+long sys_madvise(void *addr, long len, long advice);
+
+/*
+ * io_uring, as defined in <linux/io_uring.h>.
+ */
+struct sys_io_uring_sqe {
+    uint8_t opcode;
+    uint8_t flags;
+    uint16_t ioprio;
+    int32_t fd;
+    uint64_t off;
+    uint64_t addr;
+    uint32_t len;
+    uint32_t rw_flags;
+    uint64_t user_data;
+    uint64_t pad[3];
+};
+
+struct sys_io_uring_cqe {
+    uint64_t user_data;
+    int32_t res;
+    uint32_t flags;
+};
+
+struct sys_io_uring_getevents_arg {
+    uint64_t sigmask;
+    uint32_t sigmask_sz;
+    uint32_t pad;
+    uint64_t ts;
+};
+
+#define SYS_IORING_OP_READ         22
+#define SYS_IORING_OP_WRITE        23
+#define SYS_IOSQE_FIXED_FILE       (1U << 0)
+#define SYS_IORING_SQ_NEED_WAKEUP  (1U << 0)
+#define SYS_IORING_ENTER_GETEVENTS (1U << 0)
+#define SYS_IORING_ENTER_SQ_WAKEUP (1U << 1)
+#define SYS_IORING_ENTER_EXT_ARG   (1U << 3)
+
+long sys_io_uring_enter(long fd, long to_submit, long min_complete, long flags,
+                        const void *arg, long argsz);
+
 void block_init(struct spt_boot_info *arg);
+solo5_handle_set_t block_pending_set(void);
+void block_io_complete(solo5_handle_t handle, unsigned slot, int32_t res);
 void net_init(struct spt_boot_info *arg);
+void net_io_complete(unsigned kind, solo5_handle_t handle, unsigned slot,
+                     int32_t res);
+void time_init(const struct spt_boot_info *bi);
+/* True if clocks are read from the CPU cycle counter, not system calls. */
+bool tscclock_enabled(void);
+
+/*
+ * I/O through the io_uring shared with the tender, see io_uring.c. The
+ * (user_data) of each request identifies the device and buffer, or request
+ * slot, to which its completion is dispatched by io_uring_reap().
+ */
+enum io_uring_kind { IO_URING_NET_RX = 1, IO_URING_NET_TX, IO_URING_BLOCK };
+
+#define IO_URING_DATA(kind, handle, slot)                                      \
+    (((uint64_t)(kind) << 56) | ((uint64_t)(handle) << 48) | (uint64_t)(slot))
+
+void io_uring_init(const struct spt_boot_info *bi);
+/* Set of devices whose I/O goes through the io_uring. */
+uint64_t io_uring_handles(void);
+void io_uring_submit(uint8_t opcode, solo5_handle_t handle, uint64_t off,
+                     void *buf, uint32_t len, uint64_t user_data);
+/* Dispatch all available completions, returning their number. */
+unsigned io_uring_reap(void);
+/* Wait for a completion, for at most (timeout) ns unless zero. */
+void io_uring_wait(solo5_time_t timeout);
+/* Dispatch available completions, waiting for at least one if none. */
+void io_uring_reap_wait(void);
 
 #endif /* __SPT_BINDINGS_H__ */
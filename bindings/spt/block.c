@@ -43,17 +43,17 @@ solo5_result_t solo5_block_acquire(const char *name, solo5_handle_t *handle,
     return SOLO5_R_OK;
 }
 
-solo5_result_t solo5_block_read(solo5_handle_t handle, solo5_off_t offset,
-                                uint8_t *buf, size_t size)
+/*
+ * Validate an I/O request.
+ */
+static solo5_result_t block_check(const struct mft_entry *e,
+                                  solo5_block_op_t op, solo5_off_t offset,
+                                  size_t size)
 {
-    const struct mft_entry *e =
-        mft_get_by_index(mft, handle, MFT_DEV_BLOCK_BASIC);
-    if (e == NULL)
-        return SOLO5_R_EINVAL;
-
     /*
-     * Note that reads beyond capacity are additionally enforced by the
-     * tender's seccomp policy.
+     * Note that I/O beyond capacity is additionally enforced by the
+     * tender's seccomp policy, unless the device is in the io_uring, in which
+     * case it cannot grow.
      */
     if (size != e->u.block_basic.block_size)
         return SOLO5_R_EINVAL;
@@ -61,32 +61,209 @@ solo5_result_t solo5_block_read(solo5_handle_t handle, solo5_off_t offset,
         return SOLO5_R_EINVAL;
     if (offset > (e->u.block_basic.capacity - e->u.block_basic.block_size))
         return SOLO5_R_EINVAL;
+    if (op != SOLO5_BLOCK_OP_READ && op != SOLO5_BLOCK_OP_WRITE)
+        return SOLO5_R_EINVAL;
 
-    long nbytes = sys_pread64(e->b.hostfd, (char *)buf, size, offset);
+    return SOLO5_R_OK;
+}
+
+static solo5_result_t uring_rw(solo5_handle_t handle, solo5_block_op_t op,
+                               solo5_off_t offset, uint8_t *buf, size_t size);
+
+/*
+ * Validate and perform a synchronous I/O request. Shared by the synchronous
+ * and asynchronous interfaces.
+ */
+static solo5_result_t block_rw(solo5_handle_t handle, solo5_block_op_t op,
+                               solo5_off_t offset, uint8_t *buf, size_t size)
+{
+    const struct mft_entry *e =
+        mft_get_by_index(mft, handle, MFT_DEV_BLOCK_BASIC);
+    if (e == NULL)
+        return SOLO5_R_EINVAL;
+    solo5_result_t rc = block_check(e, op, offset, size);
+    if (rc != SOLO5_R_OK)
+        return rc;
+    if (io_uring_handles() & (1ULL << handle))
+        return uring_rw(handle, op, offset, buf, size);
+
+    long nbytes;
+    if (op == SOLO5_BLOCK_OP_WRITE)
+        nbytes = sys_pwrite64(e->b.hostfd, (const char *)buf, size, offset);
+    else
+        nbytes = sys_pread64(e->b.hostfd, (char *)buf, size, offset);
 
     return (nbytes == (int)size) ? SOLO5_R_OK : SOLO5_R_EUNSPEC;
 }
 
+solo5_result_t solo5_block_read(solo5_handle_t handle, solo5_off_t offset,
+                                uint8_t *buf, size_t size)
+{
+    return block_rw(handle, SOLO5_BLOCK_OP_READ, offset, buf, size);
+}
+
 solo5_result_t solo5_block_write(solo5_handle_t handle, solo5_off_t offset,
                                  const uint8_t *buf, size_t size)
+{
+    /*
+     * block_rw() does not write to (buf) for SOLO5_BLOCK_OP_WRITE.
+     */
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wcast-qual"
+    return block_rw(handle, SOLO5_BLOCK_OP_WRITE, offset, (uint8_t *)buf,
+                    size);
+#pragma GCC diagnostic pop
+}
+
+/*
+ * Asynchronous I/O. Unless the device is in the io_uring, the tender gives
+ * the guest no thread or host queue to hand requests off to, so requests are
+ * performed at submission time and only their completions are queued, to be
+ * reported by solo5_yield() and collected with solo5_block_reap().
+ *
+ * Requests in flight in the io_uring each occupy a slot, which identifies
+ * them on completion. One slot more than the queue depth is available, for
+ * synchronous requests.
+ */
+#define BLOCK_QUEUE_DEPTH 32
+#define BLOCK_SLOTS (BLOCK_QUEUE_DEPTH + 1)
+_Static_assert(BLOCK_SLOTS <= SPT_IO_URING_BLOCK_SLOTS,
+               "BLOCK_SLOTS exceeds requests allowed in flight");
+
+struct block_slot {
+    uint64_t tag;
+    uint32_t size;
+    bool sync;
+    bool done;
+    solo5_result_t result;
+};
+
+struct block_queue {
+    struct solo5_block_completion done[BLOCK_QUEUE_DEPTH];
+    unsigned head;
+    unsigned len;
+    unsigned inflight; /* Asynchronous requests in the io_uring */
+    uint64_t slots_used;
+    struct block_slot slots[BLOCK_SLOTS];
+};
+
+static struct block_queue queues[MFT_MAX_ENTRIES];
+static solo5_handle_set_t pending_set;
+
+static unsigned uring_submit(solo5_handle_t handle, solo5_block_op_t op,
+                             solo5_off_t offset, uint8_t *buf, size_t size,
+                             bool sync, uint64_t tag)
+{
+    struct block_queue *q = &queues[handle];
+    unsigned slot = __builtin_ctzll(~q->slots_used);
+    assert(slot < BLOCK_SLOTS);
+    q->slots_used |= 1ULL << slot;
+
+    struct block_slot *s = &q->slots[slot];
+    s->tag = tag;
+    s->size = size;
+    s->sync = sync;
+    s->done = false;
+    io_uring_submit((op == SOLO5_BLOCK_OP_WRITE) ? SYS_IORING_OP_WRITE
+                                                 : SYS_IORING_OP_READ,
+                    handle, offset, buf, size,
+                    IO_URING_DATA(IO_URING_BLOCK, handle, slot));
+    return slot;
+}
+
+static solo5_result_t uring_rw(solo5_handle_t handle, solo5_block_op_t op,
+                               solo5_off_t offset, uint8_t *buf, size_t size)
+{
+    struct block_queue *q = &queues[handle];
+    unsigned slot = uring_submit(handle, op, offset, buf, size, true, 0);
+
+    while (!q->slots[slot].done)
+        io_uring_reap_wait();
+    q->slots_used &= ~(1ULL << slot);
+    return q->slots[slot].result;
+}
+
+void block_io_complete(solo5_handle_t handle, unsigned slot, int32_t res)
+{
+    struct block_queue *q = &queues[handle];
+    struct block_slot *s = &q->slots[slot];
+    solo5_result_t result =
+        (res == (int32_t)s->size) ? SOLO5_R_OK : SOLO5_R_EUNSPEC;
+
+    if (s->sync) {
+        s->result = result;
+        s->done = true;
+        return;
+    }
+    struct solo5_block_completion *c =
+        &q->done[(q->head + q->len) % BLOCK_QUEUE_DEPTH];
+    c->tag = s->tag;
+    c->result = result;
+    q->len++;
+    q->inflight--;
+    q->slots_used &= ~(1ULL << slot);
+    pending_set |= 1ULL << handle;
+}
+
+solo5_result_t solo5_block_submit(solo5_handle_t handle, solo5_block_op_t op,
+                                  solo5_off_t offset, uint8_t *buf,
+                                  size_t size, uint64_t tag)
 {
     const struct mft_entry *e =
         mft_get_by_index(mft, handle, MFT_DEV_BLOCK_BASIC);
     if (e == NULL)
         return SOLO5_R_EINVAL;
 
-    /*
-     * Note that writes beyond capacity are additionally enforced by the
-     * tender's seccomp policy.
-     */
-    if (size != e->u.block_basic.block_size)
-        return SOLO5_R_EINVAL;
-    if (offset & (e->u.block_basic.block_size - 1))
-        return SOLO5_R_EINVAL;
-    if (offset > (e->u.block_basic.capacity - e->u.block_basic.block_size))
+    struct block_queue *q = &queues[handle];
+    if (q->len + q->inflight == BLOCK_QUEUE_DEPTH)
+        return SOLO5_R_AGAIN;
+
+    if (io_uring_handles() & (1ULL << handle)) {
+        solo5_result_t rc = block_check(e, op, offset, size);
+        if (rc != SOLO5_R_OK)
+            return rc;
+        uring_submit(handle, op, offset, buf, size, false, tag);
+        q->inflight++;
+        return SOLO5_R_OK;
+    }
+
+    solo5_result_t rc = block_rw(handle, op, offset, buf, size);
+    if (rc == SOLO5_R_EINVAL)
+        return rc;
+
+    struct solo5_block_completion *c =
+        &q->done[(q->head + q->len) % BLOCK_QUEUE_DEPTH];
+    c->tag = tag;
+    c->result = rc;
+    q->len++;
+    pending_set |= 1ULL << handle;
+    return SOLO5_R_OK;
+}
+
+solo5_result_t solo5_block_reap(solo5_handle_t handle,
+                                struct solo5_block_completion *completions,
+                                size_t count, size_t *reaped)
+{
+    if (mft_get_by_index(mft, handle, MFT_DEV_BLOCK_BASIC) == NULL)
         return SOLO5_R_EINVAL;
 
-    long nbytes = sys_pwrite64(e->b.hostfd, (const char *)buf, size, offset);
+    struct block_queue *q = &queues[handle];
+    if (q->len == 0 && q->inflight > 0)
+        io_uring_reap();
+    size_t n = 0;
+    while (n < count && q->len > 0) {
+        completions[n++] = q->done[q->head];
+        q->head = (q->head + 1) % BLOCK_QUEUE_DEPTH;
+        q->len--;
+    }
+    if (q->len == 0)
+        pending_set &= ~(1ULL << handle);
 
-    return (nbytes == (int)size) ? SOLO5_R_OK : SOLO5_R_EUNSPEC;
+    *reaped = n;
+    return (n > 0) ? SOLO5_R_OK : SOLO5_R_AGAIN;
+}
+
+solo5_handle_set_t block_pending_set(void)
+{
+    return pending_set;
 }
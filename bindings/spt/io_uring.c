@@ -0,0 +1,148 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * io_uring.c: I/O through the io_uring shared with the tender.
+ *
+ * See SPT_FEATURE_IO_URING in spt_abi.h. Requests are placed in the SQ, which
+ * is polled by a kernel thread, so no system call is made unless that thread
+ * has gone to sleep, or the guest waits for completions.
+ */
+
+#include "bindings.h"
+
+static struct spt_io_uring ring;
+static uint32_t sq_tail;
+
+/*
+ * Number of times to check for completions before waiting for one in the
+ * kernel, see io_uring_reap_wait().
+ */
+#define IO_URING_SPIN 4096
+
+void io_uring_init(const struct spt_boot_info *bi)
+{
+    if (!(bi->features & SPT_FEATURE_IO_URING))
+        return;
+
+    ring = bi->io_uring;
+    sq_tail = *ring.sq_tail;
+}
+
+uint64_t io_uring_handles(void)
+{
+    return ring.handles;
+}
+
+void io_uring_submit(uint8_t opcode, solo5_handle_t handle, uint64_t off,
+                     void *buf, uint32_t len, uint64_t user_data)
+{
+    /*
+     * The callers bound the number of requests in flight on each device, so
+     * that the SQ (and CQ) cannot overflow, see SPT_IO_URING_*_SLOTS.
+     */
+    assert(sq_tail - __atomic_load_n(ring.sq_head, __ATOMIC_ACQUIRE) <
+           ring.sq_entries);
+
+    struct sys_io_uring_sqe *sqe = (struct sys_io_uring_sqe *)ring.sqes +
+                                   (sq_tail & (ring.sq_entries - 1));
+    memset(sqe, 0, sizeof *sqe);
+    sqe->opcode = opcode;
+    sqe->flags = SYS_IOSQE_FIXED_FILE;
+    sqe->fd = handle;
+    sqe->off = off;
+    sqe->addr = (uint64_t)buf;
+    sqe->len = len;
+    sqe->user_data = user_data;
+    sq_tail++;
+    __atomic_store_n(ring.sq_tail, sq_tail, __ATOMIC_RELEASE);
+
+    /*
+     * The polling thread sets IORING_SQ_NEED_WAKEUP before it goes to sleep,
+     * and then checks the SQ tail again; the full barrier ensures that either
+     * it sees our new entry, or we see the flag.
+     */
+    __atomic_thread_fence(__ATOMIC_SEQ_CST);
+    if (__atomic_load_n(ring.sq_flags, __ATOMIC_RELAXED) &
+        SYS_IORING_SQ_NEED_WAKEUP)
+        sys_io_uring_enter(ring.fd, 0, 0, SYS_IORING_ENTER_SQ_WAKEUP, NULL, 0);
+}
+
+unsigned io_uring_reap(void)
+{
+    uint32_t head = *ring.cq_head;
+    uint32_t tail = __atomic_load_n(ring.cq_tail, __ATOMIC_ACQUIRE);
+    unsigned n = 0;
+
+    while (head != tail) {
+        const struct sys_io_uring_cqe *cqe =
+            (const struct sys_io_uring_cqe *)ring.cqes +
+            (head & (ring.cq_entries - 1));
+        uint64_t data = cqe->user_data;
+        int32_t res = cqe->res;
+        head++;
+        __atomic_store_n(ring.cq_head, head, __ATOMIC_RELEASE);
+
+        unsigned kind = data >> 56;
+        solo5_handle_t handle = (data >> 48) & 0xff;
+        unsigned slot = data & 0xffffffffffffULL;
+        if (kind == IO_URING_BLOCK)
+            block_io_complete(handle, slot, res);
+        else
+            net_io_complete(kind, handle, slot, res);
+        n++;
+    }
+    return n;
+}
+
+void io_uring_wait(solo5_time_t timeout)
+{
+    struct sys_timespec ts = {.tv_sec = timeout / 1000000000ULL,
+                              .tv_nsec = timeout % 1000000000ULL};
+    struct sys_io_uring_getevents_arg arg = {
+        .ts = (timeout != 0) ? (uint64_t)&ts : 0};
+    long rc;
+
+    /*
+     * Restarting on EINTR may wait for longer than (timeout), which is
+     * harmless as the caller checks its deadline again.
+     */
+    do {
+        rc = sys_io_uring_enter(ring.fd, 0, 1,
+                                SYS_IORING_ENTER_GETEVENTS |
+                                    SYS_IORING_ENTER_EXT_ARG,
+                                &arg, sizeof arg);
+    } while (rc == SYS_EINTR);
+    assert(rc >= 0 || rc == SYS_ETIME);
+}
+
+void io_uring_reap_wait(void)
+{
+    /*
+     * The polling thread usually completes a request on a fast device within
+     * microseconds, which is cheaper to spin for than to sleep.
+     */
+    for (unsigned i = 0; i < IO_URING_SPIN; i++) {
+        if (io_uring_reap() > 0)
+            return;
+    }
+    io_uring_wait(0);
+    io_uring_reap();
+}
@@ -24,18 +24,135 @@ static const struct mft *mft;
 static int epollfd;
 static int npollfds;
 static int timerfd;
+static bool use_epoll_pwait2;
+
+/*
+ * State of a network device whose I/O goes through the io_uring. A read is
+ * kept in flight on each receive buffer, and the buffers whose reads have
+ * completed are queued in order of completion. Packets written are copied
+ * to a free transmit buffer, which is freed when the write completes.
+ */
+#define NET_SLOTS SPT_IO_URING_NET_SLOTS
+
+struct net_uring {
+    uint8_t *rx_bufs;
+    uint8_t *tx_bufs;
+    int32_t rx_res[NET_SLOTS];
+    uint8_t rx_ready[NET_SLOTS];
+    unsigned rx_head;
+    unsigned rx_len;
+    uint64_t tx_free;
+};
+
+static struct net_uring nets[MFT_MAX_ENTRIES];
+static solo5_handle_set_t uring_set;
+static solo5_handle_set_t uring_ready_set;
+static uint64_t buf_size;
+
+static void post_read(solo5_handle_t handle, unsigned slot)
+{
+    io_uring_submit(SYS_IORING_OP_READ, handle, ~0ULL,
+                    nets[handle].rx_bufs + slot * buf_size, buf_size,
+                    IO_URING_DATA(IO_URING_NET_RX, handle, slot));
+}
+
+void net_io_complete(unsigned kind, solo5_handle_t handle, unsigned slot,
+                     int32_t res)
+{
+    struct net_uring *n = &nets[handle];
+
+    if (kind == IO_URING_NET_TX) {
+        n->tx_free |= 1ULL << slot;
+        return;
+    }
+    assert(kind == IO_URING_NET_RX);
+    n->rx_res[slot] = res;
+    n->rx_ready[(n->rx_head + n->rx_len) % NET_SLOTS] = slot;
+    n->rx_len++;
+    uring_ready_set |= 1ULL << handle;
+}
 
 void net_init(struct spt_boot_info *bi)
 {
     mft = bi->mft;
     epollfd = bi->epollfd;
     timerfd = bi->timerfd;
+    use_epoll_pwait2 = (bi->features & SPT_FEATURE_EPOLL_PWAIT2) != 0;
 
     npollfds = 0;
     for (unsigned i = 0; i != mft->entries; i++) {
         if (mft->e[i].type == MFT_DEV_NET_BASIC)
             npollfds++;
     }
+
+    /*
+     * Network devices in the io_uring are not in the epoll() set. Their
+     * buffers are laid out in order of handle, see spt_abi.h.
+     */
+    uint8_t *bufs = bi->io_uring.net_bufs;
+    buf_size = bi->io_uring.net_buf_size;
+    for (unsigned i = 0; i != mft->entries; i++) {
+        if (mft->e[i].type != MFT_DEV_NET_BASIC ||
+            !(io_uring_handles() & (1ULL << i)))
+            continue;
+        npollfds--;
+        uring_set |= 1ULL << i;
+        nets[i].rx_bufs = bufs;
+        nets[i].tx_bufs = bufs + NET_SLOTS * buf_size;
+        nets[i].tx_free = (1ULL << NET_SLOTS) - 1;
+        bufs += 2 * NET_SLOTS * buf_size;
+        for (unsigned slot = 0; slot != NET_SLOTS; slot++)
+            post_read(i, slot);
+    }
+}
+
+static solo5_result_t uring_read(solo5_handle_t handle, uint8_t *buf,
+                                 size_t size, size_t *read_size)
+{
+    struct net_uring *n = &nets[handle];
+
+    if (n->rx_len == 0) {
+        io_uring_reap();
+        if (n->rx_len == 0)
+            return SOLO5_R_AGAIN;
+    }
+    unsigned slot = n->rx_ready[n->rx_head];
+    int32_t res = n->rx_res[slot];
+    n->rx_head = (n->rx_head + 1) % NET_SLOTS;
+    if (--n->rx_len == 0)
+        uring_ready_set &= ~(1ULL << handle);
+
+    solo5_result_t rc = SOLO5_R_EUNSPEC;
+    if (res >= 0) {
+        /*
+         * As with read(), a packet larger than (size) is truncated.
+         */
+        size_t len = ((size_t)res < size) ? (size_t)res : size;
+        memcpy(buf, n->rx_bufs + slot * buf_size, len);
+        *read_size = len;
+        rc = SOLO5_R_OK;
+    }
+    post_read(handle, slot);
+    return rc;
+}
+
+static solo5_result_t uring_write(solo5_handle_t handle, const uint8_t *buf,
+                                  size_t size)
+{
+    struct net_uring *n = &nets[handle];
+
+    if (size > buf_size)
+        return SOLO5_R_EUNSPEC;
+    while (n->tx_free == 0)
+        io_uring_reap_wait();
+    unsigned slot = __builtin_ctzll(n->tx_free);
+    n->tx_free &= ~(1ULL << slot);
+
+    uint8_t *tx_buf = n->tx_bufs + slot * buf_size;
+    memcpy(tx_buf, buf, size);
+    io_uring_submit(SYS_IORING_OP_WRITE, handle, ~0ULL, tx_buf, size,
+                    IO_URING_DATA(IO_URING_NET_TX, handle, slot));
+    return SOLO5_R_OK;
 }
 
 solo5_result_t solo5_net_acquire(const char *name, solo5_handle_t *handle,
@@ -61,6 +178,8 @@ solo5_result_t solo5_net_read(solo5_handle_t handle, uint8_t *buf, size_t size,
         mft_get_by_index(mft, handle, MFT_DEV_NET_BASIC);
     if (e == NULL)
         return SOLO5_R_EINVAL;
+    if (uring_set & (1ULL << handle))
+        return uring_read(handle, buf, size, read_size);
 
     long nbytes = sys_read(e->b.hostfd, (char *)buf, size);
     if (nbytes < 0) {
@@ -81,14 +200,122 @@ solo5_result_t solo5_net_write(solo5_handle_t handle, const uint8_t *buf,
         mft_get_by_index(mft, handle, MFT_DEV_NET_BASIC);
     if (e == NULL)
         return SOLO5_R_EINVAL;
+    if (uring_set & (1ULL << handle))
+        return uring_write(handle, buf, size);
 
     long nbytes = sys_write(e->b.hostfd, (const char *)buf, size);
+    if (nbytes == SYS_EAGAIN || nbytes == SYS_ENOBUFS)
+        return SOLO5_R_AGAIN;
 
     return (nbytes == (int)size) ? SOLO5_R_OK : SOLO5_R_EUNSPEC;
 }
 
+/*
+ * A TAP descriptor has no multi-packet read or write system call (readv() and
+ * writev() transfer a single packet), so the batched variants issue one
+ * system call per packet, but resolve the device only once per batch.
+ */
+solo5_result_t solo5_net_write_many(solo5_handle_t handle,
+                                    const uint8_t *const bufs[],
+                                    const size_t sizes[], size_t count,
+                                    size_t *written)
+{
+    const struct mft_entry *e =
+        mft_get_by_index(mft, handle, MFT_DEV_NET_BASIC);
+    if (e == NULL)
+        return SOLO5_R_EINVAL;
+
+    size_t i;
+    solo5_result_t ret = SOLO5_R_OK;
+    for (i = 0; i < count; i++) {
+        if (uring_set & (1ULL << handle)) {
+            ret = uring_write(handle, bufs[i], sizes[i]);
+            if (ret != SOLO5_R_OK)
+                break;
+            continue;
+        }
+        long nbytes = sys_write(e->b.hostfd, (const char *)bufs[i], sizes[i]);
+        if (nbytes == SYS_EAGAIN || nbytes == SYS_ENOBUFS) {
+            ret = SOLO5_R_AGAIN;
+            break;
+        } else if (nbytes != (int)sizes[i]) {
+            ret = SOLO5_R_EUNSPEC;
+            break;
+        }
+    }
+
+    *written = i;
+    return ret;
+}
+
+solo5_result_t solo5_net_read_many(solo5_handle_t handle, uint8_t *const bufs[],
+                                   size_t size, size_t read_sizes[],
+                                   size_t count, size_t *read_count)
+{
+    const struct mft_entry *e =
+        mft_get_by_index(mft, handle, MFT_DEV_NET_BASIC);
+    if (e == NULL)
+        return SOLO5_R_EINVAL;
+
+    size_t i;
+    solo5_result_t ret = SOLO5_R_AGAIN;
+    if (uring_set & (1ULL << handle)) {
+        for (i = 0; i < count; i++) {
+            solo5_result_t rc =
+                uring_read(handle, bufs[i], size, &read_sizes[i]);
+            if (rc != SOLO5_R_OK) {
+                if (i == 0 && rc != SOLO5_R_AGAIN)
+                    ret = rc;
+                break;
+            }
+            ret = SOLO5_R_OK;
+        }
+        *read_count = i;
+        return ret;
+    }
+    for (i = 0; i < count; i++) {
+        long nbytes = sys_read(e->b.hostfd, (char *)bufs[i], size);
+        if (nbytes < 0) {
+            if (i == 0 && nbytes != SYS_EAGAIN)
+                ret = SOLO5_R_EUNSPEC;
+            break;
+        }
+        read_sizes[i] = (size_t)nbytes;
+        ret = SOLO5_R_OK;
+    }
+
+    *read_count = i;
+    return ret;
+}
+
+/*
+ * With the io_uring, completions of reads on network devices, and of
+ * asynchronous block requests, are waited for in the ring rather than in the
+ * epoll() set.
+ */
+static void uring_yield(solo5_time_t deadline, solo5_handle_set_t *ready_set)
+{
+    io_uring_reap();
+    solo5_handle_set_t tmp_ready_set = uring_ready_set | block_pending_set();
+    if (tmp_ready_set == 0 && deadline != 0) {
+        solo5_time_t now = solo5_clock_monotonic();
+        if (deadline > now) {
+            io_uring_wait(deadline - now);
+            io_uring_reap();
+            tmp_ready_set = uring_ready_set | block_pending_set();
+        }
+    }
+    if (ready_set != NULL)
+        *ready_set = tmp_ready_set;
+}
+
 void solo5_yield(solo5_time_t deadline, solo5_handle_set_t *ready_set)
 {
+    if (io_uring_handles() != 0) {
+        uring_yield(deadline, ready_set);
+        return;
+    }
+
     int nrevents;
     /*
      * In order to support nanosecond timeouts, as defined by the Solo5 API, we
@@ -98,30 +325,59 @@ void solo5_yield(solo5_time_t deadline, solo5_handle_set_t *ready_set)
     int nevents = npollfds ? (npollfds + 1) : 1;
     struct sys_epoll_event revents[nevents];
     solo5_handle_set_t tmp_ready_set = 0;
-    struct sys_itimerspec it = {
-        .it_interval = {0},
-        .it_value = {.tv_sec = deadline / 1000000000ULL,
-                     .tv_nsec = deadline % 1000000000ULL}};
     /*
-     * Ensure that it.it_value is always non-zero, otherwise the following
-     * epoll_wait() will hang if there are no other descriptors in the waitset
-     * due to the timer never firing. See timefd_settime(2).
+     * Completed asynchronous block requests are always ready; if there are
+     * any, just poll the network devices without waiting.
      */
-    it.it_value.tv_nsec |= 1;
-    /*
-     * On spt, given that Solo5 monotonic time is identical to CLOCK_MONOTONIC,
-     * we can just pass the deadline into the timerfd as an absolute timeout,
-     * saving a clock_gettime() call in the process.
-     */
-    assert(sys_timerfd_settime(timerfd, SYS_TFD_TIMER_ABSTIME, &it, NULL) !=
-           -1);
+    solo5_handle_set_t block_ready_set = block_pending_set();
+    if (block_ready_set != 0)
+        deadline = 0;
+
     /*
-     * We can always safely restart this call on EINTR, since the internal
-     * timerfd is independent of its invocation.
+     * The current time is only needed for a relative timeout, and is free to
+     * obtain with the TSC clock.
      */
-    do {
-        nrevents = sys_epoll_pwait(epollfd, revents, nevents, -1, NULL, 0);
-    } while (nrevents == SYS_EINTR);
+    solo5_time_t now = 0;
+    if (deadline != 0 && (use_epoll_pwait2 || tscclock_enabled()))
+        now = solo5_clock_monotonic();
+    if (deadline <= now) {
+        /*
+         * Fast path for a deadline which has already passed, no timeout is
+         * needed.
+         */
+        do {
+            nrevents = sys_epoll_pwait(epollfd, revents, nevents, 0, NULL, 0);
+        } while (nrevents == SYS_EINTR);
+    } else if (use_epoll_pwait2) {
+        struct sys_timespec ts = {.tv_sec = (deadline - now) / 1000000000ULL,
+                                  .tv_nsec = (deadline - now) % 1000000000ULL};
+        do {
+            nrevents =
+                sys_epoll_pwait2(epollfd, revents, nevents, &ts, NULL, 0);
+        } while (nrevents == SYS_EINTR);
+    } else {
+        /*
+         * Unless using the TSC clock, Solo5 monotonic time is identical to
+         * CLOCK_MONOTONIC, so we can just pass the deadline into the timerfd
+         * as an absolute timeout, saving a clock_gettime() call in the
+         * process. The TSC clock may drift from CLOCK_MONOTONIC, so the
+         * timeout is relative in that case.
+         */
+        solo5_time_t timeout = now ? deadline - now : deadline;
+        struct sys_itimerspec it = {
+            .it_interval = {0},
+            .it_value = {.tv_sec = timeout / 1000000000ULL,
+                         .tv_nsec = timeout % 1000000000ULL}};
+        assert(sys_timerfd_settime(timerfd, now ? 0 : SYS_TFD_TIMER_ABSTIME,
+                                   &it, NULL) != -1);
+        /*
+         * We can always safely restart this call on EINTR, since the internal
+         * timerfd is independent of its invocation.
+         */
+        do {
+            nrevents = sys_epoll_pwait(epollfd, revents, nevents, -1, NULL, 0);
+        } while (nrevents == SYS_EINTR);
+    }
     if (nrevents > 0) {
         int orig_nrevents = nrevents;
         for (int i = 0; i < orig_nrevents; i++)
@@ -131,6 +387,7 @@ void solo5_yield(solo5_time_t deadline, solo5_handle_set_t *ready_set)
                 tmp_ready_set |= 1ULL << revents[i].data;
     }
     assert(nrevents >= 0);
+    tmp_ready_set |= block_ready_set;
     if (ready_set != NULL)
         *ready_set = tmp_ready_set;
 }
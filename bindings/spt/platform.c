@@ -52,6 +52,30 @@ int platform_puts(const char *buf, int n)
     return n;
 }
 
+int platform_mem_release(uintptr_t addr, size_t size)
+{
+    /*
+     * The tender's seccomp filter only allows releasing a power of two sized
+     * chunk at a time, see spt_core.c.
+     */
+    while (size > 0) {
+        size_t chunk = 1UL << (63 - __builtin_clzl(size));
+        long rc = sys_madvise((void *)addr, chunk, SYS_MADV_DONTNEED);
+
+        /*
+         * The host refuses to discard guest memory locked with --mem-lock, in
+         * which case the hint is ignored.
+         */
+        if (rc == SYS_EINVAL)
+            return 0;
+        if (rc != 0)
+            return -1;
+        addr += chunk;
+        size -= chunk;
+    }
+    return 0;
+}
+
 int platform_set_tls_base(uint64_t base)
 {
 #if defined(__x86_64__)
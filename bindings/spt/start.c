@@ -39,6 +39,8 @@ void _start(void *arg)
     log(INFO, "Solo5: Bindings version %s\n", SOLO5_VERSION);
 
     mem_init();
+    time_init(arg);
+    io_uring_init(arg);
     block_init(arg);
     net_init(arg);
 
@@ -32,12 +32,15 @@
 
 #define SYS_read            63
 #define SYS_write           64
+#define SYS_madvise         233
 #define SYS_pread64         67
 #define SYS_pwrite64        68
 #define SYS_clock_gettime   113
 #define SYS_exit_group      94
 #define SYS_epoll_pwait     22
 #define SYS_timerfd_settime 86
+#define SYS_io_uring_enter  426
+#define SYS_epoll_pwait2    441
 
 long sys_read(long fd, void *buf, long size)
 {
@@ -69,6 +72,21 @@ long sys_write(long fd, const void *buf, long size)
     return x0;
 }
 
+long sys_madvise(void *addr, long len, long advice)
+{
+    register long x8 __asm__("x8") = SYS_madvise;
+    register long x0 __asm__("x0") = (long)addr;
+    register long x1 __asm__("x1") = len;
+    register long x2 __asm__("x2") = advice;
+
+    __asm__ __volatile__("svc 0"
+                         : "=r"(x0)
+                         : "r"(x8), "r"(x0), "r"(x1), "r"(x2)
+                         : "memory", "cc");
+
+    return x0;
+}
+
 long sys_pread64(long fd, void *buf, long size, long pos)
 {
     register long x8 __asm__("x8") = SYS_pread64;
@@ -149,6 +167,46 @@ long sys_epoll_pwait(long epfd, void *events, long maxevents, long timeout,
     return x0;
 }
 
+long sys_epoll_pwait2(long epfd, void *events, long maxevents,
+                      const void *timeout, void *sigmask, long sigsetsize)
+{
+    register long x8 __asm__("x8") = SYS_epoll_pwait2;
+    register long x0 __asm__("x0") = epfd;
+    register long x1 __asm__("x1") = (long)events;
+    register long x2 __asm__("x2") = maxevents;
+    register long x3 __asm__("x3") = (long)timeout;
+    register long x4 __asm__("x4") = (long)sigmask;
+    register long x5 __asm__("x5") = sigsetsize;
+
+    __asm__ __volatile__("svc 0"
+                         : "=r"(x0)
+                         : "r"(x8), "r"(x0), "r"(x1), "r"(x2), "r"(x3), "r"(x4),
+                           "r"(x5)
+                         : "memory", "cc");
+
+    return x0;
+}
+
+long sys_io_uring_enter(long fd, long to_submit, long min_complete, long flags,
+                        const void *arg, long argsz)
+{
+    register long x8 __asm__("x8") = SYS_io_uring_enter;
+    register long x0 __asm__("x0") = fd;
+    register long x1 __asm__("x1") = to_submit;
+    register long x2 __asm__("x2") = min_complete;
+    register long x3 __asm__("x3") = flags;
+    register long x4 __asm__("x4") = (long)arg;
+    register long x5 __asm__("x5") = argsz;
+
+    __asm__ __volatile__("svc 0"
+                         : "=r"(x0)
+                         : "r"(x8), "r"(x0), "r"(x1), "r"(x2), "r"(x3), "r"(x4),
+                           "r"(x5)
+                         : "memory", "cc");
+
+    return x0;
+}
+
 long sys_timerfd_settime(long fd, long flags, const void *utmr, void *otmr)
 {
     register long x8 __asm__("x8") = SYS_timerfd_settime;
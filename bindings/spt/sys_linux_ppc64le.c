@@ -29,12 +29,15 @@
 
 #define SYS_read            3
 #define SYS_write           4
+#define SYS_madvise         205
 #define SYS_pread64         179
 #define SYS_pwrite64        180
 #define SYS_clock_gettime   246
 #define SYS_exit_group      234
 #define SYS_epoll_pwait     303
 #define SYS_timerfd_settime 311
+#define SYS_io_uring_enter  426
+#define SYS_epoll_pwait2    441
 
 long sys_read(long fd, void *buf, long size)
 {
@@ -74,6 +77,25 @@ long sys_write(long fd, const void *buf, long size)
     return r3;
 }
 
+long sys_madvise(void *addr, long len, long advice)
+{
+    register long r0 __asm__("r0") = SYS_madvise;
+    register long r3 __asm__("r3") = (long)addr;
+    register long r4 __asm__("r4") = len;
+    register long r5 __asm__("r5") = advice;
+    long cr;
+
+    __asm__ __volatile__("sc\n\t"
+                         "mfcr %1"
+                         : "=r"(r3), "=&r"(cr)
+                         : "r"(r0), "r"(r3), "r"(r4), "r"(r5)
+                         : "memory", "cc");
+    if (cr & CR0_SO)
+        r3 = -r3;
+
+    return r3;
+}
+
 long sys_pread64(long fd, void *buf, long size, long pos)
 {
     register long r0 __asm__("r0") = SYS_pread64;
@@ -167,6 +189,54 @@ long sys_epoll_pwait(long epfd, void *events, long maxevents, long timeout,
     return r3;
 }
 
+long sys_epoll_pwait2(long epfd, void *events, long maxevents,
+                      const void *timeout, void *sigmask, long sigsetsize)
+{
+    register long r0 __asm__("r0") = SYS_epoll_pwait2;
+    register long r3 __asm__("r3") = epfd;
+    register long r4 __asm__("r4") = (long)events;
+    register long r5 __asm__("r5") = maxevents;
+    register long r6 __asm__("r6") = (long)timeout;
+    register long r7 __asm__("r7") = (long)sigmask;
+    register long r8 __asm__("r8") = sigsetsize;
+    long cr;
+
+    __asm__ __volatile__("sc\n\t"
+                         "mfcr %1"
+                         : "=r"(r3), "=&r"(cr)
+                         : "r"(r0), "r"(r3), "r"(r4), "r"(r5), "r"(r6), "r"(r7),
+                           "r"(r8)
+                         : "memory", "cc");
+    if (cr & CR0_SO)
+        r3 = -r3;
+
+    return r3;
+}
+
+long sys_io_uring_enter(long fd, long to_submit, long min_complete, long flags,
+                        const void *arg, long argsz)
+{
+    register long r0 __asm__("r0") = SYS_io_uring_enter;
+    register long r3 __asm__("r3") = fd;
+    register long r4 __asm__("r4") = to_submit;
+    register long r5 __asm__("r5") = min_complete;
+    register long r6 __asm__("r6") = flags;
+    register long r7 __asm__("r7") = (long)arg;
+    register long r8 __asm__("r8") = argsz;
+    long cr;
+
+    __asm__ __volatile__("sc\n\t"
+                         "mfcr %1"
+                         : "=r"(r3), "=&r"(cr)
+                         : "r"(r0), "r"(r3), "r"(r4), "r"(r5), "r"(r6), "r"(r7),
+                           "r"(r8)
+                         : "memory", "cc");
+    if (cr & CR0_SO)
+        r3 = -r3;
+
+    return r3;
+}
+
 long sys_timerfd_settime(long fd, long flags, const void *utmr, void *otmr)
 {
     register long r0 __asm__("r0") = SYS_timerfd_settime;
@@ -32,6 +32,7 @@
 
 #define SYS_read            0
 #define SYS_write           1
+#define SYS_madvise         28
 #define SYS_pread64         17
 #define SYS_pwrite64        18
 #define SYS_arch_prctl      158
@@ -39,6 +40,8 @@
 #define SYS_exit_group      231
 #define SYS_epoll_pwait     281
 #define SYS_timerfd_settime 286
+#define SYS_io_uring_enter  426
+#define SYS_epoll_pwait2    441
 
 long sys_read(long fd, void *buf, long size)
 {
@@ -64,6 +67,18 @@ long sys_write(long fd, const void *buf, long size)
     return ret;
 }
 
+long sys_madvise(void *addr, long len, long advice)
+{
+    long ret;
+
+    __asm__ __volatile__("syscall"
+                         : "=a"(ret)
+                         : "a"(SYS_madvise), "D"(addr), "S"(len), "d"(advice)
+                         : "rcx", "r11", "memory");
+
+    return ret;
+}
+
 long sys_pread64(long fd, void *buf, long size, long pos)
 {
     long ret;
@@ -132,6 +147,40 @@ long sys_epoll_pwait(long epfd, void *events, long maxevents, long timeout,
     return ret;
 }
 
+long sys_epoll_pwait2(long epfd, void *events, long maxevents,
+                      const void *timeout, void *sigmask, long sigsetsize)
+{
+    long ret;
+    register long r10 __asm__("r10") = (long)timeout;
+    register long r8 __asm__("r8") = (long)sigmask;
+    register long r9 __asm__("r9") = sigsetsize;
+
+    __asm__ __volatile__("syscall"
+                         : "=a"(ret)
+                         : "a"(SYS_epoll_pwait2), "D"(epfd), "S"(events),
+                           "d"(maxevents), "r"(r10), "r"(r8), "r"(r9)
+                         : "rcx", "r11", "memory");
+
+    return ret;
+}
+
+long sys_io_uring_enter(long fd, long to_submit, long min_complete, long flags,
+                        const void *arg, long argsz)
+{
+    long ret;
+    register long r10 __asm__("r10") = flags;
+    register long r8 __asm__("r8") = (long)arg;
+    register long r9 __asm__("r9") = argsz;
+
+    __asm__ __volatile__("syscall"
+                         : "=a"(ret)
+                         : "a"(SYS_io_uring_enter), "D"(fd), "S"(to_submit),
+                           "d"(min_complete), "r"(r10), "r"(r8), "r"(r9)
+                         : "rcx", "r11", "memory");
+
+    return ret;
+}
+
 long sys_timerfd_settime(long fd, long flags, const void *utmr, void *otmr)
 {
     long ret;
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * time.c: Monotonic and wall clocks for spt.
+ *
+ * If the tender offers SPT_FEATURE_TSC_CLOCK, both clocks are derived from the
+ * CPU cycle counter, with the frequency and the host clocks at a given cycle
+ * count published by the tender in the boot info. Otherwise, every read of a
+ * clock is a clock_gettime() system call.
+ *
+ * The cycle counter runs at a fixed rate, whereas the host wall clock may be
+ * stepped or slewed. The offset of the wall clock from the monotonic clock is
+ * therefore refreshed with a clock_gettime() system call if it was last
+ * obtained more than WALL_RESYNC_NS ago.
+ */
+
+#include "bindings.h"
+
+#define WALL_RESYNC_NS NSEC_PER_SEC
+
+#if defined(__x86_64__)
+#define READ_CPU_TICKS cpu_rdtsc
+#elif defined(__aarch64__)
+#define READ_CPU_TICKS cpu_cntvct
+#endif
+
+static bool tsc_clock;
+
+#if defined(READ_CPU_TICKS)
+/* Base time values at the last call to solo5_clock_monotonic(). */
+static uint64_t time_base;
+static uint64_t tsc_base;
+/* Multiplier for converting cycles to nsecs, (0.S) fixed point. */
+static uint32_t tsc_mult;
+static uint8_t tsc_shift;
+#endif
+
+/* Wall clock time minus monotonic time, as of (wall_sync). */
+static int64_t wall_offset;
+static uint64_t wall_sync;
+
+static uint64_t sys_clock(long which)
+{
+    struct sys_timespec ts;
+
+    int rc = sys_clock_gettime(which, &ts);
+    assert(rc == 0);
+    return (ts.tv_sec * NSEC_PER_SEC) + ts.tv_nsec;
+}
+
+void time_init(const struct spt_boot_info *bi)
+{
+#if defined(READ_CPU_TICKS)
+    if ((bi->features & SPT_FEATURE_TSC_CLOCK) == 0 || bi->cpu_cycle_freq == 0)
+        return;
+
+    /*
+     * See tscclock_init() in hvt/tscclock.c. The shift factor is the largest
+     * for which the multiplier still fits into 32 bits.
+     */
+    tsc_shift = 32;
+    uint64_t tmp;
+    do {
+        tmp = (NSEC_PER_SEC << tsc_shift) / bi->cpu_cycle_freq;
+        if ((tmp & 0xFFFFFFFF00000000L) == 0L)
+            tsc_mult = (uint32_t)tmp;
+        else
+            tsc_shift--;
+    } while (tsc_shift > 0 && tsc_mult == 0L);
+    assert(tsc_mult != 0L);
+
+    tsc_base = bi->cpu_cycle_base;
+    time_base = bi->monotonic_base;
+    wall_offset = (int64_t)(bi->wall_base - bi->monotonic_base);
+    wall_sync = bi->monotonic_base;
+    tsc_clock = true;
+    log(DEBUG, "Solo5: time_init(): tsc_freq=%llu tsc_mult=%u tsc_shift=%u\n",
+        (unsigned long long)bi->cpu_cycle_freq, tsc_mult, tsc_shift);
+#else
+    (void)bi;
+#endif
+}
+
+bool tscclock_enabled(void)
+{
+    return tsc_clock;
+}
+
+solo5_time_t solo5_clock_monotonic(void)
+{
+#if defined(READ_CPU_TICKS)
+    if (tsc_clock) {
+        uint64_t tsc_now = READ_CPU_TICKS();
+        time_base += mul64_32(tsc_now - tsc_base, tsc_mult, tsc_shift);
+        tsc_base = tsc_now;
+        return time_base;
+    }
+#endif
+    return sys_clock(SYS_CLOCK_MONOTONIC);
+}
+
+solo5_time_t solo5_clock_wall(void)
+{
+    if (!tsc_clock)
+        return sys_clock(SYS_CLOCK_REALTIME);
+
+    uint64_t now = solo5_clock_monotonic();
+    if (now - wall_sync > WALL_RESYNC_NS) {
+        wall_offset = (int64_t)(sys_clock(SYS_CLOCK_REALTIME) - now);
+        wall_sync = now;
+    }
+    return now + wall_offset;
+}
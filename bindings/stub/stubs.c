@@ -95,6 +95,22 @@ solo5_result_t solo5_net_read(solo5_handle_t handle U, uint8_t *buf U,
     return SOLO5_R_EUNSPEC;
 }
 
+solo5_result_t solo5_net_write_many(solo5_handle_t handle U,
+                                    const uint8_t *const bufs[] U,
+                                    const size_t sizes[] U, size_t count U,
+                                    size_t *written U)
+{
+    return SOLO5_R_EUNSPEC;
+}
+
+solo5_result_t solo5_net_read_many(solo5_handle_t handle U,
+                                   uint8_t *const bufs[] U, size_t size U,
+                                   size_t read_sizes[] U, size_t count U,
+                                   size_t *read_count U)
+{
+    return SOLO5_R_EUNSPEC;
+}
+
 solo5_result_t solo5_block_acquire(const char *name U, solo5_handle_t *handle U,
                                    struct solo5_block_info *info U)
 {
@@ -113,6 +129,20 @@ solo5_result_t solo5_block_read(solo5_handle_t handle U, solo5_off_t offset U,
     return SOLO5_R_EUNSPEC;
 }
 
+solo5_result_t solo5_block_submit(solo5_handle_t handle U,
+                                  solo5_block_op_t op U, solo5_off_t offset U,
+                                  uint8_t *buf U, size_t size U, uint64_t tag U)
+{
+    return SOLO5_R_EUNSPEC;
+}
+
+solo5_result_t solo5_block_reap(solo5_handle_t handle U,
+                                struct solo5_block_completion *completions U,
+                                size_t count U, size_t *reaped U)
+{
+    return SOLO5_R_EUNSPEC;
+}
+
 size_t solo5_tls_size(void)
 {
     return 0;
@@ -132,3 +162,8 @@ solo5_result_t solo5_set_tls_base(uintptr_t base U)
 {
     return SOLO5_R_EUNSPEC;
 }
+
+solo5_result_t solo5_mem_release(uintptr_t addr U, size_t size U)
+{
+    return SOLO5_R_EUNSPEC;
+}
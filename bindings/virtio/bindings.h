@@ -66,5 +66,6 @@ int pci_enumerate(void);
 
 int virtio_config_network(struct pci_config_info *, solo5_handle_t);
 int virtio_config_block(struct pci_config_info *, solo5_handle_t);
+solo5_handle_set_t virtio_blk_poll(bool *inflight);
 
 #endif /* __VIRTIO_BINDINGS_H__ */
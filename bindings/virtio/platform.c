@@ -142,3 +142,10 @@ int platform_set_tls_base(uint64_t base)
     cpu_set_tls_base(base);
     return 0;
 }
+
+int platform_mem_release(uintptr_t addr __attribute__((unused)),
+                         size_t size __attribute__((unused)))
+{
+    /* No balloon device is supported, ignore the hint. */
+    return 0;
+}
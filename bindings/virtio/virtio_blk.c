@@ -45,11 +45,37 @@ struct virtio_blk_hdr {
 };
 
 #define VIRTQ_BLK 0
+
+/*
+ * Requests in flight. Each request uses a chain of 3 descriptors, request
+ * slot (n) always using descriptors (3n) to (3n + 2), so that requests can
+ * complete in any order. Slot 0 is reserved for the synchronous interface.
+ */
+#define VIRTIO_BLK_MAX_REQS 32
+#define VIRTIO_BLK_SYNC_REQ 0
+
+struct virtio_blk_req {
+    bool busy;
+    bool done;
+    uint32_t type;
+    uint8_t *data;
+    size_t len;
+    uint64_t tag;
+    solo5_result_t result;
+};
+
 struct virtio_blk_desc {
     uint16_t pci_base; /* base in PCI config space */
     struct virtq blkq;
     uint64_t sectors;
     uint16_t sector_size;
+    solo5_handle_t handle;
+    unsigned nreqs;
+    struct virtio_blk_req reqs[VIRTIO_BLK_MAX_REQS];
+    unsigned outstanding; /* asynchronous requests submitted, not reaped */
+    uint8_t done[VIRTIO_BLK_MAX_REQS]; /* completed asynchronous requests */
+    unsigned done_head;
+    unsigned ndone;
 };
 
 #define VIRTIO_BLK_MAX_ENTRIES MFT_MAX_ENTRIES
@@ -58,20 +84,21 @@ static unsigned bd_num_entries = 0;
 
 extern struct mft *virtio_manifest;
 
-/* Returns the index to the head of the buffers chain. */
-static uint16_t virtio_blk_op(struct virtio_blk_desc *bd, uint32_t type,
-                              uint64_t sector, void *data, size_t len)
+/* Submits the request in slot (req) to the device. */
+static void virtio_blk_op(struct virtio_blk_desc *bd, unsigned req,
+                          uint32_t type, uint64_t sector, void *data,
+                          size_t len)
 {
-    uint16_t mask = bd->blkq.num - 1;
     struct virtio_blk_hdr hdr;
     struct io_buffer *head_buf, *data_buf, *status_buf;
-    uint16_t head = bd->blkq.next_avail & mask;
+    uint16_t head = req * 3;
 
     assert(len <= VIRTIO_BLK_SECTOR_SIZE);
+    assert(req < bd->nreqs);
 
     head_buf = &bd->blkq.bufs[head];
-    data_buf = &bd->blkq.bufs[(head + 1) & mask];
-    status_buf = &bd->blkq.bufs[(head + 2) & mask];
+    data_buf = &bd->blkq.bufs[head + 1];
+    status_buf = &bd->blkq.bufs[head + 2];
 
     hdr.type = type;
     hdr.ioprio = 0;
@@ -94,59 +121,74 @@ static uint16_t virtio_blk_op(struct virtio_blk_desc *bd, uint32_t type,
     status_buf->len = sizeof(uint8_t);
     status_buf->extra_flags = VIRTQ_DESC_F_WRITE;
 
+    bd->reqs[req].busy = true;
+    bd->reqs[req].done = false;
+    bd->reqs[req].type = type;
+    bd->reqs[req].data = data;
+    bd->reqs[req].len = len;
+
     assert(virtq_add_descriptor_chain(&bd->blkq, head, 3) == 0);
 
     virtio_mb();
     if (virtq_notify_needed(&bd->blkq))
         outw(bd->pci_base + VIRTIO_PCI_QUEUE_NOTIFY, VIRTQ_BLK);
-
-    return head;
 }
 
 /*
- * Returns the status (0 is OK, -1 is not)
- *
- * This function assumes that no other pending IO is submitted at the same
- * time.  That is true as long as we use only synchronous IO calls, and if
- * there is just a sync call at a time (which is true for solo5).
+ * Consume all descriptor chains used by the device, marking the
+ * corresponding requests as done.
  */
-static int virtio_blk_op_sync(struct virtio_blk_desc *bd, uint32_t type,
-                              uint64_t sector, void *data, size_t len)
+static void virtio_blk_process_used(struct virtio_blk_desc *bd)
 {
     uint16_t mask = bd->blkq.num - 1;
-    uint16_t head;
-    struct io_buffer *data_buf, *status_buf;
-    uint8_t status;
-
-    head = virtio_blk_op(bd, type, sector, data, len);
-    data_buf = &bd->blkq.bufs[(head + 1) & mask];
-    status_buf = &bd->blkq.bufs[(head + 2) & mask];
-
-    /* Loop until the device used all of our descriptors. */
-    while (bd->blkq.used->idx != bd->blkq.avail->idx)
-        ;
 
-    virtio_rmb();
-    /* Consume all the recently used descriptors. */
     for (; bd->blkq.used->idx != bd->blkq.last_used; bd->blkq.last_used++) {
         struct virtq_used_elem *e;
 
-        /* Assert that the used descriptor matches the descriptor of the
-         * IO we started at the start of this function. */
+        virtio_rmb();
         e = &(bd->blkq.used->ring[bd->blkq.last_used & mask]);
-        assert(head == e->id);
+        assert(e->id % 3 == 0 && e->id / 3 < bd->nreqs);
+        unsigned req = e->id / 3;
+        struct virtio_blk_req *r = &bd->reqs[req];
+        assert(r->busy && !r->done);
+
+        uint8_t status = *(uint8_t *)&bd->blkq.bufs[e->id + 2];
+        if (status == VIRTIO_BLK_S_OK) {
+            if (r->type == VIRTIO_BLK_T_IN) /* read */
+                memcpy(r->data, bd->blkq.bufs[e->id + 1].data, r->len);
+            r->result = SOLO5_R_OK;
+        } else
+            r->result = SOLO5_R_EUNSPEC;
+        r->done = true;
 
         bd->blkq.num_avail += 3; /* 3 descriptors per chain */
+        if (req != VIRTIO_BLK_SYNC_REQ) {
+            bd->done[(bd->done_head + bd->ndone) % VIRTIO_BLK_MAX_REQS] = req;
+            bd->ndone++;
+        }
     }
+}
 
-    status = (*(uint8_t *)status_buf);
-    if (status != VIRTIO_BLK_S_OK)
-        return -1;
+/*
+ * Returns the status (0 is OK, -1 is not)
+ *
+ * Synchronous requests always use the reserved request slot, and wait for it
+ * to complete. Any asynchronous requests completing in the meantime are
+ * queued for solo5_block_reap().
+ */
+static int virtio_blk_op_sync(struct virtio_blk_desc *bd, uint32_t type,
+                              uint64_t sector, void *data, size_t len)
+{
+    struct virtio_blk_req *r = &bd->reqs[VIRTIO_BLK_SYNC_REQ];
 
-    if (type == VIRTIO_BLK_T_IN) /* read */
-        memcpy(data, data_buf->data, len);
+    virtio_blk_op(bd, VIRTIO_BLK_SYNC_REQ, type, sector, data, len);
 
-    return 0;
+    /* Loop until the device used our descriptors. */
+    while (!r->done)
+        virtio_blk_process_used(bd);
+    r->busy = false;
+
+    return (r->result == SOLO5_R_OK) ? 0 : -1;
 }
 
 static void virtio_blk_config(struct virtio_blk_desc *bd,
@@ -181,6 +223,10 @@ static void virtio_blk_config(struct virtio_blk_desc *bd,
     memset(bd->blkq.bufs, 0, pgs << PAGE_SHIFT);
 
     bd->pci_base = pci->base;
+    bd->nreqs = bd->blkq.num / 3;
+    if (bd->nreqs > VIRTIO_BLK_MAX_REQS)
+        bd->nreqs = VIRTIO_BLK_MAX_REQS;
+    assert(bd->nreqs >= 2);
 
     if (guest_features & (1 << VIRTIO_F_EVENT_IDX))
         bd->blkq.uses_event_idx = 1;
@@ -221,6 +267,7 @@ int virtio_config_block(struct pci_config_info *pci, solo5_handle_t mft_index)
     struct virtio_blk_desc *bd = &bd_table[bd_index];
 
     virtio_blk_config(bd, pci);
+    bd->handle = mft_index;
     e->b.hostfd = bd_index;
     e->u.block_basic.capacity = bd->sectors;
     e->u.block_basic.block_size = bd->sector_size;
@@ -310,3 +357,97 @@ solo5_result_t solo5_block_read(solo5_handle_t h, solo5_off_t offset,
     int rv = virtio_blk_op_sync(bd, VIRTIO_BLK_T_IN, sector, buf, size);
     return (rv == 0) ? SOLO5_R_OK : SOLO5_R_EUNSPEC;
 }
+
+solo5_result_t solo5_block_submit(solo5_handle_t h, solo5_block_op_t op,
+                                  solo5_off_t offset, uint8_t *buf,
+                                  size_t size, uint64_t tag)
+{
+    struct mft_entry *e =
+        mft_get_by_index(virtio_manifest, h, MFT_DEV_BLOCK_BASIC);
+    if (e == NULL)
+        return SOLO5_R_EINVAL;
+    assert(e->attached);
+    assert(e->b.hostfd < VIRTIO_BLK_MAX_ENTRIES);
+
+    uint64_t sector = offset / VIRTIO_BLK_SECTOR_SIZE;
+    if ((offset % VIRTIO_BLK_SECTOR_SIZE != 0) ||
+        (sector >= e->u.block_basic.capacity) ||
+        (size != VIRTIO_BLK_SECTOR_SIZE))
+        return SOLO5_R_EINVAL;
+    if (op != SOLO5_BLOCK_OP_READ && op != SOLO5_BLOCK_OP_WRITE)
+        return SOLO5_R_EINVAL;
+
+    struct virtio_blk_desc *bd = &bd_table[e->b.hostfd];
+    if (bd->outstanding == bd->nreqs - 1)
+        return SOLO5_R_AGAIN;
+
+    unsigned req;
+    for (req = VIRTIO_BLK_SYNC_REQ + 1; req < bd->nreqs; req++)
+        if (!bd->reqs[req].busy)
+            break;
+    assert(req < bd->nreqs);
+
+    bd->reqs[req].tag = tag;
+    bd->outstanding++;
+    virtio_blk_op(bd, req,
+                  (op == SOLO5_BLOCK_OP_WRITE) ? VIRTIO_BLK_T_OUT
+                                               : VIRTIO_BLK_T_IN,
+                  sector, buf, size);
+    return SOLO5_R_OK;
+}
+
+solo5_result_t solo5_block_reap(solo5_handle_t h,
+                                struct solo5_block_completion *completions,
+                                size_t count, size_t *reaped)
+{
+    struct mft_entry *e =
+        mft_get_by_index(virtio_manifest, h, MFT_DEV_BLOCK_BASIC);
+    if (e == NULL)
+        return SOLO5_R_EINVAL;
+    assert(e->attached);
+    assert(e->b.hostfd < VIRTIO_BLK_MAX_ENTRIES);
+
+    struct virtio_blk_desc *bd = &bd_table[e->b.hostfd];
+    size_t n = 0;
+
+    virtio_blk_process_used(bd);
+    while (n < count && bd->ndone > 0) {
+        struct virtio_blk_req *r = &bd->reqs[bd->done[bd->done_head]];
+
+        completions[n].tag = r->tag;
+        completions[n].result = r->result;
+        r->busy = false;
+        bd->done_head = (bd->done_head + 1) % VIRTIO_BLK_MAX_REQS;
+        bd->ndone--;
+        bd->outstanding--;
+        n++;
+    }
+
+    *reaped = n;
+    return (n > 0) ? SOLO5_R_OK : SOLO5_R_AGAIN;
+}
+
+/*
+ * Returns the set of block device handles with completions ready to be
+ * reaped. (*inflight) is set if any asynchronous requests are still being
+ * processed by the device; as we do not take interrupts for the block queue,
+ * the caller must then poll rather than block.
+ */
+solo5_handle_set_t virtio_blk_poll(bool *inflight)
+{
+    solo5_handle_set_t ready_set = 0;
+
+    *inflight = false;
+    for (unsigned idx = 0; idx < bd_num_entries; idx++) {
+        struct virtio_blk_desc *bd = &bd_table[idx];
+
+        if (bd->outstanding == 0)
+            continue;
+        virtio_blk_process_used(bd);
+        if (bd->ndone > 0)
+            ready_set |= 1ULL << bd->handle;
+        if (bd->ndone < bd->outstanding)
+            *inflight = true;
+    }
+    return ready_set;
+}
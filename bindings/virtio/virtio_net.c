@@ -118,9 +118,12 @@ static void recv_setup(struct virtio_net_desc *nd)
     outw(nd->pci_base + VIRTIO_PCI_QUEUE_NOTIFY, VIRTQ_RECV);
 }
 
-/* performance note: we perform a copy into the xmit buffer */
-int virtio_net_xmit_packet(struct virtio_net_desc *nd, const void *data,
-                           size_t len)
+/*
+ * Queue a packet for transmission without notifying the host.
+ * performance note: we perform a copy into the xmit buffer
+ */
+static void virtio_net_xmit_enqueue(struct virtio_net_desc *nd,
+                                    const void *data, size_t len)
 {
     uint16_t mask = nd->xmitq.num - 1;
     uint16_t head;
@@ -163,11 +166,20 @@ int virtio_net_xmit_packet(struct virtio_net_desc *nd, const void *data,
     data_buf->extra_flags = 0;
 
     virtq_add_descriptor_chain(&nd->xmitq, head, 2);
+}
 
+static void virtio_net_xmit_notify(struct virtio_net_desc *nd)
+{
     virtio_mb();
     if (virtq_notify_needed(&nd->xmitq))
         outw(nd->pci_base + VIRTIO_PCI_QUEUE_NOTIFY, VIRTQ_XMIT);
+}
 
+int virtio_net_xmit_packet(struct virtio_net_desc *nd, const void *data,
+                           size_t len)
+{
+    virtio_net_xmit_enqueue(nd, data, len);
+    virtio_net_xmit_notify(nd);
     return 0;
 }
 
@@ -334,7 +346,7 @@ static uint8_t *virtio_net_recv_pkt_get(struct virtio_net_desc *nd,
 }
 
 /* Return the next_avail (top-most) receive buffer/descriptor to the available
- * ring. */
+ * ring. The host is not notified; see virtio_net_recv_notify(). */
 static void virtio_net_recv_pkt_put(struct virtio_net_desc *nd)
 {
     uint16_t mask = nd->recvq.num - 1;
@@ -346,6 +358,10 @@ static void virtio_net_recv_pkt_put(struct virtio_net_desc *nd)
      * advances the next_avail index. */
     assert(virtq_add_descriptor_chain(&nd->recvq, nd->recvq.next_avail & mask,
                                       1) == 0);
+}
+
+static void virtio_net_recv_notify(struct virtio_net_desc *nd)
+{
     virtio_mb();
     if (virtq_notify_needed(&nd->recvq))
         outw(nd->pci_base + VIRTIO_PCI_QUEUE_NOTIFY, VIRTQ_RECV);
@@ -432,22 +448,31 @@ solo5_handle_set_t virtio_to_handle_set(virtio_set_t virtio_set)
 void solo5_yield(solo5_time_t deadline, solo5_handle_set_t *ready_set)
 {
     virtio_set_t virtio_set = 0;
+    solo5_handle_set_t blk_set = 0;
+    bool blk_inflight;
 
     /*
      * cpu_block() as currently implemented will only poll for the maximum time
      * the PIT can be run in "one shot" mode. Loop until either I/O is possible
      * or the desired time has been reached.
+     *
+     * Block request completions do not raise interrupts, so while any are
+     * in flight we poll rather than block.
      */
     cpu_intr_disable();
     do {
         virtio_net_pkt_poll(&virtio_set);
-        if (virtio_set != 0)
+        blk_set = virtio_blk_poll(&blk_inflight);
+        if (virtio_set != 0 || blk_set != 0)
             break;
 
-        cpu_block(deadline);
+        if (!blk_inflight)
+            cpu_block(deadline);
     } while (solo5_clock_monotonic() < deadline);
-    if (virtio_set == 0)
+    if (virtio_set == 0 && blk_set == 0) {
         virtio_net_pkt_poll(&virtio_set);
+        blk_set = virtio_blk_poll(&blk_inflight);
+    }
     cpu_intr_enable();
 
     solo5_handle_set_t tmp_ready_set;
@@ -455,6 +480,7 @@ void solo5_yield(solo5_time_t deadline, solo5_handle_set_t *ready_set)
         tmp_ready_set = virtio_to_handle_set(virtio_set);
     else
         tmp_ready_set = 0;
+    tmp_ready_set |= blk_set;
 
     if (ready_set)
         *ready_set = tmp_ready_set;
@@ -475,13 +501,16 @@ solo5_result_t solo5_net_write(solo5_handle_t h, const uint8_t *buf,
     return (rv == 0) ? SOLO5_R_OK : SOLO5_R_EUNSPEC;
 }
 
-/* Returns 0 if a packet was read, -1 if there is there is no pending packet. */
-static int virtio_net_recv(struct virtio_net_desc *nd, uint8_t *buf,
-                           size_t size, size_t *read_size)
+/*
+ * Receive up to (count) packets into (bufs), each of (size) bytes. Returns the
+ * number of packets read, which may be 0. The receive descriptors consumed are
+ * returned to the device with a single notification.
+ */
+static size_t virtio_net_recv_many(struct virtio_net_desc *nd,
+                                   uint8_t *const bufs[], size_t size,
+                                   size_t read_sizes[], size_t count)
 {
-    uint8_t *pkt;
-    size_t len = size;
-
+    size_t n;
 
     /* We only need interrupts to wake up the application when it's sleeping
      * and waiting for incoming packets. The app is definitely not doing that
@@ -497,33 +526,33 @@ static int virtio_net_recv(struct virtio_net_desc *nd, uint8_t *buf,
         nd->recvq.avail->flags |= VIRTQ_AVAIL_F_NO_INTERRUPT;
     }
 
-    pkt = virtio_net_recv_pkt_get(nd, &len);
-    if (!pkt) {
-        if (nd->recvq.uses_event_idx)
-            *virtq_used_event(&nd->recvq) = nd->recvq.used->idx;
-        else
-            nd->recvq.avail->flags &= ~VIRTQ_AVAIL_F_NO_INTERRUPT;
-        return -1;
-    }
+    for (n = 0; n < count; n++) {
+        size_t len = size;
+        uint8_t *pkt = virtio_net_recv_pkt_get(nd, &len);
+        if (!pkt)
+            break;
 
-    assert(len <= size);
-    assert(len <= PKT_BUFFER_LEN);
-    *read_size = len;
-    /* also, it's clearly not zero copy */
-    memcpy(buf, pkt, len);
+        assert(len <= size);
+        assert(len <= PKT_BUFFER_LEN);
+        read_sizes[n] = len;
+        /* also, it's clearly not zero copy */
+        memcpy(bufs[n], pkt, len);
 
-    /* Consume the recently used descriptor. */
-    nd->recvq.last_used++;
-    nd->recvq.num_avail++;
+        /* Consume the recently used descriptor. */
+        nd->recvq.last_used++;
+        nd->recvq.num_avail++;
 
-    virtio_net_recv_pkt_put(nd);
+        virtio_net_recv_pkt_put(nd);
+    }
+    if (n > 0)
+        virtio_net_recv_notify(nd);
 
     if (nd->recvq.uses_event_idx)
         *virtq_used_event(&nd->recvq) = nd->recvq.used->idx;
     else
         nd->recvq.avail->flags &= ~VIRTQ_AVAIL_F_NO_INTERRUPT;
 
-    return 0;
+    return n;
 }
 
 solo5_result_t solo5_net_read(solo5_handle_t h, uint8_t *buf, size_t size,
@@ -537,6 +566,47 @@ solo5_result_t solo5_net_read(solo5_handle_t h, uint8_t *buf, size_t size,
     assert(e->attached);
     assert(e->b.hostfd < VIRTIO_NET_MAX_ENTRIES);
 
-    int rv = virtio_net_recv(&nd_table[e->b.hostfd], buf, size, read_size);
-    return (rv == 0) ? SOLO5_R_OK : SOLO5_R_AGAIN;
+    size_t n = virtio_net_recv_many(&nd_table[e->b.hostfd], &buf, size,
+                                    read_size, 1);
+    return (n == 1) ? SOLO5_R_OK : SOLO5_R_AGAIN;
+}
+
+solo5_result_t solo5_net_write_many(solo5_handle_t h,
+                                    const uint8_t *const bufs[],
+                                    const size_t sizes[], size_t count,
+                                    size_t *written)
+{
+    struct mft_entry *e =
+        mft_get_by_index(virtio_manifest, h, MFT_DEV_NET_BASIC);
+    if (e == NULL)
+        return SOLO5_R_EINVAL;
+
+    assert(e->attached);
+    assert(e->b.hostfd < VIRTIO_NET_MAX_ENTRIES);
+
+    struct virtio_net_desc *nd = &nd_table[e->b.hostfd];
+    for (size_t i = 0; i < count; i++)
+        virtio_net_xmit_enqueue(nd, bufs[i], sizes[i]);
+    if (count > 0)
+        virtio_net_xmit_notify(nd);
+
+    *written = count;
+    return SOLO5_R_OK;
+}
+
+solo5_result_t solo5_net_read_many(solo5_handle_t h, uint8_t *const bufs[],
+                                   size_t size, size_t read_sizes[],
+                                   size_t count, size_t *read_count)
+{
+    struct mft_entry *e =
+        mft_get_by_index(virtio_manifest, h, MFT_DEV_NET_BASIC);
+    if (e == NULL)
+        return SOLO5_R_EINVAL;
+
+    assert(e->attached);
+    assert(e->b.hostfd < VIRTIO_NET_MAX_ENTRIES);
+
+    *read_count = virtio_net_recv_many(&nd_table[e->b.hostfd], bufs, size,
+                                       read_sizes, count);
+    return (*read_count > 0) ? SOLO5_R_OK : SOLO5_R_AGAIN;
 }
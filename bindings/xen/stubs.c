@@ -44,6 +44,21 @@ solo5_result_t solo5_net_read(solo5_handle_t handle, uint8_t *buf, size_t size,
     return SOLO5_R_EUNSPEC;
 }
 
+solo5_result_t solo5_net_write_many(solo5_handle_t handle,
+                                    const uint8_t *const bufs[],
+                                    const size_t sizes[], size_t count,
+                                    size_t *written)
+{
+    return SOLO5_R_EUNSPEC;
+}
+
+solo5_result_t solo5_net_read_many(solo5_handle_t handle, uint8_t *const bufs[],
+                                   size_t size, size_t read_sizes[],
+                                   size_t count, size_t *read_count)
+{
+    return SOLO5_R_EUNSPEC;
+}
+
 solo5_result_t solo5_block_acquire(const char *name, solo5_handle_t *handle,
                                    struct solo5_block_info *info)
 {
@@ -61,3 +76,17 @@ solo5_result_t solo5_block_read(solo5_handle_t handle, solo5_off_t offset,
 {
     return SOLO5_R_EUNSPEC;
 }
+
+solo5_result_t solo5_block_submit(solo5_handle_t handle, solo5_block_op_t op,
+                                  solo5_off_t offset, uint8_t *buf,
+                                  size_t size, uint64_t tag)
+{
+    return SOLO5_R_EUNSPEC;
+}
+
+solo5_result_t solo5_block_reap(solo5_handle_t handle,
+                                struct solo5_block_completion *completions,
+                                size_t count, size_t *reaped)
+{
+    return SOLO5_R_EUNSPEC;
+}
@@ -69,6 +69,9 @@ typedef uint64_t hvt_gpa_t;
 /*
  * On x86, 32-bit PIO is used as the hypercall mechanism. This only supports
  * sending 32-bit pointers; raise an assertion if a bigger pointer is used.
+ * As guest memory may extend beyond 4GB, with the stack at the top, the
+ * bindings keep hypercall arguments in static storage rather than on the
+ * stack.
  *
  * On x86 the compiler-only memory barrier ("memory" clobber) is sufficient
  * across the hypercall boundary.
@@ -188,7 +191,12 @@ static inline void hvt_ring_kick(int ring_id)
 /*
  * Feature flags for host/guest negotiation.
  */
-#define HVT_FEATURE_RING_IO (1U << 0)
+#define HVT_FEATURE_RING_IO        (1U << 0)
+#define HVT_FEATURE_BLOCK_ASYNC    (1U << 1)
+#define HVT_FEATURE_BOOT_TRACE     (1U << 2)
+#define HVT_FEATURE_MULTICALL      (1U << 3)
+#define HVT_FEATURE_NET_TX_BLOCKED (1U << 4) /* hvt_ring.tx_blocked is set */
+#define HVT_FEATURE_MEM_RELEASE    (1U << 5)
 
 /*
  * A pointer to this structure is passed by the tender as the sole argument to
@@ -210,6 +218,23 @@ struct hvt_boot_info {
     uint32_t host_features; /* Features offered by the tender */
     uint32_t guest_features; /* Features accepted by the guest */
     HVT_GUEST_PTR(void *) net_ring; /* GPA of network ring, 0 if absent */
+
+    /* Extended fields (boot tracing) */
+    HVT_GUEST_PTR(uint64_t *) boot_trace; /* GPA of boot trace area */
+};
+
+/*
+ * Guest startup phases recorded in the boot trace area, if the tender offers
+ * HVT_FEATURE_BOOT_TRACE. The area holds HVT_BOOT_MAX entries, each set by the
+ * guest to the value of its CPU cycle counter on entry to that phase. Entries
+ * for phases which were not reached are left as 0.
+ */
+enum hvt_boot_phase {
+    HVT_BOOT_START,
+    HVT_BOOT_MEM_INIT,
+    HVT_BOOT_NET_INIT,
+    HVT_BOOT_APP_MAIN,
+    HVT_BOOT_MAX
 };
 
 /*
@@ -231,6 +256,10 @@ enum hvt_hypercall {
     HVT_HYPERCALL_NET_WRITE,
     HVT_HYPERCALL_NET_READ,
     HVT_HYPERCALL_HALT,
+    HVT_HYPERCALL_BLOCK_SUBMIT,
+    HVT_HYPERCALL_BLOCK_REAP,
+    HVT_HYPERCALL_MEM_RELEASE,
+    HVT_HYPERCALL_MULTICALL,
     HVT_HYPERCALL_MAX
 };
 
@@ -277,6 +306,50 @@ struct hvt_hc_block_read {
     int ret;
 };
 
+/*
+ * HVT_HYPERCALL_BLOCK_SUBMIT: Queue an asynchronous block request.
+ *
+ * Available if the tender sets HVT_FEATURE_BLOCK_ASYNC. At most
+ * HVT_BLOCK_QUEUE_DEPTH requests may be outstanding (submitted but not
+ * reaped) per device. When completions are pending, the device's handle is
+ * reported as ready by HVT_HYPERCALL_POLL.
+ */
+#define HVT_BLOCK_QUEUE_DEPTH 32
+
+#define HVT_BLOCK_OP_READ  0
+#define HVT_BLOCK_OP_WRITE 1
+
+struct hvt_hc_block_submit {
+    /* IN */
+    uint64_t handle;
+    uint64_t op;
+    uint64_t offset;
+    HVT_GUEST_PTR(void *) data;
+    size_t len;
+    uint64_t tag;
+
+    /* OUT */
+    int ret;
+};
+
+/* HVT_HYPERCALL_BLOCK_REAP */
+struct hvt_block_completion {
+    uint64_t tag;
+    int32_t ret;
+    uint32_t _reserved;
+};
+
+struct hvt_hc_block_reap {
+    /* IN */
+    uint64_t handle;
+    HVT_GUEST_PTR(struct hvt_block_completion *) completions;
+    size_t count;
+
+    /* OUT */
+    size_t reaped;
+    int ret;
+};
+
 /* HVT_HYPERCALL_NET_WRITE */
 struct hvt_hc_net_write {
     /* IN */
@@ -331,4 +404,58 @@ struct hvt_hc_halt {
     int exit_status;
 };
 
+/*
+ * HVT_HYPERCALL_MEM_RELEASE: The guest no longer needs the contents of the
+ * (len) bytes of memory at (addr), both multiples of 4kB. The tender may
+ * return the memory backing them to the host, after which their contents are
+ * undefined. (ret) is 0 if the request was valid, even if it was ignored.
+ */
+struct hvt_hc_mem_release {
+    /* IN */
+    HVT_GUEST_PTR(void *) addr;
+    size_t len;
+
+    /* OUT */
+    int ret;
+};
+
+/*
+ * HVT_HYPERCALL_MULTICALL: Perform the (count) hypercalls described by
+ * (calls), at most HVT_MULTICALL_MAX, in a single VM exit.
+ *
+ * Available if the tender sets HVT_FEATURE_MULTICALL. The hypercalls are
+ * performed in order, each as if by hvt_do_hypercall(nr, arg), and return
+ * their results in their own argument structures. The (ret) of each entry is
+ * set to 0 if the hypercall was performed, or -1 if (nr) is not available, or
+ * is HVT_HYPERCALL_HALT or HVT_HYPERCALL_MULTICALL, which cannot be batched.
+ * (ret) is 0 if all entries were performed, -1 otherwise.
+ *
+ * If (flags) includes HVT_MULTICALL_STOP_ON_ERROR, the tender stops after the
+ * first hypercall which sets a non-zero (ret) (e.g. SOLO5_R_AGAIN) in its
+ * argument structure, and sets the (ret) of the entries following it to 1.
+ * HVT_HYPERCALL_POLL, whose (ret) is a count, never stops the batch.
+ */
+#define HVT_MULTICALL_MAX 16
+
+#define HVT_MULTICALL_STOP_ON_ERROR (1U << 0)
+
+struct hvt_multicall_entry {
+    /* IN */
+    uint64_t nr;
+    HVT_GUEST_PTR(volatile void *) arg;
+
+    /* OUT */
+    int64_t ret;
+};
+
+struct hvt_hc_multicall {
+    /* IN */
+    HVT_GUEST_PTR(struct hvt_multicall_entry *) calls;
+    size_t count;
+    uint64_t flags;
+
+    /* OUT */
+    int ret;
+};
+
 #endif /* HVT_ABI_H */
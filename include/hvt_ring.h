@@ -74,7 +74,8 @@ struct hvt_ring_commit {
  * avoid false sharing between guest and host.
  *
  * Cache line 0: written ONLY by the guest (ent_tail, com_head)
- * Cache line 1: written ONLY by thes host (ent_head, com_tail, needs_kick)
+ * Cache line 1: written ONLY by thes host (ent_head, com_tail, needs_kick,
+ *               tx_blocked)
  *
  * This ensures each side only writes to its own cache line, eliminating
  * false sharing bounces.
@@ -89,7 +90,9 @@ struct hvt_ring {
     volatile uint32_t ent_head; /* consumed by host */
     volatile uint32_t com_tail; /* produced by host */
     volatile uint32_t needs_kick; /* set by host before sleeping */
-    uint8_t _pad1[52];
+    volatile uint32_t tx_blocked; /* set by host while it cannot transmit,
+                                     if HVT_FEATURE_NET_TX_BLOCKED */
+    uint8_t _pad1[48];
 
     struct hvt_ring_entry entries[HVT_RING_SIZE];
     struct hvt_ring_commit commits[HVT_RING_SIZE];
@@ -166,6 +166,25 @@ solo5_result_t solo5_tls_init(uintptr_t tls);
  */
 solo5_result_t solo5_set_tls_base(uintptr_t base);
 
+/*
+ * Memory.
+ */
+
+/*
+ * Hints that the application no longer needs the contents of the (size) bytes
+ * of heap memory at (addr), allowing the host to reclaim the memory backing
+ * them, for example after an allocator has compacted its heap.
+ *
+ * The memory remains part of the heap and may be used again at any time, but
+ * its contents are undefined once this call returns. (addr) and (size) must
+ * be multiples of the page size, and must lie within the heap described by
+ * (struct solo5_start_info).
+ *
+ * Returns SOLO5_R_EINVAL if the above conditions are not met. Targets which
+ * cannot return memory to the host ignore the hint and return SOLO5_R_OK.
+ */
+solo5_result_t solo5_mem_release(uintptr_t addr, size_t size);
+
 /*
  * Time.
  *
@@ -221,10 +240,12 @@ typedef uint64_t solo5_handle_set_t;
  * Suspends execution of the application until either:
  *
  *   a) monotonic time reaches (deadline), or
- *   b) at least one network device is ready for input.
+ *   b) at least one network device is ready for input, or
+ *   c) at least one block device has completed requests submitted with
+ *      solo5_block_submit() ready to be reaped.
  *
  * If (ready_set) is not NULL, it will be filled in with the set of
- * solo5_handle_t's ready for input.
+ * solo5_handle_t's ready for input or with completions pending.
  */
 void solo5_yield(solo5_time_t deadline, solo5_handle_set_t *ready_set);
 
@@ -271,8 +292,10 @@ solo5_result_t solo5_net_acquire(const char *name, solo5_handle_t *handle,
 
 /*
  * Sends a single network packet to the network device identified by (handle),
- * from the buffer (*buf), without blocking.  If the packet cannot be sent due
- * to a transient error (e.g.  no resources available) it will be silently
+ * from the buffer (*buf), without blocking.  If the packet cannot be sent
+ * because the host transmit queue is full, SOLO5_R_AGAIN is returned and the
+ * caller may retry sending it later. If the packet cannot be sent due to any
+ * other transient error (e.g.  no resources available) it will be silently
  * dropped.
  *
  * The maximum allowed value for (size) is (solo5_net_info.mtu +
@@ -294,6 +317,39 @@ solo5_result_t solo5_net_write(solo5_handle_t handle, const uint8_t *buf,
 solo5_result_t solo5_net_read(solo5_handle_t handle, uint8_t *buf, size_t size,
                               size_t *read_size);
 
+/*
+ * Sends up to (count) network packets to the network device identified by
+ * (handle), without blocking. Packet (i) is taken from the buffer (*bufs[i])
+ * of size (sizes[i]), with the same constraints as for solo5_net_write().
+ *
+ * Packets are sent in order. Returns SOLO5_R_OK if all packets were sent. If
+ * the host transmit queue becomes full, returns SOLO5_R_AGAIN. In either case
+ * the number of packets sent is stored in (*written), and the caller may
+ * retry sending the remainder later.
+ *
+ * Depending on the target, this amortises the cost of notifying the host
+ * over the whole batch.
+ */
+solo5_result_t solo5_net_write_many(solo5_handle_t handle,
+                                    const uint8_t *const bufs[],
+                                    const size_t sizes[], size_t count,
+                                    size_t *written);
+
+/*
+ * Receives up to (count) network packets from the network device identified
+ * by (handle) into the buffers (*bufs[0]) to (*bufs[count - 1]), without
+ * blocking. Each buffer must be of at least (size) bytes, with the same
+ * constraints as for solo5_net_read().
+ *
+ * If no packets are available returns SOLO5_R_AGAIN, otherwise returns
+ * SOLO5_R_OK, the number of packets received in (*read_count), and the size
+ * of each received packet in (read_sizes[0]) to (read_sizes[*read_count -
+ * 1]).
+ */
+solo5_result_t solo5_net_read_many(solo5_handle_t handle, uint8_t *const bufs[],
+                                   size_t size, size_t read_sizes[],
+                                   size_t count, size_t *read_count);
+
 /*
  * Block I/O.
  *
@@ -353,4 +409,59 @@ solo5_result_t solo5_block_write(solo5_handle_t handle, solo5_off_t offset,
 solo5_result_t solo5_block_read(solo5_handle_t handle, solo5_off_t offset,
                                 uint8_t *buf, size_t size);
 
+/*
+ * Asynchronous block I/O.
+ *
+ * Requests are queued with solo5_block_submit(), and their completions are
+ * collected with solo5_block_reap(). Several requests may be outstanding on
+ * a device at any one time, up to a target-dependent queue depth. Requests
+ * may complete in any order.
+ *
+ * When completions are pending on a device, solo5_yield() returns
+ * immediately with the device's handle in (ready_set).
+ */
+typedef enum {
+    SOLO5_BLOCK_OP_READ,
+    SOLO5_BLOCK_OP_WRITE
+} solo5_block_op_t;
+
+struct solo5_block_completion {
+    uint64_t tag; /* As passed to solo5_block_submit() */
+    solo5_result_t result; /* Result of the request */
+};
+
+/*
+ * Queues a request to perform (op) on the block device identified by
+ * (handle), transferring (size) bytes between the buffer (*buf) and the
+ * device, starting at byte (offset). The same constraints as for
+ * solo5_block_read() and solo5_block_write() apply to (offset) and (size).
+ *
+ * The caller-supplied (tag) is returned in the request's completion. The
+ * contents of (*buf) must not be accessed or modified by the caller until the
+ * completion has been reaped.
+ *
+ * Returns SOLO5_R_OK if the request was queued, or SOLO5_R_AGAIN if the
+ * device queue is full, in which case the caller should reap completions and
+ * try again. Returns SOLO5_R_EUNSPEC if asynchronous I/O is not supported by
+ * the target.
+ *
+ * Solo5 implementations MAY batch queued requests, and only start them on the
+ * next call to solo5_yield() or solo5_block_reap(). Callers waiting for a
+ * completion must therefore do so using those, rather than by other means.
+ */
+solo5_result_t solo5_block_submit(solo5_handle_t handle, solo5_block_op_t op,
+                                  solo5_off_t offset, uint8_t *buf,
+                                  size_t size, uint64_t tag);
+
+/*
+ * Collects up to (count) completions for requests submitted to the block
+ * device identified by (handle) into (completions), without blocking.
+ *
+ * If no completions are pending returns SOLO5_R_AGAIN, otherwise returns
+ * SOLO5_R_OK and the number of completions stored in (*reaped).
+ */
+solo5_result_t solo5_block_reap(solo5_handle_t handle,
+                                struct solo5_block_completion *completions,
+                                size_t count, size_t *reaped);
+
 #endif
@@ -38,13 +38,51 @@
  * in this file.
  */
 
-#define SPT_ABI_VERSION 2
+#define SPT_ABI_VERSION 3
 
 /*
  * Lowest virtual address at which guests can be loaded.
  */
 #define SPT_GUEST_MIN_BASE 0x100000
 
+/*
+ * An io_uring set up by the tender and shared with the guest, see
+ * SPT_FEATURE_IO_URING. The submission queue (SQ) and completion queue (CQ)
+ * and their entries are laid out as defined by the Linux kernel in
+ * <linux/io_uring.h>. They are placed at the top of guest memory, above
+ * (mem_size), if the host kernel supports it, and elsewhere in the tender's
+ * address space otherwise. Slot (i) of the SQ index array always refers to SQ
+ * entry (i), so the guest only needs to fill in the entry and advance
+ * (*sq_tail).
+ */
+struct spt_io_uring {
+    int fd; /* io_uring file descriptor, for io_uring_enter() only */
+    uint32_t sq_entries; /* Number of SQ entries, a power of 2 */
+    uint32_t cq_entries; /* Number of CQ entries, a power of 2 */
+    uint32_t *sq_head;
+    uint32_t *sq_tail;
+    uint32_t *sq_flags;
+    void *sqes; /* SQ entries (struct io_uring_sqe) */
+    uint32_t *cq_head;
+    uint32_t *cq_tail;
+    void *cqes; /* CQ entries (struct io_uring_cqe) */
+    uint64_t handles; /* Set of devices whose I/O goes through the ring */
+    uint8_t *net_bufs; /* Packet buffers for network devices, see below */
+    uint64_t net_buf_size; /* Size of each packet buffer */
+};
+
+/*
+ * Network devices in (handles) have SPT_IO_URING_NET_SLOTS receive buffers
+ * followed by as many transmit buffers at (net_bufs), for each device in
+ * ascending order of handle.
+ *
+ * The ring has room for SPT_IO_URING_NET_SLOTS receive and as many transmit
+ * requests in flight on each network device, and SPT_IO_URING_BLOCK_SLOTS on
+ * each block device.
+ */
+#define SPT_IO_URING_NET_SLOTS 32
+#define SPT_IO_URING_BLOCK_SLOTS 64
+
 /*
  * A pointer to this structure is passed by the tender as the sole argument to
  * the guest entrypoint.
@@ -56,8 +94,39 @@ struct spt_boot_info {
     const void *mft; /* Address of application manifest */
     int epollfd; /* epoll() set for yield() */
     int timerfd; /* internal timerfd for yield() */
+    uint32_t features; /* SPT_FEATURE_* offered by the tender */
+    uint64_t cpu_cycle_freq; /* CPU cycle counter frequency, Hz */
+    uint64_t cpu_cycle_base; /* CPU cycle count at which... */
+    uint64_t monotonic_base; /* ...host CLOCK_MONOTONIC was this, in ns, */
+    uint64_t wall_base; /* ...and host CLOCK_REALTIME was this */
+    struct spt_io_uring io_uring; /* If SPT_FEATURE_IO_URING */
 };
 
+/*
+ * Features offered by the tender in (features):
+ *
+ * SPT_FEATURE_EPOLL_PWAIT2: yield() may use epoll_pwait2() on (epollfd), in
+ * which case (timerfd) is not used and may not be armed.
+ */
+#define SPT_FEATURE_EPOLL_PWAIT2 (1U << 0)
+/*
+ * SPT_FEATURE_TSC_CLOCK: the CPU cycle counter is invariant and synchronised
+ * across host CPUs, so the guest may derive its clocks from it and the
+ * (cpu_cycle_*), (monotonic_base) and (wall_base) fields, and clock_gettime()
+ * may only be used for CLOCK_REALTIME.
+ */
+#define SPT_FEATURE_TSC_CLOCK (1U << 1)
+/*
+ * SPT_FEATURE_IO_URING: I/O on the devices in (io_uring.handles) must be
+ * performed through (io_uring), using only IORING_OP_READ and IORING_OP_WRITE
+ * with IOSQE_FIXED_FILE, where the fixed file index is the device's handle.
+ * The kernel polls the SQ, so io_uring_enter() is only needed to wake the
+ * polling thread if IORING_SQ_NEED_WAKEUP is set in (*sq_flags), or to wait
+ * for completions. These devices are not in the epoll() set, and the guest
+ * may not use any other system call on them.
+ */
+#define SPT_FEATURE_IO_URING (1U << 2)
+
 /*
  * Identifier (data.u64) for internal timerfd in epoll() set.
  */
@@ -0,0 +1,144 @@
+#!/bin/sh
+# Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+#
+# This file is part of Solo5, a sandboxed execution environment.
+#
+# Permission to use, copy, modify, and/or distribute this software
+# for any purpose with or without fee is hereby granted, provided
+# that the above copyright notice and this permission notice appear
+# in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+# WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+# AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+# CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+# OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+# NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+# CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+usage ()
+{
+    cat <<EOM 1>&2
+Usage: solo5-bench-boot [ OPTIONS ] UNIKERNEL [ -- ] [ ARGUMENTS ... ]
+
+Launch N concurrent instances of the Solo5 UNIKERNEL (hvt target) with
+--boot-trace, and report percentiles of their startup phase timings and peak
+resident set size. Times are measured from entry to the tender's main().
+
+Options:
+    -n N: Launch N instances (default is 16).
+
+    -t TENDER: Use TENDER (default is "solo5-hvt" in PATH).
+
+    -o OPT: Pass OPT to the tender; may be given more than once.
+
+    -k: Keep the per-instance reports and output in a temporary directory.
+EOM
+    exit 1
+}
+
+die ()
+{
+    echo solo5-bench-boot: error: "$@" 1>&2
+    exit 1
+}
+
+# Parse command line arguments.
+ARGS=$(getopt n:t:o:k $*)
+[ $? -ne 0 ] && usage
+set -- $ARGS
+N=16
+TENDER=solo5-hvt
+TENDER_OPTS=
+KEEP=
+while true; do
+    case "$1" in
+    -n)
+        N="$2"
+        shift; shift
+        ;;
+    -t)
+        TENDER="$2"
+        shift; shift
+        ;;
+    -o)
+        TENDER_OPTS="${TENDER_OPTS} $2"
+        shift; shift
+        ;;
+    -k)
+        KEEP=1
+        shift
+        ;;
+    --)
+        shift; break
+        ;;
+    esac
+done
+[ $# -lt 1 ] && usage
+[ "${N}" -gt 0 ] 2>/dev/null || die "invalid number of instances: ${N}"
+type ${TENDER} >/dev/null 2>&1 || die "not found: ${TENDER}"
+UNIKERNEL="$1"
+[ -f "${UNIKERNEL}" ] || die "not found: ${UNIKERNEL}"
+shift
+
+TMPDIR=$(mktemp -d) || die "could not create temporary directory"
+[ -z "${KEEP}" ] && trap "rm -rf ${TMPDIR}" EXIT
+
+# Start all instances at once, and wait for them to exit.
+i=0
+PIDS=
+while [ ${i} -lt ${N} ]; do
+    ${TENDER} ${TENDER_OPTS} --boot-trace-fd=3 -- "${UNIKERNEL}" "$@" \
+        3>${TMPDIR}/trace.${i} >${TMPDIR}/out.${i} 2>&1 &
+    PIDS="${PIDS} $!"
+    i=$((i + 1))
+done
+FAILED=0
+for pid in ${PIDS}; do
+    wait ${pid} || FAILED=$((FAILED + 1))
+done
+[ ${FAILED} -gt 0 ] && \
+    echo "solo5-bench-boot: warning: ${FAILED} instance(s) exited with an" \
+        "error" 1>&2
+
+# Report the p50, p99 and maximum of (key) for each phase, over all instances
+# which reached it.
+cat ${TMPDIR}/trace.* | awk '
+{
+    split($2, kv, "=");
+    if (kv[1] == "ns")
+        v = kv[2] / 1000;
+    else if (kv[1] == "max_kb")
+        v = kv[2];
+    else
+        next;
+    if (!($1 in n)) {
+        order[++nphases] = $1;
+        unit[$1] = (kv[1] == "ns") ? "us" : "kb";
+    }
+    val[$1, ++n[$1]] = v;
+}
+function pct(name, p,    r) {
+    r = int((p * n[name] + 99) / 100);
+    return val[name, (r < 1) ? 1 : r];
+}
+END {
+    printf "%-24s %6s %12s %12s %12s\n", "phase", "count", "p50", "p99", "max";
+    for (i = 1; i <= nphases; i++) {
+        name = order[i];
+        # Insertion sort, N is small.
+        for (j = 2; j <= n[name]; j++) {
+            v = val[name, j];
+            for (k = j - 1; k >= 1 && val[name, k] > v; k--)
+                val[name, k + 1] = val[name, k];
+            val[name, k + 1] = v;
+        }
+        printf "%-24s %6d %10.0f%s %10.0f%s %10.0f%s\n", name, n[name],
+            pct(name, 50), unit[name], pct(name, 99), unit[name],
+            val[name, n[name]], unit[name];
+    }
+}'
+
+[ -n "${KEEP}" ] && echo "solo5-bench-boot: reports kept in ${TMPDIR}" 1>&2
+[ ${FAILED} -eq 0 ]
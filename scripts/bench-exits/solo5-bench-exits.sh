@@ -0,0 +1,154 @@
+#!/bin/sh
+# Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+#
+# This file is part of Solo5, a sandboxed execution environment.
+#
+# Permission to use, copy, modify, and/or distribute this software
+# for any purpose with or without fee is hereby granted, provided
+# that the above copyright notice and this permission notice appear
+# in all copies.
+#
+# THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+# WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+# WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+# AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+# CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+# OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+# NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+# CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+
+usage ()
+{
+    cat <<EOM 1>&2
+Usage: solo5-bench-exits [ OPTIONS ] UNIKERNEL [ -- ] [ ARGUMENTS ... ]
+
+Run the Solo5 UNIKERNEL (hvt target) twice with --stats, once as given and
+once with the options given with -b added, and report the VM exit counters
+and guest run times of both runs side by side. The unikernel must exit by
+itself; use -l to drive it while it runs.
+
+Options:
+    -t TENDER: Use TENDER (default is "solo5-hvt" in PATH).
+
+    -o OPT: Pass OPT to the tender for both runs; may be given more than once.
+
+    -b OPT: Pass OPT to the tender for the second run only; may be given more
+        than once (default is "--dedicated-cpu").
+
+    -l COMMAND: Run COMMAND (with sh -c) once the tender has started, e.g.
+        a ping flood against the unikernel.
+
+    -k: Keep the reports and output in a temporary directory.
+EOM
+    exit 1
+}
+
+die ()
+{
+    echo solo5-bench-exits: error: "$@" 1>&2
+    exit 1
+}
+
+# Parse command line arguments.
+ARGS=$(getopt t:o:b:l:k "$@")
+[ $? -ne 0 ] && usage
+eval set -- "${ARGS}"
+TENDER=solo5-hvt
+TENDER_OPTS=
+BENCH_OPTS=
+LOAD=
+KEEP=
+while true; do
+    case "$1" in
+    -t)
+        TENDER="$2"
+        shift; shift
+        ;;
+    -o)
+        TENDER_OPTS="${TENDER_OPTS} $2"
+        shift; shift
+        ;;
+    -b)
+        BENCH_OPTS="${BENCH_OPTS} $2"
+        shift; shift
+        ;;
+    -l)
+        LOAD="$2"
+        shift; shift
+        ;;
+    -k)
+        KEEP=1
+        shift
+        ;;
+    --)
+        shift; break
+        ;;
+    esac
+done
+[ $# -lt 1 ] && usage
+[ -z "${BENCH_OPTS}" ] && BENCH_OPTS=--dedicated-cpu
+type ${TENDER} >/dev/null 2>&1 || die "not found: ${TENDER}"
+UNIKERNEL="$1"
+[ -f "${UNIKERNEL}" ] || die "not found: ${UNIKERNEL}"
+shift
+
+TMPDIR=$(mktemp -d) || die "could not create temporary directory"
+[ -z "${KEEP}" ] && trap "rm -rf ${TMPDIR}" EXIT
+
+# run NAME [ OPTS ... ]: Run the unikernel with the load, if any, and write
+# its statistics to ${TMPDIR}/stats.NAME.
+run ()
+{
+    name="$1"
+    shift
+    ${TENDER} ${TENDER_OPTS} "$@" --stats-fd=3 -- "${UNIKERNEL}" ${UK_ARGS} \
+        3>${TMPDIR}/stats.${name} >${TMPDIR}/out.${name} 2>&1 &
+    pid=$!
+    if [ -n "${LOAD}" ]; then
+        sleep 1
+        sh -c "${LOAD}" >${TMPDIR}/load.${name} 2>&1
+    fi
+    wait ${pid} || { cat ${TMPDIR}/out.${name} 1>&2; die "${name} run failed"; }
+}
+
+UK_ARGS="$*"
+run baseline
+run bench ${BENCH_OPTS}
+
+# Report count= for each counter, and the mean and maximum guest run time,
+# in order of first appearance.
+awk -v opts="${BENCH_OPTS# }" '
+{
+    run = (FILENAME ~ /baseline$/) ? 1 : 2;
+    if (!($1 in seen)) {
+        seen[$1] = 1;
+        order[++n] = $1;
+    }
+    for (i = 2; i <= NF; i++) {
+        split($i, kv, "=");
+        v[run, $1, kv[1]] = kv[2];
+    }
+}
+function show(name, key, label) {
+    if (((1, name, key) in v) || ((2, name, key) in v))
+        printf "%-36s %14.0f %14.0f\n", label,
+            v[1, name, key], v[2, name, key];
+}
+END {
+    printf "%-36s %14s %14s\n", "counter", "baseline", opts;
+    for (i = 1; i <= n; i++) {
+        name = order[i];
+        show(name, "count", name);
+        if (name == "guest") {
+            for (r = 1; r <= 2; r++)
+                if (v[r, name, "count"] > 0)
+                    v[r, name, "mean_ns"] = \
+                        v[r, name, "total_ns"] / v[r, name, "count"];
+            show(name, "mean_ns", "guest.mean_ns");
+            show(name, "max_ns", "guest.max_ns");
+        }
+    }
+}' ${TMPDIR}/stats.baseline ${TMPDIR}/stats.bench
+
+[ -n "${KEEP}" ] && echo "solo5-bench-exits: reports kept in ${TMPDIR}" 1>&2
+exit 0
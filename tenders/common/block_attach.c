@@ -25,12 +25,18 @@
 #define _GNU_SOURCE
 #define _FILE_OFFSET_BITS 64
 #include <err.h>
+#include <errno.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <fcntl.h>
 #include <unistd.h>
 #include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
 #include <assert.h>
+#include <limits.h>
+
+#include "block_attach.h"
 
 /*
  * Attach to the block device specified by (path), returning its capacity in
@@ -48,3 +54,107 @@ int block_attach(const char *path, off_t *capacity_)
     *capacity_ = capacity;
     return fd;
 }
+
+void block_attach_stripe(const char *spec, struct block_stripe *stripe,
+                         off_t *capacity_)
+{
+    char *end;
+    unsigned long long unit = strtoull(spec, &end, 10);
+
+    if (*end == 'k' || *end == 'K') {
+        unit <<= 10;
+        end++;
+    } else if (*end == 'm' || *end == 'M') {
+        unit <<= 20;
+        end++;
+    }
+    if (end == spec || *end != ':')
+        errx(1, "%s: Malformed stripe specification, expected UNIT:PATH,...",
+             spec);
+    if (unit < 512 || unit > SSIZE_MAX || (unit & (unit - 1)) != 0)
+        errx(1, "%s: Stripe unit must be a power of two greater than or "
+                "equal 512",
+             spec);
+
+    char *paths = strdup(end + 1);
+    if (paths == NULL)
+        err(1, "strdup");
+
+    off_t member_capacity = -1;
+    unsigned nmembers = 0;
+    char *saveptr;
+    for (char *path = strtok_r(paths, ",", &saveptr); path != NULL;
+         path = strtok_r(NULL, ",", &saveptr)) {
+        if (nmembers == BLOCK_STRIPE_MAX)
+            errx(1, "%s: Too many stripe members (maximum %d)", spec,
+                 BLOCK_STRIPE_MAX);
+        off_t capacity;
+        stripe->fds[nmembers] = block_attach(path, &capacity);
+        /*
+         * Only whole stripe units are usable on each member; the device is as
+         * large as its smallest member allows.
+         */
+        capacity &= ~((off_t)unit - 1);
+        if (capacity == 0)
+            errx(1, "%s: Backing storage must be at least 1 stripe unit "
+                    "(%llu bytes) in size",
+                 path, unit);
+        if (member_capacity == -1 || capacity < member_capacity)
+            member_capacity = capacity;
+        nmembers++;
+    }
+    free(paths);
+    if (nmembers == 0)
+        errx(1, "%s: No stripe members specified", spec);
+
+    stripe->unit = unit;
+    stripe->nmembers = nmembers;
+    *capacity_ = member_capacity * nmembers;
+}
+
+unsigned block_stripe_member(const struct block_stripe *stripe, off_t pos,
+                             size_t len, bool *span)
+{
+    uint64_t chunk = (uint64_t)pos / stripe->unit;
+
+    if (span != NULL)
+        *span = (((uint64_t)pos % stripe->unit) + len) > stripe->unit &&
+                stripe->nmembers > 1;
+    return chunk % stripe->nmembers;
+}
+
+int block_stripe_io(const struct block_stripe *stripe, int member, bool write,
+                    void *buf, size_t len, off_t pos)
+{
+    uint8_t *p = buf;
+
+    while (len > 0) {
+        uint64_t chunk = (uint64_t)pos / stripe->unit;
+        size_t chunk_off = (uint64_t)pos % stripe->unit;
+        size_t n = stripe->unit - chunk_off;
+        if (n > len)
+            n = len;
+
+        unsigned m = chunk % stripe->nmembers;
+        if (member == -1 || (unsigned)member == m) {
+            off_t m_pos =
+                (off_t)((chunk / stripe->nmembers) * stripe->unit + chunk_off);
+            ssize_t ret;
+
+            if (write)
+                ret = pwrite(stripe->fds[m], p, n, m_pos);
+            else
+                ret = pread(stripe->fds[m], p, n, m_pos);
+            if (ret == -1)
+                return -1;
+            if ((size_t)ret != n) {
+                errno = EIO;
+                return -1;
+            }
+        }
+        p += n;
+        pos += n;
+        len -= n;
+    }
+    return 0;
+}
@@ -28,6 +28,8 @@
 #define _GNU_SOURCE
 #define _FILE_OFFSET_BITS 64
 #include <sys/types.h>
+#include <stdbool.h>
+#include <stddef.h>
 #include <stdint.h>
 
 /*
@@ -36,4 +38,54 @@
  */
 int block_attach(const char *path, off_t *capacity_);
 
+/*
+ * Prefix of a --block PATH which describes a striped block device, rather
+ * than a single backing file.
+ */
+#define BLOCK_STRIPE_PREFIX "stripe:"
+
+/*
+ * Maximum number of backing files ("members") in a striped block device.
+ */
+#define BLOCK_STRIPE_MAX 16
+
+/*
+ * A striped block device. Consecutive chunks of (unit) bytes of the device
+ * are stored on each of the (nmembers) backing files in turn.
+ */
+struct block_stripe {
+    size_t unit;
+    unsigned nmembers;
+    int fds[BLOCK_STRIPE_MAX];
+};
+
+/*
+ * Attach to the striped block device described by (spec), which is of the
+ * form "UNIT:PATH,PATH[,...]" with UNIT being the stripe unit in bytes, with
+ * an optional "k" or "m" suffix. UNIT must be a power of two of at least 512
+ * bytes. The device capacity in bytes is returned in (*capacity), and is
+ * that of the smallest member (rounded down to UNIT) times the number of
+ * members. Aborts the tender on failure.
+ */
+void block_attach_stripe(const char *spec, struct block_stripe *stripe,
+                         off_t *capacity_);
+
+/*
+ * Perform a pread() (write == false) or pwrite() (write == true) of (len)
+ * bytes at device offset (pos) of the striped block device (stripe). If
+ * (member) is not -1, only the parts of the request which are stored on that
+ * member are transferred. Returns 0 on success, or -1 on error with errno
+ * set. A short transfer is reported as EIO.
+ */
+int block_stripe_io(const struct block_stripe *stripe, int member, bool write,
+                    void *buf, size_t len, off_t pos);
+
+/*
+ * Returns the index of the member of (stripe) holding device offset (pos).
+ * If (span) is not NULL, it will be set to true if a request of (len) bytes
+ * at (pos) spans more than one member.
+ */
+unsigned block_stripe_member(const struct block_stripe *stripe, off_t pos,
+                             size_t len, bool *span);
+
 #endif /* COMMON_BLOCK_ATTACH_H */
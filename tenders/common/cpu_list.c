@@ -0,0 +1,74 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * cpu_list.c: Parsing lists of host CPUs.
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "cpu_list.h"
+
+#if defined(__linux__)
+int cpu_list_parse(const char *list, cpu_set_t *set)
+{
+    const char *p = list;
+
+    CPU_ZERO(set);
+    do {
+        char *end;
+        unsigned long lo = strtoul(p, &end, 10), hi = lo;
+        if (end == p)
+            return -1;
+        if (*end == '-') {
+            p = end + 1;
+            hi = strtoul(p, &end, 10);
+            if (end == p || hi < lo)
+                return -1;
+        }
+        if (hi >= CPU_SETSIZE)
+            return -1;
+        for (unsigned long cpu = lo; cpu <= hi; cpu++)
+            CPU_SET(cpu, set);
+        p = end;
+    } while (*p++ == ',');
+
+    return (p[-1] == '\0') ? 0 : -1;
+}
+
+void cpu_list_read(const char *what, const char *path, cpu_set_t *set)
+{
+    char list[1024];
+
+    FILE *f = fopen(path, "r");
+    if (f == NULL)
+        err(1, "%s: Could not open %s", what, path);
+    if (fgets(list, sizeof list, f) == NULL)
+        errx(1, "%s: Could not read %s", what, path);
+    fclose(f);
+    list[strcspn(list, "\n")] = '\0';
+    if (cpu_list_parse(list, set) == -1)
+        errx(1, "%s: %s: Malformed CPU list: %s", what, path, list);
+}
+#endif
@@ -0,0 +1,47 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * cpu_list.h: Parsing lists of host CPUs.
+ */
+
+#ifndef COMMON_CPU_LIST_H
+#define COMMON_CPU_LIST_H
+
+#if defined(__linux__)
+#ifndef _GNU_SOURCE
+#define _GNU_SOURCE
+#endif
+#include <sched.h>
+
+/*
+ * Parse a list of CPUs in the format used by the kernel, e.g. "0-3,8", into
+ * (*set). Returns 0 on success, -1 if (list) is malformed.
+ */
+int cpu_list_parse(const char *list, cpu_set_t *set);
+
+/*
+ * Read a list of CPUs from the first line of the file at (path), usually in
+ * sysfs. Exits on failure, with (what) as the prefix of the error message.
+ */
+void cpu_list_read(const char *what, const char *path, cpu_set_t *set);
+#endif
+
+#endif /* COMMON_CPU_LIST_H */
@@ -39,6 +39,7 @@
 #include <string.h>
 #include <sys/mman.h>
 #include <sys/param.h>
+#include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
@@ -194,9 +195,35 @@ static int align_up(Elf64_Addr addr, Elf64_Xword align, Elf64_Addr *out_result)
 
 #define INV_EXE "invalid executable"
 
+/*
+ * Returns true if any PT_LOAD segment other than phdr[skip] touches a page in
+ * the range (start .. end). Segments whose extent cannot be computed are
+ * assumed to overlap.
+ */
+static bool phdr_overlaps(const Elf64_Phdr *phdr, Elf64_Half phnum,
+                          Elf64_Half skip, Elf64_Addr start, Elf64_Addr end)
+{
+    for (Elf64_Half i = 0; i < phnum; i++) {
+        if (i == skip || phdr[i].p_type != PT_LOAD || phdr[i].p_memsz == 0)
+            continue;
+
+        Elf64_Addr o_start, o_end;
+        if (align_down(phdr[i].p_vaddr, EM_PAGE_SIZE, &o_start))
+            return true;
+        if (add_overflow(phdr[i].p_vaddr, phdr[i].p_memsz, o_end))
+            return true;
+        if (align_up(o_end, EM_PAGE_SIZE, &o_end))
+            return true;
+        if (o_start < end && o_end > start)
+            return true;
+    }
+    return false;
+}
+
 void elf_load(int bin_fd, const char *bin_name, uint8_t *mem, size_t mem_size,
-              uint64_t p_min_loadaddr, guest_mprotect_fn_t t_guest_mprotect,
-              void *t_guest_mprotect_arg, uint64_t *p_entry, uint64_t *p_end)
+              uint64_t p_min_loadaddr, bool map_ro,
+              guest_mprotect_fn_t t_guest_mprotect, void *t_guest_mprotect_arg,
+              uint64_t *p_entry, uint64_t *p_end)
 {
     ssize_t nbytes;
     Elf64_Phdr *phdr = NULL;
@@ -229,6 +256,18 @@ void elf_load(int bin_fd, const char *bin_name, uint8_t *mem, size_t mem_size,
               bin_name);
         goto mem_cleanup;
     }
+    /*
+     * Read-only segments mapped from the binary are not copied, so only do
+     * so if the binary is a regular file that others cannot modify while
+     * the unikernel is running.
+     */
+    if (map_ro) {
+        struct stat st;
+
+        if (fstat(bin_fd, &st) == -1 || !S_ISREG(st.st_mode) ||
+            (st.st_mode & (S_IWGRP | S_IWOTH)) != 0)
+            map_ro = false;
+    }
     /*
      * e_entry must be non-zero and within range of our memory allocation.
      */
@@ -416,20 +455,58 @@ void elf_load(int bin_fd, const char *bin_name, uint8_t *mem, size_t mem_size,
                   bin_name, INV_EXE, ph_i);
             goto mem_cleanup;
         }
-        nbytes =
-            pread_in_full(bin_fd, host_vaddr, p_filesz, phdr[ph_i].p_offset);
-        if (nbytes < 0) {
-            warnx("%s: phdr[%u] pread_in_full returned %zu", bin_name, ph_i,
-                  nbytes);
-            goto mem_cleanup;
+        /*
+         * If allowed by the caller, read-only segments are mapped from the
+         * binary rather than copied, provided they start on a page boundary
+         * in both the file and memory and do not share pages with other
+         * segments. This saves copying them, and lets the host share their
+         * pages between all instances of the unikernel. The guest then sees
+         * any later changes to the binary, and truncating it raises SIGBUS
+         * in the tender, so nothing is mapped from a binary that anyone but
+         * its owner may write to (see above).
+         */
+        Elf64_Off p_offset = phdr[ph_i].p_offset;
+        Elf64_Addr map_start = p_vaddr;
+        Elf64_Addr map_end = 0;
+        bool map = map_ro && !(phdr[ph_i].p_flags & PF_W) && p_filesz > 0 &&
+            p_memsz == p_filesz && p_align >= EM_PAGE_SIZE &&
+            (p_vaddr & (EM_PAGE_SIZE - 1)) == 0 &&
+            (p_offset & (EM_PAGE_SIZE - 1)) == 0;
+        if (map) {
+            if (align_up(p_vaddr + p_filesz, EM_PAGE_SIZE, &map_end)) {
+                warnx("%s: %s: phdr[%u] program file segment falls outside"
+                      " of valid range", bin_name, INV_EXE, ph_i);
+                goto mem_cleanup;
+            }
+            /*
+             * A segment sharing any of these pages would either be clobbered
+             * by the mapping or fault writing into it; copy instead.
+             */
+            map = !phdr_overlaps(phdr, ehdr->e_phnum, ph_i, map_start,
+                                 map_end);
         }
-        if ((size_t)nbytes != p_filesz) {
-            warnx("%s: phdr[%u] host file segment mismatched (pread_in_full"
-                  " returned %zu != %llu (p_filesz))",
-                  bin_name, ph_i, nbytes, (unsigned long long)p_filesz);
-            goto mem_cleanup;
+        if (map) {
+            if (mmap(mem + map_start, map_end - map_start, PROT_READ,
+                     MAP_PRIVATE | MAP_FIXED, bin_fd, p_offset) == MAP_FAILED) {
+                warnx("%s: phdr[%u] mmap failed: %s", bin_name, ph_i,
+                      strerror(errno));
+                goto mem_cleanup;
+            }
+        } else {
+            nbytes = pread_in_full(bin_fd, host_vaddr, p_filesz, p_offset);
+            if (nbytes < 0) {
+                warnx("%s: phdr[%u] pread_in_full returned %zu", bin_name,
+                      ph_i, nbytes);
+                goto mem_cleanup;
+            }
+            if ((size_t)nbytes != p_filesz) {
+                warnx("%s: phdr[%u] host file segment mismatched"
+                      " (pread_in_full returned %zu != %llu (p_filesz))",
+                      bin_name, ph_i, nbytes, (unsigned long long)p_filesz);
+                goto mem_cleanup;
+            }
+            memset(host_vaddr + p_filesz, 0, p_memsz - p_filesz);
         }
-        memset(host_vaddr + p_filesz, 0, p_memsz - p_filesz);
 
         /*
          * Memory protection flags should be applied to the aligned address
@@ -670,3 +747,152 @@ mem_cleanup:
     free(note_data);
     exit(1);
 }
+
+/*
+ * Upper bound on the size of the symbol and string tables we are willing to
+ * load, as a sanity check.
+ */
+#define SYMTAB_MAX_SIZE (64UL << 20)
+
+static int elf_sym_cmp(const void *a, const void *b)
+{
+    const struct elf_sym *sa = a, *sb = b;
+
+    return (sa->addr > sb->addr) - (sa->addr < sb->addr);
+}
+
+int elf_load_symbols(int bin_fd, const char *bin_name, struct elf_sym **syms,
+                     size_t *nsyms)
+{
+    ssize_t nbytes;
+    Elf64_Ehdr ehdr;
+    Elf64_Shdr *shdr = NULL;
+    Elf64_Sym *symtab = NULL;
+    char *strtab = NULL;
+    struct elf_sym *out = NULL;
+
+    nbytes = pread_in_full(bin_fd, &ehdr, sizeof ehdr, 0);
+    if (nbytes != sizeof ehdr || !ehdr_is_valid(&ehdr)) {
+        warnx("%s: %s: invalid or unsupported executable (elf header invalid"
+              " while loading symbols)",
+              bin_name, INV_EXE);
+        goto mem_cleanup;
+    }
+    if (ehdr.e_shnum == 0)
+        return -1;
+    if (ehdr.e_shentsize != sizeof(Elf64_Shdr)) {
+        warnx("%s: %s: section header entry size mismatch (%u != %zu)",
+              bin_name, INV_EXE, ehdr.e_shentsize, sizeof(Elf64_Shdr));
+        goto mem_cleanup;
+    }
+
+    size_t sh_size = ehdr.e_shnum * sizeof(Elf64_Shdr);
+    shdr = malloc(sh_size);
+    if (shdr == NULL) {
+        warnx("%s: malloc(sh_size) returned NULL while loading symbols",
+              bin_name);
+        goto mem_cleanup;
+    }
+    nbytes = pread_in_full(bin_fd, shdr, sh_size, ehdr.e_shoff);
+    if (nbytes < 0 || (size_t)nbytes != sh_size) {
+        warnx("%s: %s: section header does not match the expected size"
+              " (%zd != %zu)",
+              bin_name, INV_EXE, nbytes, sh_size);
+        goto mem_cleanup;
+    }
+
+    Elf64_Half sh_i;
+    for (sh_i = 0; sh_i < ehdr.e_shnum; sh_i++) {
+        if (shdr[sh_i].sh_type == SHT_SYMTAB)
+            break;
+    }
+    if (sh_i == ehdr.e_shnum) {
+        free(shdr);
+        return -1;
+    }
+    const Elf64_Shdr *sym_sh = &shdr[sh_i];
+    if (sym_sh->sh_link >= ehdr.e_shnum ||
+        shdr[sym_sh->sh_link].sh_type != SHT_STRTAB ||
+        sym_sh->sh_entsize != sizeof(Elf64_Sym) ||
+        sym_sh->sh_size > SYMTAB_MAX_SIZE ||
+        shdr[sym_sh->sh_link].sh_size == 0 ||
+        shdr[sym_sh->sh_link].sh_size > SYMTAB_MAX_SIZE) {
+        warnx("%s: %s: shdr[%u] symbol table is invalid", bin_name, INV_EXE,
+              sh_i);
+        goto mem_cleanup;
+    }
+    const Elf64_Shdr *str_sh = &shdr[sym_sh->sh_link];
+
+    size_t nsymtab = sym_sh->sh_size / sizeof(Elf64_Sym);
+    symtab = malloc(sym_sh->sh_size);
+    strtab = malloc(str_sh->sh_size);
+    out = malloc((nsymtab ? nsymtab : 1) * sizeof(struct elf_sym));
+    if (symtab == NULL || strtab == NULL || out == NULL) {
+        warnx("%s: malloc() returned NULL while loading symbols", bin_name);
+        goto mem_cleanup;
+    }
+    nbytes = pread_in_full(bin_fd, symtab, sym_sh->sh_size, sym_sh->sh_offset);
+    if (nbytes < 0 || (size_t)nbytes != sym_sh->sh_size) {
+        warnx("%s: shdr[%u] pread_in_full for symbol table returned %zd",
+              bin_name, sh_i, nbytes);
+        goto mem_cleanup;
+    }
+    nbytes = pread_in_full(bin_fd, strtab, str_sh->sh_size, str_sh->sh_offset);
+    if (nbytes < 0 || (size_t)nbytes != str_sh->sh_size) {
+        warnx("%s: shdr[%u] pread_in_full for string table returned %zd",
+              bin_name, sym_sh->sh_link, nbytes);
+        goto mem_cleanup;
+    }
+    /*
+     * Guarantee that any name we hand out is terminated.
+     */
+    strtab[str_sh->sh_size - 1] = '\0';
+
+    size_t n = 0;
+    for (size_t i = 0; i < nsymtab; i++) {
+        if (ELF64_ST_TYPE(symtab[i].st_info) != STT_FUNC ||
+            symtab[i].st_value == 0 || symtab[i].st_name >= str_sh->sh_size)
+            continue;
+        out[n].addr = symtab[i].st_value;
+        out[n].size = symtab[i].st_size;
+        out[n].name = strtab + symtab[i].st_name;
+        n++;
+    }
+    qsort(out, n, sizeof(struct elf_sym), elf_sym_cmp);
+
+    free(shdr);
+    free(symtab);
+    *syms = out;
+    *nsyms = n;
+    return 0;
+
+mem_cleanup:
+    free(shdr);
+    free(symtab);
+    free(strtab);
+    free(out);
+    exit(1);
+}
+
+const struct elf_sym *elf_sym_lookup(const struct elf_sym *syms, size_t nsyms,
+                                     uint64_t addr)
+{
+    size_t lo = 0, hi = nsyms;
+
+    /*
+     * Find the last symbol starting at or below (addr).
+     */
+    while (lo < hi) {
+        size_t mid = lo + (hi - lo) / 2;
+        if (syms[mid].addr <= addr)
+            lo = mid + 1;
+        else
+            hi = mid;
+    }
+    if (lo == 0)
+        return NULL;
+    const struct elf_sym *s = &syms[lo - 1];
+    if (s->size != 0 && addr - s->addr >= s->size)
+        return NULL;
+    return s;
+}
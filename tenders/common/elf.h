@@ -25,6 +25,9 @@
 #ifndef COMMON_ELF_H
 #define COMMON_ELF_H
 
+#include <stdbool.h>
+#include <stdint.h>
+
 /*
  * guest_mprotect_fn() is called by the ELF loader to request that the page
  * protection flags (prot) as used by the system mprotect(), i.e. PROT_X from
@@ -40,6 +43,11 @@ typedef int (*guest_mprotect_fn_t)(void *t_arg, uint64_t addr_start,
  * Load an ELF binary from (bin_fd) into (mem_size) bytes of memory at (*mem).
  * (p_min_loadaddr) is the lowest allowed load address within (*mem). (bin_name)
  * is the file name of the binary and is used to report errors.
+ * If (map_ro) is true, read-only segments may be mapped MAP_PRIVATE from
+ * (bin_fd) over (*mem) instead of being copied; the caller must then not
+ * depend on (*mem) being a single mapping, and the binary must not be
+ * modified while it is in use. Nothing is mapped if (bin_fd) is not a regular
+ * file, or is writable by its group or others.
  * (t_guest_mprotect) is a pointer to the function described above.
  * (t_guest_mprotect_arg) is passed through to t_guest_mprotect().
  *
@@ -50,8 +58,9 @@ typedef int (*guest_mprotect_fn_t)(void *t_arg, uint64_t addr_start,
  * terminates the program.
  */
 void elf_load(int bin_fd, const char *bin_name, uint8_t *mem, size_t mem_size,
-              uint64_t p_min_loadaddr, guest_mprotect_fn_t t_guest_mprotect,
-              void *t_guest_mprotect_arg, uint64_t *p_entry, uint64_t *p_end);
+              uint64_t p_min_loadaddr, bool map_ro,
+              guest_mprotect_fn_t t_guest_mprotect, void *t_guest_mprotect_arg,
+              uint64_t *p_entry, uint64_t *p_end);
 
 /*
  * Load the Solo5-owned NOTE of (note_type) from the ELF binary (file).
@@ -80,4 +89,39 @@ int elf_load_note(int bin_fd, const char *bin_name, uint32_t note_type,
                   size_t note_align, size_t max_note_size, void **note_data,
                   size_t *note_size);
 
+/*
+ * A function symbol loaded by elf_load_symbols().
+ */
+struct elf_sym {
+    uint64_t addr;
+    uint64_t size;
+    const char *name;
+};
+
+/*
+ * Load the function symbols from the symbol table of the ELF binary
+ * (bin_fd). (bin_name) is the file name of the binary and is used to report
+ * errors.
+ *
+ * Returns / error handling:
+ *
+ * On success: Returns 0 and an array of (*nsyms) symbols sorted by address is
+ * allocated with malloc(), returned in (*syms). Symbol names point into a
+ * single string table allocation, which lives as long as the process.
+ *
+ * If the executable has no symbol table (i.e. has been stripped), but is
+ * otherwise valid: Returns -1.
+ *
+ * In all other cases, reports any errors to stderr and terminates the program.
+ */
+int elf_load_symbols(int bin_fd, const char *bin_name, struct elf_sym **syms,
+                     size_t *nsyms);
+
+/*
+ * Look up the symbol containing (addr) in (syms), as returned by
+ * elf_load_symbols(). Returns NULL if no symbol contains (addr).
+ */
+const struct elf_sym *elf_sym_lookup(const struct elf_sym *syms, size_t nsyms,
+                                     uint64_t addr);
+
 #endif /* COMMON_ELF_H */
@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * hugepages.c: Backing guest memory with host huge pages.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <err.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#include "hugepages.h"
+
+#if defined(__linux__)
+#ifndef MAP_HUGE_SHIFT
+#define MAP_HUGE_SHIFT 26
+#endif
+#ifndef MAP_HUGE_2MB
+#define MAP_HUGE_2MB (21 << MAP_HUGE_SHIFT)
+#endif
+#ifndef MAP_HUGE_1GB
+#define MAP_HUGE_1GB (30 << MAP_HUGE_SHIFT)
+#endif
+#endif
+
+static const char *hugepages_name[] = {
+    [HUGEPAGES_NONE] = "none",
+    [HUGEPAGES_THP] = "thp",
+    [HUGEPAGES_2M] = "2M",
+    [HUGEPAGES_1G] = "1G",
+};
+
+int hugepages_parse(const char *str, enum hugepages *hp)
+{
+    if (strcmp(str, "2M") == 0)
+        *hp = HUGEPAGES_2M;
+    else if (strcmp(str, "1G") == 0)
+        *hp = HUGEPAGES_1G;
+    else if (strcmp(str, "thp") == 0)
+        *hp = HUGEPAGES_THP;
+    else
+        return -1;
+    return 0;
+}
+
+uint64_t hugepages_align(enum hugepages hp)
+{
+    switch (hp) {
+    case HUGEPAGES_THP:
+    case HUGEPAGES_2M:
+        return 1ULL << 21;
+    case HUGEPAGES_1G:
+        return 1ULL << 30;
+    default:
+        return 0;
+    }
+}
+
+#if defined(__linux__)
+void hugepages_back(uint8_t *mem, uint64_t start, uint64_t end, int prot,
+                    enum hugepages hp)
+{
+    uint64_t align = hugepages_align(hp);
+    assert(align != 0);
+    assert(((uintptr_t)mem & (align - 1)) == 0);
+
+    start = (start + align - 1) & ~(align - 1);
+    end &= ~(align - 1);
+    if (start >= end) {
+        warnx("--mem-hugepages=%s: Guest memory too small, not using huge "
+              "pages", hugepages_name[hp]);
+        return;
+    }
+    size_t len = end - start;
+    uint8_t *addr = mem + start;
+
+    if (hp == HUGEPAGES_2M || hp == HUGEPAGES_1G) {
+        int flags = MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED | MAP_HUGETLB |
+                    (hp == HUGEPAGES_1G ? MAP_HUGE_1GB : MAP_HUGE_2MB);
+        if (mmap(addr, len, prot, flags, -1, 0) != MAP_FAILED)
+            return;
+        warn("--mem-hugepages=%s: Could not allocate %zu MB of huge pages, "
+             "falling back to transparent huge pages", hugepages_name[hp],
+             len >> 20);
+    }
+
+    /*
+     * Re-map the range as private anonymous memory, both because a failed
+     * MAP_FIXED mmap() above may have left it unmapped, and because shared
+     * memory is subject to a different (usually disabled) transparent huge
+     * page policy.
+     */
+    if (mmap(addr, len, prot, MAP_PRIVATE | MAP_ANONYMOUS | MAP_FIXED, -1,
+             0) == MAP_FAILED)
+        err(1, "Error allocating guest memory");
+    if (madvise(addr, len, MADV_HUGEPAGE) == -1)
+        warn("--mem-hugepages=%s: madvise(MADV_HUGEPAGE) failed, using "
+             "regular pages", hugepages_name[hp]);
+}
+#else /* !__linux__ */
+void hugepages_back(uint8_t *mem, uint64_t start, uint64_t end, int prot,
+                    enum hugepages hp)
+{
+    (void)mem;
+    (void)start;
+    (void)end;
+    (void)prot;
+
+    warnx("--mem-hugepages=%s: Not supported on this host, not using huge "
+          "pages", hugepages_name[hp]);
+}
+#endif
@@ -0,0 +1,63 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * hugepages.h: Backing guest memory with host huge pages.
+ */
+
+#ifndef COMMON_HUGEPAGES_H
+#define COMMON_HUGEPAGES_H
+
+#include <stdint.h>
+
+enum hugepages {
+    HUGEPAGES_NONE = 0,
+    HUGEPAGES_THP, /* transparent huge pages, via madvise() */
+    HUGEPAGES_2M, /* 2MB pages from the hugetlbfs pool */
+    HUGEPAGES_1G /* 1GB pages from the hugetlbfs pool */
+};
+
+/*
+ * Parse a --mem-hugepages= specification in (str): one of "2M", "1G" or
+ * "thp". Returns 0 and the page type in (*hp) on success, -1 on error.
+ */
+int hugepages_parse(const char *str, enum hugepages *hp);
+
+/*
+ * Returns the alignment required for huge pages of type (hp).
+ */
+uint64_t hugepages_align(enum hugepages hp);
+
+/*
+ * Back the guest memory range [start, end) of (mem) with huge pages of type
+ * (hp), mapped with (prot). Only the part of the range aligned to
+ * hugepages_align(hp) is affected, and its previous contents are discarded,
+ * so this must be called before the range is used. (mem) must itself be
+ * aligned to hugepages_align(hp), so that host and guest large pages line
+ * up.
+ *
+ * If the hugetlbfs pool cannot satisfy the request, warns and falls back to
+ * transparent huge pages. Failure to enable transparent huge pages is not
+ * fatal either; the range is then backed by regular pages.
+ */
+void hugepages_back(uint8_t *mem, uint64_t start, uint64_t end, int prot,
+                    enum hugepages hp);
+
+#endif /* COMMON_HUGEPAGES_H */
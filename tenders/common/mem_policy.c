@@ -0,0 +1,143 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * mem_policy.c: NUMA placement, prefaulting and locking of guest memory.
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <unistd.h>
+
+#include "mem_policy.h"
+
+#if defined(__linux__)
+#include <sched.h>
+#include <sys/syscall.h>
+#include <linux/mempolicy.h>
+
+#include "cpu_list.h"
+
+#ifndef MADV_POPULATE_WRITE
+#define MADV_POPULATE_WRITE 23
+#endif
+#endif
+
+int mem_policy_parse(const char *arg, struct mem_policy *mp)
+{
+    if (strncmp("--numa-node=", arg, 12) == 0) {
+        char *end;
+        unsigned long node = strtoul(arg + 12, &end, 10);
+        if (end == arg + 12 || *end != '\0' || node > 1023)
+            errx(1, "Malformed argument to --numa-node");
+        mp->numa_node = node;
+    } else if (strcmp("--mem-prefault", arg) == 0) {
+        mp->prefault = true;
+    } else if (strcmp("--mem-lock", arg) == 0) {
+        mp->lock = true;
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+#if defined(__linux__)
+static void bind_node(int node, uint8_t *addr, size_t len)
+{
+    char path[64];
+    cpu_set_t cpus;
+
+    snprintf(path, sizeof path, "/sys/devices/system/node/node%d/cpulist",
+             node);
+    if (access(path, R_OK) == -1)
+        errx(1, "--numa-node=%d: No such NUMA node", node);
+    cpu_list_read("--numa-node", path, &cpus);
+
+    /*
+     * glibc does not provide mbind(), and we do not want to depend on
+     * libnuma for this alone.
+     */
+    unsigned long nodemask[1024 / (8 * sizeof(unsigned long))] = {0};
+    nodemask[node / (8 * sizeof(unsigned long))] |=
+        1UL << (node % (8 * sizeof(unsigned long)));
+    if (syscall(SYS_mbind, addr, len, MPOL_BIND, nodemask,
+                8 * sizeof nodemask, MPOL_MF_MOVE) == -1)
+        err(1, "--numa-node=%d: mbind() failed", node);
+
+    /*
+     * Memory-less nodes have no CPUs; the memory is still bound.
+     */
+    if (CPU_COUNT(&cpus) > 0 && sched_setaffinity(0, sizeof cpus, &cpus) == -1)
+        err(1, "--numa-node=%d: sched_setaffinity() failed", node);
+}
+#endif
+
+/*
+ * Fault in every page of [addr, addr + len) for writing.
+ */
+static void populate(uint8_t *addr, size_t len)
+{
+#if defined(__linux__)
+    /*
+     * Linux 5.14 and later can do this in one system call. Unlike
+     * MAP_POPULATE, this also works on memory which is already mapped.
+     */
+    if (madvise(addr, len, MADV_POPULATE_WRITE) == 0)
+        return;
+    if (errno != EINVAL)
+        err(1, "--mem-prefault: madvise(MADV_POPULATE_WRITE) failed");
+#endif
+    long pagesize = sysconf(_SC_PAGESIZE);
+    for (size_t off = 0; off < len; off += pagesize) {
+        volatile uint8_t *p = addr + off;
+        *p = *p;
+    }
+}
+
+void mem_policy_apply(const struct mem_policy *mp, uint8_t *mem,
+                      uint64_t start, uint64_t end, uint64_t populate_start)
+{
+    uint8_t *addr = mem + start;
+    size_t len = end - start;
+
+    if (populate_start < start)
+        populate_start = start;
+
+    if (mp->numa_node != -1) {
+#if defined(__linux__)
+        bind_node(mp->numa_node, addr, len);
+#else
+        errx(1, "--numa-node: Not supported on this host");
+#endif
+    }
+
+    if (mp->lock) {
+        if (mlock(addr, len) == -1)
+            err(1, "--mem-lock: Could not lock %zu MB of guest memory (check "
+                   "RLIMIT_MEMLOCK)", len >> 20);
+    } else if (mp->prefault && populate_start < end) {
+        populate(mem + populate_start, end - populate_start);
+    }
+}
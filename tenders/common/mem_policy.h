@@ -0,0 +1,58 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * mem_policy.h: NUMA placement, prefaulting and locking of guest memory.
+ */
+
+#ifndef COMMON_MEM_POLICY_H
+#define COMMON_MEM_POLICY_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+struct mem_policy {
+    int numa_node; /* -1 if not set */
+    bool prefault;
+    bool lock;
+};
+
+#define MEM_POLICY_INIT { .numa_node = -1, .prefault = false, .lock = false }
+
+/*
+ * Parse the core options --numa-node=N, --mem-prefault and --mem-lock in
+ * (arg) into (*mp). Returns 0 if (arg) is one of these, -1 if not. Exits on a
+ * malformed argument.
+ */
+int mem_policy_parse(const char *arg, struct mem_policy *mp);
+
+/*
+ * Apply (*mp) to the guest memory range [start, end) of (mem): bind it to the
+ * NUMA node, moving any pages already present, and then lock it, or populate
+ * the writable part of it, [populate_start, end). Also restricts the calling
+ * thread, and any threads it starts afterwards, to the CPUs of the NUMA node.
+ *
+ * Must be called after guest memory is mapped and the unikernel loaded, and
+ * before module setup starts any I/O threads.
+ */
+void mem_policy_apply(const struct mem_policy *mp, uint8_t *mem,
+                      uint64_t start, uint64_t end, uint64_t populate_start);
+
+#endif /* COMMON_MEM_POLICY_H */
@@ -0,0 +1,127 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * rate_limit.c: Token bucket rate limiting for tender I/O paths.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <errno.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "rate_limit.h"
+
+#define NSEC_PER_SEC 1000000000ULL
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    int rc = clock_gettime(CLOCK_MONOTONIC, &ts);
+    assert(rc == 0);
+    return ((uint64_t)ts.tv_sec * NSEC_PER_SEC) + (uint64_t)ts.tv_nsec;
+}
+
+void rate_limit_init(struct rate_limit *rl, uint64_t rate)
+{
+    rl->rate = rate;
+    /*
+     * Allow bursts of up to 100ms worth of tokens. Anything larger than that
+     * is smoothed out by the debt mechanism in rate_limit_take().
+     */
+    rl->burst = rate / 10;
+    if (rl->burst == 0)
+        rl->burst = 1;
+    rl->tokens = (double)rl->burst;
+    rl->last_ns = now_ns();
+    rl->nthrottled = 0;
+    rl->throttled_ns = 0;
+}
+
+uint64_t rate_limit_take(struct rate_limit *rl, uint64_t n)
+{
+    if (rl->rate == 0)
+        return 0;
+
+    uint64_t now = now_ns();
+    uint64_t elapsed = now - rl->last_ns;
+    rl->last_ns = now;
+    rl->tokens += (double)elapsed * (double)rl->rate / (double)NSEC_PER_SEC;
+    if (rl->tokens > (double)rl->burst)
+        rl->tokens = (double)rl->burst;
+
+    rl->tokens -= (double)n;
+    if (rl->tokens >= 0)
+        return 0;
+
+    uint64_t delay =
+        (uint64_t)(-rl->tokens * (double)NSEC_PER_SEC / (double)rl->rate);
+    rl->nthrottled++;
+    rl->throttled_ns += delay;
+    return delay;
+}
+
+void rate_limit_sleep(uint64_t ns)
+{
+    struct timespec ts = {.tv_sec = ns / NSEC_PER_SEC,
+                          .tv_nsec = ns % NSEC_PER_SEC};
+
+    while (nanosleep(&ts, &ts) == -1 && errno == EINTR)
+        ;
+}
+
+int rate_limit_parse(const char *str, uint64_t *rate)
+{
+    char *end;
+
+    errno = 0;
+    unsigned long long v = strtoull(str, &end, 10);
+    if (errno != 0 || end == str || str[0] == '-')
+        return -1;
+
+    unsigned shift = 0;
+    switch (*end) {
+    case '\0':
+        break;
+    case 'k':
+    case 'K':
+        shift = 10;
+        end++;
+        break;
+    case 'm':
+    case 'M':
+        shift = 20;
+        end++;
+        break;
+    case 'g':
+    case 'G':
+        shift = 30;
+        end++;
+        break;
+    default:
+        return -1;
+    }
+    if (*end != '\0' || v == 0 || v > (UINT64_MAX >> shift))
+        return -1;
+
+    *rate = (uint64_t)v << shift;
+    return 0;
+}
@@ -0,0 +1,76 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * rate_limit.h: Token bucket rate limiting for tender I/O paths.
+ */
+
+#ifndef COMMON_RATE_LIMIT_H
+#define COMMON_RATE_LIMIT_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*
+ * A token bucket refilled at (rate) tokens per second, holding at most
+ * (burst) tokens. Requests larger than the remaining tokens are never
+ * refused: the bucket goes into debt and the caller is told how long to
+ * delay completion by, so a throttled guest sees added latency rather than
+ * lost I/O.
+ */
+struct rate_limit {
+    uint64_t rate; /* tokens per second, 0 if unlimited */
+    uint64_t burst;
+    double tokens; /* may be negative (debt) */
+    uint64_t last_ns;
+    /* Statistics */
+    uint64_t nthrottled; /* requests which were delayed */
+    uint64_t throttled_ns; /* total delay imposed */
+};
+
+/*
+ * Initialise (rl) to (rate) tokens per second, starting with a full bucket.
+ */
+void rate_limit_init(struct rate_limit *rl, uint64_t rate);
+
+static inline bool rate_limit_enabled(const struct rate_limit *rl)
+{
+    return rl->rate != 0;
+}
+
+/*
+ * Consume (n) tokens from (rl). Returns the number of nanoseconds the caller
+ * must wait before completing the request, 0 if none.
+ */
+uint64_t rate_limit_take(struct rate_limit *rl, uint64_t n);
+
+/*
+ * Sleep for (ns) nanoseconds, restarting on EINTR.
+ */
+void rate_limit_sleep(uint64_t ns);
+
+/*
+ * Parse a rate specification in (str): a decimal number optionally followed
+ * by a K, M or G suffix (multiples of 1024). Returns 0 and the rate in
+ * (*rate) on success, -1 on error.
+ */
+int rate_limit_parse(const char *str, uint64_t *rate);
+
+#endif /* COMMON_RATE_LIMIT_H */
@@ -30,6 +30,7 @@
 
 #include <inttypes.h>
 #include <err.h>
+#include <stdbool.h>
 
 #include "../common/cc.h"
 #include "../common/elf.h"
@@ -58,6 +59,9 @@ struct hvt {
     size_t mem_alloc_size;
     uint64_t cpu_cycle_freq;
     hvt_gpa_t cpu_boot_info_base;
+    int elf_fd; /* Unikernel binary, open during module setup only */
+    bool mem_mappable; /* Guest sees file mappings placed over (mem) */
+    hvt_gpa_t boot_trace; /* Guest boot trace area, 0 if none */
     struct hvt_b *b;
 };
 
@@ -96,6 +100,14 @@ struct hvt *hvt_init(size_t mem_size);
  */
 void hvt_net_reserve_ring(struct hvt *hvt, struct mft *mft);
 
+/*
+ * Discard any network I/O left in the ring by a guest being resumed from a
+ * snapshot: queued transmits are dropped, queued receives complete with
+ * SOLO5_R_AGAIN. Must be called after replacing guest memory and before
+ * module setup starts the network I/O thread.
+ */
+void hvt_net_reset_ring(struct hvt *hvt);
+
 /*
  * Rounds up (mem_size) to the next architecture page boundary.
  * Unlike hvt_mem_size() which rounds down, this is used when adding overhead
@@ -107,7 +119,8 @@ void hvt_mem_size_roundup(size_t *mem_size);
  * Returns the extra guest memory needed for the network ring buffer, rounded
  * up to the architecture page boundary, or 0 if no NET_BASIC device is
  * attached in the manifest. The return value is roundup on the system page.
- * Must be called after command-line parsing has set the attached flags.
+ * Must be called after command-line parsing has set the attached flags. If
+ * (mft) is NULL, returns the amount needed if a NET_BASIC device is attached.
  */
 size_t hvt_net_mem_overhead(struct mft *mft);
 
@@ -154,6 +167,56 @@ void hvt_drop_privileges();
  * is in hvt_seccomp_linux.c.
  */
 void hvt_seccomp_apply(void);
+
+/*
+ * True if the POLL hypercall waits using epoll_pwait2(), in which case it
+ * does not need to arm a timerfd.
+ */
+extern bool hvt_core_epoll_pwait2;
+
+/*
+ * Instructions which should no longer cause a VM exit, as the vCPU has a host
+ * CPU to itself. Set by a module while handling its command line options and
+ * applied by hvt_init(), on x86_64 only. See hvt_module_cpu.c.
+ */
+#define HVT_DISABLE_EXITS_PAUSE 0x1
+#define HVT_DISABLE_EXITS_HLT   0x2
+extern unsigned hvt_core_disable_exits;
+
+/*
+ * Syscalls which only some modules use once the guest is running. Set by a
+ * module during setup, and allowed by hvt_seccomp_apply() only if set.
+ */
+#define HVT_SECCOMP_ALLOW_SLEEP    0x01 /* nanosleep(), clock_nanosleep() */
+#define HVT_SECCOMP_ALLOW_SIGNAL   0x02 /* pthread_kill(), sigtimedwait() */
+#define HVT_SECCOMP_ALLOW_ACCEPT   0x04 /* accept(), accept4() */
+#define HVT_SECCOMP_ALLOW_SNAPSHOT 0x08 /* mincore(), fcntl() */
+#define HVT_SECCOMP_ALLOW_SENDMSG  0x10 /* sendmsg() */
+#define HVT_SECCOMP_ALLOW_RUSAGE   0x20 /* getrusage() */
+extern unsigned hvt_core_seccomp_allow;
+
+/*
+ * Reduce the guest memory of (hvt), as created by hvt_init(), to (mem_size)
+ * bytes. Used to fit a VM created in advance to the unikernel it is given.
+ */
+void hvt_mem_shrink(struct hvt *hvt, size_t mem_size);
+
+/*
+ * Pool of tenders started in advance (hvt_pool.c), see --pool-serve.
+ *
+ * hvt_pool_serve() runs the daemon serving (spec). It only returns in a
+ * tender process which has been handed a unikernel to run, with (*argc,
+ * *argv) replaced by the client's command line, and the VM created for it
+ * in advance, if any. hvt_pool_take() returns that VM if it fits (mem_size)
+ * and the options given, or a new one otherwise.
+ *
+ * hvt_pool_client() runs the command line (argc, argv) in the daemon serving
+ * (path), and exits with its exit status.
+ */
+struct hvt *hvt_pool_serve(const char *spec, int *argc, char ***argv);
+struct hvt *hvt_pool_take(struct hvt *warm, size_t mem_size);
+void hvt_pool_client(const char *path, int argc, char **argv)
+    __attribute__((noreturn));
 #endif
 
 /*
@@ -186,6 +249,49 @@ int hvt_core_register_halt_hook(hvt_halt_fn_t fn);
 extern hvt_hypercall_fn_t hvt_core_hypercalls[];
 int hvt_core_hypercall_halt(struct hvt *hvt, hvt_gpa_t gpa);
 
+/*
+ * Names of hypercalls, indexed by number, for reporting.
+ */
+extern const char *const hvt_core_hypercall_names[];
+
+/*
+ * If set by a module while handling its command line options, the guest is
+ * resumed from a snapshot rather than booted: the unikernel is not loaded
+ * into guest memory, no boot information is written, and (fn) is called
+ * after hvt_vcpu_init() and before module setup to replace guest memory and
+ * vCPU state. See hvt_module_snapshot.c.
+ */
+typedef void (*hvt_restore_fn_t)(struct hvt *hvt);
+extern hvt_restore_fn_t hvt_core_restore;
+
+/*
+ * If set by a module during setup, returns the number of guest requests in
+ * flight whose state is held by the tender, and would be lost by a snapshot
+ * taken now. See hvt_module_blk.c.
+ */
+typedef unsigned (*hvt_inflight_fn_t)(void);
+extern hvt_inflight_fn_t hvt_core_inflight;
+
+/*
+ * Threads started by the tender. If set by a module while handling its
+ * command line options, (hvt_core_thread_hook) is called on each of these,
+ * from that thread, before it does any work: by main() for the thread which
+ * runs the vCPU, just before privileges are dropped, and by modules for the
+ * I/O threads they start during setup. See hvt_module_cpu.c.
+ */
+enum hvt_thread_kind {
+    HVT_THREAD_VCPU,
+    HVT_THREAD_IO,
+};
+typedef void (*hvt_thread_fn_t)(enum hvt_thread_kind kind);
+extern hvt_thread_fn_t hvt_core_thread_hook;
+
+static inline void hvt_core_thread_start(enum hvt_thread_kind kind)
+{
+    if (hvt_core_thread_hook != NULL)
+        hvt_core_thread_hook(kind);
+}
+
 /*
  * Register a custom vmexit handler (fn). (fn) must return 0 if the vmexit was
  * handled, -1 if not.
@@ -198,6 +304,96 @@ int hvt_core_register_vmexit(hvt_vmexit_fn_t fn);
  */
 extern hvt_vmexit_fn_t hvt_core_vmexits[];
 
+/*
+ * VM exit and hypercall accounting, maintained by the backend vCPU loop when
+ * (hvt_stats_enabled) is set by a module before the guest is started.
+ *
+ * Latency histograms use power of two buckets: bucket 0 counts durations
+ * below 1us, bucket (i) durations in [2^(i-1)us .. 2^i us), and the last
+ * bucket anything longer.
+ */
+#define HVT_STATS_BUCKETS 24
+#define HVT_STATS_EXITS   64 /* Backend exit reasons tracked */
+
+struct hvt_stats_hist {
+    uint64_t count;
+    uint64_t total_ns;
+    uint64_t max_ns;
+    uint64_t bucket[HVT_STATS_BUCKETS];
+};
+
+struct hvt_stats {
+    struct hvt_stats_hist guest; /* time spent running the guest */
+    uint64_t exits[HVT_STATS_EXITS]; /* by backend exit reason */
+    struct hvt_stats_hist hypercall[HVT_HYPERCALL_MAX]; /* time in handler */
+    uint64_t mem_released; /* bytes returned to the host on guest request */
+    uint64_t mem_release_failed; /* bytes which could not be returned */
+};
+
+extern bool hvt_stats_enabled;
+extern struct hvt_stats hvt_stats;
+
+uint64_t hvt_stats_clock(void);
+
+/*
+ * Returns the current monotonic time in nanoseconds if accounting is enabled,
+ * 0 otherwise.
+ */
+static inline uint64_t hvt_stats_now(void)
+{
+    return hvt_stats_enabled ? hvt_stats_clock() : 0;
+}
+
+/*
+ * Adds the time elapsed since (start), as returned by hvt_stats_now(), to the
+ * histogram (h). Returns the current time.
+ */
+uint64_t hvt_stats_add(struct hvt_stats_hist *h, uint64_t start);
+
+static inline uint64_t hvt_stats_record(struct hvt_stats_hist *h,
+                                        uint64_t start)
+{
+    return hvt_stats_enabled ? hvt_stats_add(h, start) : 0;
+}
+
+static inline void hvt_stats_exit(unsigned reason)
+{
+    if (hvt_stats_enabled && reason < HVT_STATS_EXITS)
+        hvt_stats.exits[reason]++;
+}
+
+/*
+ * Startup phases of the tender. The monotonic time on entry to each phase is
+ * recorded in (hvt_boot_trace_ns) unconditionally, as this is cheap.
+ *
+ * If (hvt_boot_trace_enabled) is set by a module while handling its command
+ * line options, main() calls hvt_boot_trace_reserve() to set aside an area of
+ * HVT_BOOT_TRACE_SIZE bytes of guest memory at (hvt->boot_trace) for the guest
+ * to record its own startup phases in, see enum hvt_boot_phase.
+ */
+enum hvt_trace_phase {
+    HVT_TRACE_MAIN,
+    HVT_TRACE_ELF_LOAD_NOTE,
+    HVT_TRACE_HVT_INIT,
+    HVT_TRACE_ELF_LOAD,
+    HVT_TRACE_VCPU_INIT,
+    HVT_TRACE_SETUP_MODULES,
+    HVT_TRACE_VCPU_RUN, /* first entry into the guest */
+    HVT_TRACE_MAX
+};
+
+#define HVT_BOOT_TRACE_SIZE 0x1000
+
+extern bool hvt_boot_trace_enabled;
+extern uint64_t hvt_boot_trace_ns[HVT_TRACE_MAX];
+
+void hvt_boot_trace_reserve(struct hvt *hvt);
+
+static inline void hvt_boot_trace_mark(enum hvt_trace_phase phase)
+{
+    hvt_boot_trace_ns[phase] = hvt_stats_clock();
+}
+
 /*
  * Operations provided by a module. (setup) is required, all other functions
  * are optional.
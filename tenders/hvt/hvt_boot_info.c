@@ -105,13 +105,47 @@ void hvt_boot_info_init(struct hvt *hvt, hvt_gpa_t gpa_kend, int cmdline_argc,
         ring_active = hvb->kick_net_pipe[0] != -1;
 #endif
         if (ring_active) {
-            bi->host_features |= HVT_FEATURE_RING_IO;
+            bi->host_features |=
+                HVT_FEATURE_RING_IO | HVT_FEATURE_NET_TX_BLOCKED;
             bi->net_ring = hvb->net_ring_gpa;
             /* [hvt_net_reserve_ring] sets [guest_mem_size] (and,
              * [bi->mem_size]) if we have a net device for our ringbuffer. We
              * ensure here that the memory given to the unikernel does not
              * include our ringbuffer. */
-            assert(bi->mem_size == hvb->net_ring_gpa);
+            assert(bi->mem_size <= hvb->net_ring_gpa);
         }
     }
+
+    /*
+     * Asynchronous block I/O is available if the block module is in use.
+     */
+    if (hvt_core_hypercalls[HVT_HYPERCALL_BLOCK_SUBMIT] != NULL)
+        bi->host_features |= HVT_FEATURE_BLOCK_ASYNC;
+
+    if (hvt_core_hypercalls[HVT_HYPERCALL_MULTICALL] != NULL)
+        bi->host_features |= HVT_FEATURE_MULTICALL;
+
+    if (hvt_core_hypercalls[HVT_HYPERCALL_MEM_RELEASE] != NULL)
+        bi->host_features |= HVT_FEATURE_MEM_RELEASE;
+
+    /*
+     * The boot trace area, if any, has been reserved by
+     * hvt_boot_trace_reserve().
+     */
+    bi->boot_trace = hvt->boot_trace;
+    if (hvt->boot_trace != 0)
+        bi->host_features |= HVT_FEATURE_BOOT_TRACE;
+}
+
+void hvt_boot_trace_reserve(struct hvt *hvt)
+{
+    /*
+     * Guest low memory is read-only to the guest, so the area is instead
+     * taken from the top of guest memory, below the network ring if any.
+     */
+    if (hvt->guest_mem_size < 2 * HVT_BOOT_TRACE_SIZE)
+        errx(1, "Not enough guest memory for boot trace area");
+    hvt->guest_mem_size -= HVT_BOOT_TRACE_SIZE;
+    hvt->boot_trace = hvt->guest_mem_size;
+    memset(hvt->mem + hvt->boot_trace, 0, HVT_BOOT_TRACE_SIZE);
 }
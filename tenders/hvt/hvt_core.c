@@ -30,6 +30,7 @@
 #include <err.h>
 #include <errno.h>
 #include <signal.h>
+#include <stddef.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -40,6 +41,8 @@
 #if defined(__linux__)
 
 #include <sys/epoll.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include <sys/timerfd.h>
 
 #elif defined(__FreeBSD__) || defined(__OpenBSD__) || defined(__DragonFly__)
@@ -58,6 +61,25 @@
 
 hvt_hypercall_fn_t hvt_core_hypercalls[HVT_HYPERCALL_MAX] = {0};
 
+const char *const hvt_core_hypercall_names[HVT_HYPERCALL_MAX] = {
+    [HVT_HYPERCALL_WALLTIME] = "walltime",
+    [HVT_HYPERCALL_PUTS] = "puts",
+    [HVT_HYPERCALL_POLL] = "poll",
+    [HVT_HYPERCALL_BLOCK_WRITE] = "block_write",
+    [HVT_HYPERCALL_BLOCK_READ] = "block_read",
+    [HVT_HYPERCALL_NET_WRITE] = "net_write",
+    [HVT_HYPERCALL_NET_READ] = "net_read",
+    [HVT_HYPERCALL_HALT] = "halt",
+    [HVT_HYPERCALL_BLOCK_SUBMIT] = "block_submit",
+    [HVT_HYPERCALL_BLOCK_REAP] = "block_reap",
+    [HVT_HYPERCALL_MEM_RELEASE] = "mem_release",
+    [HVT_HYPERCALL_MULTICALL] = "multicall",
+};
+
+hvt_restore_fn_t hvt_core_restore;
+hvt_inflight_fn_t hvt_core_inflight;
+hvt_thread_fn_t hvt_core_thread_hook;
+
 int hvt_core_register_hypercall(int nr, hvt_hypercall_fn_t fn)
 {
     if (nr >= HVT_HYPERCALL_MAX)
@@ -123,6 +145,39 @@ int hvt_core_register_vmexit(hvt_vmexit_fn_t fn)
     return 0;
 }
 
+bool hvt_stats_enabled;
+struct hvt_stats hvt_stats;
+
+bool hvt_boot_trace_enabled;
+uint64_t hvt_boot_trace_ns[HVT_TRACE_MAX];
+
+uint64_t hvt_stats_clock(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+uint64_t hvt_stats_add(struct hvt_stats_hist *h, uint64_t start)
+{
+    uint64_t now = hvt_stats_clock();
+    uint64_t ns = now - start;
+    uint64_t us = ns / 1000;
+    unsigned b = 0;
+
+    while (us != 0 && b < HVT_STATS_BUCKETS - 1) {
+        us >>= 1;
+        b++;
+    }
+    h->count++;
+    h->total_ns += ns;
+    if (ns > h->max_ns)
+        h->max_ns = ns;
+    h->bucket[b]++;
+    return now;
+}
+
 static void hypercall_walltime(struct hvt *hvt, hvt_gpa_t gpa)
 {
     struct hvt_hc_walltime *t =
@@ -142,11 +197,133 @@ static void hypercall_puts(struct hvt *hvt, hvt_gpa_t gpa)
     assert(rc >= 0);
 }
 
+static void hypercall_mem_release(struct hvt *hvt, hvt_gpa_t gpa)
+{
+    struct hvt_hc_mem_release *r =
+        HVT_CHECKED_GPA_P(hvt, gpa, sizeof(struct hvt_hc_mem_release));
+    hvt_gpa_t addr = r->addr, end;
+
+    if (((addr | r->len) & 0xfff) || addr < HVT_GUEST_MIN_BASE ||
+        add_overflow(addr, r->len, end) || end > hvt->guest_mem_size) {
+        r->ret = -1;
+        return;
+    }
+    r->ret = 0;
+
+#if defined(__linux__)
+    /*
+     * Guest memory is normally a shared mapping, whose pages are only freed
+     * by MADV_REMOVE. MADV_DONTNEED covers private mappings, such as that of
+     * a guest restored from a snapshot.
+     */
+    if (madvise(hvt->mem + addr, r->len, MADV_REMOVE) == -1 &&
+        madvise(hvt->mem + addr, r->len, MADV_DONTNEED) == -1) {
+        if (hvt_stats_enabled)
+            hvt_stats.mem_release_failed += r->len;
+        return;
+    }
+    if (hvt_stats_enabled)
+        hvt_stats.mem_released += r->len;
+#else
+    /*
+     * Guest memory belongs to the vmm(4) instance, the hint is ignored.
+     */
+    if (hvt_stats_enabled)
+        hvt_stats.mem_release_failed += r->len;
+#endif
+}
+
+/*
+ * Offset of (ret) in the argument structure of each hypercall which reports
+ * success as a zero (ret), for HVT_MULTICALL_STOP_ON_ERROR. No structure
+ * starts with its (ret), so 0 means there is none.
+ */
+static const size_t multicall_ret_off[HVT_HYPERCALL_MAX] = {
+    [HVT_HYPERCALL_BLOCK_WRITE] = offsetof(struct hvt_hc_block_write, ret),
+    [HVT_HYPERCALL_BLOCK_READ] = offsetof(struct hvt_hc_block_read, ret),
+    [HVT_HYPERCALL_NET_WRITE] = offsetof(struct hvt_hc_net_write, ret),
+    [HVT_HYPERCALL_NET_READ] = offsetof(struct hvt_hc_net_read, ret),
+    [HVT_HYPERCALL_BLOCK_SUBMIT] = offsetof(struct hvt_hc_block_submit, ret),
+    [HVT_HYPERCALL_BLOCK_REAP] = offsetof(struct hvt_hc_block_reap, ret),
+    [HVT_HYPERCALL_MEM_RELEASE] = offsetof(struct hvt_hc_mem_release, ret),
+};
+
+/*
+ * Each hypercall in the batch is dispatched through hvt_core_hypercalls[],
+ * and so is subject to the same checks as if the guest had made it directly,
+ * and accounted for separately by --stats, in addition to the multicall
+ * itself.
+ */
+static void hypercall_multicall(struct hvt *hvt, hvt_gpa_t gpa)
+{
+    struct hvt_hc_multicall *m =
+        HVT_CHECKED_GPA_P(hvt, gpa, sizeof(struct hvt_hc_multicall));
+    size_t count = m->count;
+
+    if (count > HVT_MULTICALL_MAX) {
+        m->ret = -1;
+        return;
+    }
+    struct hvt_multicall_entry *calls = HVT_CHECKED_GPA_P(
+        hvt, m->calls, count * sizeof(struct hvt_multicall_entry));
+
+    bool stop_on_error = m->flags & HVT_MULTICALL_STOP_ON_ERROR;
+    m->ret = 0;
+    for (size_t i = 0; i < count; i++) {
+        uint64_t nr = calls[i].nr;
+        hvt_hypercall_fn_t fn = NULL;
+
+        if (nr < HVT_HYPERCALL_MAX && nr != HVT_HYPERCALL_HALT &&
+            nr != HVT_HYPERCALL_MULTICALL)
+            fn = hvt_core_hypercalls[nr];
+        if (fn == NULL) {
+            calls[i].ret = -1;
+            m->ret = -1;
+            continue;
+        }
+        uint64_t t_start = hvt_stats_enabled ? hvt_stats_clock() : 0;
+        fn(hvt, calls[i].arg);
+        hvt_stats_record(&hvt_stats.hypercall[nr], t_start);
+        calls[i].ret = 0;
+
+        if (stop_on_error && multicall_ret_off[nr] != 0) {
+            int *ret = HVT_CHECKED_GPA_P(hvt, calls[i].arg +
+                                         multicall_ret_off[nr], sizeof(int));
+            if (*ret != 0) {
+                for (size_t j = i + 1; j < count; j++)
+                    calls[j].ret = 1;
+                if (i + 1 < count)
+                    m->ret = -1;
+                break;
+            }
+        }
+    }
+}
+
 static int waitsetfd = -1;
 static int npollfds;
 #if defined(__linux__)
 static int timerfd = -1;
 #define INTERNAL_TIMERFD (~1U)
+bool hvt_core_epoll_pwait2;
+unsigned hvt_core_disable_exits;
+unsigned hvt_core_seccomp_allow;
+
+/*
+ * epoll_pwait2() (Linux 5.11 and later) is called directly, as older C
+ * libraries do not provide a wrapper for it.
+ */
+static int epoll_pwait2_(int epfd, struct epoll_event *events, int maxevents,
+                         const struct timespec *timeout)
+{
+#if defined(SYS_epoll_pwait2)
+    return syscall(SYS_epoll_pwait2, epfd, events, maxevents, timeout, NULL,
+                   0);
+#else
+    errno = ENOSYS;
+    return -1;
+#endif
+}
 #endif
 
 static void setup_waitset(void)
@@ -165,6 +342,13 @@ static void setup_waitset(void)
     ev.data.u64 = INTERNAL_TIMERFD;
     if (epoll_ctl(waitsetfd, EPOLL_CTL_ADD, timerfd, &ev) == -1)
         err(1, "epoll_ctl(EPOLL_CTL_ADD) failed");
+
+    /*
+     * If the host kernel supports epoll_pwait2(), use it in preference to
+     * arming the timerfd, which is then kept only as a fallback.
+     */
+    struct timespec ts = {0};
+    hvt_core_epoll_pwait2 = epoll_pwait2_(waitsetfd, &ev, 1, &ts) != -1;
 #else /* kqueue */
     waitsetfd = kqueue();
     if (waitsetfd == -1)
@@ -217,25 +401,36 @@ static void hypercall_poll(struct hvt *hvt, hvt_gpa_t gpa)
     uint64_t ready_set = 0;
 
     struct epoll_event revents[nevents];
-    struct itimerspec it = {
-        .it_interval = {0},
-        .it_value = {.tv_sec = t->timeout_nsecs / 1000000000ULL,
-                     .tv_nsec = t->timeout_nsecs % 1000000000ULL}};
-    /*
-     * Ensure that it.it_value is always non-zero, otherwise the following
-     * epoll_wait() will hang if there are no other descriptors in the waitset
-     * due to the timer never firing. See timefd_settime(2).
-     */
-    it.it_value.tv_nsec |= 1;
-    if (timerfd_settime(timerfd, 0, &it, NULL) == -1)
-        err(1, "timerfd_settime() failed");
-    /*
-     * We can always safely restart this call on EINTR, since the internal
-     * timerfd is independent of its invocation.
-     */
-    do {
-        nrevents = epoll_pwait(waitsetfd, revents, nevents, -1, NULL);
-    } while (nrevents == -1 && errno == EINTR);
+    struct timespec ts = {.tv_sec = t->timeout_nsecs / 1000000000ULL,
+                          .tv_nsec = t->timeout_nsecs % 1000000000ULL};
+
+    if (t->timeout_nsecs == 0) {
+        /*
+         * Fast path for a readiness check, no timeout is needed.
+         */
+        do {
+            nrevents = epoll_pwait(waitsetfd, revents, nevents, 0, NULL);
+        } while (nrevents == -1 && errno == EINTR);
+    } else if (hvt_core_epoll_pwait2) {
+        /*
+         * Restarting this call on EINTR may extend the timeout, but only
+         * signals which terminate the tender are expected here.
+         */
+        do {
+            nrevents = epoll_pwait2_(waitsetfd, revents, nevents, &ts);
+        } while (nrevents == -1 && errno == EINTR);
+    } else {
+        struct itimerspec it = {.it_interval = {0}, .it_value = ts};
+        if (timerfd_settime(timerfd, 0, &it, NULL) == -1)
+            err(1, "timerfd_settime() failed");
+        /*
+         * We can always safely restart this call on EINTR, since the internal
+         * timerfd is independent of its invocation.
+         */
+        do {
+            nrevents = epoll_pwait(waitsetfd, revents, nevents, -1, NULL);
+        } while (nrevents == -1 && errno == EINTR);
+    }
     if (nrevents > 0) {
         int orig_nrevents = nrevents;
         for (int i = 0; i < orig_nrevents; i++)
@@ -298,6 +493,10 @@ static int setup(struct hvt *hvt, struct mft *mft)
            0);
     assert(hvt_core_register_hypercall(HVT_HYPERCALL_POLL, hypercall_poll) ==
            0);
+    assert(hvt_core_register_hypercall(HVT_HYPERCALL_MEM_RELEASE,
+                                       hypercall_mem_release) == 0);
+    assert(hvt_core_register_hypercall(HVT_HYPERCALL_MULTICALL,
+                                       hypercall_multicall) == 0);
 
     return 0;
 }
@@ -31,7 +31,7 @@
 
 #include "hvt_cpu_x86_64.h"
 
-void hvt_x86_mem_size(size_t *mem_size)
+void hvt_x86_mem_size(size_t *mem_size, size_t max_mem_size)
 {
     size_t mem;
     mem = (*mem_size / X86_GUEST_PAGE_SIZE) * X86_GUEST_PAGE_SIZE;
@@ -40,9 +40,9 @@ void hvt_x86_mem_size(size_t *mem_size)
         mem = X86_GUEST_PAGE_SIZE;
     if (mem != *mem_size)
         warnx("adjusting memory to %zu bytes", mem);
-    if (mem > X86_GUEST_MAX_MEM_SIZE)
+    if (mem > max_mem_size)
         errx(1, "guest memory size %zu bytes exceeds the max size %zu bytes",
-             mem, X86_GUEST_MAX_MEM_SIZE);
+             mem, max_mem_size);
     *mem_size = mem;
 }
 
@@ -60,18 +60,21 @@ void hvt_x86_setup_pagetables(uint8_t *mem, size_t mem_size)
      */
 
     /*
-     * We currently use 2MB pages.  Sanity check that the guest size is a
-     * multiple of the page size and will fit in up to four PDEs (512 entries /
-     * 4GB). Additionally, check that the guest size is at least 2MB.
+     * We use 2MB pages for the first 4GB, and 1GB pages above that.  Sanity
+     * check that the guest size is a multiple of the 2MB page size and will
+     * fit in the single PDPT (512 entries / 512GB). Additionally, check that
+     * the guest size is at least 2MB. The caller is responsible for checking
+     * that the CPU supports 1GB pages if the guest size exceeds 4GB.
      */
     assert((mem_size & (X86_GUEST_PAGE_SIZE - 1)) == 0);
-    assert(mem_size <= X86_GUEST_MAX_MEM_SIZE);
+    assert(mem_size <= X86_GUEST_MAX_MEM_SIZE_1GB);
     assert(mem_size >= X86_GUEST_PAGE_SIZE);
 
     memset(pml4, 0, X86_PML4_SIZE);
     memset(pdpte, 0, X86_PDPTE_SIZE);
     memset(pde, 0, X86_PDE_SIZE);
     memset(pt0e, 0, X86_PTE_SIZE);
+    memset(mem + X86_PDE_TAIL_BASE, 0, X86_PDE_TAIL_SIZE);
 
     *pml4 = X86_PDPTE_BASE | (X86_PDPT_P | X86_PDPT_RW);
     *pdpte = X86_PDE_BASE | (X86_PDPT_P | X86_PDPT_RW);
@@ -108,6 +111,26 @@ void hvt_x86_setup_pagetables(uint8_t *mem, size_t mem_size)
             *pt0e = paddr | (X86_PDPT_P | X86_PDPT_RW);
     }
     assert(paddr == X86_GUEST_PAGE_SIZE);
+    for (; paddr < mem_size && paddr < X86_GUEST_MAX_MEM_SIZE;
+         paddr += X86_GUEST_PAGE_SIZE, pde++)
+        *pde = paddr | (X86_PDPT_P | X86_PDPT_RW | X86_PDPT_PS);
+    if (paddr == mem_size)
+        return;
+
+    /*
+     * Above 4GB: 1GB pages mapped directly by PDPTEs, and a final PDE of 2MB
+     * pages for the remainder, if any.
+     */
+    pdpte = (uint64_t *)(mem + X86_PDPTE_BASE);
+    for (; paddr + X86_GUEST_HUGE_PAGE_SIZE <= mem_size;
+         paddr += X86_GUEST_HUGE_PAGE_SIZE)
+        pdpte[paddr / X86_GUEST_HUGE_PAGE_SIZE] =
+            paddr | (X86_PDPT_P | X86_PDPT_RW | X86_PDPT_PS);
+    if (paddr == mem_size)
+        return;
+    pdpte[paddr / X86_GUEST_HUGE_PAGE_SIZE] =
+        X86_PDE_TAIL_BASE | (X86_PDPT_P | X86_PDPT_RW);
+    pde = (uint64_t *)(mem + X86_PDE_TAIL_BASE);
     for (; paddr < mem_size; paddr += X86_GUEST_PAGE_SIZE, pde++)
         *pde = paddr | (X86_PDPT_P | X86_PDPT_RW | X86_PDPT_PS);
 }
@@ -202,6 +202,9 @@ static const struct x86_sreg hvt_x86_sreg_unusable = {.selector = X86_GDT_NULL,
 #define X86_PDE_SIZE       0x4000
 #define X86_PT0E_BASE      0x8000
 #define X86_PTE_SIZE       0x1000
+/* PDE for the last, partial, GB of guest memory above 4GB */
+#define X86_PDE_TAIL_BASE  0x9000
+#define X86_PDE_TAIL_SIZE  0x1000
 #define X86_BOOT_INFO_BASE 0x10000
 #define X86_PT0_MAP_START  X86_BOOT_INFO_BASE
 #define X86_GUEST_MIN_BASE HVT_GUEST_MIN_BASE
@@ -215,13 +218,22 @@ static const struct x86_sreg hvt_x86_sreg_unusable = {.selector = X86_GDT_NULL,
  */
 #define X86_GUEST_MAX_MEM_SIZE (2048UL * X86_GUEST_PAGE_SIZE)
 
+/*
+ * Memory above X86_GUEST_MAX_MEM_SIZE is mapped using 1GB pages, if supported
+ * by the CPU, with the remainder of the last GB mapped by X86_PDE_TAIL. The
+ * maximum guest allocation size is then bounded by the 512 entries of the
+ * single PDPT.
+ */
+#define X86_GUEST_HUGE_PAGE_SIZE   0x40000000UL
+#define X86_GUEST_MAX_MEM_SIZE_1GB (512UL * X86_GUEST_HUGE_PAGE_SIZE)
+
 
 /*
  * Initial RFLAGS value. Bit 1 is reserved and must be set.
  */
 #define X86_RFLAGS_INIT 0x2
 
-void hvt_x86_mem_size(size_t *mem_size);
+void hvt_x86_mem_size(size_t *mem_size, size_t max_mem_size);
 void hvt_x86_setup_pagetables(uint8_t *mem, size_t mem_size);
 void hvt_x86_setup_gdt(uint8_t *mem);
 
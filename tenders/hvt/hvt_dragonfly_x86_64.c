@@ -83,7 +83,7 @@ static struct nvmm_assist_callbacks callbacks = {.io = io_callback,
 
 void hvt_mem_size(size_t *mem_size)
 {
-    hvt_x86_mem_size(mem_size);
+    hvt_x86_mem_size(mem_size, X86_GUEST_MAX_MEM_SIZE);
 }
 
 void hvt_mem_size_roundup(size_t *mem_size)
@@ -178,6 +178,7 @@ int hvt_vcpu_loop(struct hvt *hvt)
     struct nvmm_vcpu *vcpu = &hvb->vcpu;
     int ret;
 
+    hvt_boot_trace_mark(HVT_TRACE_VCPU_RUN);
     while (1) {
         if (nvmm_vcpu_run(mach, vcpu) == -1)
             err(EXIT_FAILURE, "unable to run VCPU");
@@ -39,3 +39,9 @@ int hvt_dumpcore_write_prstatus(int fd, struct hvt *hvt, void *cookie)
     /* Not supported yet */
     return -1;
 }
+
+int hvt_dumpcore_stack_pointer(struct hvt *hvt, void *cookie, uint64_t *sp)
+{
+    /* Not supported yet */
+    return -1;
+}
@@ -122,6 +122,15 @@ int hvt_dumpcore_write_prstatus(int fd, struct hvt *hvt, void *cookie)
     return 0;
 }
 
+int hvt_dumpcore_stack_pointer(struct hvt *hvt, void *cookie, uint64_t *sp)
+{
+    if (cookie)
+        *sp = ((struct x86_trap_regs *)cookie)->rsp;
+    else
+        *sp = vmm_get_reg(hvt->b->vmfd, VM_REG_GUEST_RSP);
+    return 0;
+}
+
 int hvt_dumpcore_supported()
 {
     return 0;
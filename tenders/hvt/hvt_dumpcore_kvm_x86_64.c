@@ -116,6 +116,22 @@ int hvt_dumpcore_write_prstatus(int fd, struct hvt *hvt, void *cookie)
     return 0;
 }
 
+int hvt_dumpcore_stack_pointer(struct hvt *hvt, void *cookie, uint64_t *sp)
+{
+    struct kvm_regs kregs;
+
+    if (cookie) {
+        *sp = ((struct x86_trap_regs *)cookie)->rsp;
+        return 0;
+    }
+    if (ioctl(hvt->b->vcpufd, KVM_GET_REGS, &kregs) == -1) {
+        warn("dumpcore: KVM: ioctl(KVM_GET_REGS) failed");
+        return -1;
+    }
+    *sp = kregs.rsp;
+    return 0;
+}
+
 int hvt_dumpcore_supported()
 {
     return 0;
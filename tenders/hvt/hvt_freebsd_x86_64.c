@@ -48,7 +48,7 @@
 
 void hvt_mem_size(size_t *mem_size)
 {
-    hvt_x86_mem_size(mem_size);
+    hvt_x86_mem_size(mem_size, X86_GUEST_MAX_MEM_SIZE);
 }
 
 void hvt_mem_size_roundup(size_t *mem_size)
@@ -169,6 +169,7 @@ int hvt_vcpu_loop(struct hvt *hvt)
     hvb->vmrun.vm_exit = &vmexit;
 #endif
 
+    hvt_boot_trace_mark(HVT_TRACE_VCPU_RUN);
     while (1) {
         ret = ioctl(hvt->b->vmfd, VM_RUN, &hvb->vmrun);
         if (ret == -1 && errno == EINTR)
@@ -61,6 +61,32 @@ struct hvt *hvt_init(size_t mem_size)
     if (hvb->vmfd == -1)
         err(1, "KVM: ioctl (CREATE_VM) failed");
 
+#if defined(__x86_64__)
+    /*
+     * Must be done before any vCPUs are created.
+     */
+    if (hvt_core_disable_exits) {
+        uint64_t exits =
+            ((hvt_core_disable_exits & HVT_DISABLE_EXITS_PAUSE)
+                 ? KVM_X86_DISABLE_EXITS_PAUSE : 0) |
+            ((hvt_core_disable_exits & HVT_DISABLE_EXITS_HLT)
+                 ? KVM_X86_DISABLE_EXITS_HLT : 0);
+        ret = ioctl(hvb->kvmfd, KVM_CHECK_EXTENSION, KVM_CAP_X86_DISABLE_EXITS);
+        if (ret == -1)
+            err(1, "KVM: ioctl (KVM_CHECK_EXTENSION) failed");
+        if (((uint64_t)ret & exits) != exits)
+            errx(1, "KVM: host does not support disabling %s exits",
+                 (exits & ~(uint64_t)ret & KVM_X86_DISABLE_EXITS_PAUSE)
+                     ? "PAUSE" : "HLT");
+        struct kvm_enable_cap cap = {
+            .cap = KVM_CAP_X86_DISABLE_EXITS,
+            .args[0] = exits,
+        };
+        if (ioctl(hvb->vmfd, KVM_ENABLE_CAP, &cap) == -1)
+            err(1, "KVM: ioctl (ENABLE_CAP, X86_DISABLE_EXITS) failed");
+    }
+#endif
+
     hvb->vcpufd = ioctl(hvb->vmfd, KVM_CREATE_VCPU, 0);
     if (hvb->vcpufd == -1)
         err(1, "KVM: ioctl (CREATE_VCPU) failed");
@@ -89,12 +115,34 @@ struct hvt *hvt_init(size_t mem_size)
      * On FreeBSD and OpenBSD, the hypervisor should provide us a memory region
      * that has been initialised to zero.
      */
-    hvt->mem = mmap(NULL, mem_size, PROT_READ | PROT_WRITE,
-                    MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    /*
+     * Guest memory is aligned to the largest host page size that could back
+     * it (see hugepages_back()), so that host and guest large pages line up.
+     * Reserve enough address space to align it and trim the excess.
+     */
+    size_t mem_align = (mem_size >= (1ULL << 30)) ? (1ULL << 30)
+                                                  : (1ULL << 21);
+    uint8_t *reserve = mmap(NULL, mem_size + mem_align, PROT_NONE,
+                            MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (reserve == MAP_FAILED)
+        err(1, "Error allocating guest memory");
+    uint8_t *aligned = (uint8_t *)(((uintptr_t)reserve + mem_align - 1) &
+                                   ~(uintptr_t)(mem_align - 1));
+    hvt->mem = mmap(aligned, mem_size, PROT_READ | PROT_WRITE,
+                    MAP_SHARED | MAP_ANONYMOUS | MAP_FIXED, -1, 0);
     if (hvt->mem == MAP_FAILED)
         err(1, "Error allocating guest memory");
+    if (aligned > reserve)
+        munmap(reserve, aligned - reserve);
+    munmap(aligned + mem_size, (reserve + mem_size + mem_align) -
+                               (aligned + mem_size));
     hvt->guest_mem_size = mem_size;
     hvt->mem_alloc_size = mem_size;
+    /*
+     * KVM follows changes to the mapping at (hvt->mem), so parts of guest
+     * memory can be mapped from files (see elf_load()).
+     */
+    hvt->mem_mappable = true;
 
     struct kvm_userspace_memory_region region = {
         .slot = 0,
@@ -117,6 +165,38 @@ struct hvt *hvt_init(size_t mem_size)
     return hvt;
 }
 
+void hvt_mem_shrink(struct hvt *hvt, size_t mem_size)
+{
+    struct hvt_b *hvb = hvt->b;
+
+    assert(mem_size <= hvt->mem_alloc_size);
+    if (mem_size == hvt->mem_alloc_size)
+        return;
+
+    /*
+     * A memory slot cannot be resized, only deleted and created anew.
+     */
+    struct kvm_userspace_memory_region region = {
+        .slot = 0,
+        .guest_phys_addr = 0,
+        .memory_size = 0,
+        .userspace_addr = (uint64_t)hvt->mem,
+    };
+    if (ioctl(hvb->vmfd, KVM_SET_USER_MEMORY_REGION, &region) == -1)
+        err(1, "KVM: ioctl (SET_USER_MEMORY_REGION) failed");
+    /*
+     * Guest memory is a shared mapping, whose pages outlive a partial
+     * munmap() unless removed first.
+     */
+    madvise(hvt->mem + mem_size, hvt->mem_alloc_size - mem_size, MADV_REMOVE);
+    munmap(hvt->mem + mem_size, hvt->mem_alloc_size - mem_size);
+    hvt->guest_mem_size = mem_size;
+    hvt->mem_alloc_size = mem_size;
+    region.memory_size = mem_size;
+    if (ioctl(hvb->vmfd, KVM_SET_USER_MEMORY_REGION, &region) == -1)
+        err(1, "KVM: ioctl (SET_USER_MEMORY_REGION) failed");
+}
+
 #if defined(HVT_DROP_PRIVILEGES) && HVT_DROP_PRIVILEGES == 1
 void hvt_drop_privileges()
 {
@@ -167,5 +247,15 @@ int hvt_guest_mprotect(void *t_arg, uint64_t addr_start, uint64_t addr_end,
         prot &= ~(PROT_EXEC);
         prot |= PROT_READ;
     }
-    return mprotect(vaddr_start, size, prot);
+    if (mprotect(vaddr_start, size, prot) == -1)
+        return -1;
+
+    struct hvt_b *hvb = hvt->b;
+    if (hvb->nprot < HVT_KVM_PROT_MAX) {
+        hvb->prot[hvb->nprot].start = addr_start;
+        hvb->prot[hvb->nprot].end = addr_end;
+        hvb->prot[hvb->nprot].prot = prot;
+    }
+    hvb->nprot++;
+    return 0;
 }
@@ -27,6 +27,18 @@
 
 #include <pthread.h>
 
+/*
+ * Guest memory protections applied by hvt_guest_mprotect() are recorded, so
+ * that they can be saved with a snapshot (see hvt_module_snapshot.c).
+ */
+#define HVT_KVM_PROT_MAX 16
+
+struct hvt_kvm_prot {
+    uint64_t start;
+    uint64_t end;
+    int prot;
+};
+
 struct hvt_b {
     int kvmfd;
     int vmfd;
@@ -38,6 +50,9 @@ struct hvt_b {
     int kick_net_efd;
     pthread_t io_thread_net;
     hvt_gpa_t net_ring_gpa;
+
+    struct hvt_kvm_prot prot[HVT_KVM_PROT_MAX];
+    unsigned nprot; /* may exceed HVT_KVM_PROT_MAX, see hvt_guest_mprotect() */
 };
 
 #endif /* HVT_HV_KVM_H */
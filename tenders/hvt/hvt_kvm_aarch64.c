@@ -324,10 +324,23 @@ int hvt_vcpu_loop(struct hvt *hvt)
     struct hvt_b *hvb = hvt->b;
     int ret;
 
+    hvt_boot_trace_mark(HVT_TRACE_VCPU_RUN);
     while (1) {
+        uint64_t t_entry = hvt_stats_now();
         ret = ioctl(hvb->vcpufd, KVM_RUN, NULL);
-        if (ret == -1 && errno == EINTR)
+        uint64_t t_exit = hvt_stats_record(&hvt_stats.guest, t_entry);
+        if (ret == 0 || errno == EINTR)
+            hvt_stats_exit(hvb->vcpurun->exit_reason);
+        if (ret == -1 && errno == EINTR) {
+            /*
+             * Interrupted by a signal (exit_reason is KVM_EXIT_INTR). Give
+             * modules a chance to act on it (e.g. the profiler samples the
+             * vCPU here), then re-enter the guest.
+             */
+            for (hvt_vmexit_fn_t *fn = hvt_core_vmexits; *fn; fn++)
+                (*fn)(hvt);
             continue;
+        }
         if (ret == -1) {
             if (errno == EFAULT) {
                 uint64_t pc;
@@ -372,6 +385,7 @@ int hvt_vcpu_loop(struct hvt *hvt)
 
             hvt_gpa_t gpa = mmio_read32(run->mmio.data);
             fn(hvt, gpa);
+            hvt_stats_record(&hvt_stats.hypercall[nr], t_exit);
             break;
         }
 
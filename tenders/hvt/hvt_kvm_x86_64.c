@@ -32,23 +32,67 @@
 #include <sys/mman.h>
 #include <string.h>
 #include <stdlib.h>
+#include <unistd.h>
 #include <linux/kvm.h>
 
 #include "hvt.h"
 #include "hvt_kvm.h"
 #include "hvt_cpu_x86_64.h"
 
+/*
+ * Guests larger than 4GB require 1GB page support (see
+ * hvt_x86_setup_pagetables()); determined by hvt_mem_size().
+ */
+static size_t max_mem_size = X86_GUEST_MAX_MEM_SIZE;
+
+/*
+ * Returns true if KVM can expose 1GB pages (CPUID.80000001H:EDX.Page1GB) to
+ * the guest.
+ */
+static bool has_1gb_pages(void)
+{
+    struct kvm_cpuid2 *kvm_cpuid;
+    int max_entries = 100;
+    bool found = false;
+
+    int kvmfd = open("/dev/kvm", O_RDWR | O_CLOEXEC);
+    if (kvmfd == -1)
+        err(1, "Could not open: /dev/kvm");
+    kvm_cpuid = calloc(1, sizeof(*kvm_cpuid) +
+                              max_entries * sizeof(*kvm_cpuid->entries));
+    assert(kvm_cpuid);
+    kvm_cpuid->nent = max_entries;
+    if (ioctl(kvmfd, KVM_GET_SUPPORTED_CPUID, kvm_cpuid) < 0)
+        err(1, "KVM: ioctl (GET_SUPPORTED_CPUID) failed");
+    for (unsigned i = 0; i < kvm_cpuid->nent; i++) {
+        if (kvm_cpuid->entries[i].function == 0x80000001) {
+            found = (kvm_cpuid->entries[i].edx & (1U << 26)) != 0;
+            break;
+        }
+    }
+    free(kvm_cpuid);
+    close(kvmfd);
+    return found;
+}
+
 void hvt_mem_size(size_t *mem_size)
 {
-    hvt_x86_mem_size(mem_size);
+    if (*mem_size > X86_GUEST_MAX_MEM_SIZE) {
+        if (has_1gb_pages())
+            max_mem_size = X86_GUEST_MAX_MEM_SIZE_1GB;
+        else
+            warnx("Host does not support 1GB pages, guest memory is limited "
+                  "to %zu MB", (size_t)(X86_GUEST_MAX_MEM_SIZE >> 20));
+    }
+    hvt_x86_mem_size(mem_size, max_mem_size);
 }
 
 void hvt_mem_size_roundup(size_t *mem_size)
 {
     size_t mem = ((*mem_size + X86_GUEST_PAGE_SIZE - 1) / X86_GUEST_PAGE_SIZE) *
                  X86_GUEST_PAGE_SIZE;
-    if (mem > X86_GUEST_MAX_MEM_SIZE)
-        mem = X86_GUEST_MAX_MEM_SIZE;
+    if (mem > max_mem_size)
+        mem = max_mem_size;
     *mem_size = mem;
 }
 
@@ -166,10 +210,23 @@ int hvt_vcpu_loop(struct hvt *hvt)
     struct hvt_b *hvb = hvt->b;
     int ret;
 
+    hvt_boot_trace_mark(HVT_TRACE_VCPU_RUN);
     while (1) {
+        uint64_t t_entry = hvt_stats_now();
         ret = ioctl(hvb->vcpufd, KVM_RUN, NULL);
-        if (ret == -1 && errno == EINTR)
+        uint64_t t_exit = hvt_stats_record(&hvt_stats.guest, t_entry);
+        if (ret == 0 || errno == EINTR)
+            hvt_stats_exit(hvb->vcpurun->exit_reason);
+        if (ret == -1 && errno == EINTR) {
+            /*
+             * Interrupted by a signal (exit_reason is KVM_EXIT_INTR). Give
+             * modules a chance to act on it (e.g. the profiler samples the
+             * vCPU here), then re-enter the guest.
+             */
+            for (hvt_vmexit_fn_t *fn = hvt_core_vmexits; *fn; fn++)
+                (*fn)(hvt);
             continue;
+        }
         if (ret == -1) {
             if (errno == EFAULT) {
                 struct kvm_regs regs;
@@ -213,6 +270,7 @@ int hvt_vcpu_loop(struct hvt *hvt)
 
             hvt_gpa_t gpa = *(uint32_t *)((uint8_t *)run + run->io.data_offset);
             fn(hvt, gpa);
+            hvt_stats_record(&hvt_stats.hypercall[nr], t_exit);
             break;
         }
 
@@ -32,11 +32,14 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/mman.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <unistd.h>
 
 #include "hvt.h"
+#include "../common/hugepages.h"
+#include "../common/mem_policy.h"
 #include "version.h"
 
 extern struct hvt_module __start_modules;
@@ -99,16 +102,38 @@ static void handle_mem(char *cmdarg, size_t *mem_size)
     *mem_size = mem;
 }
 
+static void handle_mem_hugepages(char *cmdarg, enum hugepages *hp)
+{
+    if (hugepages_parse(cmdarg + 16, hp) == -1)
+        errx(1, "Malformed argument to --mem-hugepages");
+}
+
 static void usage(const char *prog)
 {
     fprintf(stderr,
             "usage: %s [ CORE OPTIONS ] [ MODULE OPTIONS ] [ -- ] "
             "KERNEL [ ARGS ]\n",
             prog);
-    fprintf(stderr, "KERNEL is the filename of the unikernel to run.\n");
+    fprintf(stderr, "KERNEL is the filename of the unikernel to run, "
+            "and must not be\nmodified while it is running.\n");
     fprintf(stderr, "ARGS are optional arguments passed to the unikernel.\n");
     fprintf(stderr, "Core options:\n");
     fprintf(stderr, "  [ --mem=512 ] (guest memory in MB)\n");
+    fprintf(stderr, "  [ --mem-hugepages=2M|1G|thp ] (back guest memory with "
+                    "huge pages)\n");
+    fprintf(stderr, "  [ --mem-prefault ] (populate guest memory before "
+                    "starting the guest)\n");
+    fprintf(stderr, "  [ --mem-lock ] (populate and lock guest memory before "
+                    "starting the guest)\n");
+    fprintf(stderr, "  [ --numa-node=N ] (allocate guest memory on, and run "
+                    "on the CPUs of, NUMA node N)\n");
+#if defined(__linux__)
+    fprintf(stderr, "    --pool-serve=PATH[,shells=N][,mem=MB[:MB...]] (run a "
+                    "daemon keeping tenders ready for --pool, must come "
+                    "first)\n");
+    fprintf(stderr, "    --pool=PATH (run in the daemon serving PATH, must "
+                    "come first)\n");
+#endif
     fprintf(stderr, "    --help (display this help)\n");
     fprintf(stderr, "    --version (display version information)\n");
     fprintf(stderr, "Compiled-in modules: ");
@@ -139,16 +164,31 @@ static void version(const char *prog)
 int main(int argc, char **argv)
 {
     size_t mem_size = 0x20000000;
+    enum hugepages mem_hugepages = HUGEPAGES_NONE;
+    struct mem_policy mem_policy = MEM_POLICY_INIT;
     hvt_gpa_t gpa_ep, gpa_kend;
     const char *prog;
     const char *elf_filename;
     int elf_fd = -1;
     int matched;
 
+    hvt_boot_trace_mark(HVT_TRACE_MAIN);
     prog = basename(*argv);
     argc--;
     argv++;
 
+#if defined(__linux__)
+    /*
+     * In a pool daemon, hvt_pool_serve() returns in a shell which has been
+     * handed a command line to run, along with a VM created in advance.
+     */
+    struct hvt *warm = NULL;
+    if (argc > 0 && strncmp("--pool-serve=", *argv, 13) == 0)
+        warm = hvt_pool_serve(*argv + 13, &argc, &argv);
+    else if (argc > 0 && strncmp("--pool=", *argv, 7) == 0)
+        hvt_pool_client(*argv + 7, argc - 1, argv + 1);
+#endif
+
     /*
      * Scan command line arguments, looking for the first non-option argument
      * which will be the ELF file to load. Stop if a "terminal" option such as
@@ -187,6 +227,7 @@ int main(int argc, char **argv)
 
     struct abi1_info *abi1;
     size_t abi1_size;
+    hvt_boot_trace_mark(HVT_TRACE_ELF_LOAD_NOTE);
     if (elf_load_note(elf_fd, elf_filename, ABI1_NOTE_TYPE, ABI1_NOTE_ALIGN,
                       ABI1_NOTE_MAX_SIZE, (void **)&abi1, &abi1_size) == -1)
         errx(1, "%s: No Solo5 ABI information found in executable",
@@ -226,6 +267,15 @@ int main(int argc, char **argv)
             matched = 1;
             argc--;
             argv++;
+        } else if (strncmp("--mem-hugepages=", *argv, 16) == 0) {
+            handle_mem_hugepages(*argv, &mem_hugepages);
+            matched = 1;
+            argc--;
+            argv++;
+        } else if (mem_policy_parse(*argv, &mem_policy) == 0) {
+            matched = 1;
+            argc--;
+            argv++;
         }
         if (handle_cmdarg(*argv, mft) == 0) {
             /* Handled by module, consume and go on to next arg */
@@ -259,18 +309,63 @@ int main(int argc, char **argv)
         hvt_mem_size_roundup(&mem_size);
     }
 
+    hvt_boot_trace_mark(HVT_TRACE_HVT_INIT);
+#if defined(__linux__)
+    struct hvt *hvt = hvt_pool_take(warm, mem_size);
+#else
     struct hvt *hvt = hvt_init(mem_size);
+#endif
 
-    elf_load(elf_fd, elf_filename, hvt->mem, hvt->guest_mem_size,
-             HVT_GUEST_MIN_BASE, hvt_guest_mprotect, hvt, &gpa_ep, &gpa_kend);
-    close(elf_fd); /* Done with ELF binary */
+    if (hvt_core_restore == NULL) {
+        hvt_boot_trace_mark(HVT_TRACE_ELF_LOAD);
+        elf_load(elf_fd, elf_filename, hvt->mem, hvt->guest_mem_size,
+                 HVT_GUEST_MIN_BASE, hvt->mem_mappable, hvt_guest_mprotect,
+                 hvt, &gpa_ep, &gpa_kend);
+        /*
+         * Huge pages are only used above the loaded ELF binary, whose
+         * segments need page-granular protection.
+         */
+        if (mem_hugepages != HUGEPAGES_NONE)
+            hugepages_back(hvt->mem, gpa_kend, hvt->guest_mem_size,
+                           PROT_READ | PROT_WRITE, mem_hugepages);
+    } else {
+        /* Guest memory and vCPU state come from the snapshot. */
+        gpa_ep = gpa_kend = 0;
+        if (mem_hugepages != HUGEPAGES_NONE)
+            warnx("--mem-hugepages has no effect on a restored guest");
+    }
 
     hvt_net_reserve_ring(hvt, mft);
+    if (hvt_boot_trace_enabled && hvt_core_restore == NULL)
+        hvt_boot_trace_reserve(hvt);
+    hvt_boot_trace_mark(HVT_TRACE_VCPU_INIT);
     hvt_vcpu_init(hvt, gpa_ep);
 
+    hvt->elf_fd = elf_fd;
+    if (hvt_core_restore != NULL)
+        hvt_core_restore(hvt);
+    if (hvt_core_restore != NULL && mem_policy.prefault && !mem_policy.lock) {
+        /*
+         * Guest memory is now mapped from the snapshot, partly read-only, and
+         * is faulted in as the guest touches it.
+         */
+        warnx("--mem-prefault has no effect on a restored guest");
+        mem_policy.prefault = false;
+    }
+    mem_policy_apply(&mem_policy, hvt->mem, 0, hvt->guest_mem_size, gpa_kend);
+    hvt_boot_trace_mark(HVT_TRACE_SETUP_MODULES);
     setup_modules(hvt, mft);
+    close(elf_fd); /* Done with ELF binary */
+    hvt->elf_fd = -1;
+
+    if (hvt_core_restore == NULL)
+        hvt_boot_info_init(hvt, gpa_kend, argc, argv, mft, mft_size);
 
-    hvt_boot_info_init(hvt, gpa_kend, argc, argv, mft, mft_size);
+    /*
+     * Any threads started by modules are already running, and do not inherit
+     * the placement of the vCPU thread.
+     */
+    hvt_core_thread_start(HVT_THREAD_VCPU);
 
 #if defined(HVT_DROP_PRIVILEGES) && HVT_DROP_PRIVILEGES == 1
     hvt_drop_privileges();
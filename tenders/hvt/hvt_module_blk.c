@@ -27,7 +27,10 @@
 #include <assert.h>
 #include <err.h>
 #include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
 #include <limits.h>
+#include <pthread.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -38,12 +41,410 @@
 #endif
 
 #include "../common/block_attach.h"
+#include "../common/rate_limit.h"
 #include "hvt.h"
 #include "solo5.h"
 
 static bool module_in_use;
 static struct mft *host_mft;
 
+/*
+ * Striped block devices (--block:NAME=stripe:...). Requests which fall within
+ * a single stripe unit are served inline from the VCPU thread. Requests which
+ * span several members are fanned out to one worker thread per member, so
+ * that the per-member I/Os are issued in parallel.
+ */
+struct stripe_dev {
+    struct block_stripe s;
+    pthread_mutex_t lock;
+    pthread_cond_t work_cv;
+    pthread_cond_t done_cv;
+    pthread_mutex_t fanout_lock; /* serialises fanned-out requests */
+    uint64_t gen; /* incremented for each fanned-out request */
+    unsigned busy; /* workers yet to finish the current request */
+    unsigned ready; /* workers started */
+    int error; /* errno of first failed member I/O, or 0 */
+    /* Current fanned-out request */
+    bool write;
+    void *buf;
+    size_t len;
+    off_t pos;
+};
+
+struct stripe_worker_arg {
+    struct stripe_dev *dev;
+    unsigned member;
+};
+
+static struct stripe_dev *stripe_devs[MFT_MAX_ENTRIES];
+
+/*
+ * Per-device limits (--block-iops, --block-bw). Synchronous requests are
+ * throttled in the VCPU thread and asynchronous requests in the worker
+ * threads, so accesses are serialised by limits_lock.
+ */
+static struct rate_limit iops_limits[MFT_MAX_ENTRIES];
+static struct rate_limit bw_limits[MFT_MAX_ENTRIES];
+static pthread_mutex_t limits_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool limits_in_use;
+
+/*
+ * Account a request of (len) bytes against the limits for device (handle),
+ * delaying its completion if either limit has been exceeded.
+ */
+static void block_throttle(unsigned handle, size_t len)
+{
+    if (!limits_in_use)
+        return;
+
+    pthread_mutex_lock(&limits_lock);
+    uint64_t delay = rate_limit_take(&iops_limits[handle], 1);
+    uint64_t bw_delay = rate_limit_take(&bw_limits[handle], len);
+    pthread_mutex_unlock(&limits_lock);
+    if (bw_delay > delay)
+        delay = bw_delay;
+    if (delay)
+        rate_limit_sleep(delay);
+}
+
+static void print_limit_stats(struct hvt *hvt, int status, void *cookie)
+{
+    (void)hvt;
+    (void)status;
+    (void)cookie;
+
+    for (unsigned i = 0; i != host_mft->entries; i++) {
+        const struct rate_limit *iops = &iops_limits[i];
+        const struct rate_limit *bw = &bw_limits[i];
+
+        if (!rate_limit_enabled(iops) && !rate_limit_enabled(bw))
+            continue;
+        warnx("%." XSTR(MFT_NAME_MAX) "s: throttled %" PRIu64
+              " requests by IOPS limit, %" PRIu64 " by bandwidth limit, "
+              "%" PRIu64 " ms total delay",
+              host_mft->e[i].name, iops->nthrottled, bw->nthrottled,
+              (iops->throttled_ns + bw->throttled_ns) / 1000000);
+    }
+}
+
+static void *stripe_worker_fn(void *arg)
+{
+    struct stripe_worker_arg *wa = arg;
+    struct stripe_dev *dev = wa->dev;
+    unsigned member = wa->member;
+    uint64_t seen;
+
+    free(wa);
+    hvt_core_thread_start(HVT_THREAD_IO);
+    pthread_mutex_lock(&dev->lock);
+    seen = dev->gen;
+    dev->ready++;
+    pthread_cond_signal(&dev->done_cv);
+    while (1) {
+        while (dev->gen == seen)
+            pthread_cond_wait(&dev->work_cv, &dev->lock);
+        seen = dev->gen;
+        bool write = dev->write;
+        void *buf = dev->buf;
+        size_t len = dev->len;
+        off_t pos = dev->pos;
+        pthread_mutex_unlock(&dev->lock);
+
+        int rc = block_stripe_io(&dev->s, member, write, buf, len, pos);
+        int error = (rc == -1) ? errno : 0;
+
+        pthread_mutex_lock(&dev->lock);
+        if (error && !dev->error)
+            dev->error = error;
+        if (--dev->busy == 0)
+            pthread_cond_signal(&dev->done_cv);
+    }
+    return NULL;
+}
+
+static void stripe_start_workers(struct stripe_dev *dev)
+{
+    if (dev->s.nmembers == 1)
+        return;
+
+    for (unsigned m = 0; m < dev->s.nmembers; m++) {
+        struct stripe_worker_arg *wa = malloc(sizeof(*wa));
+        if (wa == NULL)
+            err(1, "malloc");
+        wa->dev = dev;
+        wa->member = m;
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, stripe_worker_fn, wa) != 0)
+            errx(1, "Could not create stripe worker thread");
+        pthread_detach(thread);
+    }
+    /*
+     * As for the net I/O thread, wait for all workers to be fully initialized
+     * before hvt_drop_privileges() restricts the available syscalls.
+     */
+    pthread_mutex_lock(&dev->lock);
+    while (dev->ready != dev->s.nmembers)
+        pthread_cond_wait(&dev->done_cv, &dev->lock);
+    pthread_mutex_unlock(&dev->lock);
+}
+
+/*
+ * Transfer (len) bytes at (pos) to or from the striped block device (dev).
+ * Returns 0 on success, -1 on error with errno set.
+ */
+static int stripe_io(struct stripe_dev *dev, bool write, void *buf, size_t len,
+                     off_t pos)
+{
+    bool span;
+    unsigned member = block_stripe_member(&dev->s, pos, len, &span);
+
+    if (!span)
+        return block_stripe_io(&dev->s, member, write, buf, len, pos);
+
+    /*
+     * Only one fanned-out request can be in flight at a time; asynchronous
+     * requests may be issued from several threads.
+     */
+    pthread_mutex_lock(&dev->fanout_lock);
+    pthread_mutex_lock(&dev->lock);
+    dev->write = write;
+    dev->buf = buf;
+    dev->len = len;
+    dev->pos = pos;
+    dev->error = 0;
+    dev->busy = dev->s.nmembers;
+    dev->gen++;
+    pthread_cond_broadcast(&dev->work_cv);
+    while (dev->busy != 0)
+        pthread_cond_wait(&dev->done_cv, &dev->lock);
+    int error = dev->error;
+    pthread_mutex_unlock(&dev->lock);
+    pthread_mutex_unlock(&dev->fanout_lock);
+
+    if (error) {
+        errno = error;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Transfer (len) bytes between (buf) and the block device at manifest index
+ * (index), starting at (pos). Returns 0 on success, -1 on error with errno
+ * set.
+ */
+static int block_io(unsigned index, bool write, void *buf, size_t len,
+                    off_t pos)
+{
+    if (stripe_devs[index] != NULL)
+        return stripe_io(stripe_devs[index], write, buf, len, pos);
+
+    int fd = host_mft->e[index].b.hostfd;
+    ssize_t ret = write ? pwrite(fd, buf, len, pos) : pread(fd, buf, len, pos);
+    if (ret == -1)
+        return -1;
+    if ((size_t)ret != len) {
+        errno = EIO;
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Returns true if a request of (len) bytes at (offset) lies within the
+ * capacity of the block device (e).
+ */
+static bool valid_request(const struct mft_entry *e, uint64_t offset,
+                          size_t len)
+{
+    off_t end;
+
+    if (len > SSIZE_MAX || offset >= e->u.block_basic.capacity)
+        return false;
+    if (add_overflow((off_t)offset, len, end) ||
+        (end > (off_t)e->u.block_basic.capacity))
+        return false;
+    return true;
+}
+
+/*
+ * Asynchronous requests (HVT_HYPERCALL_BLOCK_SUBMIT). Submitted requests are
+ * queued on a single queue serviced by a pool of worker threads, so that up
+ * to ASYNC_WORKERS requests are issued to the host in parallel. Completions
+ * are queued per device until reaped by the guest; the read end of the
+ * device's notify pipe is registered in the waitset and is readable while
+ * completions are pending.
+ */
+#define ASYNC_WORKERS 4
+
+struct async_req {
+    unsigned index;
+    bool write;
+    void *buf;
+    size_t len;
+    off_t pos;
+    uint64_t tag;
+};
+
+struct async_dev {
+    unsigned outstanding; /* submitted but not yet reaped */
+    struct hvt_block_completion done[HVT_BLOCK_QUEUE_DEPTH];
+    unsigned done_head;
+    unsigned ndone;
+    int notify[2];
+};
+
+static struct async_dev async_devs[MFT_MAX_ENTRIES];
+static pthread_mutex_t async_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t async_cv = PTHREAD_COND_INITIALIZER;
+static struct async_req async_queue[MFT_MAX_ENTRIES * HVT_BLOCK_QUEUE_DEPTH];
+#define ASYNC_QUEUE_SIZE (sizeof async_queue / sizeof async_queue[0])
+static unsigned async_queue_head, async_queue_len;
+static unsigned async_workers_ready;
+
+static void *async_worker_fn(void *arg)
+{
+    (void)arg;
+
+    hvt_core_thread_start(HVT_THREAD_IO);
+    pthread_mutex_lock(&async_lock);
+    async_workers_ready++;
+    pthread_cond_broadcast(&async_cv);
+    while (1) {
+        while (async_queue_len == 0)
+            pthread_cond_wait(&async_cv, &async_lock);
+        struct async_req req = async_queue[async_queue_head];
+        async_queue_head = (async_queue_head + 1) % ASYNC_QUEUE_SIZE;
+        async_queue_len--;
+        pthread_mutex_unlock(&async_lock);
+
+        block_throttle(req.index, req.len);
+        /*
+         * As for synchronous requests, host I/O errors are fatal.
+         */
+        if (block_io(req.index, req.write, req.buf, req.len, req.pos) == -1)
+            err(1, "%." XSTR(MFT_NAME_MAX) "s: Fatal error when %s",
+                host_mft->e[req.index].name,
+                req.write ? "writing" : "reading");
+
+        pthread_mutex_lock(&async_lock);
+        struct async_dev *dev = &async_devs[req.index];
+        assert(dev->ndone < HVT_BLOCK_QUEUE_DEPTH);
+        struct hvt_block_completion *c =
+            &dev->done[(dev->done_head + dev->ndone) % HVT_BLOCK_QUEUE_DEPTH];
+        c->tag = req.tag;
+        c->ret = SOLO5_R_OK;
+        if (dev->ndone++ == 0) {
+            uint8_t byte = 1;
+            (void)!write(dev->notify[1], &byte, 1);
+        }
+    }
+    return NULL;
+}
+
+/*
+ * Requests submitted but not yet reaped, for hvt_core_inflight.
+ */
+static unsigned async_inflight(void)
+{
+    unsigned n = 0;
+
+    pthread_mutex_lock(&async_lock);
+    for (unsigned i = 0; i != host_mft->entries; i++)
+        n += async_devs[i].outstanding;
+    pthread_mutex_unlock(&async_lock);
+    return n;
+}
+
+static void async_start_workers(void)
+{
+    for (unsigned i = 0; i < ASYNC_WORKERS; i++) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, async_worker_fn, NULL) != 0)
+            errx(1, "Could not create block worker thread");
+        pthread_detach(thread);
+    }
+    /* See stripe_start_workers(). */
+    pthread_mutex_lock(&async_lock);
+    while (async_workers_ready != ASYNC_WORKERS)
+        pthread_cond_wait(&async_cv, &async_lock);
+    pthread_mutex_unlock(&async_lock);
+}
+
+static void hypercall_block_submit(struct hvt *hvt, hvt_gpa_t gpa)
+{
+    struct hvt_hc_block_submit *sb =
+        HVT_CHECKED_GPA_P(hvt, gpa, sizeof(struct hvt_hc_block_submit));
+    const struct mft_entry *e =
+        mft_get_by_index(host_mft, sb->handle, MFT_DEV_BLOCK_BASIC);
+    if (e == NULL || !e->attached ||
+        (sb->op != HVT_BLOCK_OP_READ && sb->op != HVT_BLOCK_OP_WRITE) ||
+        !valid_request(e, sb->offset, sb->len)) {
+        sb->ret = SOLO5_R_EINVAL;
+        return;
+    }
+
+    struct async_dev *dev = &async_devs[sb->handle];
+    struct async_req req = {
+        .index = sb->handle,
+        .write = (sb->op == HVT_BLOCK_OP_WRITE),
+        .buf = HVT_CHECKED_GPA_P(hvt, sb->data, sb->len),
+        .len = sb->len,
+        .pos = sb->offset,
+        .tag = sb->tag,
+    };
+
+    pthread_mutex_lock(&async_lock);
+    if (dev->outstanding == HVT_BLOCK_QUEUE_DEPTH) {
+        pthread_mutex_unlock(&async_lock);
+        sb->ret = SOLO5_R_AGAIN;
+        return;
+    }
+    dev->outstanding++;
+    assert(async_queue_len < ASYNC_QUEUE_SIZE);
+    async_queue[(async_queue_head + async_queue_len) % ASYNC_QUEUE_SIZE] = req;
+    async_queue_len++;
+    pthread_cond_signal(&async_cv);
+    pthread_mutex_unlock(&async_lock);
+    sb->ret = SOLO5_R_OK;
+}
+
+static void hypercall_block_reap(struct hvt *hvt, hvt_gpa_t gpa)
+{
+    struct hvt_hc_block_reap *rp =
+        HVT_CHECKED_GPA_P(hvt, gpa, sizeof(struct hvt_hc_block_reap));
+    const struct mft_entry *e =
+        mft_get_by_index(host_mft, rp->handle, MFT_DEV_BLOCK_BASIC);
+    if (e == NULL || !e->attached) {
+        rp->ret = SOLO5_R_EINVAL;
+        return;
+    }
+
+    size_t count = rp->count;
+    if (count > HVT_BLOCK_QUEUE_DEPTH)
+        count = HVT_BLOCK_QUEUE_DEPTH;
+    struct hvt_block_completion *out = HVT_CHECKED_GPA_P(
+        hvt, rp->completions, count * sizeof(struct hvt_block_completion));
+    struct async_dev *dev = &async_devs[rp->handle];
+    size_t n = 0;
+
+    pthread_mutex_lock(&async_lock);
+    while (n < count && dev->ndone > 0) {
+        out[n++] = dev->done[dev->done_head];
+        dev->done_head = (dev->done_head + 1) % HVT_BLOCK_QUEUE_DEPTH;
+        dev->ndone--;
+        dev->outstanding--;
+    }
+    if (n > 0 && dev->ndone == 0) {
+        uint8_t byte;
+        (void)!read(dev->notify[0], &byte, 1);
+    }
+    pthread_mutex_unlock(&async_lock);
+
+    rp->reaped = n;
+    rp->ret = (n > 0) ? SOLO5_R_OK : SOLO5_R_AGAIN;
+}
+
 static void hypercall_block_write(struct hvt *hvt, hvt_gpa_t gpa)
 {
     struct hvt_hc_block_write *wr =
@@ -56,16 +457,22 @@ static void hypercall_block_write(struct hvt *hvt, hvt_gpa_t gpa)
     }
 
     ssize_t ret;
-    off_t pos, end;
+    off_t pos;
 
-    if (wr->len > SSIZE_MAX || wr->offset >= e->u.block_basic.capacity) {
+    if (!valid_request(e, wr->offset, wr->len)) {
         wr->ret = SOLO5_R_EINVAL;
         return;
     }
     pos = wr->offset;
-    if (add_overflow(pos, wr->len, end) ||
-        (end > (off_t)e->u.block_basic.capacity)) {
-        wr->ret = SOLO5_R_EINVAL;
+
+    block_throttle(wr->handle, wr->len);
+
+    if (stripe_devs[wr->handle] != NULL) {
+        if (stripe_io(stripe_devs[wr->handle], true,
+                      HVT_CHECKED_GPA_P(hvt, wr->data, wr->len), wr->len,
+                      pos) == -1)
+            err(1, "Fatal error when writing to striped device");
+        wr->ret = SOLO5_R_OK;
         return;
     }
 
@@ -94,16 +501,22 @@ static void hypercall_block_read(struct hvt *hvt, hvt_gpa_t gpa)
     }
 
     ssize_t ret;
-    off_t pos, end;
+    off_t pos;
 
-    if (rd->len > SSIZE_MAX || rd->offset >= e->u.block_basic.capacity) {
+    if (!valid_request(e, rd->offset, rd->len)) {
         rd->ret = SOLO5_R_EINVAL;
         return;
     }
     pos = rd->offset;
-    if (add_overflow(pos, rd->len, end) ||
-        (end > (off_t)e->u.block_basic.capacity)) {
-        rd->ret = SOLO5_R_EINVAL;
+
+    block_throttle(rd->handle, rd->len);
+
+    if (stripe_devs[rd->handle] != NULL) {
+        if (stripe_io(stripe_devs[rd->handle], false,
+                      HVT_CHECKED_GPA_P(hvt, rd->data, rd->len), rd->len,
+                      pos) == -1)
+            err(1, "Fatal error when reading from striped device");
+        rd->ret = SOLO5_R_OK;
         return;
     }
 
@@ -122,18 +535,28 @@ static void hypercall_block_read(struct hvt *hvt, hvt_gpa_t gpa)
 
 #define BLOCK_PREFIX             "--block:"
 #define BLOCK_SECTOR_SIZE_PREFIX "--block-sector-size:"
+#define BLOCK_IOPS_PREFIX        "--block-iops:"
+#define BLOCK_BW_PREFIX          "--block-bw:"
 
 static int handle_cmdarg(char *cmdarg, struct mft *mft)
 {
     enum {
         opt_block,
         opt_block_size,
+        opt_block_iops,
+        opt_block_bw,
     } which;
     if (strncmp(BLOCK_PREFIX, cmdarg, sizeof(BLOCK_PREFIX) - 1) == 0)
         which = opt_block;
     else if (strncmp(BLOCK_SECTOR_SIZE_PREFIX, cmdarg,
                      sizeof(BLOCK_SECTOR_SIZE_PREFIX) - 1) == 0)
         which = opt_block_size;
+    else if (strncmp(BLOCK_IOPS_PREFIX, cmdarg,
+                     sizeof(BLOCK_IOPS_PREFIX) - 1) == 0)
+        which = opt_block_iops;
+    else if (strncmp(BLOCK_BW_PREFIX, cmdarg, sizeof(BLOCK_BW_PREFIX) - 1) ==
+             0)
+        which = opt_block_bw;
     else
         return -1;
 
@@ -148,14 +571,30 @@ static int handle_cmdarg(char *cmdarg, struct mft *mft)
         if (rc != 2)
             return -1;
 
+        unsigned index;
         struct mft_entry *e =
-            mft_get_by_name(mft, name, MFT_DEV_BLOCK_BASIC, NULL);
+            mft_get_by_name(mft, name, MFT_DEV_BLOCK_BASIC, &index);
         if (e == NULL) {
             warnx("Resource not declared in manifest: '%s'", name);
             return -1;
         }
         off_t capacity;
-        int fd = block_attach(path, &capacity);
+        int fd;
+        if (strncmp(BLOCK_STRIPE_PREFIX, path,
+                    sizeof(BLOCK_STRIPE_PREFIX) - 1) == 0) {
+            struct stripe_dev *dev = calloc(1, sizeof(*dev));
+            if (dev == NULL)
+                err(1, "calloc");
+            block_attach_stripe(path + sizeof(BLOCK_STRIPE_PREFIX) - 1,
+                                &dev->s, &capacity);
+            pthread_mutex_init(&dev->lock, NULL);
+            pthread_mutex_init(&dev->fanout_lock, NULL);
+            pthread_cond_init(&dev->work_cv, NULL);
+            pthread_cond_init(&dev->done_cv, NULL);
+            stripe_devs[index] = dev;
+            fd = -1; /* I/O goes through stripe_devs[index] */
+        } else
+            fd = block_attach(path, &capacity);
         /* e->u.block_basic.block_size is set either by option or generated
          * later by setup().
          */
@@ -185,6 +624,32 @@ static int handle_cmdarg(char *cmdarg, struct mft *mft)
             return -1;
         }
         e->u.block_basic.block_size = block_size;
+    } else if (which == opt_block_iops || which == opt_block_bw) {
+        const char *prefix =
+            (which == opt_block_iops) ? BLOCK_IOPS_PREFIX : BLOCK_BW_PREFIX;
+        char spec[32];
+        int rc = sscanf(cmdarg + strlen(prefix),
+                        "%" XSTR(MFT_NAME_MAX) "[A-Za-z0-9]=%31s", name, spec);
+        if (rc != 2)
+            return -1;
+        uint64_t rate;
+        if (rate_limit_parse(spec, &rate) == -1) {
+            warnx("%s: Invalid limit: '%s'", name, spec);
+            return -1;
+        }
+
+        unsigned index;
+        struct mft_entry *e =
+            mft_get_by_name(mft, name, MFT_DEV_BLOCK_BASIC, &index);
+        if (e == NULL) {
+            warnx("Resource not declared in manifest: '%s'", name);
+            return -1;
+        }
+        if (which == opt_block_iops)
+            rate_limit_init(&iops_limits[index], rate);
+        else
+            rate_limit_init(&bw_limits[index], rate);
+        limits_in_use = true;
     }
 
     return 0;
@@ -200,6 +665,10 @@ static int setup(struct hvt *hvt, struct mft *mft)
                                        hypercall_block_write) == 0);
     assert(hvt_core_register_hypercall(HVT_HYPERCALL_BLOCK_READ,
                                        hypercall_block_read) == 0);
+    assert(hvt_core_register_hypercall(HVT_HYPERCALL_BLOCK_SUBMIT,
+                                       hypercall_block_submit) == 0);
+    assert(hvt_core_register_hypercall(HVT_HYPERCALL_BLOCK_REAP,
+                                       hypercall_block_reap) == 0);
 
     for (unsigned i = 0; i != mft->entries; i++) {
         if (mft->e[i].type != MFT_DEV_BLOCK_BASIC || !mft->e[i].attached)
@@ -228,6 +697,22 @@ static int setup(struct hvt *hvt, struct mft *mft)
                                          "1 block (%hu bytes) "
                                          "in size",
                  name, block_size);
+
+        if (stripe_devs[i] != NULL)
+            stripe_start_workers(stripe_devs[i]);
+
+        if (pipe2(async_devs[i].notify, O_NONBLOCK | O_CLOEXEC) == -1)
+            err(1, "pipe2() failed");
+        assert(hvt_core_register_pollfd(async_devs[i].notify[0], i) == 0);
+    }
+    async_start_workers();
+    hvt_core_inflight = async_inflight;
+
+    if (limits_in_use) {
+        assert(hvt_core_register_halt_hook(print_limit_stats) == 0);
+#if defined(__linux__)
+        hvt_core_seccomp_allow |= HVT_SECCOMP_ALLOW_SLEEP;
+#endif
     }
 
 #if HVT_FREEBSD_ENABLE_CAPSICUM
@@ -244,9 +729,16 @@ static const char *usage(void)
 {
     return "--block:NAME=PATH (attach block device/file at PATH as block "
            "storage NAME)\n"
+           "  [ --block:NAME=stripe:UNIT:PATH,PATH[,...] ] (attach the "
+           "block devices/files at PATHs striped in units of UNIT bytes as "
+           "block storage NAME)\n"
            "  [ --block-sector-size:NAME=SECTORSIZE ] (set sector size for "
            "block device NAME; must be a power of two greater than or equal "
-           "512)";
+           "512)\n"
+           "  [ --block-iops:NAME=N ] (limit block device NAME to N requests "
+           "per second)\n"
+           "  [ --block-bw:NAME=RATE[K|M|G] ] (limit block device NAME to "
+           "RATE bytes per second)";
 }
 
 DECLARE_MODULE(block, .setup = setup, .handle_cmdarg = handle_cmdarg,
@@ -0,0 +1,210 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * hvt_module_boottrace.c: Reporting of startup phase timestamps.
+ *
+ * The tender timestamps its own startup phases (see enum hvt_trace_phase in
+ * hvt.h). With --boot-trace, the guest is additionally given an area in which
+ * to record the CPU cycle counter on entry to its startup phases (see enum
+ * hvt_boot_phase in hvt_abi.h). When the guest halts, both are reported as
+ * "NAME ns=N mono_ns=M" lines, one per phase reached, where N is the time
+ * since the tender entered main() and M the absolute CLOCK_MONOTONIC time,
+ * followed by a "tender.rss max_kb=N" line giving the peak resident set size
+ * of the tender, which includes all guest memory touched.
+ *
+ * Guest cycle counts are converted by reading the guest's cycle counter at
+ * halt time, relying on it advancing at (hvt->cpu_cycle_freq) in step with
+ * the host monotonic clock.
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#include <linux/kvm.h>
+
+#include "hvt.h"
+#include "hvt_kvm.h"
+
+static int trace_fd = 2;
+
+static const char *tender_names[HVT_TRACE_MAX] = {
+    [HVT_TRACE_MAIN] = "tender.main",
+    [HVT_TRACE_ELF_LOAD_NOTE] = "tender.elf_load_note",
+    [HVT_TRACE_HVT_INIT] = "tender.hvt_init",
+    [HVT_TRACE_ELF_LOAD] = "tender.elf_load",
+    [HVT_TRACE_VCPU_INIT] = "tender.hvt_vcpu_init",
+    [HVT_TRACE_SETUP_MODULES] = "tender.setup_modules",
+    [HVT_TRACE_VCPU_RUN] = "tender.vcpu_run",
+};
+
+static const char *guest_names[HVT_BOOT_MAX] = {
+    [HVT_BOOT_START] = "guest._start",
+    [HVT_BOOT_MEM_INIT] = "guest.mem_init",
+    [HVT_BOOT_NET_INIT] = "guest.net_init",
+    [HVT_BOOT_APP_MAIN] = "guest.solo5_app_main",
+};
+
+#if defined(__x86_64__)
+#define MSR_IA32_TSC 0x10
+
+static int guest_cycles(struct hvt *hvt, uint64_t *cycles)
+{
+    struct {
+        struct kvm_msrs hdr;
+        struct kvm_msr_entry entry;
+    } msrs = {.hdr.nmsrs = 1, .entry.index = MSR_IA32_TSC};
+
+    if (ioctl(hvt->b->vcpufd, KVM_GET_MSRS, &msrs) != 1)
+        return -1;
+    *cycles = msrs.entry.data;
+    return 0;
+}
+#elif defined(__aarch64__)
+static int guest_cycles(struct hvt *hvt, uint64_t *cycles)
+{
+    struct kvm_one_reg reg = {.id = KVM_REG_ARM_TIMER_CNT,
+                              .addr = (uint64_t)cycles};
+
+    return ioctl(hvt->b->vcpufd, KVM_GET_ONE_REG, &reg);
+}
+#else
+#error Unsupported target
+#endif
+
+/*
+ * The report is formatted into a static buffer, since it is generated after
+ * hvt_drop_privileges().
+ */
+static char report[2048];
+static size_t report_len;
+
+static void report_line(const char *name, uint64_t mono_ns)
+{
+    int rc = snprintf(report + report_len, sizeof report - report_len,
+                      "%s ns=%" PRIu64 " mono_ns=%" PRIu64 "\n", name,
+                      mono_ns - hvt_boot_trace_ns[HVT_TRACE_MAIN], mono_ns);
+    if (rc > 0 && (size_t)rc < sizeof report - report_len)
+        report_len += rc;
+}
+
+static void halt_hook(struct hvt *hvt, int status, void *cookie)
+{
+    (void)status;
+    (void)cookie;
+
+    uint64_t now_ns = hvt_stats_clock();
+    uint64_t now_cycles;
+    if (guest_cycles(hvt, &now_cycles) == -1) {
+        warn("boot-trace: Could not read guest cycle counter");
+        now_cycles = 0;
+    }
+
+    report_len = 0;
+    for (int i = 0; i < HVT_TRACE_MAX; i++) {
+        if (hvt_boot_trace_ns[i] != 0)
+            report_line(tender_names[i], hvt_boot_trace_ns[i]);
+    }
+    /*
+     * The area lies above (guest_mem_size), see hvt_boot_trace_reserve().
+     */
+    const uint64_t *trace = (const uint64_t *)(hvt->mem + hvt->boot_trace);
+    for (int i = 0; i < HVT_BOOT_MAX; i++) {
+        if (trace[i] == 0 || now_cycles < trace[i])
+            continue;
+        double ns = (double)(now_cycles - trace[i]) * 1e9 /
+                    (double)hvt->cpu_cycle_freq;
+        report_line(guest_names[i], now_ns - (uint64_t)ns);
+    }
+    struct rusage ru;
+    if (getrusage(RUSAGE_SELF, &ru) == 0) {
+        int rc = snprintf(report + report_len, sizeof report - report_len,
+                          "tender.rss max_kb=%ld\n", ru.ru_maxrss);
+        if (rc > 0 && (size_t)rc < sizeof report - report_len)
+            report_len += rc;
+    }
+
+    const char *p = report;
+    while (report_len > 0) {
+        ssize_t n = write(trace_fd, p, report_len);
+        if (n == -1 && errno == EINTR)
+            continue;
+        if (n <= 0)
+            break;
+        p += n;
+        report_len -= n;
+    }
+}
+
+static int handle_cmdarg(char *cmdarg, struct mft *mft)
+{
+    (void)mft;
+    char *end;
+
+    if (strcmp("--boot-trace", cmdarg) == 0) {
+        hvt_boot_trace_enabled = true;
+        return 0;
+    } else if (strncmp("--boot-trace-fd=", cmdarg, 16) == 0) {
+        long fd = strtol(cmdarg + 16, &end, 10);
+        if (*end != '\0' || fd < 0 || fd > INT32_MAX)
+            return -1;
+        trace_fd = fd;
+        hvt_boot_trace_enabled = true;
+        return 0;
+    }
+    return -1;
+}
+
+static const char *usage(void)
+{
+    return "--boot-trace (report startup phase timestamps on exit)\n"
+           "  [ --boot-trace-fd=FD ] (write the report to FD instead of "
+           "stderr)";
+}
+
+static int setup(struct hvt *hvt, struct mft *mft)
+{
+    (void)hvt;
+    (void)mft;
+
+    if (!hvt_boot_trace_enabled)
+        return 0; /* Not present */
+
+    if (hvt_core_restore != NULL)
+        errx(1, "boot-trace: Cannot trace the startup of a restored guest");
+
+    struct stat sb;
+    if (fstat(trace_fd, &sb) == -1)
+        err(1, "boot-trace: Invalid file descriptor: %d", trace_fd);
+
+    hvt_core_seccomp_allow |= HVT_SECCOMP_ALLOW_RUSAGE;
+    return hvt_core_register_halt_hook(halt_hook);
+}
+
+DECLARE_MODULE(boottrace, .setup = setup, .handle_cmdarg = handle_cmdarg,
+               .usage = usage)
@@ -0,0 +1,236 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * hvt_module_cpu.c: Placement and scheduling of the tender's threads.
+ *
+ * --vcpu-cpu pins the thread running the vCPU, and --io-cpus the I/O threads
+ * started by the net and block modules, to the given host CPUs. --sched sets
+ * the scheduling policy of all of these. The guest and the net I/O thread
+ * both spin waiting for each other (see hvt_module_net.c), so they are not
+ * allowed to share a CPU.
+ *
+ * --dedicated-cpu additionally tells KVM that the vCPU has its CPU to itself,
+ * so that the guest spinning with PAUSE, or halting, does not exit to the host
+ * to let something else run (see hvt_core_disable_exits).
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "hvt.h"
+#include "../common/cpu_list.h"
+
+static int vcpu_cpu = -1;
+static bool io_cpus_opt;
+static bool io_cpus_siblings;
+static cpu_set_t io_cpus;
+static int sched_policy = -1;
+static int sched_priority;
+static bool dedicated_cpu;
+
+/*
+ * Replace (io_cpus) with the hyperthread siblings of (vcpu_cpu), i.e. the
+ * other CPUs sharing its core.
+ */
+static void resolve_siblings(void)
+{
+    if (vcpu_cpu == -1)
+        errx(1, "cpu: --io-cpus=siblings requires --vcpu-cpu");
+
+    char path[64];
+    snprintf(path, sizeof path,
+             "/sys/devices/system/cpu/cpu%d/topology/thread_siblings_list",
+             vcpu_cpu);
+    cpu_list_read("cpu", path, &io_cpus);
+    CPU_CLR(vcpu_cpu, &io_cpus);
+    if (CPU_COUNT(&io_cpus) == 0)
+        errx(1, "cpu: CPU %d has no hyperthread siblings", vcpu_cpu);
+}
+
+/*
+ * Check the options given against each other and the host. Called once, by
+ * the first thread to be placed, as I/O threads are started during module
+ * setup in no particular order with respect to this module.
+ */
+static void validate(void)
+{
+    if (io_cpus_siblings)
+        resolve_siblings();
+
+    cpu_set_t allowed;
+    if (sched_getaffinity(0, sizeof allowed, &allowed) == -1)
+        err(1, "cpu: sched_getaffinity() failed");
+    if (vcpu_cpu != -1 && !CPU_ISSET(vcpu_cpu, &allowed))
+        errx(1, "cpu: --vcpu-cpu: CPU %d is not available", vcpu_cpu);
+    if (io_cpus_opt) {
+        for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+            if (CPU_ISSET(cpu, &io_cpus) && !CPU_ISSET(cpu, &allowed))
+                errx(1, "cpu: --io-cpus: CPU %d is not available", cpu);
+        }
+    }
+
+    /*
+     * If the guest and the net I/O thread were to share a CPU, each would
+     * spin waiting for the other while holding it. Under a real-time policy
+     * this never resolves, so also require the placement to be explicit.
+     */
+    if (vcpu_cpu != -1 && io_cpus_opt && CPU_ISSET(vcpu_cpu, &io_cpus))
+        errx(1, "cpu: The vCPU (CPU %d) must not share a CPU with the I/O "
+                "threads",
+             vcpu_cpu);
+    if (sched_policy != -1 && (vcpu_cpu == -1 || !io_cpus_opt))
+        errx(1, "cpu: --sched requires --vcpu-cpu and --io-cpus");
+
+    /*
+     * With PAUSE exits disabled, a spinning guest no longer yields its CPU to
+     * other threads of the host, which should be kept off it (isolcpus=).
+     */
+    if (dedicated_cpu) {
+        if (vcpu_cpu == -1)
+            errx(1, "cpu: --dedicated-cpu requires --vcpu-cpu");
+        cpu_set_t isolated;
+        CPU_ZERO(&isolated);
+        FILE *f = fopen("/sys/devices/system/cpu/isolated", "r");
+        char list[1024];
+        if (f != NULL && fgets(list, sizeof list, f) != NULL) {
+            list[strcspn(list, "\n")] = '\0';
+            if (list[0] != '\0' && cpu_list_parse(list, &isolated) == -1)
+                CPU_ZERO(&isolated);
+        }
+        if (f != NULL)
+            fclose(f);
+        if (!CPU_ISSET(vcpu_cpu, &isolated))
+            warnx("cpu: --dedicated-cpu: CPU %d is not isolated from the host "
+                  "scheduler (isolcpus=)", vcpu_cpu);
+    }
+}
+
+static pthread_once_t validate_once = PTHREAD_ONCE_INIT;
+
+static void thread_hook(enum hvt_thread_kind kind)
+{
+    const char *name = (kind == HVT_THREAD_VCPU) ? "vCPU" : "I/O";
+    int rc;
+
+    pthread_once(&validate_once, validate);
+
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (kind == HVT_THREAD_VCPU && vcpu_cpu != -1)
+        CPU_SET(vcpu_cpu, &set);
+    else if (kind == HVT_THREAD_IO && io_cpus_opt)
+        set = io_cpus;
+    if (CPU_COUNT(&set) > 0) {
+        rc = pthread_setaffinity_np(pthread_self(), sizeof set, &set);
+        if (rc != 0) {
+            errno = rc;
+            err(1, "cpu: Could not set CPU affinity of %s thread", name);
+        }
+    }
+
+    if (sched_policy != -1) {
+        struct sched_param sp = {.sched_priority = sched_priority};
+        rc = pthread_setschedparam(pthread_self(), sched_policy, &sp);
+        if (rc != 0) {
+            errno = rc;
+            err(1, "cpu: Could not set scheduling policy of %s thread", name);
+        }
+    }
+}
+
+static int handle_cmdarg(char *cmdarg, struct mft *mft)
+{
+    (void)mft;
+    char *end;
+
+    if (strncmp("--vcpu-cpu=", cmdarg, 11) == 0) {
+        unsigned long cpu = strtoul(cmdarg + 11, &end, 10);
+        if (end == cmdarg + 11 || *end != '\0' || cpu >= CPU_SETSIZE)
+            return -1;
+        vcpu_cpu = cpu;
+    } else if (strncmp("--io-cpus=", cmdarg, 10) == 0) {
+        if (strcmp(cmdarg + 10, "siblings") == 0)
+            io_cpus_siblings = true;
+        else if (cpu_list_parse(cmdarg + 10, &io_cpus) == -1)
+            return -1;
+        io_cpus_opt = true;
+    } else if (strncmp("--sched=", cmdarg, 8) == 0) {
+        const char *spec = cmdarg + 8;
+        if (strncmp("fifo:", spec, 5) == 0)
+            sched_policy = SCHED_FIFO;
+        else if (strncmp("rr:", spec, 3) == 0)
+            sched_policy = SCHED_RR;
+        else
+            return -1;
+        spec = strchr(spec, ':') + 1;
+        long prio = strtol(spec, &end, 10);
+        if (end == spec || *end != '\0' ||
+            prio < sched_get_priority_min(sched_policy) ||
+            prio > sched_get_priority_max(sched_policy))
+            return -1;
+        sched_priority = prio;
+    } else if (strcmp("--dedicated-cpu", cmdarg) == 0 ||
+               strcmp("--dedicated-cpu=hlt", cmdarg) == 0) {
+#if defined(__x86_64__)
+        dedicated_cpu = true;
+        hvt_core_disable_exits |= HVT_DISABLE_EXITS_PAUSE;
+        if (cmdarg[15] == '=')
+            hvt_core_disable_exits |= HVT_DISABLE_EXITS_HLT;
+#else
+        warnx("cpu: --dedicated-cpu is only supported on x86_64");
+        return -1;
+#endif
+    } else {
+        return -1;
+    }
+
+    hvt_core_thread_hook = thread_hook;
+    return 0;
+}
+
+static const char *usage(void)
+{
+    return "--vcpu-cpu=N (run the vCPU on host CPU N)\n"
+           "  [ --io-cpus=LIST | siblings ] (run I/O threads on the host CPUs "
+           "in LIST, e.g. 2-3,6, or on the hyperthread siblings of the vCPU)\n"
+           "  [ --sched=fifo:PRIO | rr:PRIO ] (run the vCPU and I/O threads "
+           "with a real-time scheduling policy)\n"
+           "  [ --dedicated-cpu[=hlt] ] (the vCPU's CPU is isolated, do not "
+           "exit on PAUSE, or also HLT)";
+}
+
+static int setup(struct hvt *hvt, struct mft *mft)
+{
+    (void)hvt;
+    (void)mft;
+
+    /* See validate(). */
+    return 0;
+}
+
+DECLARE_MODULE(cpu, .setup = setup, .handle_cmdarg = handle_cmdarg,
+               .usage = usage)
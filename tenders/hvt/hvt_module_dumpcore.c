@@ -39,6 +39,9 @@
 #include <assert.h>
 #include <stdio.h>
 #include <sys/uio.h>
+#include <sys/wait.h>
+#include <inttypes.h>
+#include <signal.h>
 
 #include "hvt.h"
 
@@ -84,13 +87,194 @@ typedef unsigned char *host_mvec_t;
 static char *dumpcoredir;
 static int dir;
 
+/*
+ * Regions of guest memory which can be selected with regions=, in ascending
+ * address order. The boundaries are determined at dump time, see
+ * dump_ranges().
+ */
+#define REGION_BOOT  (1U << 0) /* Below the unikernel: boot info, cmdline */
+#define REGION_IMAGE (1U << 1) /* Unikernel text, data and bss */
+#define REGION_HEAP  (1U << 2) /* From the end of the unikernel to the stack */
+#define REGION_STACK (1U << 3) /* From the stack pointer to the top */
+#define REGION_ALL   (REGION_BOOT | REGION_IMAGE | REGION_HEAP | REGION_STACK)
+#define REGION_MAX   4
+
+static const char *region_names[REGION_MAX] = {"boot", "image", "heap",
+                                               "stack"};
+static unsigned dump_regions = REGION_ALL;
+
+/*
+ * Compressors which the core file can be streamed through, run with their
+ * fastest settings so as not to delay restarting the tender.
+ */
+struct compressor {
+    const char *name;
+    const char *suffix;
+    const char *argv[5];
+};
+
+static const struct compressor compressors[] = {
+    {"gzip", ".gz", {"gzip", "-1", "-c", NULL}},
+    {"zstd", ".zst", {"zstd", "-1", "-q", "-c", NULL}},
+    {"xz", ".xz", {"xz", "-0", "-c", NULL}},
+    {"lz4", ".lz4", {"lz4", "-1", "-q", "-c", NULL}},
+};
+static const struct compressor *compressor;
+
+struct range {
+    uint64_t start, end;
+};
+
+struct run {
+    uint64_t start, end;
+    unsigned range; /* Index of the range containing this run */
+};
+
+/*
+ * Computes the ranges of guest memory to dump, one per selected region,
+ * merging adjacent ones. Returns the number of ranges stored in (r).
+ */
+static unsigned dump_ranges(struct hvt *hvt, void *cookie, long page_size,
+                            uint64_t *kend, struct range *r)
+{
+    uint64_t top = hvt->guest_mem_size;
+    uint64_t b[REGION_MAX + 1];
+
+    /*
+     * The end of the unikernel is taken from the boot info, which is not
+     * writable by the guest. Clamp it anyway, the guest has crashed.
+     */
+    *kend = HVT_GUEST_MIN_BASE;
+    if (hvt->cpu_boot_info_base != 0 &&
+        hvt->cpu_boot_info_base + sizeof(struct hvt_boot_info) <= top) {
+        struct hvt_boot_info *bi =
+            (struct hvt_boot_info *)(hvt->mem + hvt->cpu_boot_info_base);
+        if (bi->kernel_end > *kend && bi->kernel_end <= top)
+            *kend = (bi->kernel_end + page_size - 1) & ~(page_size - 1);
+    }
+
+    uint64_t sp = *kend;
+    if ((dump_regions & (REGION_HEAP | REGION_STACK)) != 0 &&
+        (dump_regions & (REGION_HEAP | REGION_STACK)) !=
+            (REGION_HEAP | REGION_STACK)) {
+        if (hvt_dumpcore_stack_pointer(hvt, cookie, &sp) == -1)
+            warnx("dumpcore: Could not determine guest stack pointer, "
+                  "treating the heap as part of the stack");
+        sp &= ~(page_size - 1);
+        if (sp < *kend || sp > top)
+            sp = *kend;
+    }
+
+    b[0] = 0;
+    b[1] = HVT_GUEST_MIN_BASE;
+    b[2] = *kend;
+    b[3] = sp;
+    b[4] = top;
+
+    unsigned n = 0;
+    for (unsigned i = 0; i < REGION_MAX; i++) {
+        if ((dump_regions & (1U << i)) == 0 || b[i] >= b[i + 1])
+            continue;
+        if (n > 0 && r[n - 1].end == b[i])
+            r[n - 1].end = b[i + 1];
+        else
+            r[n++] = (struct range){.start = b[i], .end = b[i + 1]};
+    }
+    return n;
+}
+
+static bool page_is_zero(const uint8_t *p, long page_size)
+{
+    const uint64_t *w = (const uint64_t *)p;
+
+    for (size_t i = 0; i < page_size / sizeof *w; i++)
+        if (w[i] != 0)
+            return false;
+    return true;
+}
+
+/*
+ * Merges runs which are separated by at most (gap) bytes. Returns the new
+ * number of runs.
+ */
+static size_t merge_runs(struct run *runs, size_t nruns, uint64_t gap)
+{
+    size_t n = 0;
+
+    for (size_t i = 0; i < nruns; i++) {
+        if (n > 0 && runs[n - 1].range == runs[i].range &&
+            runs[i].start - runs[n - 1].end <= gap)
+            runs[n - 1].end = runs[i].end;
+        else
+            runs[n++] = runs[i];
+    }
+    return n;
+}
+
+static int write_all(int fd, const uint8_t *buf, size_t len, off_t off,
+                     bool stream)
+{
+    while (len > 0) {
+        ssize_t nbytes =
+            stream ? write(fd, buf, len) : pwrite(fd, buf, len, off);
+        if (nbytes == -1 && errno == EINTR)
+            continue;
+        if (nbytes <= 0)
+            return -1;
+        buf += nbytes;
+        len -= nbytes;
+        off += nbytes;
+    }
+    return 0;
+}
+
+/*
+ * Starts (compressor), reading from a pipe and writing to (fd). Returns the
+ * write end of the pipe, or -1 on error.
+ */
+static int start_compressor(int fd, pid_t *pid)
+{
+    int pfd[2];
+
+    if (pipe(pfd) == -1) {
+        warn("dumpcore: pipe() failed");
+        return -1;
+    }
+    *pid = fork();
+    if (*pid == -1) {
+        warn("dumpcore: fork() failed");
+        close(pfd[0]);
+        close(pfd[1]);
+        return -1;
+    }
+    if (*pid == 0) {
+        if (dup2(pfd[0], 0) == -1 || dup2(fd, 1) == -1)
+            _exit(127);
+        close(pfd[0]);
+        close(pfd[1]);
+        close(fd);
+        execvp(compressor->argv[0], (char *const *)(uintptr_t)compressor->argv);
+        warn("dumpcore: Could not run %s", compressor->argv[0]);
+        _exit(127);
+    }
+    close(pfd[0]);
+    /*
+     * If the compressor fails, we want to see an error from write(), not be
+     * killed.
+     */
+    signal(SIGPIPE, SIG_IGN);
+    return pfd[1];
+}
+
 void hvt_dumpcore_hook(struct hvt *hvt, int status, void *cookie)
 {
     if (status != 255) /* SOLO5_EXIT_ABORT */
         return;
 
+    uint64_t t_start = hvt_stats_clock();
     char *filename;
-    assert(asprintf(&filename, "core.solo5-hvt.%d", getpid()) != -1);
+    assert(asprintf(&filename, "core.solo5-hvt.%d%s", getpid(),
+                    compressor ? compressor->suffix : "") != -1);
     /*
      * Note that O_APPEND must not be set as this modifies the behaviour of
      * pwrite() on Linux.
@@ -98,16 +282,104 @@ void hvt_dumpcore_hook(struct hvt *hvt, int status, void *cookie)
     int fd =
         openat(dir, filename, O_WRONLY | O_CREAT | O_EXCL, S_IRUSR | S_IWUSR);
     close(dir);
+    int out = fd;
+    pid_t pid = -1;
+    struct run *runs = NULL;
+    Elf64_Phdr *phdrs = NULL;
+    host_mvec_t mvec = NULL;
     if (fd < 0) {
         warn("dumpcore: open(%s)", filename);
         goto failure;
     }
     warnx("dumpcore: dumping guest core to: %s/%s", dumpcoredir, filename);
 
+    long page_size = sysconf(_SC_PAGESIZE);
+    if (page_size == -1) {
+        warn("dumpcore: Could not determine _SC_PAGESIZE");
+        goto failure;
+    }
+    assert(hvt->guest_mem_size % page_size == 0);
+    size_t npages = hvt->guest_mem_size / page_size;
+
+    struct range ranges[REGION_MAX];
+    uint64_t kend;
+    unsigned nranges = dump_ranges(hvt, cookie, page_size, &kend, ranges);
+
+    /*
+     * Find the runs of pages to dump.
+     *
+     * We use mincore() to get the host kernel's view of which pages have
+     * actually been touched by the guest, and skip those which have not, as
+     * well as those which are all zero. This speeds up the process of writing
+     * out the core file significantly by reducing memory pressure on the host.
+     * Read-only segments of the unikernel may be mapped from its binary (see
+     * elf_load()), so are not necessarily resident, and are always dumped.
+     *
+     * Note that mincore() is definitely not portable, but the "mvec[pg] & 1"
+     * construct should be portable across at least Linux and FreeBSD.
+     */
+    mvec = malloc(npages);
+    assert(mvec);
+    if (mincore(hvt->mem, hvt->guest_mem_size, mvec) == -1) {
+        warn("dumpcore: mincore() failed");
+        goto failure;
+    }
+    size_t nruns = 0, ndumped = 0;
+    runs = malloc(((npages + 1) / 2 + REGION_MAX) * sizeof *runs);
+    assert(runs);
+    for (unsigned i = 0; i < nranges; i++) {
+        for (uint64_t gpa = ranges[i].start; gpa < ranges[i].end;
+             gpa += page_size) {
+            bool present =
+                (mvec[gpa / page_size] & 1) ||
+                (hvt->mem_mappable && gpa >= HVT_GUEST_MIN_BASE && gpa < kend);
+            if (!present || page_is_zero(hvt->mem + gpa, page_size))
+                continue;
+            if (nruns > 0 && runs[nruns - 1].range == i &&
+                runs[nruns - 1].end == gpa)
+                runs[nruns - 1].end += page_size;
+            else
+                runs[nruns++] =
+                    (struct run){.start = gpa, .end = gpa + page_size,
+                                 .range = i};
+            ndumped++;
+        }
+    }
+    free(mvec);
+    mvec = NULL;
+
     /*
      * Core file structure:
      * (1) ELF header with e_type=ET_CORE
+     * (2) PT_NOTE pointing to NT_PRSTATUS descriptor
+     * (3) PT_LOAD(s) pointing to guest memory dump
+     * (4) NT_PRSTATUS descriptor and content
+     * (5) guest memory dump
+     *
+     * A core file written directly is sparse, with one PT_LOAD per range of
+     * guest memory, and pages which are not dumped left as holes which read
+     * as zero.
+     *
+     * A core file streamed through a compressor cannot have holes, so instead
+     * has one PT_LOAD per run of dumped pages; other pages will be
+     * inaccessible in the debugger. To fit the number of program headers in
+     * e_phnum, runs are merged across increasingly large gaps if necessary.
      */
+    bool stream = compressor != NULL;
+    size_t nload = nranges;
+    if (stream) {
+        uint64_t gap = page_size;
+        while (nruns > PN_XNUM - 2) {
+            nruns = merge_runs(runs, nruns, gap);
+            gap *= 2;
+        }
+        nload = nruns;
+    }
+    if (nload > PN_XNUM - 2) {
+        warnx("dumpcore: Too many ranges to dump");
+        goto failure;
+    }
+
     size_t offset = sizeof(Elf64_Ehdr);
     Elf64_Ehdr ehdr = {
         .e_ident = {ELFMAG0, ELFMAG1, ELFMAG2, ELFMAG3, ELFCLASS64, ELFDATA2LSB,
@@ -116,20 +388,21 @@ void hvt_dumpcore_hook(struct hvt *hvt, int status, void *cookie)
         .e_version = EV_CURRENT,
         .e_machine = EM_HOST,
         .e_ehsize = sizeof(Elf64_Ehdr),
-        .e_phnum = 2, /* PT_NOTE, PT_LOAD */
+        .e_phnum = 1 + nload, /* PT_NOTE, PT_LOAD(s) */
         .e_phentsize = sizeof(Elf64_Phdr),
         .e_phoff = offset,
     };
     offset += ehdr.e_phnum * sizeof(Elf64_Phdr);
 
     /*
-     * (2) PT_NOTE pointing to NT_PRSTATUS descriptor
      * name[] must be a multiple of the ELF word size, SVR4 uses "CORE".
      */
     const char name[8] = "CORE";
     size_t pnote_size =
         sizeof(Elf64_Nhdr) + sizeof name + hvt_dumpcore_prstatus_size();
-    Elf64_Phdr pnote = {
+    phdrs = calloc(ehdr.e_phnum, sizeof *phdrs);
+    assert(phdrs);
+    phdrs[0] = (Elf64_Phdr){
         .p_type = PT_NOTE,
         .p_filesz = pnote_size,
         .p_memsz = pnote_size,
@@ -137,115 +410,155 @@ void hvt_dumpcore_hook(struct hvt *hvt, int status, void *cookie)
     };
     offset += pnote_size;
 
-    /*
-     * (3) PT_LOAD pointing to guest memory dump
-     */
-    Elf64_Phdr pload = {.p_type = PT_LOAD,
-                        .p_align = 0,
-                        .p_paddr = 0,
-                        .p_vaddr = 0,
-                        .p_memsz = hvt->guest_mem_size,
-                        .p_filesz = hvt->guest_mem_size,
-                        .p_flags = 0,
-                        .p_offset = offset};
+    off_t range_offset[REGION_MAX];
+    for (size_t i = 0; i < nload; i++) {
+        uint64_t start = stream ? runs[i].start : ranges[i].start;
+        uint64_t end = stream ? runs[i].end : ranges[i].end;
+        phdrs[1 + i] = (Elf64_Phdr){.p_type = PT_LOAD,
+                                    .p_paddr = start,
+                                    .p_vaddr = start,
+                                    .p_memsz = end - start,
+                                    .p_filesz = end - start,
+                                    .p_offset = offset};
+        if (!stream)
+            range_offset[i] = offset;
+        offset += end - start;
+    }
 
-    /*
-     * (4) NT_PRSTATUS descriptor
-     */
     Elf64_Nhdr nhdr = {
         .n_type = NT_PRSTATUS,
         .n_namesz = sizeof name,
         .n_descsz = hvt_dumpcore_prstatus_size(),
     };
 
+    if (stream) {
+        out = start_compressor(fd, &pid);
+        if (out == -1)
+            goto failure;
+    }
     const struct iovec iov[] = {
         {.iov_base = &ehdr, .iov_len = sizeof ehdr},
-        {.iov_base = &pnote, .iov_len = sizeof pnote},
-        {.iov_base = &pload, .iov_len = sizeof pload},
+        {.iov_base = phdrs, .iov_len = ehdr.e_phnum * sizeof *phdrs},
         {.iov_base = &nhdr, .iov_len = sizeof nhdr},
         {.iov_base = (void *)(uintptr_t)name, .iov_len = nhdr.n_namesz}};
-    ssize_t iovlen =
-        sizeof ehdr + sizeof pnote + sizeof pload + sizeof nhdr + nhdr.n_namesz;
-    if (writev(fd, iov, 5) != iovlen) {
+    ssize_t iovlen = sizeof ehdr + ehdr.e_phnum * sizeof *phdrs + sizeof nhdr +
+                     nhdr.n_namesz;
+    if (writev(out, iov, 4) != iovlen) {
         warn("dumpcore: Error writing ELF headers");
         goto failure;
     }
 
-    /*
-     * (5) NT_PRSTATUS content
-     */
-    if (hvt_dumpcore_write_prstatus(fd, hvt, cookie) < 0) {
+    if (hvt_dumpcore_write_prstatus(out, hvt, cookie) < 0) {
         warnx("dumpcore: Could not retrieve guest state");
         goto failure;
     }
 
-    /*
-     * (6) guest memory dump
-     *
-     * We use mincore() to get the host kernel's view of which pages have
-     * actually been touched by the guest. This speeds up the process of writing
-     * out the core file significantly by reducing memory pressure on the host
-     * and writing out a sparse file.
-     *
-     * Note that mincore() is definitely not portable, but the "mvec[pg] & 1"
-     * construct should be portable across at least Linux and FreeBSD.
-     */
-    long page_size = sysconf(_SC_PAGESIZE);
-    if (page_size == -1) {
-        warn("dumpcore: Could not determine _SC_PAGESIZE");
-        goto failure;
-    }
-    assert(hvt->guest_mem_size % page_size == 0);
-    size_t npages = hvt->guest_mem_size / page_size;
-    size_t ndumped = 0;
-    host_mvec_t mvec = malloc(npages);
-    assert(mvec);
-    if (mincore(hvt->mem, hvt->guest_mem_size, mvec) == -1) {
-        warn("dumpcore: mincore() failed");
-        goto failure;
+    for (size_t i = 0; i < nruns; i++) {
+        off_t off = 0;
+        if (!stream)
+            off = range_offset[runs[i].range] +
+                  (runs[i].start - ranges[runs[i].range].start);
+        if (write_all(out, hvt->mem + runs[i].start,
+                      runs[i].end - runs[i].start, off, stream) == -1) {
+            warn("dumpcore: Error dumping guest memory at 0x%" PRIx64,
+                 runs[i].start);
+            goto failure;
+        }
     }
-    off_t start = lseek(fd, 0, SEEK_CUR);
-    for (size_t pg = 0; pg < npages; pg++) {
-        if (mvec[pg] & 1) {
-            off_t pgoff = (pg * page_size);
-            ssize_t nbytes =
-                pwrite(fd, hvt->mem + pgoff, page_size, start + pgoff);
-            if (nbytes == -1) {
-                warn("dumpcore: Error dumping guest memory page %zd", pg);
-                free(mvec);
-                goto failure;
-            } else if (nbytes != page_size) {
-                warnx("dumpcore: Short write dumping guest memory page"
-                      "%zd: %zd bytes",
-                      pg, nbytes);
-                free(mvec);
-                goto failure;
-            }
-            ndumped++;
+
+    if (stream) {
+        int wstatus;
+        close(out);
+        out = -1;
+        if (waitpid(pid, &wstatus, 0) == -1 || !WIFEXITED(wstatus) ||
+            WEXITSTATUS(wstatus) != 0) {
+            warnx("dumpcore: %s failed", compressor->name);
+            pid = -1;
+            goto failure;
         }
+        pid = -1;
+    } else if (ftruncate(fd, offset) == -1) {
+        /* Extend the file over any trailing pages not dumped. */
+        warn("dumpcore: ftruncate() failed");
+        goto failure;
     }
-    free(mvec);
-    warnx("dumpcore: dumped %zd pages of total %zd pages", ndumped, npages);
+
+    struct stat sb;
+    if (fstat(fd, &sb) == -1)
+        sb.st_blocks = 0;
+    warnx("dumpcore: dumped %zd pages of total %zd pages in %" PRIu64
+          " ms (%lld bytes on disk)",
+          ndumped, npages, (hvt_stats_clock() - t_start) / 1000000,
+          (long long)sb.st_blocks * 512);
+    free(runs);
+    free(phdrs);
     close(fd);
     return;
 
 failure:
     warnx("dumpcore: error(s) dumping core, file may be incomplete");
-    close(fd);
+    if (out != fd && out != -1)
+        close(out);
+    if (pid != -1)
+        waitpid(pid, NULL, 0);
+    free(mvec);
+    free(runs);
+    free(phdrs);
+    if (fd != -1)
+        close(fd);
 }
 
 static int handle_cmdarg(char *cmdarg, struct mft *mft)
 {
     if (strncmp("--dumpcore=", cmdarg, 11))
         return -1;
-    dumpcoredir = cmdarg + 11;
+
+    char *opts = strdup(cmdarg + 11);
+    assert(opts != NULL);
+    char *saveptr;
+    char *tok = strtok_r(opts, ",", &saveptr);
+    if (tok == NULL)
+        return -1;
+    dumpcoredir = tok;
+
+    while ((tok = strtok_r(NULL, ",", &saveptr)) != NULL) {
+        if (strncmp("compress=", tok, 9) == 0) {
+            compressor = NULL;
+            for (size_t i = 0;
+                 i < sizeof compressors / sizeof compressors[0]; i++) {
+                if (strcmp(tok + 9, compressors[i].name) == 0)
+                    compressor = &compressors[i];
+            }
+            if (compressor == NULL)
+                errx(1, "dumpcore: Unknown compressor: %s", tok + 9);
+        } else if (strncmp("regions=", tok, 8) == 0) {
+            char *rsaveptr;
+            dump_regions = 0;
+            for (char *r = strtok_r(tok + 8, ":", &rsaveptr); r != NULL;
+                 r = strtok_r(NULL, ":", &rsaveptr)) {
+                unsigned i;
+                for (i = 0; i < REGION_MAX; i++) {
+                    if (strcmp(r, region_names[i]) == 0)
+                        break;
+                }
+                if (i == REGION_MAX)
+                    errx(1, "dumpcore: Unknown region: %s", r);
+                dump_regions |= 1U << i;
+            }
+            if (dump_regions == 0)
+                errx(1, "dumpcore: No regions given");
+        } else
+            return -1;
+    }
 
     return 0;
 }
 
 static const char *usage(void)
 {
-    return "--dumpcore=DIR (enable guest core dump on abort/trap)";
+    return "--dumpcore=DIR[,compress=gzip|zstd|xz|lz4][,regions=R[:R...]] "
+           "(enable guest core dump on abort/trap, optionally compressed "
+           "and limited to regions R of boot, image, heap and stack)";
 }
 
 static int setup(struct hvt *hvt, struct mft *mft)
@@ -268,7 +581,8 @@ static int setup(struct hvt *hvt, struct mft *mft)
 
 #if HVT_FREEBSD_ENABLE_CAPSICUM
     cap_rights_t rights;
-    cap_rights_init(&rights, CAP_CREATE, CAP_WRITE, CAP_LOOKUP, CAP_SEEK);
+    cap_rights_init(&rights, CAP_CREATE, CAP_WRITE, CAP_LOOKUP, CAP_SEEK,
+                    CAP_FTRUNCATE, CAP_FSTAT);
     if (cap_rights_limit(dir, &rights) == -1)
         err(1, "cap_rights_limit() failed");
 #endif
@@ -26,6 +26,7 @@
 #include <err.h>
 #include <errno.h>
 #include <inttypes.h>
+#include <poll.h>
 #include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -36,6 +37,7 @@
 #include <sys/capsicum.h>
 #endif
 
+#include "../common/rate_limit.h"
 #include "../common/tap_attach.h"
 #include "hvt.h"
 #include "solo5.h"
@@ -61,14 +63,59 @@ static struct mft *host_mft;
 static volatile int io_thread_stop;
 static hvt_gpa_t reserved_ring_gpa;
 
+/*
+ * Per-device transmit limits (--net-rate). Shared between the VCPU thread
+ * (NET_WRITE hypercall) and the I/O thread (ring), hence the lock.
+ */
+static struct rate_limit tx_limits[MFT_MAX_ENTRIES];
+static pthread_mutex_t tx_limits_lock = PTHREAD_MUTEX_INITIALIZER;
+static bool limits_in_use;
+
+/*
+ * Account a frame of (len) bytes against the transmit limit for device
+ * (handle). Returns the number of nanoseconds by which the frame must be
+ * delayed, 0 if none.
+ */
+static uint64_t net_throttle(unsigned handle, size_t len)
+{
+    if (!limits_in_use)
+        return 0;
+
+    pthread_mutex_lock(&tx_limits_lock);
+    uint64_t delay = rate_limit_take(&tx_limits[handle], len);
+    pthread_mutex_unlock(&tx_limits_lock);
+    return delay;
+}
+
+static void print_limit_stats(struct hvt *hvt, int status, void *cookie)
+{
+    (void)hvt;
+    (void)status;
+    (void)cookie;
+
+    pthread_mutex_lock(&tx_limits_lock);
+    for (unsigned i = 0; i != host_mft->entries; i++) {
+        const struct rate_limit *tx = &tx_limits[i];
+
+        if (!rate_limit_enabled(tx))
+            continue;
+        warnx("%." XSTR(MFT_NAME_MAX) "s: throttled %" PRIu64
+              " frames, %" PRIu64 " ms total delay",
+              host_mft->e[i].name, tx->nthrottled, tx->throttled_ns / 1000000);
+    }
+    pthread_mutex_unlock(&tx_limits_lock);
+}
+
 size_t hvt_net_mem_overhead(struct mft *mft)
 {
+    size_t overhead = sizeof(struct hvt_ring);
+    hvt_mem_size_roundup(&overhead);
+
+    if (mft == NULL)
+        return overhead;
     for (unsigned i = 0; i != mft->entries; i++) {
-        if (mft->e[i].type == MFT_DEV_NET_BASIC && mft->e[i].attached) {
-            size_t overhead = sizeof(struct hvt_ring);
-            hvt_mem_size_roundup(&overhead);
+        if (mft->e[i].type == MFT_DEV_NET_BASIC && mft->e[i].attached)
             return overhead;
-        }
     }
     return 0;
 }
@@ -98,6 +145,35 @@ void hvt_net_reserve_ring(struct hvt *hvt, struct mft *mft)
     hvt->guest_mem_size = gpa_ring;
 }
 
+void hvt_net_reset_ring(struct hvt *hvt)
+{
+    if (reserved_ring_gpa == 0)
+        return;
+
+    struct hvt_ring *ring = (struct hvt_ring *)(hvt->mem + reserved_ring_gpa);
+
+    /*
+     * Transmits were queued by the guest we were cloned or restored from and
+     * are its business; drop them. Receives are completed with no data, as
+     * if nothing had arrived.
+     */
+    while (ring->ent_head != ring->ent_tail) {
+        struct hvt_ring_entry *ent =
+            &ring->entries[ring->ent_head & HVT_RING_MASK];
+        if (ent->operation == HVT_RING_NET_READ) {
+            struct hvt_ring_commit *commit =
+                &ring->commits[ring->com_tail & HVT_RING_MASK];
+            commit->id = ent->id;
+            commit->ret = SOLO5_R_AGAIN;
+            commit->len = 0;
+            ring->com_tail++;
+        }
+        ring->ent_head++;
+    }
+    ring->needs_kick = 0;
+    ring->tx_blocked = 0;
+}
+
 static void hypercall_net_write(struct hvt *hvt, hvt_gpa_t gpa)
 {
     struct hvt_hc_net_write *wr =
@@ -111,9 +187,17 @@ static void hypercall_net_write(struct hvt *hvt, hvt_gpa_t gpa)
 
     ssize_t ret;
 
+    uint64_t delay = net_throttle(wr->handle, wr->len);
+    if (delay)
+        rate_limit_sleep(delay);
+
     ret =
         write(e->b.hostfd, HVT_CHECKED_GPA_P(hvt, wr->data, wr->len), wr->len);
-    if (ret == -1) {
+    if (ret == -1 && (errno == EAGAIN || errno == ENOBUFS)) {
+        /* Host transmit queue is full; let the guest retry. */
+        wr->ret = SOLO5_R_AGAIN;
+        return;
+    } else if (ret == -1) {
         fprintf(stderr, "Fatal error when writing: %s\n", strerror(errno));
         exit(1);
     } else if ((size_t)ret != wr->len) {
@@ -200,12 +284,62 @@ static inline void process_read_entry(struct hvt *hvt, struct hvt_ring *ring,
     ring->ent_head++;
 }
 
+/*
+ * Publish the (*processed) entries following (*batch_start) as consumed, and
+ * start a new batch.
+ */
+static inline void flush_batch(struct hvt_ring *ring, uint32_t *batch_start,
+                               uint32_t *processed)
+{
+    if (*processed > 0) {
+        hvt_wmb();
+        ring->ent_head += *processed;
+        *batch_start = ring->ent_head;
+        *processed = 0;
+    }
+}
+
+/*
+ * The TAP device (fd) has no transmit space left. Block until it becomes
+ * writable again, or until the I/O thread is asked to stop via (nfd). While
+ * blocked, (ring->tx_blocked) is set so that the guest returns SOLO5_R_AGAIN
+ * once the ring fills up, instead of spinning.
+ */
+static void wait_tx_space(struct hvt_ring *ring, int fd, int nfd)
+{
+    struct pollfd pfd[2] = {
+        {.fd = fd, .events = POLLOUT},
+        {.fd = nfd, .events = POLLIN},
+    };
+
+    ring->tx_blocked = 1;
+    hvt_wmb();
+    while (!io_thread_stop) {
+        int rc = poll(pfd, 2, -1);
+        if (rc == -1) {
+            if (errno == EINTR)
+                continue;
+            err(1, "Fatal error waiting for net device");
+        }
+        if (pfd[1].revents & POLLIN) {
+            /* Kick or stop request; io_thread_stop is checked above. */
+            uint64_t val;
+            (void)!read(nfd, &val, sizeof(val));
+        }
+        if (pfd[0].revents & (POLLOUT | POLLERR | POLLHUP))
+            break;
+    }
+    ring->tx_blocked = 0;
+    hvt_wmb();
+}
+
 /*
  * Process all pending ring commits with batched ent_head updates for
  * consecutive writes. For N consecutive NET_WRITE entries, only a single
  * hvt_wmb() + ent_head update is issued instead of N.
  */
-static inline void process_ring_commits(struct hvt *hvt, struct hvt_ring *ring)
+static inline void process_ring_commits(struct hvt *hvt, struct hvt_ring *ring,
+                                        int nfd)
 {
     /*
      * Snapshot ent_tail after the caller's hvt_rmb(). On aarch64 (weakly
@@ -236,7 +370,34 @@ static inline void process_ring_commits(struct hvt *hvt, struct hvt_ring *ring)
                     uint64_t ent_data = ent->data;
                     uint32_t ent_len = ent->len;
                     void *data = HVT_CHECKED_GPA_P(hvt, ent_data, ent_len);
-                    ssize_t ret = write(e->b.hostfd, data, ent_len);
+                    uint64_t delay = net_throttle(ent->handle, ent_len);
+                    if (delay) {
+                        /*
+                         * Over the transmit limit. Publish the frames sent
+                         * so far before stalling, so that the guest keeps
+                         * queueing until the ring fills up, and then sees
+                         * backpressure as for a full TAP queue.
+                         */
+                        flush_batch(ring, &batch_start, &processed);
+                        ring->tx_blocked = 1;
+                        hvt_wmb();
+                        rate_limit_sleep(delay);
+                        ring->tx_blocked = 0;
+                        hvt_wmb();
+                    }
+                    ssize_t ret;
+                    while ((ret = write(e->b.hostfd, data, ent_len)) == -1 &&
+                           (errno == EAGAIN || errno == ENOBUFS)) {
+                        /*
+                         * TAP queue is full. Leave this frame (and any
+                         * following it) queued in the ring until there is
+                         * room for it.
+                         */
+                        flush_batch(ring, &batch_start, &processed);
+                        wait_tx_space(ring, e->b.hostfd, nfd);
+                        if (io_thread_stop)
+                            return;
+                    }
                     if (ret == -1)
                         err(1, "Fatal write error on net device");
                     if ((size_t)ret != ent_len)
@@ -278,6 +439,8 @@ static void *io_thread_net_fn(void *arg)
     struct hvt_ring *ring = ta->ring;
     int nfd = ta->notify_fd;
 
+    hvt_core_thread_start(HVT_THREAD_IO);
+
     /*
      * Signal the main thread that this thread is fully initialized.
      * On OpenBSD, hvt_drop_privileges() calls pledge("stdio vmm") after
@@ -339,7 +502,7 @@ static void *io_thread_net_fn(void *arg)
          * Process all pending submissions with batched ent_head updates.
          */
         hvt_rmb();
-        process_ring_commits(hvt, ring);
+        process_ring_commits(hvt, ring, nfd);
     }
 
     free(ta);
@@ -377,12 +540,14 @@ static void kill_net_pthread(struct hvt *hvt, int status, void *cookie)
 
 static int handle_cmdarg(char *cmdarg, struct mft *mft)
 {
-    enum { opt_net, opt_net_mac } which;
+    enum { opt_net, opt_net_mac, opt_net_rate } which;
 
     if (strncmp("--net:", cmdarg, 6) == 0)
         which = opt_net;
     else if (strncmp("--net-mac:", cmdarg, 10) == 0)
         which = opt_net_mac;
+    else if (strncmp("--net-rate:", cmdarg, 11) == 0)
+        which = opt_net_rate;
     else
         return -1;
 
@@ -434,6 +599,28 @@ static int handle_cmdarg(char *cmdarg, struct mft *mft)
             return -1;
         }
         memcpy(e->u.net_basic.mac, mac, sizeof mac);
+    } else if (which == opt_net_rate) {
+        char spec[32];
+        rc = sscanf(cmdarg,
+                    "--net-rate:%" XSTR(MFT_NAME_MAX) "[A-Za-z0-9]="
+                                                      "%31s",
+                    name, spec);
+        if (rc != 2)
+            return -1;
+        uint64_t rate;
+        if (rate_limit_parse(spec, &rate) == -1) {
+            warnx("%s: Invalid rate: '%s'", name, spec);
+            return -1;
+        }
+        unsigned index;
+        struct mft_entry *e =
+            mft_get_by_name(mft, name, MFT_DEV_NET_BASIC, &index);
+        if (e == NULL) {
+            warnx("Resource not declared in manifest: '%s'", name);
+            return -1;
+        }
+        rate_limit_init(&tx_limits[index], rate);
+        limits_in_use = true;
     }
 
     return 0;
@@ -459,6 +646,13 @@ static int setup(struct hvt *hvt, struct mft *mft)
         assert(hvt_core_register_pollfd(mft->e[i].b.hostfd, i) == 0);
     }
 
+    if (limits_in_use) {
+        assert(hvt_core_register_halt_hook(print_limit_stats) == 0);
+#if defined(__linux__)
+        hvt_core_seccomp_allow |= HVT_SECCOMP_ALLOW_SLEEP;
+#endif
+    }
+
     if (reserved_ring_gpa != 0) {
         struct hvt_b *hvb = hvt->b;
         struct hvt_ring *ring =
@@ -560,7 +754,9 @@ static const char *usage(void)
 {
     return "--net:NAME=IFACE | @NN (attach tap at IFACE or at fd @NN as "
            "network NAME)\n"
-           "  [ --net-mac:NAME=HWADDR ] (set HWADDR for network NAME)";
+           "  [ --net-mac:NAME=HWADDR ] (set HWADDR for network NAME)\n"
+           "  [ --net-rate:NAME=RATE[K|M|G] ] (limit transmit on network NAME "
+           "to RATE bytes per second)";
 }
 
 DECLARE_MODULE(net, .setup = setup, .handle_cmdarg = handle_cmdarg,
@@ -0,0 +1,474 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * hvt_module_profile.c: Sampling profiler for the guest.
+ *
+ * A sampler thread periodically sends SIGPROF to the vCPU thread. SIGPROF is
+ * blocked in the vCPU thread except while it is running guest code
+ * (KVM_SET_SIGNAL_MASK), so the signal forces KVM_RUN to return with
+ * KVM_EXIT_INTR. At that point we consume the signal, read the guest PC and
+ * frame pointer, and walk the chain of frame records through guest memory.
+ *
+ * Stacks are aggregated in memory and written out when the guest halts in
+ * "folded" format, i.e. one "outer;...;inner COUNT" line per unique stack as
+ * consumed by flamegraph.pl and compatible tools. Frames are symbolized
+ * against the symbol table of the unikernel binary, if present.
+ *
+ * Only time spent running guest code is sampled. A sample requested while
+ * the vCPU is in the tender (e.g. blocked in solo5_yield()) is taken when it
+ * next enters the guest, so each such period contributes at most one sample.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <time.h>
+#include <unistd.h>
+#include <linux/kvm.h>
+
+#include "hvt.h"
+#include "hvt_kvm.h"
+
+#if defined(__aarch64__)
+/* See hvt_kvm_aarch64.c. */
+#define KVM_REG_ARM_CORE (0x0010 << KVM_REG_ARM_COPROC_SHIFT)
+#define ARM64_CORE_REG(x)                                                      \
+    (KVM_REG_ARM64 | KVM_REG_SIZE_U64 | KVM_REG_ARM_CORE |                     \
+     KVM_REG_ARM_CORE_REG(x))
+#endif
+
+#define PROFILE_HZ_DEFAULT    99
+#define PROFILE_HZ_MAX        10000
+#define PROFILE_DEPTH_DEFAULT 32
+#define PROFILE_DEPTH_MAX     64
+
+/*
+ * Unique stacks are kept in an open-addressed hash table. Samples which do
+ * not fit once the table is 3/4 full are counted as lost.
+ */
+#define PROFILE_TABLE_SIZE 4096
+
+struct profile_stack {
+    uint64_t count;
+    unsigned depth;
+    uint64_t pc[PROFILE_DEPTH_MAX + 1]; /* pc[0] is the innermost frame */
+};
+
+static char *profile_file;
+static unsigned profile_hz = PROFILE_HZ_DEFAULT;
+static unsigned profile_depth = PROFILE_DEPTH_DEFAULT;
+
+static int out_fd = -1;
+static struct elf_sym *syms;
+static size_t nsyms;
+static struct profile_stack *table;
+static size_t nstacks;
+static uint64_t nsamples, nlost;
+static pthread_t vcpu_thread;
+static volatile bool sampler_stop;
+static pthread_mutex_t sampler_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t sampler_cv = PTHREAD_COND_INITIALIZER;
+static bool sampler_ready;
+
+static void *sampler_fn(void *arg)
+{
+    (void)arg;
+    uint64_t interval = 1000000000ULL / profile_hz;
+    struct timespec next;
+
+    pthread_mutex_lock(&sampler_lock);
+    sampler_ready = true;
+    pthread_cond_signal(&sampler_cv);
+    pthread_mutex_unlock(&sampler_lock);
+
+    clock_gettime(CLOCK_MONOTONIC, &next);
+    while (!sampler_stop) {
+        uint64_t ns = next.tv_nsec + interval;
+        next.tv_sec += ns / 1000000000ULL;
+        next.tv_nsec = ns % 1000000000ULL;
+        while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &next, NULL) ==
+               EINTR)
+            ;
+        pthread_kill(vcpu_thread, SIGPROF);
+    }
+    return NULL;
+}
+
+static void sigprof_handler(int signo)
+{
+    /*
+     * Never called in practice: SIGPROF is consumed with sigtimedwait() by
+     * handle_exit(). A handler must be installed for KVM_RUN to be
+     * interrupted rather than the process terminated.
+     */
+    (void)signo;
+}
+
+static int read_vcpu_regs(struct hvt *hvt, uint64_t *pc, uint64_t *fp)
+{
+#if defined(__x86_64__)
+    struct kvm_regs regs;
+
+    if (ioctl(hvt->b->vcpufd, KVM_GET_REGS, &regs) == -1)
+        return -1;
+    *pc = regs.rip;
+    *fp = regs.rbp;
+    return 0;
+#elif defined(__aarch64__)
+    struct kvm_one_reg one_reg = {
+        .id = ARM64_CORE_REG(regs.pc),
+        .addr = (uint64_t)pc,
+    };
+
+    if (ioctl(hvt->b->vcpufd, KVM_GET_ONE_REG, &one_reg) == -1)
+        return -1;
+    one_reg.id = ARM64_CORE_REG(regs.regs[29]);
+    one_reg.addr = (uint64_t)fp;
+    return ioctl(hvt->b->vcpufd, KVM_GET_ONE_REG, &one_reg);
+#else
+#error Unsupported target
+#endif
+}
+
+static uint64_t hash_stack(const uint64_t *pc, unsigned depth)
+{
+    uint64_t h = 14695981039346656037ULL; /* FNV-1a */
+
+    for (unsigned i = 0; i < depth; i++) {
+        h ^= pc[i];
+        h *= 1099511628211ULL;
+    }
+    return h;
+}
+
+static void record_sample(const uint64_t *pc, unsigned depth)
+{
+    size_t mask = PROFILE_TABLE_SIZE - 1;
+    size_t i = hash_stack(pc, depth) & mask;
+
+    nsamples++;
+    for (;; i = (i + 1) & mask) {
+        struct profile_stack *s = &table[i];
+        if (s->count == 0) {
+            if (nstacks >= PROFILE_TABLE_SIZE / 4 * 3) {
+                nlost++;
+                return;
+            }
+            memcpy(s->pc, pc, depth * sizeof(uint64_t));
+            s->depth = depth;
+            s->count = 1;
+            nstacks++;
+            return;
+        }
+        if (s->depth == depth &&
+            memcmp(s->pc, pc, depth * sizeof(uint64_t)) == 0) {
+            s->count++;
+            return;
+        }
+    }
+}
+
+/*
+ * Returns the start of the function containing (addr), so that samples
+ * taken anywhere within the same function are aggregated. If (addr) is not
+ * covered by any symbol, returns (addr) unchanged and sets (*known) to false.
+ */
+static uint64_t normalize_pc(uint64_t addr, bool *known)
+{
+    const struct elf_sym *sym = elf_sym_lookup(syms, nsyms, addr);
+
+    *known = (sym != NULL);
+    return sym ? sym->addr : addr;
+}
+
+/*
+ * Both x86_64 and aarch64 frame records consist of the caller's frame
+ * pointer followed by the return address. Guest addresses are identity
+ * mapped. The frame pointer chain is guest-controlled: rather than using
+ * HVT_CHECKED_GPA_P(), which terminates the tender, an invalid or
+ * non-ascending frame pointer just ends the walk. So does a return address
+ * outside of any known function, which is what we usually find if the guest
+ * was not built with -fno-omit-frame-pointer.
+ */
+static void take_sample(struct hvt *hvt)
+{
+    uint64_t pc[PROFILE_DEPTH_MAX + 1];
+    uint64_t fp;
+    unsigned depth = 0;
+    bool known;
+
+    if (read_vcpu_regs(hvt, &pc[0], &fp) == -1)
+        err(1, "profile: Could not read vCPU registers");
+    pc[0] = normalize_pc(pc[0], &known);
+    depth++;
+
+    while (depth <= profile_depth && fp != 0) {
+        if ((fp & 7) || fp > hvt->guest_mem_size - 16)
+            break;
+        const uint64_t *frame = (const uint64_t *)(hvt->mem + fp);
+        uint64_t next_fp = frame[0], ret = frame[1];
+        if (ret == 0)
+            break;
+        /*
+         * Return addresses point after the call instruction, which may be
+         * the start of the next function, so look up the address before.
+         */
+        uint64_t caller = normalize_pc(ret - 1, &known);
+        if (!known && nsyms > 0)
+            break;
+        pc[depth++] = caller;
+        if (next_fp <= fp)
+            break;
+        fp = next_fp;
+    }
+
+    record_sample(pc, depth);
+}
+
+static int handle_exit(struct hvt *hvt)
+{
+    if (hvt->b->vcpurun->exit_reason != KVM_EXIT_INTR)
+        return -1;
+
+    sigset_t set;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPROF);
+    const struct timespec zero = {0, 0};
+    if (sigtimedwait(&set, NULL, &zero) != SIGPROF)
+        return -1;
+
+    take_sample(hvt);
+    return 0;
+}
+
+static char outbuf[65536];
+static size_t outlen;
+
+static void out_flush(void)
+{
+    size_t off = 0;
+
+    while (off < outlen) {
+        ssize_t nbytes = write(out_fd, outbuf + off, outlen - off);
+        if (nbytes == -1 && errno == EINTR)
+            continue;
+        if (nbytes == -1) {
+            warn("profile: Error writing %s", profile_file);
+            break;
+        }
+        off += nbytes;
+    }
+    outlen = 0;
+}
+
+static void out_printf(const char *fmt, ...)
+    __attribute__((format(printf, 1, 2)));
+
+static void out_printf(const char *fmt, ...)
+{
+    va_list ap;
+
+    va_start(ap, fmt);
+    int n = vsnprintf(outbuf + outlen, sizeof outbuf - outlen, fmt, ap);
+    va_end(ap);
+    assert(n >= 0);
+    if ((size_t)n >= sizeof outbuf - outlen) {
+        out_flush();
+        va_start(ap, fmt);
+        n = vsnprintf(outbuf, sizeof outbuf, fmt, ap);
+        va_end(ap);
+        assert(n >= 0);
+        if ((size_t)n >= sizeof outbuf)
+            n = sizeof outbuf - 1; /* Truncate absurdly long symbols */
+    }
+    outlen += n;
+}
+
+static void print_frame(uint64_t addr)
+{
+    const struct elf_sym *sym = elf_sym_lookup(syms, nsyms, addr);
+
+    if (sym != NULL)
+        out_printf("%s", sym->name);
+    else
+        out_printf("0x%" PRIx64, addr);
+}
+
+static void write_profile(struct hvt *hvt, int status, void *cookie)
+{
+    (void)hvt;
+    (void)status;
+    (void)cookie;
+
+    sampler_stop = true;
+
+    for (size_t i = 0; i < PROFILE_TABLE_SIZE; i++) {
+        const struct profile_stack *s = &table[i];
+        if (s->count == 0)
+            continue;
+        /*
+         * Outermost frame first.
+         */
+        for (unsigned f = s->depth; f-- > 0;) {
+            print_frame(s->pc[f]);
+            out_printf(f == 0 ? " %" PRIu64 "\n" : ";", s->count);
+        }
+    }
+    out_flush();
+    close(out_fd);
+
+    warnx("profile: %" PRIu64 " samples in %zu unique stacks written to %s",
+          nsamples, nstacks, profile_file);
+    if (nlost > 0)
+        warnx("profile: %" PRIu64 " samples lost (too many unique stacks)",
+              nlost);
+}
+
+static int handle_cmdarg(char *cmdarg, struct mft *mft)
+{
+    (void)mft;
+
+    if (strncmp("--profile=", cmdarg, 10))
+        return -1;
+
+    char *opts = strdup(cmdarg + 10);
+    assert(opts != NULL);
+    char *saveptr;
+    char *tok = strtok_r(opts, ",", &saveptr);
+    if (tok == NULL)
+        return -1;
+    profile_file = tok;
+
+    while ((tok = strtok_r(NULL, ",", &saveptr)) != NULL) {
+        char *end;
+        unsigned long val;
+
+        if (strncmp("hz=", tok, 3) == 0) {
+            val = strtoul(tok + 3, &end, 10);
+            if (*end != '\0' || val < 1 || val > PROFILE_HZ_MAX)
+                errx(1, "profile: hz must be between 1 and %d",
+                     PROFILE_HZ_MAX);
+            profile_hz = val;
+        } else if (strncmp("depth=", tok, 6) == 0) {
+            val = strtoul(tok + 6, &end, 10);
+            if (*end != '\0' || val > PROFILE_DEPTH_MAX)
+                errx(1, "profile: depth must be between 0 and %d",
+                     PROFILE_DEPTH_MAX);
+            profile_depth = val;
+        } else
+            return -1;
+    }
+
+    return 0;
+}
+
+static const char *usage(void)
+{
+    return "--profile=FILE[,hz=N][,depth=N] (sample guest stacks N times per "
+           "second, walking up to depth frames, and write them to FILE in "
+           "folded format on exit; defaults: hz=" XSTR(PROFILE_HZ_DEFAULT)
+           ", depth=" XSTR(PROFILE_DEPTH_DEFAULT) ")";
+}
+
+static int setup(struct hvt *hvt, struct mft *mft)
+{
+    (void)mft;
+
+    if (profile_file == NULL)
+        return 0; /* Not present */
+
+    out_fd = open(profile_file, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                  0644);
+    if (out_fd == -1)
+        err(1, "profile: Could not open %s", profile_file);
+
+    assert(hvt->elf_fd != -1);
+    if (elf_load_symbols(hvt->elf_fd, "unikernel", &syms, &nsyms) == -1)
+        warnx("profile: Executable has no symbol table, stacks will not be "
+              "symbolized");
+
+    table = calloc(PROFILE_TABLE_SIZE, sizeof(struct profile_stack));
+    if (table == NULL)
+        err(1, "profile: calloc");
+
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = sigprof_handler;
+    sigemptyset(&sa.sa_mask);
+    if (sigaction(SIGPROF, &sa, NULL) == -1)
+        err(1, "profile: Could not install signal handler");
+
+    /*
+     * Block SIGPROF in the vCPU thread (and the sampler thread, which
+     * inherits our mask), but unblock it while running the guest.
+     */
+    sigset_t set, oldset;
+    sigemptyset(&set);
+    sigaddset(&set, SIGPROF);
+    if (pthread_sigmask(SIG_BLOCK, &set, &oldset) != 0)
+        errx(1, "profile: Could not block SIGPROF");
+    sigdelset(&oldset, SIGPROF);
+    struct kvm_signal_mask *kmask = malloc(sizeof *kmask + 8);
+    assert(kmask != NULL);
+    kmask->len = 8; /* Size of the kernel's sigset_t */
+    memcpy(kmask->sigset, &oldset, 8);
+    if (ioctl(hvt->b->vcpufd, KVM_SET_SIGNAL_MASK, kmask) == -1)
+        err(1, "KVM: ioctl (SET_SIGNAL_MASK) failed");
+    free(kmask);
+
+    if (hvt_core_register_vmexit(handle_exit) == -1)
+        return -1;
+    if (hvt_core_register_halt_hook(write_profile) == -1)
+        return -1;
+
+    vcpu_thread = pthread_self();
+    hvt_core_seccomp_allow |=
+        HVT_SECCOMP_ALLOW_SLEEP | HVT_SECCOMP_ALLOW_SIGNAL;
+    pthread_t sampler;
+    if (pthread_create(&sampler, NULL, sampler_fn, NULL) != 0)
+        errx(1, "profile: Could not create sampler thread");
+    pthread_detach(sampler);
+    /*
+     * As for the net I/O thread, wait for the sampler to be fully initialized
+     * before hvt_drop_privileges() restricts the available syscalls.
+     */
+    pthread_mutex_lock(&sampler_lock);
+    while (!sampler_ready)
+        pthread_cond_wait(&sampler_cv, &sampler_lock);
+    pthread_mutex_unlock(&sampler_lock);
+
+    return 0;
+}
+
+DECLARE_MODULE(profile, .setup = setup, .handle_cmdarg = handle_cmdarg,
+               .usage = usage)
@@ -0,0 +1,683 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * hvt_module_snapshot.c: Snapshot and restore of a running guest.
+ *
+ * --snapshot=FILE --snapshot-at=HYPERCALL[:N] writes the complete guest state
+ * to FILE once the guest has made its Nth call of HYPERCALL, and lets the
+ * guest continue. --restore=FILE resumes a guest from such a file instead of
+ * booting it: guest memory is mapped MAP_PRIVATE from the file, so that it is
+ * paged in on demand and never written back.
+ *
+ * --clone-socket=PATH instead writes the snapshot to a sealed memfd and hands
+ * it out to any tender started with --clone=PATH, which resumes from it in the
+ * same way. All clones thus share the unmodified pages of the guest as of the
+ * snapshot, copy-on-write.
+ *
+ * The snapshot does not include any host resources. Devices are attached on
+ * restore from the command line as usual, and the same unikernel binary and
+ * --mem must be given. Block requests submitted with solo5_block_submit() at
+ * the time of the snapshot are lost, network I/O is discarded (see
+ * hvt_net_reset_ring()).
+ *
+ * File layout:
+ *
+ *   0x0000  struct snapshot_hdr
+ *   0x1000  struct snapshot_vcpu
+ *   0x4000  guest memory (mem_alloc_size bytes, sparse)
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <linux/kvm.h>
+#include <linux/memfd.h>
+
+#include "hvt.h"
+#include "hvt_kvm.h"
+
+#define SNAPSHOT_MAGIC      "SOLO5SNP"
+#define SNAPSHOT_VERSION    1
+#define SNAPSHOT_VCPU_OFF   0x1000
+#define SNAPSHOT_MEM_OFF    0x4000
+#define SNAPSHOT_PAGE_SIZE  0x1000
+
+struct snapshot_hdr {
+    char magic[8];
+    uint32_t version;
+    uint32_t nprot;
+    uint64_t elf_hash;
+    uint64_t mem_alloc_size;
+    uint64_t guest_mem_size;
+    uint64_t cpu_cycle_freq;
+    struct hvt_kvm_prot prot[HVT_KVM_PROT_MAX];
+};
+
+#if defined(__x86_64__)
+struct snapshot_vcpu {
+    struct kvm_regs regs;
+    struct kvm_sregs sregs;
+    struct kvm_vcpu_events events;
+    struct kvm_xcrs xcrs;
+    struct kvm_xsave xsave;
+    uint64_t tsc;
+};
+#else
+struct snapshot_vcpu {
+    uint64_t unused;
+};
+#endif
+
+_Static_assert(sizeof(struct snapshot_hdr) <= SNAPSHOT_VCPU_OFF,
+               "struct snapshot_hdr too large");
+_Static_assert(SNAPSHOT_VCPU_OFF + sizeof(struct snapshot_vcpu) <=
+               SNAPSHOT_MEM_OFF, "struct snapshot_vcpu too large");
+
+static const char *snapshot_file;
+static int snapshot_nr = -1;
+static unsigned long snapshot_count = 1;
+static unsigned long snapshot_calls;
+static hvt_hypercall_fn_t snapshot_orig_fn;
+static hvt_hypercall_fn_t multicall_orig_fn;
+static bool in_multicall, snapshot_pending;
+static int snapshot_fd = -1;
+static uint64_t snapshot_elf_hash;
+
+static const char *restore_file;
+static bool restored;
+
+static const char *clone_socket;
+static const char *clone_from;
+static int clone_listen_fd = -1;
+static pthread_mutex_t clone_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t clone_cv = PTHREAD_COND_INITIALIZER;
+static bool clone_thread_ready;
+static bool clone_ready;
+
+static inline int _memfd_create(const char *name, unsigned int flags)
+{
+    return syscall(__NR_memfd_create, name, flags);
+}
+
+/*
+ * Used to identify the unikernel binary a snapshot belongs to (FNV-1a).
+ */
+static uint64_t elf_hash(int fd)
+{
+    static uint8_t buf[65536];
+    uint64_t h = 0xcbf29ce484222325ULL;
+    off_t off = 0;
+    ssize_t nbytes;
+
+    while ((nbytes = pread(fd, buf, sizeof buf, off)) > 0) {
+        for (ssize_t i = 0; i < nbytes; i++) {
+            h ^= buf[i];
+            h *= 0x100000001b3ULL;
+        }
+        off += nbytes;
+    }
+    if (nbytes == -1)
+        err(1, "snapshot: Could not read unikernel binary");
+    return h;
+}
+
+#if defined(__x86_64__)
+#define MSR_IA32_TSC 0x10
+
+static int vcpu_save(struct hvt *hvt, struct snapshot_vcpu *v)
+{
+    struct hvt_b *hvb = hvt->b;
+    struct {
+        struct kvm_msrs hdr;
+        struct kvm_msr_entry entry;
+    } msrs = {.hdr.nmsrs = 1, .entry.index = MSR_IA32_TSC};
+
+    if (ioctl(hvb->vcpufd, KVM_GET_REGS, &v->regs) == -1 ||
+        ioctl(hvb->vcpufd, KVM_GET_SREGS, &v->sregs) == -1 ||
+        ioctl(hvb->vcpufd, KVM_GET_VCPU_EVENTS, &v->events) == -1 ||
+        ioctl(hvb->vcpufd, KVM_GET_XCRS, &v->xcrs) == -1 ||
+        ioctl(hvb->vcpufd, KVM_GET_XSAVE, &v->xsave) == -1)
+        return -1;
+    if (ioctl(hvb->vcpufd, KVM_GET_MSRS, &msrs) != 1)
+        return -1;
+    v->tsc = msrs.entry.data;
+    return 0;
+}
+
+static int vcpu_restore(struct hvt *hvt, const struct snapshot_vcpu *v)
+{
+    struct hvt_b *hvb = hvt->b;
+    struct {
+        struct kvm_msrs hdr;
+        struct kvm_msr_entry entry;
+    } msrs = {.hdr.nmsrs = 1, .entry.index = MSR_IA32_TSC,
+              .entry.data = v->tsc};
+
+    if (ioctl(hvb->vcpufd, KVM_SET_SREGS, &v->sregs) == -1 ||
+        ioctl(hvb->vcpufd, KVM_SET_XCRS, &v->xcrs) == -1 ||
+        ioctl(hvb->vcpufd, KVM_SET_XSAVE, &v->xsave) == -1 ||
+        ioctl(hvb->vcpufd, KVM_SET_REGS, &v->regs) == -1 ||
+        ioctl(hvb->vcpufd, KVM_SET_VCPU_EVENTS, &v->events) == -1)
+        return -1;
+    /*
+     * The guest clock is based on the TSC, which continues from where it was
+     * at the time of the snapshot. Some hosts ignore this, in which case the
+     * guest sees its monotonic clock jump forward across the restore.
+     */
+    if (ioctl(hvb->vcpufd, KVM_SET_MSRS, &msrs) != 1)
+        return -1;
+    return 0;
+}
+#else
+static int vcpu_save(struct hvt *hvt, struct snapshot_vcpu *v)
+{
+    (void)hvt;
+    (void)v;
+    errno = ENOTSUP;
+    return -1;
+}
+
+static int vcpu_restore(struct hvt *hvt, const struct snapshot_vcpu *v)
+{
+    (void)hvt;
+    (void)v;
+    errno = ENOTSUP;
+    return -1;
+}
+#endif
+
+static void write_all(int fd, const void *buf, size_t len, off_t off)
+{
+    while (len > 0) {
+        ssize_t nbytes = pwrite(fd, buf, len, off);
+        if (nbytes == -1 && errno == EINTR)
+            continue;
+        if (nbytes == -1)
+            err(1, "snapshot: %s: Write failed", snapshot_file);
+        buf = (const uint8_t *)buf + nbytes;
+        len -= nbytes;
+        off += nbytes;
+    }
+}
+
+/*
+ * Returns true if (gpa) lies in a range protected by the loader. Read-only
+ * segments may be mapped from the unikernel binary, see elf_load().
+ */
+static bool in_elf_segment(struct hvt *hvt, size_t gpa)
+{
+    struct hvt_b *hvb = hvt->b;
+    unsigned n = hvb->nprot < HVT_KVM_PROT_MAX ? hvb->nprot : HVT_KVM_PROT_MAX;
+
+    for (unsigned i = 0; i < n; i++)
+        if (gpa >= hvb->prot[i].start && gpa < hvb->prot[i].end)
+            return true;
+    return false;
+}
+
+/*
+ * Writes guest memory in (start .. end) to the snapshot, which has been
+ * pre-sized with ftruncate(), skipping pages which were never touched or are
+ * all zero. Returns the number of pages written.
+ */
+static size_t write_range(struct hvt *hvt, size_t start, size_t end)
+{
+    static const uint8_t zero_page[SNAPSHOT_PAGE_SIZE];
+    static unsigned char vec[16384];
+    const size_t chunk = sizeof vec * SNAPSHOT_PAGE_SIZE;
+    size_t written = 0;
+
+    for (size_t c = start; c < end; c += chunk) {
+        size_t len = end - c;
+        if (len > chunk)
+            len = chunk;
+        /*
+         * Residency says nothing about pages mapped from a snapshot we were
+         * restored from, or from the unikernel binary; it reflects the page
+         * cache. Those must all be examined.
+         */
+        if (restored || mincore(hvt->mem + c, len, vec) == -1)
+            memset(vec, 1, sizeof vec);
+
+        size_t run_start = 0, run_len = 0;
+        for (size_t p = 0; p < len / SNAPSHOT_PAGE_SIZE; p++) {
+            size_t gpa = c + p * SNAPSHOT_PAGE_SIZE;
+            bool data = ((vec[p] & 1) || in_elf_segment(hvt, gpa)) &&
+                        memcmp(hvt->mem + gpa, zero_page,
+                               SNAPSHOT_PAGE_SIZE) != 0;
+            if (data) {
+                if (run_len == 0)
+                    run_start = gpa;
+                run_len += SNAPSHOT_PAGE_SIZE;
+                written++;
+            }
+            if (run_len > 0 && (!data || p == len / SNAPSHOT_PAGE_SIZE - 1)) {
+                write_all(snapshot_fd, hvt->mem + run_start, run_len,
+                          SNAPSHOT_MEM_OFF + run_start);
+                run_len = 0;
+            }
+        }
+    }
+    return written;
+}
+
+static size_t write_mem(struct hvt *hvt)
+{
+    /*
+     * The network I/O thread keeps running while we copy. Copying the ring
+     * above (guest_mem_size) first ensures that any receive it records as
+     * complete has its data in the guest buffer copied after it.
+     */
+    return write_range(hvt, hvt->guest_mem_size, hvt->mem_alloc_size) +
+           write_range(hvt, 0, hvt->guest_mem_size);
+}
+
+static void take_snapshot(struct hvt *hvt)
+{
+    struct hvt_b *hvb = hvt->b;
+    static struct snapshot_hdr hdr;
+    static struct snapshot_vcpu vcpu;
+
+    /*
+     * Asynchronous block requests are queued and completed by the tender, so
+     * could never be reaped by a restored guest.
+     */
+    unsigned inflight = (hvt_core_inflight != NULL) ? hvt_core_inflight() : 0;
+    if (inflight != 0)
+        errx(1, "snapshot: Cannot snapshot with %u asynchronous requests"
+                " outstanding", inflight);
+
+    /*
+     * We are called from a hypercall handler, with the guest's I/O
+     * instruction not yet completed. Re-enter the vCPU just far enough for
+     * KVM to complete it, so that the saved state resumes after it.
+     */
+    hvb->vcpurun->immediate_exit = 1;
+    int ret = ioctl(hvb->vcpufd, KVM_RUN, NULL);
+    hvb->vcpurun->immediate_exit = 0;
+    if (ret != -1 || errno != EINTR)
+        errx(1, "snapshot: Could not complete guest I/O");
+
+    if (vcpu_save(hvt, &vcpu) == -1)
+        err(1, "snapshot: Could not save vCPU state");
+    size_t written = write_mem(hvt);
+    write_all(snapshot_fd, &vcpu, sizeof vcpu, SNAPSHOT_VCPU_OFF);
+
+    /*
+     * The header goes last, so that an incomplete file is never restored.
+     */
+    memcpy(hdr.magic, SNAPSHOT_MAGIC, sizeof hdr.magic);
+    hdr.version = SNAPSHOT_VERSION;
+    hdr.nprot = hvb->nprot;
+    memcpy(hdr.prot, hvb->prot, sizeof hdr.prot);
+    hdr.elf_hash = snapshot_elf_hash;
+    hdr.mem_alloc_size = hvt->mem_alloc_size;
+    hdr.guest_mem_size = hvt->guest_mem_size;
+    hdr.cpu_cycle_freq = hvt->cpu_cycle_freq;
+    write_all(snapshot_fd, &hdr, sizeof hdr, 0);
+
+    if (clone_socket) {
+        if (fcntl(snapshot_fd, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW |
+                                                F_SEAL_WRITE | F_SEAL_SEAL) ==
+            -1)
+            err(1, "snapshot: Could not seal snapshot");
+        warnx("snapshot: wrote %zu of %zu pages, serving clones on %s",
+              written, hvt->mem_alloc_size / SNAPSHOT_PAGE_SIZE,
+              clone_socket);
+        pthread_mutex_lock(&clone_lock);
+        clone_ready = true;
+        pthread_cond_signal(&clone_cv);
+        pthread_mutex_unlock(&clone_lock);
+    } else {
+        close(snapshot_fd);
+        snapshot_fd = -1;
+        warnx("snapshot: wrote %zu of %zu pages to %s", written,
+              hvt->mem_alloc_size / SNAPSHOT_PAGE_SIZE, snapshot_file);
+    }
+}
+
+static void hypercall_snapshot(struct hvt *hvt, hvt_gpa_t gpa)
+{
+    snapshot_orig_fn(hvt, gpa);
+    if (++snapshot_calls != snapshot_count)
+        return;
+    if (in_multicall)
+        snapshot_pending = true;
+    else
+        take_snapshot(hvt);
+}
+
+/*
+ * If the hypercall is made as part of a multicall, the snapshot is taken once
+ * the whole batch has been performed, as the guest only resumes then.
+ */
+static void hypercall_multicall(struct hvt *hvt, hvt_gpa_t gpa)
+{
+    in_multicall = true;
+    multicall_orig_fn(hvt, gpa);
+    in_multicall = false;
+    if (snapshot_pending) {
+        snapshot_pending = false;
+        take_snapshot(hvt);
+    }
+}
+
+/*
+ * Hands out the snapshot memfd, once written, to each client connecting to
+ * (clone_socket). Clients connecting earlier wait until then.
+ */
+static void *clone_thread_fn(void *arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&clone_lock);
+    clone_thread_ready = true;
+    pthread_cond_signal(&clone_cv);
+    while (!clone_ready)
+        pthread_cond_wait(&clone_cv, &clone_lock);
+    pthread_mutex_unlock(&clone_lock);
+
+    while (1) {
+        int cfd = accept(clone_listen_fd, NULL, NULL);
+        if (cfd == -1)
+            continue;
+
+        char byte = 0;
+        struct iovec iov = {.iov_base = &byte, .iov_len = 1};
+        union {
+            struct cmsghdr hdr;
+            char buf[CMSG_SPACE(sizeof(int))];
+        } cmsg;
+        struct msghdr msg = {.msg_iov = &iov,
+                             .msg_iovlen = 1,
+                             .msg_control = cmsg.buf,
+                             .msg_controllen = sizeof cmsg.buf};
+        struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int));
+        memcpy(CMSG_DATA(c), &snapshot_fd, sizeof(int));
+        (void)!sendmsg(cfd, &msg, MSG_NOSIGNAL);
+        close(cfd);
+    }
+    return NULL;
+}
+
+/*
+ * Connects to the tender serving clones on (path), and returns the snapshot
+ * memfd it sends.
+ */
+static int clone_connect(const char *path)
+{
+    struct sockaddr_un sun = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof sun.sun_path)
+        errx(1, "snapshot: Socket path too long: %s", path);
+    strcpy(sun.sun_path, path);
+    int sfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (sfd == -1)
+        err(1, "snapshot: socket() failed");
+    if (connect(sfd, (struct sockaddr *)&sun, sizeof sun) == -1)
+        err(1, "snapshot: Could not connect to %s", path);
+
+    char byte;
+    struct iovec iov = {.iov_base = &byte, .iov_len = 1};
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(sizeof(int))];
+    } cmsg;
+    struct msghdr msg = {.msg_iov = &iov,
+                         .msg_iovlen = 1,
+                         .msg_control = cmsg.buf,
+                         .msg_controllen = sizeof cmsg.buf};
+    ssize_t nbytes;
+    while ((nbytes = recvmsg(sfd, &msg, MSG_CMSG_CLOEXEC)) == -1 &&
+           errno == EINTR)
+        ;
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    if (nbytes != 1 || c == NULL || c->cmsg_level != SOL_SOCKET ||
+        c->cmsg_type != SCM_RIGHTS || c->cmsg_len != CMSG_LEN(sizeof(int)))
+        errx(1, "snapshot: %s: No snapshot received", path);
+    int fd;
+    memcpy(&fd, CMSG_DATA(c), sizeof(int));
+    close(sfd);
+    return fd;
+}
+
+static void restore(struct hvt *hvt)
+{
+    struct hvt_b *hvb = hvt->b;
+    struct snapshot_hdr hdr;
+    struct snapshot_vcpu *vcpu;
+    struct stat sb;
+    const char *name = clone_from ? clone_from : restore_file;
+    int fd;
+
+    if (clone_from) {
+        fd = clone_connect(clone_from);
+    } else {
+        fd = open(restore_file, O_RDONLY | O_CLOEXEC);
+        if (fd == -1)
+            err(1, "snapshot: %s: Could not open", name);
+    }
+    if (fstat(fd, &sb) == -1)
+        err(1, "snapshot: %s: Could not stat", name);
+    if (pread(fd, &hdr, sizeof hdr, 0) != sizeof hdr ||
+        memcmp(hdr.magic, SNAPSHOT_MAGIC, sizeof hdr.magic) != 0 ||
+        hdr.version != SNAPSHOT_VERSION)
+        errx(1, "snapshot: %s: Not a snapshot file", name);
+    if (hdr.nprot > HVT_KVM_PROT_MAX ||
+        (uint64_t)sb.st_size < SNAPSHOT_MEM_OFF + hdr.mem_alloc_size)
+        errx(1, "snapshot: %s: Snapshot file is invalid", name);
+    if (hdr.elf_hash != elf_hash(hvt->elf_fd))
+        errx(1, "snapshot: %s: Snapshot is of a different unikernel",
+             name);
+    if (hdr.mem_alloc_size != hvt->mem_alloc_size ||
+        hdr.guest_mem_size != hvt->guest_mem_size)
+        errx(1, "snapshot: %s: Guest memory size differs, the snapshot was "
+                "taken with --mem=%" PRIu64 " and the same network devices",
+             name, hdr.mem_alloc_size >> 20);
+    if (hdr.cpu_cycle_freq != hvt->cpu_cycle_freq)
+        errx(1, "snapshot: %s: Host TSC frequency differs (%" PRIu64
+                " Hz, snapshot has %" PRIu64 " Hz)",
+             name, hvt->cpu_cycle_freq, hdr.cpu_cycle_freq);
+
+    vcpu = mmap(NULL, sizeof *vcpu, PROT_READ, MAP_PRIVATE, fd,
+                SNAPSHOT_VCPU_OFF);
+    if (vcpu == MAP_FAILED)
+        err(1, "snapshot: %s: Could not map vCPU state", name);
+    if (vcpu_restore(hvt, vcpu) == -1)
+        err(1, "snapshot: Could not restore vCPU state");
+    munmap(vcpu, sizeof *vcpu);
+
+    /*
+     * Replace guest memory wholesale; KVM follows the new mapping. The ring
+     * set up by hvt_net_reserve_ring() is replaced too, so the network I/O
+     * thread started by module setup picks up where the snapshot left off.
+     */
+    if (mmap(hvt->mem, hvt->mem_alloc_size, PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_FIXED, fd, SNAPSHOT_MEM_OFF) == MAP_FAILED)
+        err(1, "snapshot: %s: Could not map guest memory", name);
+    close(fd);
+    hvt_net_reset_ring(hvt);
+    hvb->nprot = 0;
+    for (unsigned i = 0; i < hdr.nprot; i++) {
+        if (hvt_guest_mprotect(hvt, hdr.prot[i].start, hdr.prot[i].end,
+                               hdr.prot[i].prot) == -1)
+            err(1, "snapshot: Could not protect guest memory");
+    }
+    restored = true;
+}
+
+static int handle_cmdarg(char *cmdarg, struct mft *mft)
+{
+    (void)mft;
+
+    if (strncmp("--snapshot=", cmdarg, 11) == 0) {
+        snapshot_file = cmdarg + 11;
+        return 0;
+    } else if (strncmp("--snapshot-at=", cmdarg, 14) == 0) {
+        char *name = cmdarg + 14;
+        size_t len = strcspn(name, ":");
+        if (name[len] == ':') {
+            char *end;
+            snapshot_count = strtoul(name + len + 1, &end, 10);
+            if (*end != '\0' || snapshot_count == 0)
+                return -1;
+        }
+        for (int nr = 0; nr < HVT_HYPERCALL_MAX; nr++) {
+            const char *n = hvt_core_hypercall_names[nr];
+            if (nr != HVT_HYPERCALL_HALT && n && strlen(n) == len &&
+                strncmp(n, name, len) == 0)
+                snapshot_nr = nr;
+        }
+        return snapshot_nr == -1 ? -1 : 0;
+    } else if (strncmp("--restore=", cmdarg, 10) == 0) {
+        restore_file = cmdarg + 10;
+        hvt_core_restore = restore;
+        return 0;
+    } else if (strncmp("--clone-socket=", cmdarg, 15) == 0) {
+        clone_socket = cmdarg + 15;
+        return 0;
+    } else if (strncmp("--clone=", cmdarg, 8) == 0) {
+        clone_from = cmdarg + 8;
+        hvt_core_restore = restore;
+        return 0;
+    }
+    return -1;
+}
+
+static const char *usage(void)
+{
+    return "--snapshot=FILE (write guest state to FILE)\n"
+           "  [ --snapshot-at=HYPERCALL[:N] ] (once the guest has made N calls "
+           "of HYPERCALL, e.g. poll:1)\n"
+           "  [ --restore=FILE ] (resume the guest from a snapshot in FILE)\n"
+           "  [ --clone-socket=PATH ] (instead of --snapshot, serve the "
+           "snapshot to clones connecting to the Unix socket at PATH)\n"
+           "  [ --clone=PATH ] (resume the guest as a clone of the one "
+           "serving PATH)";
+}
+
+static int setup(struct hvt *hvt, struct mft *mft)
+{
+    (void)mft;
+
+    if (restore_file && clone_from)
+        return -1;
+    if (snapshot_file == NULL && clone_socket == NULL && snapshot_nr == -1)
+        return 0; /* Not present */
+    if ((snapshot_file == NULL) == (clone_socket == NULL) || snapshot_nr == -1)
+        return -1;
+
+    /*
+     * This module is set up after those registering the hypercalls it may
+     * wrap.
+     */
+    snapshot_orig_fn = hvt_core_hypercalls[snapshot_nr];
+    if (snapshot_orig_fn == NULL)
+        errx(1, "snapshot: Hypercall `%s' is not used by this unikernel",
+             hvt_core_hypercall_names[snapshot_nr]);
+    if (ioctl(hvt->b->kvmfd, KVM_CHECK_EXTENSION, KVM_CAP_IMMEDIATE_EXIT) != 1)
+        errx(1, "snapshot: Host does not support KVM_CAP_IMMEDIATE_EXIT");
+    if (hvt->b->nprot > HVT_KVM_PROT_MAX)
+        errx(1, "snapshot: Unikernel has too many loadable segments");
+#if !defined(__x86_64__)
+    errx(1, "snapshot: Not supported on this architecture");
+#endif
+
+    snapshot_elf_hash = elf_hash(hvt->elf_fd);
+    if (snapshot_file) {
+        struct stat sa, sb;
+        if (restore_file && stat(restore_file, &sa) == 0 &&
+            stat(snapshot_file, &sb) == 0 && sa.st_dev == sb.st_dev &&
+            sa.st_ino == sb.st_ino)
+            errx(1, "snapshot: Cannot overwrite the snapshot being restored");
+        snapshot_fd = open(snapshot_file,
+                           O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+        if (snapshot_fd == -1)
+            err(1, "snapshot: %s: Could not open", snapshot_file);
+    } else {
+        snapshot_fd = _memfd_create("solo5-hvt-snapshot",
+                                    MFD_CLOEXEC | MFD_ALLOW_SEALING);
+        if (snapshot_fd == -1)
+            err(1, "snapshot: memfd_create() failed");
+    }
+    if (ftruncate(snapshot_fd, SNAPSHOT_MEM_OFF + hvt->mem_alloc_size) == -1)
+        err(1, "snapshot: Could not size snapshot");
+    hvt_core_seccomp_allow |= HVT_SECCOMP_ALLOW_SNAPSHOT;
+
+    if (clone_socket) {
+        struct sockaddr_un sun = {.sun_family = AF_UNIX};
+        struct stat sb;
+        if (strlen(clone_socket) >= sizeof sun.sun_path)
+            errx(1, "snapshot: Socket path too long: %s", clone_socket);
+        strcpy(sun.sun_path, clone_socket);
+        /* Replace a stale socket left over from a previous run. */
+        if (lstat(clone_socket, &sb) == 0 && S_ISSOCK(sb.st_mode))
+            unlink(clone_socket);
+        clone_listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (clone_listen_fd == -1)
+            err(1, "snapshot: socket() failed");
+        if (bind(clone_listen_fd, (struct sockaddr *)&sun, sizeof sun) == -1)
+            err(1, "snapshot: Could not bind to %s", clone_socket);
+        if (listen(clone_listen_fd, 64) == -1)
+            err(1, "snapshot: listen() failed");
+        hvt_core_seccomp_allow |=
+            HVT_SECCOMP_ALLOW_ACCEPT | HVT_SECCOMP_ALLOW_SENDMSG;
+
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, clone_thread_fn, NULL) != 0)
+            errx(1, "snapshot: Could not create thread");
+        pthread_detach(thread);
+        /*
+         * As for the net I/O thread, wait for the thread to be fully
+         * initialized before hvt_drop_privileges() restricts the available
+         * syscalls.
+         */
+        pthread_mutex_lock(&clone_lock);
+        while (!clone_thread_ready)
+            pthread_cond_wait(&clone_cv, &clone_lock);
+        pthread_mutex_unlock(&clone_lock);
+    }
+
+    hvt_core_hypercalls[snapshot_nr] = hypercall_snapshot;
+    if (snapshot_nr != HVT_HYPERCALL_MULTICALL) {
+        multicall_orig_fn = hvt_core_hypercalls[HVT_HYPERCALL_MULTICALL];
+        hvt_core_hypercalls[HVT_HYPERCALL_MULTICALL] = hypercall_multicall;
+    }
+    return 0;
+}
+
+DECLARE_MODULE(snapshot, .setup = setup, .handle_cmdarg = handle_cmdarg,
+               .usage = usage)
@@ -0,0 +1,527 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * hvt_module_stats.c: Reporting of VM exit and hypercall accounting.
+ *
+ * Enables the accounting done by the vCPU loop (see hvt_stats in hvt.h) and
+ * reports it when the guest halts, optionally also periodically
+ * (--stats-interval) and on demand to any client connecting to a Unix socket
+ * (--stats-socket).
+ *
+ * The report is line-oriented text, one "NAME key=value ..." line per
+ * non-zero counter. Histograms are reported as "hist=BUCKET:COUNT,..." with
+ * only non-empty buckets listed, labelled by their upper bound.
+ *
+ * Where the host supports it, the counters KVM keeps for the vCPU are also
+ * reported, as "kvm.NAME count=N". Unlike exit.*, these include the VM exits
+ * handled entirely in the kernel, such as those on HLT (halt_exits) or on the
+ * guest spinning with PAUSE (directed_yield_attempted).
+ *
+ * --perf-counters=LIST additionally counts the listed perf events on the vCPU
+ * thread, reported as "perf.NAME guest=N host=N": events counted in guest mode
+ * (exclude_host) and in host mode (exclude_guest) respectively. Where the host
+ * has no PMU, cycles are counted as task-clock instead, and other hardware
+ * events are not counted. Software events are not split and are reported as
+ * "perf.NAME count=N".
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <inttypes.h>
+#include <poll.h>
+#include <pthread.h>
+#include <signal.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <sys/un.h>
+#include <unistd.h>
+#include <linux/kvm.h>
+#include <linux/perf_event.h>
+
+#include "hvt.h"
+#include "hvt_kvm.h"
+
+static bool stats_opt;
+static int stats_fd = 2;
+static char *stats_socket;
+static unsigned stats_interval; /* seconds, 0 = disabled */
+
+static int listen_fd = -1;
+static pthread_mutex_t stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_cond_t stats_cv = PTHREAD_COND_INITIALIZER;
+static bool stats_thread_ready;
+
+static const char *exit_names[HVT_STATS_EXITS] = {
+    [KVM_EXIT_IO] = "io",
+    [KVM_EXIT_MMIO] = "mmio",
+    [KVM_EXIT_INTR] = "intr",
+    [KVM_EXIT_DEBUG] = "debug",
+    [KVM_EXIT_HLT] = "hlt",
+    [KVM_EXIT_SHUTDOWN] = "shutdown",
+    [KVM_EXIT_FAIL_ENTRY] = "fail_entry",
+    [KVM_EXIT_INTERNAL_ERROR] = "internal_error",
+};
+
+static const char *kvm_stat_names[] = {
+    "exits",
+    "io_exits",
+    "mmio_exits",
+    "irq_exits",
+    "halt_exits",
+    "directed_yield_attempted",
+};
+#define KVM_STATS_MAX (sizeof kvm_stat_names / sizeof kvm_stat_names[0])
+
+static int kvm_stats_fd = -1;
+static off_t kvm_stat_offset[KVM_STATS_MAX]; /* 0 if not available */
+
+/*
+ * Find the counters in kvm_stat_names[] in the vCPU's binary statistics (Linux
+ * 5.14 and later). Failure is not fatal, the counters are then not reported.
+ */
+static void kvm_stats_init(struct hvt *hvt)
+{
+#if defined(KVM_GET_STATS_FD)
+    int fd = ioctl(hvt->b->vcpufd, KVM_GET_STATS_FD, NULL);
+    if (fd == -1)
+        return;
+
+    struct kvm_stats_header hdr;
+    if (pread(fd, &hdr, sizeof hdr, 0) != sizeof hdr) {
+        close(fd);
+        return;
+    }
+    size_t desc_size = sizeof(struct kvm_stats_desc) + hdr.name_size;
+    uint8_t *descs = malloc(desc_size * hdr.num_desc);
+    if (descs == NULL)
+        err(1, "malloc");
+    if (pread(fd, descs, desc_size * hdr.num_desc, hdr.desc_offset) !=
+        (ssize_t)(desc_size * hdr.num_desc)) {
+        free(descs);
+        close(fd);
+        return;
+    }
+    for (uint32_t i = 0; i < hdr.num_desc; i++) {
+        struct kvm_stats_desc *d =
+            (struct kvm_stats_desc *)(descs + i * desc_size);
+        if ((d->flags & KVM_STATS_TYPE_MASK) != KVM_STATS_TYPE_CUMULATIVE ||
+            d->size != 1)
+            continue;
+        for (unsigned j = 0; j < KVM_STATS_MAX; j++) {
+            if (strncmp(d->name, kvm_stat_names[j], hdr.name_size) == 0)
+                kvm_stat_offset[j] = hdr.data_offset + d->offset;
+        }
+    }
+    free(descs);
+    kvm_stats_fd = fd;
+#else
+    (void)hvt;
+#endif
+}
+
+static const struct {
+    const char *name;
+    uint32_t type;
+    uint64_t config;
+} perf_events[] = {
+    {"cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CPU_CYCLES},
+    {"instructions", PERF_TYPE_HARDWARE, PERF_COUNT_HW_INSTRUCTIONS},
+    {"cache-references", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_REFERENCES},
+    {"cache-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_CACHE_MISSES},
+    {"branches", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_INSTRUCTIONS},
+    {"branch-misses", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BRANCH_MISSES},
+    {"bus-cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_BUS_CYCLES},
+    {"stalled-cycles-frontend", PERF_TYPE_HARDWARE,
+     PERF_COUNT_HW_STALLED_CYCLES_FRONTEND},
+    {"stalled-cycles-backend", PERF_TYPE_HARDWARE,
+     PERF_COUNT_HW_STALLED_CYCLES_BACKEND},
+    {"ref-cycles", PERF_TYPE_HARDWARE, PERF_COUNT_HW_REF_CPU_CYCLES},
+    {"task-clock", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_TASK_CLOCK},
+    {"page-faults", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_PAGE_FAULTS},
+    {"context-switches", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CONTEXT_SWITCHES},
+    {"cpu-migrations", PERF_TYPE_SOFTWARE, PERF_COUNT_SW_CPU_MIGRATIONS},
+};
+#define PERF_EVENTS_MAX (sizeof perf_events / sizeof perf_events[0])
+#define PERF_TASK_CLOCK 10 /* Index of task-clock in perf_events[] */
+
+static bool perf_requested[PERF_EVENTS_MAX];
+static int perf_fd[PERF_EVENTS_MAX][2]; /* guest, host; -1 if not counted */
+
+static int perf_open(unsigned event, bool exclude_host, bool exclude_guest)
+{
+    struct perf_event_attr attr = {
+        .size = sizeof attr,
+        .type = perf_events[event].type,
+        .config = perf_events[event].config,
+        .read_format = PERF_FORMAT_TOTAL_TIME_ENABLED |
+                       PERF_FORMAT_TOTAL_TIME_RUNNING,
+        .exclude_host = exclude_host,
+        .exclude_guest = exclude_guest,
+    };
+
+    return syscall(SYS_perf_event_open, &attr, 0, -1, -1,
+                   PERF_FLAG_FD_CLOEXEC);
+}
+
+/*
+ * Open the counters requested with --perf-counters for the calling thread,
+ * which must be the one running the vCPU.
+ */
+static void perf_init(void)
+{
+    bool no_pmu = false;
+
+    for (unsigned i = 0; i < PERF_EVENTS_MAX; i++)
+        perf_fd[i][0] = perf_fd[i][1] = -1;
+    for (unsigned i = 0; i < PERF_EVENTS_MAX; i++) {
+        if (!perf_requested[i])
+            continue;
+        if (perf_events[i].type == PERF_TYPE_SOFTWARE) {
+            if (perf_fd[i][0] != -1)
+                continue; /* Already counted in place of cycles */
+            perf_fd[i][0] = perf_open(i, false, false);
+            if (perf_fd[i][0] == -1)
+                err(1, "perf: Could not count %s", perf_events[i].name);
+            continue;
+        }
+        if (!no_pmu) {
+            perf_fd[i][0] = perf_open(i, true, false);
+            if (perf_fd[i][0] != -1) {
+                perf_fd[i][1] = perf_open(i, false, true);
+                if (perf_fd[i][1] == -1)
+                    err(1, "perf: Could not count %s", perf_events[i].name);
+                continue;
+            }
+            if (errno != ENOENT && errno != ENODEV && errno != EOPNOTSUPP)
+                err(1, "perf: Could not count %s", perf_events[i].name);
+            no_pmu = true;
+        }
+        /*
+         * Without a PMU, the time spent by the vCPU thread is the nearest
+         * available measure of cycles.
+         */
+        if (perf_events[i].config == PERF_COUNT_HW_CPU_CYCLES &&
+            perf_fd[PERF_TASK_CLOCK][0] == -1) {
+            warnx("perf: No hardware counters, counting task-clock instead "
+                  "of %s", perf_events[i].name);
+            perf_fd[PERF_TASK_CLOCK][0] = perf_open(PERF_TASK_CLOCK, false,
+                                                    false);
+            if (perf_fd[PERF_TASK_CLOCK][0] == -1)
+                err(1, "perf: Could not count task-clock");
+        } else if (perf_events[i].config != PERF_COUNT_HW_CPU_CYCLES) {
+            warnx("perf: No hardware counters, not counting %s",
+                  perf_events[i].name);
+        }
+    }
+}
+
+/*
+ * Returns the value of the counter (fd), scaled up if the kernel had to
+ * multiplex it with others.
+ */
+static uint64_t perf_read(int fd)
+{
+    uint64_t v[3]; /* value, time_enabled, time_running */
+
+    if (read(fd, v, sizeof v) != sizeof v || v[2] == 0)
+        return 0;
+    if (v[2] < v[1])
+        return (uint64_t)((double)v[0] * v[1] / v[2]);
+    return v[0];
+}
+
+/*
+ * The report is formatted into a static buffer rather than with stdio or
+ * malloc(), since it is also generated after hvt_drop_privileges().
+ */
+static char report[16384];
+static size_t report_len;
+
+static void report_add(const char *fmt, ...)
+    __attribute__ ((format (printf, 1, 2)));
+
+static void report_add(const char *fmt, ...)
+{
+    va_list ap;
+
+    if (report_len >= sizeof report)
+        return;
+    va_start(ap, fmt);
+    int rc = vsnprintf(report + report_len, sizeof report - report_len, fmt,
+                       ap);
+    va_end(ap);
+    if (rc > 0)
+        report_len += rc;
+    if (report_len > sizeof report)
+        report_len = sizeof report;
+}
+
+static void report_hist(const char *name, const struct hvt_stats_hist *h)
+{
+    report_add("%s count=%" PRIu64 " total_ns=%" PRIu64 " max_ns=%" PRIu64
+               " hist=", name, h->count, h->total_ns, h->max_ns);
+    const char *sep = "";
+    for (unsigned b = 0; b < HVT_STATS_BUCKETS; b++) {
+        if (h->bucket[b] == 0)
+            continue;
+        if (b == HVT_STATS_BUCKETS - 1)
+            report_add("%s>=%lluus:%" PRIu64, sep, 1ULL << (b - 1),
+                       h->bucket[b]);
+        else
+            report_add("%s<%lluus:%" PRIu64, sep, 1ULL << b, h->bucket[b]);
+        sep = ",";
+    }
+    report_add("\n");
+}
+
+/*
+ * Counters are updated by the vCPU thread without locking, so a report
+ * generated while the guest is running is only an approximate snapshot.
+ */
+static void write_stats(int fd)
+{
+    pthread_mutex_lock(&stats_lock);
+    report_len = 0;
+    report_hist("guest", &hvt_stats.guest);
+    for (unsigned i = 0; i < HVT_STATS_EXITS; i++) {
+        if (hvt_stats.exits[i] == 0)
+            continue;
+        if (exit_names[i])
+            report_add("exit.%s", exit_names[i]);
+        else
+            report_add("exit.%u", i);
+        report_add(" count=%" PRIu64 "\n", hvt_stats.exits[i]);
+    }
+    for (unsigned i = 0; i < HVT_HYPERCALL_MAX; i++) {
+        if (hvt_stats.hypercall[i].count == 0)
+            continue;
+        char name[64];
+        if (hvt_core_hypercall_names[i])
+            snprintf(name, sizeof name, "hypercall.%s",
+                     hvt_core_hypercall_names[i]);
+        else
+            snprintf(name, sizeof name, "hypercall.%u", i);
+        report_hist(name, &hvt_stats.hypercall[i]);
+    }
+    for (unsigned i = 0; kvm_stats_fd != -1 && i < KVM_STATS_MAX; i++) {
+        uint64_t count;
+        if (kvm_stat_offset[i] == 0 ||
+            pread(kvm_stats_fd, &count, sizeof count, kvm_stat_offset[i]) !=
+                sizeof count ||
+            count == 0)
+            continue;
+        report_add("kvm.%s count=%" PRIu64 "\n", kvm_stat_names[i], count);
+    }
+    for (unsigned i = 0; i < PERF_EVENTS_MAX; i++) {
+        if (perf_fd[i][0] == -1)
+            continue;
+        if (perf_fd[i][1] == -1)
+            report_add("perf.%s count=%" PRIu64 "\n", perf_events[i].name,
+                       perf_read(perf_fd[i][0]));
+        else
+            report_add("perf.%s guest=%" PRIu64 " host=%" PRIu64 "\n",
+                       perf_events[i].name, perf_read(perf_fd[i][0]),
+                       perf_read(perf_fd[i][1]));
+    }
+    if (hvt_stats.mem_released != 0 || hvt_stats.mem_release_failed != 0)
+        report_add("mem.release bytes=%" PRIu64 " failed_bytes=%" PRIu64 "\n",
+                   hvt_stats.mem_released, hvt_stats.mem_release_failed);
+
+    size_t off = 0;
+    while (off < report_len) {
+        ssize_t nbytes = write(fd, report + off, report_len - off);
+        if (nbytes == -1 && errno == EINTR)
+            continue;
+        if (nbytes == -1)
+            break;
+        off += nbytes;
+    }
+    pthread_mutex_unlock(&stats_lock);
+}
+
+static void *stats_thread_fn(void *arg)
+{
+    (void)arg;
+
+    pthread_mutex_lock(&stats_lock);
+    stats_thread_ready = true;
+    pthread_cond_signal(&stats_cv);
+    pthread_mutex_unlock(&stats_lock);
+
+    while (1) {
+        struct pollfd pfd = {.fd = listen_fd, .events = POLLIN};
+        int rc = poll(&pfd, listen_fd != -1 ? 1 : 0,
+                      stats_interval ? (int)stats_interval * 1000 : -1);
+        if (rc == -1 && errno == EINTR)
+            continue;
+        if (rc == -1)
+            err(1, "stats: poll() failed");
+        if (rc == 0) {
+            write_stats(stats_fd);
+            continue;
+        }
+        int cfd = accept(listen_fd, NULL, NULL);
+        if (cfd == -1)
+            continue;
+        write_stats(cfd);
+        close(cfd);
+    }
+    return NULL;
+}
+
+static void halt_hook(struct hvt *hvt, int status, void *cookie)
+{
+    (void)hvt;
+    (void)status;
+    (void)cookie;
+
+    write_stats(stats_fd);
+}
+
+static int handle_cmdarg(char *cmdarg, struct mft *mft)
+{
+    (void)mft;
+    char *end;
+
+    if (strcmp("--stats", cmdarg) == 0) {
+        stats_opt = true;
+        return 0;
+    } else if (strncmp("--stats-fd=", cmdarg, 11) == 0) {
+        long fd = strtol(cmdarg + 11, &end, 10);
+        if (*end != '\0' || fd < 0 || fd > INT32_MAX)
+            return -1;
+        stats_fd = fd;
+        stats_opt = true;
+        return 0;
+    } else if (strncmp("--stats-socket=", cmdarg, 15) == 0) {
+        stats_socket = cmdarg + 15;
+        stats_opt = true;
+        return 0;
+    } else if (strncmp("--stats-interval=", cmdarg, 17) == 0) {
+        unsigned long secs = strtoul(cmdarg + 17, &end, 10);
+        if (*end != '\0' || secs < 1 || secs > 86400)
+            return -1;
+        stats_interval = secs;
+        stats_opt = true;
+        return 0;
+    } else if (strncmp("--perf-counters=", cmdarg, 16) == 0) {
+        char *list = cmdarg + 16;
+        do {
+            size_t len = strcspn(list, ",");
+            unsigned i;
+            for (i = 0; i < PERF_EVENTS_MAX; i++) {
+                if (strlen(perf_events[i].name) == len &&
+                    strncmp(perf_events[i].name, list, len) == 0)
+                    break;
+            }
+            if (i == PERF_EVENTS_MAX)
+                return -1;
+            perf_requested[i] = true;
+            list += len;
+        } while (*list++ == ',');
+        stats_opt = true;
+        return 0;
+    }
+    return -1;
+}
+
+static const char *usage(void)
+{
+    return "--stats (report VM exit and hypercall statistics on exit)\n"
+           "  [ --stats-fd=FD ] (write statistics to FD instead of stderr)\n"
+           "  [ --stats-interval=SECS ] (also report every SECS seconds)\n"
+           "  [ --stats-socket=PATH ] (report statistics to clients "
+           "connecting to the Unix socket at PATH)\n"
+           "  [ --perf-counters=LIST ] (also count perf events in LIST, "
+           "e.g. cycles,instructions)";
+}
+
+static int setup(struct hvt *hvt, struct mft *mft)
+{
+    (void)mft;
+
+    if (!stats_opt)
+        return 0; /* Not present */
+
+    struct stat sb;
+    if (fstat(stats_fd, &sb) == -1)
+        err(1, "stats: Invalid file descriptor: %d", stats_fd);
+
+    if (stats_socket) {
+        struct sockaddr_un sun = {.sun_family = AF_UNIX};
+        if (strlen(stats_socket) >= sizeof sun.sun_path)
+            errx(1, "stats: Socket path too long: %s", stats_socket);
+        strcpy(sun.sun_path, stats_socket);
+        /*
+         * Replace a stale socket left over from a previous run, but nothing
+         * else.
+         */
+        if (lstat(stats_socket, &sb) == 0 && S_ISSOCK(sb.st_mode))
+            unlink(stats_socket);
+        listen_fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+        if (listen_fd == -1)
+            err(1, "stats: socket() failed");
+        if (bind(listen_fd, (struct sockaddr *)&sun, sizeof sun) == -1)
+            err(1, "stats: Could not bind to %s", stats_socket);
+        if (listen(listen_fd, 4) == -1)
+            err(1, "stats: listen() failed");
+        /*
+         * A client going away before reading its report must not take the
+         * tender down with it.
+         */
+        signal(SIGPIPE, SIG_IGN);
+        hvt_core_seccomp_allow |= HVT_SECCOMP_ALLOW_ACCEPT;
+    }
+
+    if (hvt_core_register_halt_hook(halt_hook) == -1)
+        return -1;
+
+    if (listen_fd != -1 || stats_interval != 0) {
+        pthread_t thread;
+        if (pthread_create(&thread, NULL, stats_thread_fn, NULL) != 0)
+            errx(1, "stats: Could not create thread");
+        pthread_detach(thread);
+        /*
+         * As for the net I/O thread, wait for the thread to be fully
+         * initialized before hvt_drop_privileges() restricts the available
+         * syscalls.
+         */
+        pthread_mutex_lock(&stats_lock);
+        while (!stats_thread_ready)
+            pthread_cond_wait(&stats_cv, &stats_lock);
+        pthread_mutex_unlock(&stats_lock);
+    }
+
+    kvm_stats_init(hvt);
+    perf_init();
+    hvt_stats_enabled = true;
+    return 0;
+}
+
+DECLARE_MODULE(stats, .setup = setup, .handle_cmdarg = handle_cmdarg,
+               .usage = usage)
@@ -95,7 +95,7 @@ static struct vcpu_segment_info sreg_to_vsi(const struct x86_sreg *sreg)
 
 void hvt_mem_size(size_t *mem_size)
 {
-    hvt_x86_mem_size(mem_size);
+    hvt_x86_mem_size(mem_size, X86_GUEST_MAX_MEM_SIZE);
 }
 
 void hvt_mem_size_roundup(size_t *mem_size)
@@ -167,6 +167,7 @@ int hvt_vcpu_loop(struct hvt *hvt)
     vrp->vrp_vm_id = hvb->vcp_id;
     vrp->vrp_vcpu_id = hvb->vcpu_id;
 
+    hvt_boot_trace_mark(HVT_TRACE_VCPU_RUN);
     for (;;) {
         if (ioctl(hvb->vmd_fd, VMM_IOC_RUN, vrp) < 0) {
             err(1, "hvt_vcpu_loop: vm / vcpu run ioctl failed");
@@ -0,0 +1,631 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * hvt_pool.c: Pool of tenders started in advance.
+ *
+ * solo5-hvt --pool-serve=PATH runs a daemon listening on the Unix socket at
+ * PATH, which keeps a number of tender processes ("shells") for each of the
+ * given guest memory sizes. Each shell has opened /dev/kvm, created the VM
+ * and vCPU, and allocated and populated guest memory, and waits to be handed
+ * a unikernel to run.
+ *
+ * solo5-hvt --pool=PATH [ OPTIONS ] KERNEL [ ARGS ] sends its command line,
+ * working directory and standard file descriptors to the daemon, which passes
+ * them on to the smallest idle shell with at least the requested --mem, and
+ * starts a new shell in its place. The shell then carries on as a tender
+ * started with that command line would, from reading the unikernel onwards,
+ * including dropping privileges. If no shell fits, a tender is started from
+ * scratch. The daemon reports the exit status of the tender back to the
+ * client, and terminates the tender should the client go away.
+ *
+ * Tenders run as the user running the daemon, so only that user (or root) may
+ * connect to it.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <inttypes.h>
+#include <limits.h>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <unistd.h>
+#include <linux/kvm.h>
+
+#include "hvt.h"
+#include "hvt_kvm.h"
+#include "../common/mem_policy.h"
+
+/*
+ * A request is the client's working directory followed by its command line,
+ * as consecutive NUL-terminated strings, with its standard input, output and
+ * error passed as SCM_RIGHTS. The reply is the tender's exit status, as an
+ * int32_t.
+ */
+#define POOL_MSG_MAX 65536
+#define POOL_NFDS 3
+
+#define POOL_SIZES_MAX 8
+#define POOL_DEFAULT_MEM 512 /* MB, as for --mem */
+
+struct pool_shell {
+    pid_t pid;
+    int fd; /* Daemon end of the socket pair to the shell */
+    size_t mem; /* Guest memory in MB, 0 for a tender started from scratch */
+    int client_fd; /* -1 while idle */
+};
+
+static struct pool_shell *shells;
+static size_t nshells;
+static int listen_fd = -1;
+static int sig_pipe[2] = {-1, -1};
+
+static void sig_handler(int signo)
+{
+    unsigned char byte = signo;
+    (void)!write(sig_pipe[1], &byte, 1);
+}
+
+/*
+ * Send (len) bytes of (buf) to (fd), with (fds) attached.
+ */
+static int send_fds(int fd, const void *buf, size_t len, const int *fds,
+                    size_t nfds)
+{
+    struct iovec iov = {.iov_base = (void *)(uintptr_t)buf, .iov_len = len};
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(POOL_NFDS * sizeof(int))];
+    } cmsg;
+    struct msghdr msg = {.msg_iov = &iov,
+                         .msg_iovlen = 1,
+                         .msg_control = cmsg.buf,
+                         .msg_controllen = CMSG_SPACE(nfds * sizeof(int))};
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+
+    assert(nfds <= POOL_NFDS);
+    c->cmsg_level = SOL_SOCKET;
+    c->cmsg_type = SCM_RIGHTS;
+    c->cmsg_len = CMSG_LEN(nfds * sizeof(int));
+    memcpy(CMSG_DATA(c), fds, nfds * sizeof(int));
+    ssize_t nbytes;
+    while ((nbytes = sendmsg(fd, &msg, MSG_NOSIGNAL)) == -1 && errno == EINTR)
+        ;
+    return (nbytes == (ssize_t)len) ? 0 : -1;
+}
+
+/*
+ * Receive a request from (fd) into (buf), and its file descriptors into
+ * (fds). Returns the size of the request, 0 on end of file, or -1 if the
+ * request is malformed.
+ */
+static ssize_t recv_request(int fd, char *buf, int *fds)
+{
+    struct iovec iov = {.iov_base = buf, .iov_len = POOL_MSG_MAX};
+    union {
+        struct cmsghdr hdr;
+        char buf[CMSG_SPACE(POOL_NFDS * sizeof(int))];
+    } cmsg;
+    struct msghdr msg = {.msg_iov = &iov,
+                         .msg_iovlen = 1,
+                         .msg_control = cmsg.buf,
+                         .msg_controllen = sizeof cmsg.buf};
+    ssize_t nbytes;
+
+    while ((nbytes = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC)) == -1 &&
+           errno == EINTR)
+        ;
+    if (nbytes <= 0)
+        return nbytes;
+
+    struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+    if (c == NULL || c->cmsg_level != SOL_SOCKET ||
+        c->cmsg_type != SCM_RIGHTS) {
+        return -1;
+    }
+    size_t nfds = (c->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+    memcpy(fds, CMSG_DATA(c), nfds * sizeof(int));
+    if (nfds != POOL_NFDS || (msg.msg_flags & (MSG_TRUNC | MSG_CTRUNC)) ||
+        buf[nbytes - 1] != '\0') {
+        for (size_t i = 0; i < nfds; i++)
+            close(fds[i]);
+        return -1;
+    }
+    return nbytes;
+}
+
+/*
+ * Returns the guest memory in MB requested by the command line in (args),
+ * (len) bytes of NUL-terminated strings.
+ */
+static size_t request_mem(const char *args, size_t len)
+{
+    size_t mem = POOL_DEFAULT_MEM;
+
+    for (const char *a = args; a < args + len && a[0] == '-';
+         a += strlen(a) + 1) {
+        if (strcmp(a, "--") == 0)
+            break;
+        if (strncmp(a, "--mem=", 6) == 0)
+            sscanf(a + 6, "%zu", &mem);
+    }
+    return mem;
+}
+
+/*
+ * Runs in a new shell: creates the VM for (mem) MB of guest memory, if any,
+ * waits for a request on (fd) and takes on the client's standard file
+ * descriptors, working directory and command line.
+ */
+static struct hvt *shell_run(int fd, size_t mem, int *argc, char ***argv)
+{
+    struct hvt *hvt = NULL;
+
+    if (mem > 0) {
+        size_t mem_size = mem << 20;
+        hvt_mem_size(&mem_size);
+        mem_size += hvt_net_mem_overhead(NULL);
+        hvt_mem_size_roundup(&mem_size);
+        hvt = hvt_init(mem_size);
+
+        struct mem_policy mp = MEM_POLICY_INIT;
+        mp.prefault = true;
+        mem_policy_apply(&mp, hvt->mem, 0, hvt->mem_alloc_size, 0);
+    }
+
+    static char buf[POOL_MSG_MAX];
+    int fds[POOL_NFDS];
+    ssize_t len = recv_request(fd, buf, fds);
+    if (len <= 0)
+        _exit(len == 0 ? 0 : 1); /* The daemon went away */
+    close(fd);
+
+    hvt_boot_trace_mark(HVT_TRACE_MAIN);
+    for (int i = 0; i < POOL_NFDS; i++) {
+        if (dup2(fds[i], i) == -1)
+            _exit(1);
+        close(fds[i]);
+    }
+    if (chdir(buf) == -1)
+        err(1, "pool: %s", buf);
+
+    /*
+     * The command line follows the working directory.
+     */
+    size_t nargs = 0;
+    for (ssize_t i = strlen(buf) + 1; i < len; i++)
+        if (buf[i] == '\0')
+            nargs++;
+    char **args = calloc(nargs + 1, sizeof(char *));
+    if (args == NULL)
+        err(1, "calloc");
+    char *a = buf + strlen(buf) + 1;
+    for (size_t i = 0; i < nargs; i++) {
+        args[i] = a;
+        a += strlen(a) + 1;
+    }
+    *argc = nargs;
+    *argv = args;
+    return hvt;
+}
+
+/*
+ * Starts a shell for (mem) MB of guest memory. Returns its index in shells[]
+ * in the daemon, or (size_t)-1 in the shell itself.
+ */
+static size_t shell_start(size_t mem)
+{
+    int sv[2];
+
+    if (socketpair(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0, sv) == -1)
+        err(1, "pool: socketpair() failed");
+    pid_t pid = fork();
+    if (pid == -1)
+        err(1, "pool: fork() failed");
+    if (pid == 0) {
+        /*
+         * Only keep what the shell needs of the daemon's state.
+         */
+        signal(SIGCHLD, SIG_DFL);
+        signal(SIGPIPE, SIG_DFL);
+        signal(SIGINT, SIG_DFL);
+        signal(SIGTERM, SIG_DFL);
+        close(listen_fd);
+        close(sig_pipe[0]);
+        close(sig_pipe[1]);
+        for (size_t i = 0; i < nshells; i++) {
+            close(shells[i].fd);
+            if (shells[i].client_fd != -1)
+                close(shells[i].client_fd);
+        }
+        free(shells);
+        close(sv[0]);
+        listen_fd = sv[1];
+        return (size_t)-1;
+    }
+    close(sv[1]);
+
+    struct pool_shell *s = realloc(shells, (nshells + 1) * sizeof *s);
+    if (s == NULL)
+        err(1, "realloc");
+    shells = s;
+    shells[nshells] = (struct pool_shell){
+        .pid = pid, .fd = sv[0], .mem = mem, .client_fd = -1};
+    return nshells++;
+}
+
+static void shell_remove(size_t i)
+{
+    close(shells[i].fd);
+    if (shells[i].client_fd != -1)
+        close(shells[i].client_fd);
+    shells[i] = shells[--nshells];
+}
+
+/*
+ * Handles a connection on the daemon's socket. Returns true in a shell which
+ * has been handed the request, false in the daemon.
+ */
+static bool handle_client(int cfd)
+{
+    struct ucred cred;
+    socklen_t cred_len = sizeof cred;
+    if (getsockopt(cfd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == -1 ||
+        (cred.uid != geteuid() && cred.uid != 0)) {
+        warnx("pool: Rejecting connection from uid %u", (unsigned)cred.uid);
+        close(cfd);
+        return false;
+    }
+
+    static char buf[POOL_MSG_MAX];
+    int fds[POOL_NFDS];
+    ssize_t len = recv_request(cfd, buf, fds);
+    if (len <= 0) {
+        if (len == -1)
+            warnx("pool: Malformed request");
+        close(cfd);
+        return false;
+    }
+
+    size_t cwd_len = strlen(buf) + 1;
+    size_t mem = request_mem(buf + cwd_len, len - cwd_len);
+    size_t best = (size_t)-1;
+    for (size_t i = 0; i < nshells; i++) {
+        if (shells[i].client_fd == -1 && shells[i].mem >= mem &&
+            (best == (size_t)-1 || shells[i].mem < shells[best].mem))
+            best = i;
+    }
+    size_t replace = (best == (size_t)-1) ? 0 : shells[best].mem;
+    if (best == (size_t)-1) {
+        best = shell_start(0);
+        if (best == (size_t)-1) {
+            close(cfd);
+            for (int i = 0; i < POOL_NFDS; i++)
+                close(fds[i]);
+            return true;
+        }
+    }
+
+    int rc = send_fds(shells[best].fd, buf, len, fds, POOL_NFDS);
+    for (int i = 0; i < POOL_NFDS; i++)
+        close(fds[i]);
+    if (rc == -1) {
+        warn("pool: Could not hand request to shell %d", (int)shells[best].pid);
+        kill(shells[best].pid, SIGKILL);
+        close(cfd);
+        return false;
+    }
+    shells[best].client_fd = cfd;
+
+    if (replace > 0)
+        return shell_start(replace) == (size_t)-1;
+    return false;
+}
+
+/*
+ * Reaps exited shells, reporting the status of those running a unikernel to
+ * their client. Returns true in a replacement shell.
+ */
+static bool reap_shells(void)
+{
+    pid_t pid;
+    int status;
+
+    while ((pid = waitpid(-1, &status, WNOHANG)) > 0) {
+        size_t i;
+        for (i = 0; i < nshells && shells[i].pid != pid; i++)
+            ;
+        if (i == nshells)
+            continue;
+
+        int32_t code = WIFEXITED(status) ? WEXITSTATUS(status)
+                                         : 128 + WTERMSIG(status);
+        if (shells[i].client_fd != -1) {
+            (void)!send(shells[i].client_fd, &code, sizeof code,
+                        MSG_NOSIGNAL);
+            shell_remove(i);
+            continue;
+        }
+
+        /*
+         * An idle shell only exits by itself if it could not be set up, in
+         * which case starting another is likely to fail just the same.
+         */
+        size_t mem = shells[i].mem;
+        shell_remove(i);
+        if (code == 0 || code == 128 + SIGKILL || code == 128 + SIGTERM) {
+            if (shell_start(mem) == (size_t)-1)
+                return true;
+        } else {
+            warnx("pool: Shell for %zu MB exited with status %d, not "
+                  "replacing it",
+                  mem, (int)code);
+        }
+    }
+    return false;
+}
+
+static void parse_spec(const char *spec, char *path, size_t path_size,
+                       size_t *sizes, size_t *nsizes, unsigned *count)
+{
+    size_t len = strcspn(spec, ",");
+    if (len == 0 || len >= path_size)
+        errx(1, "pool: Invalid socket path");
+    memcpy(path, spec, len);
+    path[len] = '\0';
+
+    *nsizes = 0;
+    *count = 2;
+    for (const char *opt = spec + len; *opt == ',';) {
+        opt++;
+        char *end;
+        if (strncmp(opt, "shells=", 7) == 0) {
+            unsigned long n = strtoul(opt + 7, &end, 10);
+            if (end == opt + 7 || n == 0 || n > 64)
+                errx(1, "pool: Invalid number of shells: %s", opt + 7);
+            *count = n;
+            opt = end;
+        } else if (strncmp(opt, "mem=", 4) == 0) {
+            opt += 4;
+            do {
+                if (*opt == ':')
+                    opt++;
+                unsigned long long mem = strtoull(opt, &end, 10);
+                if (end == opt || mem == 0 || mem > (SIZE_MAX >> 20))
+                    errx(1, "pool: Invalid memory size: %s", opt);
+                if (*nsizes == POOL_SIZES_MAX)
+                    errx(1, "pool: At most %d memory sizes may be given",
+                         POOL_SIZES_MAX);
+                sizes[(*nsizes)++] = mem;
+                opt = end;
+            } while (*opt == ':');
+        } else {
+            errx(1, "pool: Invalid option: %s", opt);
+        }
+        if (*opt != '\0' && *opt != ',')
+            errx(1, "pool: Invalid option: %s", opt);
+    }
+    if (*nsizes == 0)
+        sizes[(*nsizes)++] = POOL_DEFAULT_MEM;
+}
+
+struct hvt *hvt_pool_serve(const char *spec, int *argc, char ***argv)
+{
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    size_t sizes[POOL_SIZES_MAX], nsizes;
+    unsigned count;
+
+    if (*argc != 1)
+        errx(1, "pool: --pool-serve takes no other options");
+    parse_spec(spec, path, sizeof path, sizes, &nsizes, &count);
+
+    struct sockaddr_un sun = {.sun_family = AF_UNIX};
+    strcpy(sun.sun_path, path);
+    /*
+     * Replace a stale socket left over from a previous run, but nothing else.
+     */
+    struct stat sb;
+    if (lstat(path, &sb) == 0 && S_ISSOCK(sb.st_mode))
+        unlink(path);
+    listen_fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (listen_fd == -1)
+        err(1, "pool: socket() failed");
+    mode_t mask = umask(0077);
+    if (bind(listen_fd, (struct sockaddr *)&sun, sizeof sun) == -1)
+        err(1, "pool: Could not bind to %s", path);
+    umask(mask);
+    if (listen(listen_fd, 64) == -1)
+        err(1, "pool: listen() failed");
+
+    if (pipe2(sig_pipe, O_CLOEXEC | O_NONBLOCK) == -1)
+        err(1, "pool: pipe2() failed");
+    struct sigaction sa;
+    memset(&sa, 0, sizeof sa);
+    sa.sa_handler = sig_handler;
+    sa.sa_flags = SA_RESTART;
+    sigfillset(&sa.sa_mask);
+    if (sigaction(SIGCHLD, &sa, NULL) == -1 ||
+        sigaction(SIGINT, &sa, NULL) == -1 ||
+        sigaction(SIGTERM, &sa, NULL) == -1)
+        err(1, "pool: Could not install signal handler");
+    signal(SIGPIPE, SIG_IGN);
+
+    for (size_t i = 0; i < nsizes; i++) {
+        for (unsigned n = 0; n < count; n++) {
+            if (shell_start(sizes[i]) == (size_t)-1)
+                return shell_run(listen_fd, sizes[i], argc, argv);
+        }
+    }
+    warnx("pool: Serving %s with %u shell(s) each of %zu size(s)", path,
+          count, nsizes);
+
+    struct pollfd *pfds = NULL;
+    for (;;) {
+        /*
+         * Clients are watched so that their tender can be terminated should
+         * they go away.
+         */
+        pfds = realloc(pfds, (2 + nshells) * sizeof *pfds);
+        if (pfds == NULL)
+            err(1, "realloc");
+        pfds[0] = (struct pollfd){.fd = listen_fd, .events = POLLIN};
+        pfds[1] = (struct pollfd){.fd = sig_pipe[0], .events = POLLIN};
+        size_t npfds = 2;
+        for (size_t i = 0; i < nshells; i++) {
+            if (shells[i].client_fd != -1)
+                pfds[npfds++] =
+                    (struct pollfd){.fd = shells[i].client_fd, .events = 0};
+        }
+        if (poll(pfds, npfds, -1) == -1) {
+            if (errno == EINTR)
+                continue;
+            err(1, "pool: poll() failed");
+        }
+
+        if (pfds[1].revents & POLLIN) {
+            unsigned char signo;
+            bool child = false;
+            while (read(sig_pipe[0], &signo, 1) == 1) {
+                if (signo == SIGCHLD) {
+                    child = true;
+                    continue;
+                }
+                unlink(path);
+                for (size_t i = 0; i < nshells; i++)
+                    kill(shells[i].pid, SIGTERM);
+                errx(1, "Exiting on signal %d", signo);
+            }
+            if (child && reap_shells())
+                break;
+        }
+        for (size_t p = 2; p < npfds; p++) {
+            if (!(pfds[p].revents & (POLLHUP | POLLERR)))
+                continue;
+            for (size_t i = 0; i < nshells; i++) {
+                if (shells[i].client_fd == pfds[p].fd)
+                    kill(shells[i].pid, SIGTERM);
+            }
+        }
+        if (pfds[0].revents & POLLIN) {
+            int cfd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC);
+            if (cfd == -1)
+                continue;
+            if (handle_client(cfd))
+                break;
+        }
+    }
+
+    /*
+     * This is a new shell, started by shell_start() above.
+     */
+    free(pfds);
+    return shell_run(listen_fd, 0, argc, argv);
+}
+
+/*
+ * Releases a VM created by hvt_init() in advance which does not suit the
+ * tender after all.
+ */
+static void pool_release(struct hvt *hvt)
+{
+    struct hvt_b *hvb = hvt->b;
+
+    size_t runsize = ioctl(hvb->kvmfd, KVM_GET_VCPU_MMAP_SIZE, NULL);
+    if (runsize != (size_t)-1)
+        munmap(hvb->vcpurun, runsize);
+    close(hvb->vcpufd);
+    close(hvb->vmfd);
+    close(hvb->kvmfd);
+    munmap(hvt->mem, hvt->mem_alloc_size);
+    free(hvb);
+    free(hvt);
+}
+
+struct hvt *hvt_pool_take(struct hvt *warm, size_t mem_size)
+{
+    if (warm == NULL)
+        return hvt_init(mem_size);
+    /*
+     * Exits can only be disabled before the vCPU is created.
+     */
+    if (mem_size > warm->mem_alloc_size || hvt_core_disable_exits) {
+        pool_release(warm);
+        return hvt_init(mem_size);
+    }
+    hvt_mem_shrink(warm, mem_size);
+    return warm;
+}
+
+void hvt_pool_client(const char *path, int argc, char **argv)
+{
+    static char buf[POOL_MSG_MAX];
+    size_t len;
+
+    if (getcwd(buf, sizeof buf) == NULL)
+        err(1, "pool: getcwd() failed");
+    len = strlen(buf) + 1;
+    for (int i = 0; i < argc; i++) {
+        size_t arg_len = strlen(argv[i]) + 1;
+        if (arg_len > sizeof buf - len)
+            errx(1, "pool: Command line too long");
+        memcpy(buf + len, argv[i], arg_len);
+        len += arg_len;
+    }
+
+    struct sockaddr_un sun = {.sun_family = AF_UNIX};
+    if (strlen(path) >= sizeof sun.sun_path)
+        errx(1, "pool: Invalid socket path");
+    strcpy(sun.sun_path, path);
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd == -1)
+        err(1, "pool: socket() failed");
+    if (connect(fd, (struct sockaddr *)&sun, sizeof sun) == -1)
+        err(1, "pool: Could not connect to %s", path);
+    const int fds[POOL_NFDS] = {0, 1, 2};
+    if (send_fds(fd, buf, len, fds, POOL_NFDS) == -1)
+        err(1, "pool: Could not send request to %s", path);
+
+    /*
+     * The tender now runs in the daemon, and its exit status is ours. Signals
+     * which terminate us also end it, by closing the connection.
+     */
+    int32_t status;
+    ssize_t nbytes;
+    while ((nbytes = recv(fd, &status, sizeof status, 0)) == -1 &&
+           errno == EINTR)
+        ;
+    if (nbytes == -1)
+        err(1, "pool: %s", path);
+    if (nbytes != sizeof status)
+        errx(1, "pool: %s: Connection closed by the daemon", path);
+    exit(status);
+}
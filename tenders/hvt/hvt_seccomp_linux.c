@@ -66,8 +66,9 @@ void hvt_seccomp_apply(void)
         SCMP_SYS(write), /* console, net tap, stderr */
         SCMP_SYS(pread64), /* block read */
         SCMP_SYS(pwrite64), /* block write */
-        SCMP_SYS(epoll_pwait), /* poll hypercall */
-        SCMP_SYS(timerfd_settime), /* timeout for the poll */
+        SCMP_SYS(epoll_pwait), /* poll hypercall, no timeout or fallback */
+        SCMP_SYS(poll), /* net I/O thread, waiting for TX space */
+        SCMP_SYS(ppoll), /* net I/O thread, waiting for TX space */
         SCMP_SYS(clock_gettime), /* walltime hypercall */
         SCMP_SYS(exit_group), /* guest exit */
         SCMP_SYS(rt_sigreturn), /* signal handler returning */
@@ -88,6 +89,61 @@ void hvt_seccomp_apply(void)
             errx(1, "seccomp_rule_add() failed: %s", strerror(-rc));
     }
 
+    /*
+     * Syscalls only allowed if a module in use needs them, see
+     * hvt_core_seccomp_allow.
+     */
+    static const struct {
+        unsigned flag;
+        int nr;
+    } allow_if[] = {
+        /* I/O rate limits, profiler sampling */
+        {HVT_SECCOMP_ALLOW_SLEEP, SCMP_SYS(nanosleep)},
+        {HVT_SECCOMP_ALLOW_SLEEP, SCMP_SYS(clock_nanosleep)},
+        /* profiler: pthread_kill() of the vCPU thread, consuming SIGPROF */
+        {HVT_SECCOMP_ALLOW_SIGNAL, SCMP_SYS(rt_sigtimedwait)},
+        {HVT_SECCOMP_ALLOW_SIGNAL, SCMP_SYS(tgkill)},
+        {HVT_SECCOMP_ALLOW_SIGNAL, SCMP_SYS(getpid)},
+        /* stats and clone server sockets */
+        {HVT_SECCOMP_ALLOW_ACCEPT, SCMP_SYS(accept)},
+        {HVT_SECCOMP_ALLOW_ACCEPT, SCMP_SYS(accept4)},
+        /* snapshot: skipping untouched guest memory, sealing the memfd */
+        {HVT_SECCOMP_ALLOW_SNAPSHOT, SCMP_SYS(mincore)},
+        {HVT_SECCOMP_ALLOW_SNAPSHOT, SCMP_SYS(fcntl)},
+        /* clone server, passing the snapshot memfd to clones */
+        {HVT_SECCOMP_ALLOW_SENDMSG, SCMP_SYS(sendmsg)},
+        /* boot trace, peak RSS */
+        {HVT_SECCOMP_ALLOW_RUSAGE, SCMP_SYS(getrusage)},
+    };
+    for (size_t i = 0; i < sizeof(allow_if) / sizeof(allow_if[0]); i++) {
+        if (!(hvt_core_seccomp_allow & allow_if[i].flag))
+            continue;
+        rc = seccomp_rule_add(ctx, SCMP_ACT_ALLOW, allow_if[i].nr, 0);
+        if (rc != 0)
+            errx(1, "seccomp_rule_add() failed: %s", strerror(-rc));
+    }
+
+    /*
+     * The poll hypercall waits with a timeout using epoll_pwait2() if the host
+     * kernel and libseccomp (2.5.2 and later) support it, otherwise it arms a
+     * timerfd.
+     */
+#if defined(__SNR_epoll_pwait2)
+    if (hvt_core_epoll_pwait2) {
+        rc = seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(epoll_pwait2), 0);
+        if (rc != 0)
+            errx(1, "seccomp_rule_add() failed: %s", strerror(-rc));
+    }
+#else
+    hvt_core_epoll_pwait2 = false;
+#endif
+    if (!hvt_core_epoll_pwait2) {
+        rc = seccomp_rule_add(ctx, SCMP_ACT_ALLOW, SCMP_SYS(timerfd_settime),
+                              0);
+        if (rc != 0)
+            errx(1, "seccomp_rule_add() failed: %s", strerror(-rc));
+    }
+
     /* memfd install: clean libseccomp up before arming the filter. */
     int bpf_fd = _memfd_create("hvt_bpf_filter", 0);
     if (bpf_fd < 0)
@@ -31,6 +31,7 @@
 
 #include "../common/cc.h"
 #include "../common/elf.h"
+#include "../common/hugepages.h"
 #include "../common/mft.h"
 #include "spt_abi.h"
 
@@ -40,6 +41,10 @@ struct spt {
     struct spt_boot_info *bi;
     int epollfd;
     int timerfd;
+    uint32_t features; /* SPT_FEATURE_* */
+    uint64_t cycles_start; /* CPU cycle count at spt_init() */
+    uint64_t ns_start; /* CLOCK_MONOTONIC at spt_init() */
+    struct spt_io_uring io_uring; /* If SPT_FEATURE_IO_URING */
     void *sc_ctx;
 };
 
@@ -48,6 +53,22 @@ struct spt *spt_init(size_t mem_size);
 int spt_guest_mprotect(void *t_arg, uint64_t addr_start, uint64_t addr_end,
                        int prot);
 
+/*
+ * Back guest memory from (addr_start) to the end with huge pages of type
+ * (hp). See hugepages_back().
+ */
+void spt_mem_hugepages(struct spt *spt, uint64_t addr_start,
+                       enum hugepages hp);
+
+/*
+ * If enabled with --io-uring, set up an io_uring for the attached devices
+ * which can use it, reserving space for it at the top of guest memory above
+ * (p_end). Must be called before setup_modules(), whose net and block modules
+ * do not give the guest system call access to the devices in
+ * (spt->io_uring.handles).
+ */
+void spt_io_uring_init(struct spt *spt, struct mft *mft, uint64_t p_end);
+
 void spt_boot_info_init(struct spt *spt, uint64_t p_end, int cmdline_argc,
                         char **cmdline_argv, struct mft *mft, size_t mft_size);
 
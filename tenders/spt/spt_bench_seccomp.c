@@ -0,0 +1,269 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * spt_bench_seccomp.c: Measure the cost of the spt seccomp filter.
+ *
+ * For a given number of devices, builds a filter resembling that installed by
+ * solo5-spt using each of the rule layouts below, loads it in a child process
+ * and times a read() from the device with the highest file descriptor, i.e.
+ * the worst case for a filter checking the devices one after the other. The
+ * devices are all /dev/null, so the system call itself does no work.
+ */
+
+#define _GNU_SOURCE
+#include <assert.h>
+#include <err.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/wait.h>
+#include <time.h>
+#include <unistd.h>
+#include <seccomp.h>
+
+#include "mft_abi.h"
+#include "spt_seccomp.h"
+
+enum layout {
+    LAYOUT_NONE,        /* No filter */
+    LAYOUT_PER_FD,      /* One rule per device, no priorities */
+    LAYOUT_RANGES,      /* spt_seccomp_allow_fds(), priorities */
+    LAYOUT_RANGES_TREE, /* As above, with a binary tree of system calls */
+    LAYOUT_MAX
+};
+
+static const char *layout_names[LAYOUT_MAX] = {
+    [LAYOUT_NONE] = "none",
+    [LAYOUT_PER_FD] = "per-fd",
+    [LAYOUT_RANGES] = "ranges",
+    [LAYOUT_RANGES_TREE] = "ranges+tree",
+};
+
+#define ITERATIONS 1000000
+#define RUNS 15
+
+static uint64_t now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static void add_rule(scmp_filter_ctx ctx, int syscall, unsigned ncmps,
+                     const struct scmp_arg_cmp *cmps)
+{
+    int rc = seccomp_rule_add_array(ctx, SCMP_ACT_ALLOW, syscall, ncmps, cmps);
+    if (rc != 0)
+        errx(1, "seccomp_rule_add(%d) failed: %s", syscall, strerror(-rc));
+}
+
+/*
+ * Build a filter with the fixed rules of spt_core.c, followed by read() and
+ * write() rules for the (nfds) devices in (fds), and pread64() and pwrite64()
+ * rules for as many block devices.
+ */
+static scmp_filter_ctx build_filter(enum layout layout, const int *fds,
+                                    unsigned nfds)
+{
+    scmp_filter_ctx ctx = seccomp_init(SCMP_ACT_KILL);
+    assert(ctx != NULL);
+
+    if (layout == LAYOUT_RANGES)
+        spt_seccomp_optimize(ctx, false);
+    else if (layout == LAYOUT_RANGES_TREE)
+        spt_seccomp_optimize(ctx, true);
+
+    add_rule(ctx, SCMP_SYS(write), 1,
+             (struct scmp_arg_cmp[]){ SCMP_A0(SCMP_CMP_EQ, 1) });
+    add_rule(ctx, SCMP_SYS(exit_group), 0, NULL);
+    add_rule(ctx, SCMP_SYS(epoll_pwait), 1,
+             (struct scmp_arg_cmp[]){ SCMP_A0(SCMP_CMP_EQ, 1000) });
+    add_rule(ctx, SCMP_SYS(timerfd_settime), 1,
+             (struct scmp_arg_cmp[]){ SCMP_A0(SCMP_CMP_EQ, 1001) });
+    add_rule(ctx, SCMP_SYS(clock_gettime), 1,
+             (struct scmp_arg_cmp[]){ SCMP_A0(SCMP_CMP_EQ, CLOCK_MONOTONIC) });
+    add_rule(ctx, SCMP_SYS(clock_gettime), 1,
+             (struct scmp_arg_cmp[]){ SCMP_A0(SCMP_CMP_EQ, CLOCK_REALTIME) });
+    add_rule(ctx, SCMP_SYS(madvise), 3,
+             (struct scmp_arg_cmp[]){ SCMP_A0(SCMP_CMP_GE, 0x100000),
+                                      SCMP_A1(SCMP_CMP_LE, 0x20000000),
+                                      SCMP_A2(SCMP_CMP_EQ, MADV_DONTNEED) });
+
+    const struct scmp_arg_cmp block_cmps[] = {
+        SCMP_A2(SCMP_CMP_EQ, 512),
+        SCMP_A3(SCMP_CMP_LE, (1ULL << 30) - 512),
+    };
+    if (layout == LAYOUT_PER_FD) {
+        for (unsigned i = 0; i < nfds; i++) {
+            struct scmp_arg_cmp cmps[3] = {
+                SCMP_A0(SCMP_CMP_EQ, fds[i]), block_cmps[0], block_cmps[1]
+            };
+            add_rule(ctx, SCMP_SYS(read), 1, cmps);
+            add_rule(ctx, SCMP_SYS(write), 1, cmps);
+            add_rule(ctx, SCMP_SYS(pread64), 3, cmps);
+            add_rule(ctx, SCMP_SYS(pwrite64), 3, cmps);
+        }
+    }
+    else if (layout != LAYOUT_NONE) {
+        spt_seccomp_allow_fds(ctx, SCMP_SYS(read), "read", fds, nfds, NULL, 0);
+        spt_seccomp_allow_fds(ctx, SCMP_SYS(write), "write", fds, nfds, NULL,
+                              0);
+        spt_seccomp_allow_fds(ctx, SCMP_SYS(pread64), "pread64", fds, nfds,
+                              block_cmps, 2);
+        spt_seccomp_allow_fds(ctx, SCMP_SYS(pwrite64), "pwrite64", fds, nfds,
+                              block_cmps, 2);
+    }
+
+    return ctx;
+}
+
+static unsigned bpf_insns(scmp_filter_ctx ctx)
+{
+    FILE *f = tmpfile();
+    if (f == NULL)
+        err(1, "tmpfile() failed");
+    int rc = seccomp_export_bpf(ctx, fileno(f));
+    if (rc != 0)
+        errx(1, "seccomp_export_bpf() failed: %s", strerror(-rc));
+    struct stat sb;
+    if (fstat(fileno(f), &sb) == -1)
+        err(1, "fstat() failed");
+    fclose(f);
+    return sb.st_size / 8;
+}
+
+/*
+ * Returns the time taken by a read() from the last of (fds), in nanoseconds,
+ * with the filter for (layout) loaded.
+ */
+static double measure(enum layout layout, const int *fds, unsigned nfds)
+{
+    double *result = mmap(NULL, sizeof *result,
+                          PROT_READ | PROT_WRITE,
+                          MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+    if (result == MAP_FAILED)
+        err(1, "mmap() failed");
+    *result = -1.0;
+
+    pid_t pid = fork();
+    if (pid == -1)
+        err(1, "fork() failed");
+    if (pid == 0) {
+        if (layout != LAYOUT_NONE) {
+            scmp_filter_ctx ctx = build_filter(layout, fds, nfds);
+            int rc = seccomp_load(ctx);
+            if (rc != 0)
+                errx(1, "seccomp_load() failed: %s", strerror(-rc));
+        }
+        int fd = fds[nfds - 1];
+        char buf[1];
+        uint64_t start = now_ns();
+        for (unsigned i = 0; i < ITERATIONS; i++) {
+            if (read(fd, buf, 0) != 0)
+                _exit(1);
+        }
+        *result = (double)(now_ns() - start) / ITERATIONS;
+        _exit(0);
+    }
+
+    int status;
+    if (waitpid(pid, &status, 0) == -1)
+        err(1, "waitpid() failed");
+    if (!WIFEXITED(status) || WEXITSTATUS(status) != 0 || *result < 0)
+        errx(1, "%s: child failed (status 0x%x)", layout_names[layout],
+             status);
+    double ns = *result;
+    munmap(result, sizeof *result);
+    return ns;
+}
+
+static void usage(const char *prog)
+{
+    fprintf(stderr, "usage: %s [ NDEVICES ... ]\n", prog);
+    fprintf(stderr, "Measure the cost of a read() under the spt seccomp "
+                    "filter, for each rule layout\n"
+                    "and NDEVICES devices (default: 1 8 64).\n");
+    exit(1);
+}
+
+int main(int argc, char **argv)
+{
+    unsigned counts[16] = { 1, 8, 64 };
+    unsigned ncounts = 3;
+
+    if (argc > 1) {
+        if (argc - 1 > (int)(sizeof counts / sizeof counts[0]))
+            usage(argv[0]);
+        ncounts = 0;
+        for (int i = 1; i < argc; i++) {
+            char *end;
+            unsigned long n = strtoul(argv[i], &end, 10);
+            if (*end != '\0' || n < 1 || n > MFT_MAX_ENTRIES)
+                usage(argv[0]);
+            counts[ncounts++] = n;
+        }
+    }
+
+    printf("%8s %-12s %10s %10s %10s\n", "devices", "layout", "insns",
+           "ns/call", "overhead");
+    for (unsigned c = 0; c < ncounts; c++) {
+        unsigned nfds = counts[c];
+        int fds[nfds];
+        for (unsigned i = 0; i < nfds; i++) {
+            fds[i] = open("/dev/null", O_RDWR);
+            if (fds[i] == -1)
+                err(1, "open(/dev/null) failed");
+        }
+
+        /*
+         * Take the best of several runs, interleaving the layouts so that
+         * they are equally affected by other activity on the host.
+         */
+        double best[LAYOUT_MAX];
+        for (unsigned r = 0; r < RUNS; r++) {
+            for (enum layout l = LAYOUT_NONE; l < LAYOUT_MAX; l++) {
+                double ns = measure(l, fds, nfds);
+                if (r == 0 || ns < best[l])
+                    best[l] = ns;
+            }
+        }
+        for (enum layout l = LAYOUT_NONE; l < LAYOUT_MAX; l++) {
+            unsigned insns = 0;
+            if (l != LAYOUT_NONE) {
+                scmp_filter_ctx ctx = build_filter(l, fds, nfds);
+                insns = bpf_insns(ctx);
+                seccomp_release(ctx);
+            }
+            printf("%8u %-12s %10u %10.1f %+10.1f\n", nfds, layout_names[l],
+                   insns, best[l], best[l] - best[LAYOUT_NONE]);
+        }
+
+        for (unsigned i = 0; i < nfds; i++)
+            close(fds[i]);
+    }
+
+    return 0;
+}
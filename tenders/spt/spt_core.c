@@ -36,8 +36,14 @@
 #include <time.h>
 #include <seccomp.h>
 #include <sys/personality.h>
+#if defined(__x86_64__)
+#include <cpuid.h>
+#include <x86intrin.h>
+#endif
 #include <sys/epoll.h>
+#include <sys/syscall.h>
 #include <sys/timerfd.h>
+#include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
 #include <sys/prctl.h>
@@ -53,6 +59,7 @@
 #endif
 
 #include "spt.h"
+#include "spt_seccomp.h"
 
 /*
  * TODO: Split up the functions in this module better, and introduce something
@@ -67,6 +74,134 @@ extern long __executable_start;
 
 static bool use_exec_heap = false;
 
+/*
+ * Guest clocks may be derived from the CPU cycle counter, see
+ * SPT_FEATURE_TSC_CLOCK. If the frequency of the counter cannot be obtained
+ * from the CPU, it is measured against CLOCK_MONOTONIC over at least
+ * CYCLES_CALIBRATE_NS, starting from spt_init().
+ */
+#define CYCLES_CALIBRATE_NS 5000000ULL
+
+static bool host_clocksource_is(const char *name)
+{
+    char buf[64];
+    bool rc = false;
+
+    FILE *f = fopen(
+        "/sys/devices/system/clocksource/clocksource0/current_clocksource", "r");
+    if (f == NULL)
+        return false;
+    if (fgets(buf, sizeof buf, f) != NULL) {
+        buf[strcspn(buf, "\n")] = '\0';
+        rc = strcmp(buf, name) == 0;
+    }
+    fclose(f);
+    return rc;
+}
+
+#if defined(__x86_64__)
+static inline uint64_t read_cycles(void)
+{
+    return __rdtsc();
+}
+
+/*
+ * The TSC can only be used if it is invariant, and the host kernel uses it
+ * for its own clocks, i.e. it found it to be synchronised across CPUs.
+ */
+static bool cycles_usable(void)
+{
+    unsigned eax, ebx, ecx, edx;
+
+    if (__get_cpuid(0x80000007, &eax, &ebx, &ecx, &edx) == 0 ||
+        (edx & (1U << 8)) == 0)
+        return false;
+    return host_clocksource_is("tsc");
+}
+
+/*
+ * Returns the TSC frequency as enumerated by the CPU (CPUID leaf 0x15) or the
+ * hypervisor (leaf 0x40000010), or 0 if not available.
+ */
+static uint64_t cycles_freq(void)
+{
+    unsigned eax, ebx, ecx, edx;
+
+    if (__get_cpuid_max(0, NULL) >= 0x15) {
+        __cpuid_count(0x15, 0, eax, ebx, ecx, edx);
+        if (eax != 0 && ebx != 0 && ecx != 0)
+            return (uint64_t)ecx * ebx / eax;
+    }
+    __cpuid(1, eax, ebx, ecx, edx);
+    if ((ecx & (1U << 31)) == 0)
+        return 0; /* No hypervisor */
+    __cpuid(0x40000000, eax, ebx, ecx, edx);
+    if (eax >= 0x40000010) {
+        __cpuid(0x40000010, eax, ebx, ecx, edx);
+        if (eax != 0)
+            return (uint64_t)eax * 1000;
+    }
+    return 0;
+}
+#elif defined(__aarch64__)
+static inline uint64_t read_cycles(void)
+{
+    uint64_t val;
+
+    __asm__ __volatile__("isb; mrs %0, cntvct_el0" : "=r"(val)::"memory");
+    return val;
+}
+
+static bool cycles_usable(void)
+{
+    return host_clocksource_is("arch_sys_counter");
+}
+
+static uint64_t cycles_freq(void)
+{
+    uint64_t val;
+
+    __asm__ __volatile__("mrs %0, cntfrq_el0" : "=r"(val));
+    return val;
+}
+#else
+static inline uint64_t read_cycles(void)
+{
+    return 0;
+}
+
+static bool cycles_usable(void)
+{
+    return false;
+}
+
+static uint64_t cycles_freq(void)
+{
+    return 0;
+}
+#endif
+
+static uint64_t clock_ns(clockid_t id)
+{
+    struct timespec ts;
+
+    if (clock_gettime(id, &ts) == -1)
+        err(1, "clock_gettime() failed");
+    return (ts.tv_sec * 1000000000ULL) + ts.tv_nsec;
+}
+
+/*
+ * Reads the CPU cycle counter and CLOCK_MONOTONIC at (as close as possible
+ * to) the same time.
+ */
+static void read_cycles_ns(uint64_t *cycles, uint64_t *ns)
+{
+    uint64_t c0 = read_cycles();
+    *ns = clock_ns(CLOCK_MONOTONIC);
+    uint64_t c1 = read_cycles();
+    *cycles = c0 + (c1 - c0) / 2;
+}
+
 struct spt *spt_init(size_t mem_size)
 {
     struct spt *spt = malloc(sizeof(struct spt));
@@ -148,8 +283,31 @@ struct spt *spt_init(size_t mem_size)
     if (epoll_ctl(spt->epollfd, EPOLL_CTL_ADD, spt->timerfd, &ev) == -1)
         err(1, "epoll_ctl(EPOLL_CTL_ADD) failed");
 
+    /*
+     * If both the host kernel (5.11 and later) and libseccomp (2.5.2 and
+     * later) know about epoll_pwait2(), let the guest use it in yield()
+     * instead of arming the timerfd.
+     */
+#if defined(SYS_epoll_pwait2) && defined(__SNR_epoll_pwait2)
+    struct timespec ts = {0};
+    if (syscall(SYS_epoll_pwait2, spt->epollfd, &ev, 1, &ts, NULL, 0) != -1)
+        spt->features |= SPT_FEATURE_EPOLL_PWAIT2;
+#endif
+
+    if (cycles_usable()) {
+        spt->features |= SPT_FEATURE_TSC_CLOCK;
+        read_cycles_ns(&spt->cycles_start, &spt->ns_start);
+    }
+
     spt->sc_ctx = seccomp_init(SCMP_ACT_KILL);
     assert(spt->sc_ctx != NULL);
+    /*
+     * A binary tree of system calls measures no faster than checking the
+     * hot ones first, for the dozen or so we allow, and is one more thing
+     * which may differ between libseccomp versions. See
+     * solo5-spt-bench-seccomp.
+     */
+    spt_seccomp_optimize(spt->sc_ctx, false);
 
     return spt;
 }
@@ -176,6 +334,14 @@ int spt_guest_mprotect(void *t_arg, uint64_t addr_start, uint64_t addr_end,
     return mprotect(vaddr_start, size, prot);
 }
 
+void spt_mem_hugepages(struct spt *spt, uint64_t addr_start,
+                       enum hugepages hp)
+{
+    int prot = PROT_READ | PROT_WRITE | (use_exec_heap ? PROT_EXEC : 0);
+
+    hugepages_back(spt->mem, addr_start, spt->mem_size, prot, hp);
+}
+
 static void setup_cmdline(uint8_t *cmdline, int argc, char **argv)
 {
     size_t cmdline_free = SPT_CMDLINE_SIZE;
@@ -206,6 +372,30 @@ void spt_boot_info_init(struct spt *spt, uint64_t p_end, int cmdline_argc,
     bi->kernel_end = p_end;
     bi->epollfd = spt->epollfd;
     bi->timerfd = spt->timerfd;
+    bi->features = spt->features;
+    if (spt->features & SPT_FEATURE_IO_URING)
+        bi->io_uring = spt->io_uring;
+
+    if (spt->features & SPT_FEATURE_TSC_CLOCK) {
+        uint64_t freq = cycles_freq();
+        uint64_t cycles, ns;
+
+        read_cycles_ns(&cycles, &ns);
+        if (freq == 0) {
+            if (ns - spt->ns_start < CYCLES_CALIBRATE_NS) {
+                struct timespec ts = {
+                    .tv_nsec = CYCLES_CALIBRATE_NS - (ns - spt->ns_start)};
+                nanosleep(&ts, NULL);
+                read_cycles_ns(&cycles, &ns);
+            }
+            freq = (cycles - spt->cycles_start) * 1000000000ULL /
+                   (ns - spt->ns_start);
+        }
+        bi->cpu_cycle_freq = freq;
+        bi->cpu_cycle_base = cycles;
+        bi->monotonic_base = ns;
+        bi->wall_base = clock_ns(CLOCK_REALTIME);
+    }
 
     bi->mft = (void *)lowmem_pos;
     memcpy(spt->mem + lowmem_pos, mft, mft_size);
@@ -327,21 +517,63 @@ static int setup(struct spt *spt, struct mft *mft)
                           SCMP_A0(SCMP_CMP_EQ, spt->epollfd));
     if (rc != 0)
         errx(1, "seccomp_rule_add(epoll_pwait) failed: %s", strerror(-rc));
-    rc =
-        seccomp_rule_add(spt->sc_ctx, SCMP_ACT_ALLOW, SCMP_SYS(timerfd_settime),
-                         1, SCMP_A0(SCMP_CMP_EQ, spt->timerfd));
-    if (rc != 0)
-        errx(1, "seccomp_rule_add(timerfd_settime) failed: %s", strerror(-rc));
-    rc = seccomp_rule_add(spt->sc_ctx, SCMP_ACT_ALLOW, SCMP_SYS(clock_gettime),
-                          1, SCMP_A0(SCMP_CMP_EQ, CLOCK_MONOTONIC));
-    if (rc != 0)
-        errx(1, "seccomp_rule_add(clock_gettime, CLOCK_MONOTONIC) failed: %s",
-             strerror(-rc));
+    /*
+     * yield() waits with a timeout using either epoll_pwait2(), or the timerfd
+     * as a fallback, see spt_init().
+     */
+#if defined(__SNR_epoll_pwait2)
+    if (spt->features & SPT_FEATURE_EPOLL_PWAIT2) {
+        rc = seccomp_rule_add(spt->sc_ctx, SCMP_ACT_ALLOW,
+                              SCMP_SYS(epoll_pwait2), 1,
+                              SCMP_A0(SCMP_CMP_EQ, spt->epollfd));
+        if (rc != 0)
+            errx(1, "seccomp_rule_add(epoll_pwait2) failed: %s",
+                 strerror(-rc));
+    }
+#endif
+    if (!(spt->features & SPT_FEATURE_EPOLL_PWAIT2)) {
+        rc = seccomp_rule_add(spt->sc_ctx, SCMP_ACT_ALLOW,
+                              SCMP_SYS(timerfd_settime), 1,
+                              SCMP_A0(SCMP_CMP_EQ, spt->timerfd));
+        if (rc != 0)
+            errx(1, "seccomp_rule_add(timerfd_settime) failed: %s",
+                 strerror(-rc));
+    }
+    /*
+     * With the TSC clock, the guest only needs to read CLOCK_REALTIME, to
+     * resynchronise its wall clock.
+     */
+    if (!(spt->features & SPT_FEATURE_TSC_CLOCK)) {
+        rc = seccomp_rule_add(spt->sc_ctx, SCMP_ACT_ALLOW,
+                              SCMP_SYS(clock_gettime), 1,
+                              SCMP_A0(SCMP_CMP_EQ, CLOCK_MONOTONIC));
+        if (rc != 0)
+            errx(1,
+                 "seccomp_rule_add(clock_gettime, CLOCK_MONOTONIC) failed: %s",
+                 strerror(-rc));
+    }
     rc = seccomp_rule_add(spt->sc_ctx, SCMP_ACT_ALLOW, SCMP_SYS(clock_gettime),
                           1, SCMP_A0(SCMP_CMP_EQ, CLOCK_REALTIME));
     if (rc != 0)
         errx(1, "seccomp_rule_add(clock_gettime, CLOCK_REALTIME) failed: %s",
              strerror(-rc));
+    /*
+     * solo5_mem_release(). A filter cannot check that (addr + len) lies
+     * within guest memory, so the bindings release a range in chunks whose
+     * size is a power of two (of at least a 4 KB page), and a chunk of each
+     * size is only allowed if it starts at least that far below the end of
+     * guest memory. The bindings also check that the range lies within the
+     * guest heap.
+     */
+    for (uint64_t size = 0x1000; size <= spt->mem_size; size <<= 1) {
+        rc = seccomp_rule_add(spt->sc_ctx, SCMP_ACT_ALLOW, SCMP_SYS(madvise),
+                              3, SCMP_A0(SCMP_CMP_LE, spt->mem_size - size),
+                              SCMP_A1(SCMP_CMP_LE, size),
+                              SCMP_A2(SCMP_CMP_EQ, MADV_DONTNEED));
+        if (rc != 0)
+            errx(1, "seccomp_rule_add(madvise, MADV_DONTNEED) failed: %s",
+                 strerror(-rc));
+    }
 #if defined(__x86_64__)
     rc = seccomp_rule_add(spt->sc_ctx, SCMP_ACT_ALLOW, SCMP_SYS(arch_prctl), 1,
                           SCMP_A0(SCMP_CMP_EQ, ARCH_SET_FS));
@@ -36,6 +36,7 @@
 #include <unistd.h>
 
 #include "spt.h"
+#include "../common/mem_policy.h"
 #include "version.h"
 
 extern struct spt_module __start_modules;
@@ -93,16 +94,31 @@ static void handle_mem(char *cmdarg, size_t *mem_size)
     *mem_size = mem;
 }
 
+static void handle_mem_hugepages(char *cmdarg, enum hugepages *hp)
+{
+    if (hugepages_parse(cmdarg + 16, hp) == -1)
+        errx(1, "Malformed argument to --mem-hugepages");
+}
+
 static void usage(const char *prog)
 {
     fprintf(stderr,
             "usage: %s [ CORE OPTIONS ] [ -- ] "
             "KERNEL [ ARGS ]\n",
             prog);
-    fprintf(stderr, "KERNEL is the filename of the unikernel to run.\n");
+    fprintf(stderr, "KERNEL is the filename of the unikernel to run, "
+            "and must not be\nmodified while it is running.\n");
     fprintf(stderr, "ARGS are optional arguments passed to the unikernel.\n");
     fprintf(stderr, "Core options:\n");
     fprintf(stderr, "  [ --mem=512 ] (guest memory in MB)\n");
+    fprintf(stderr, "  [ --mem-hugepages=2M|1G|thp ] (back guest memory with "
+                    "huge pages)\n");
+    fprintf(stderr, "  [ --mem-prefault ] (populate guest memory before "
+                    "starting the guest)\n");
+    fprintf(stderr, "  [ --mem-lock ] (populate and lock guest memory before "
+                    "starting the guest)\n");
+    fprintf(stderr, "  [ --numa-node=N ] (allocate guest memory on, and run "
+                    "on the CPUs of, NUMA node N)\n");
     fprintf(stderr, "    --help (display this help)\n");
     fprintf(stderr, "Compiled-in modules: ");
     for (struct spt_module *m = &__start_modules; m < &__stop_modules; m++) {
@@ -132,6 +148,8 @@ static void version(const char *prog)
 int main(int argc, char **argv)
 {
     size_t mem_size = 0x20000000;
+    enum hugepages mem_hugepages = HUGEPAGES_NONE;
+    struct mem_policy mem_policy = MEM_POLICY_INIT;
     uint64_t p_entry, p_end;
     const char *prog;
     const char *elf_filename;
@@ -219,6 +237,15 @@ int main(int argc, char **argv)
             matched = 1;
             argc--;
             argv++;
+        } else if (strncmp("--mem-hugepages=", *argv, 16) == 0) {
+            handle_mem_hugepages(*argv, &mem_hugepages);
+            matched = 1;
+            argc--;
+            argv++;
+        } else if (mem_policy_parse(*argv, &mem_policy) == 0) {
+            matched = 1;
+            argc--;
+            argv++;
         }
         if (handle_cmdarg(*argv, mft) == 0) {
             /* Handled by module, consume and go on to next arg */
@@ -243,7 +270,16 @@ int main(int argc, char **argv)
     struct spt *spt = spt_init(mem_size);
 
     elf_load(elf_fd, elf_filename, spt->mem, spt->mem_size, SPT_GUEST_MIN_BASE,
-             spt_guest_mprotect, spt, &p_entry, &p_end);
+             true, spt_guest_mprotect, spt, &p_entry, &p_end);
+    spt_io_uring_init(spt, mft, p_end);
+    /*
+     * Huge pages are only used above the loaded ELF binary, whose segments
+     * need page-granular protection.
+     */
+    if (mem_hugepages != HUGEPAGES_NONE)
+        spt_mem_hugepages(spt, p_end, mem_hugepages);
+    mem_policy_apply(&mem_policy, spt->mem, SPT_HOST_MEM_BASE, spt->mem_size,
+                     p_end);
     close(elf_fd);
 
     setup_modules(spt, mft);
@@ -27,6 +27,7 @@
 #include <assert.h>
 #include <err.h>
 #include <limits.h>
+#include <stdbool.h>
 #include <stdio.h>
 #include <string.h>
 #include <sys/types.h>
@@ -34,6 +35,7 @@
 
 #include "../common/block_attach.h"
 #include "spt.h"
+#include "spt_seccomp.h"
 
 static bool module_in_use;
 
@@ -70,6 +72,16 @@ static int handle_cmdarg(char *cmdarg, struct mft *mft)
             warnx("Resource not declared in manifest: '%s'", name);
             return -1;
         }
+        /*
+         * On spt the guest issues its block I/O system calls directly on the
+         * backing host descriptor, so there is no tender-side I/O path which
+         * could distribute requests over several backing files.
+         */
+        if (strncmp(BLOCK_STRIPE_PREFIX, path,
+                    sizeof(BLOCK_STRIPE_PREFIX) - 1) == 0) {
+            warnx("%s: Striped block devices are not supported on spt", name);
+            return -1;
+        }
         off_t capacity;
         int fd = block_attach(path, &capacity);
         /* e->u.block_basic.block_size is set either by option or generated
@@ -111,6 +123,9 @@ static int setup(struct spt *spt, struct mft *mft)
     if (!module_in_use)
         return 0;
 
+    struct mft_entry *devs[MFT_MAX_ENTRIES];
+    int fds[MFT_MAX_ENTRIES];
+    unsigned nfds = 0;
     for (unsigned i = 0; i != mft->entries; i++) {
         if (mft->e[i].type != MFT_DEV_BLOCK_BASIC || !mft->e[i].attached)
             continue;
@@ -139,36 +154,53 @@ static int setup(struct spt *spt, struct mft *mft)
                                          "in size",
                  name, block_size);
 
-        int rc = -1;
-
         /*
-         * When reading or writing to the file descriptor, enforce that the
-         * operation cannot be performed beyond the (detected) capacity,
-         * otherwise, when backed by a regular file, the guest could grow the
-         * file size arbitrarily.
-         *
-         * The Solo5 API mandates that reads/writes must be equal to
-         * block_size, so we implement the above by ensuring that (A2 ==
-         * block_size) && (A3 <= (capacity - block_size) holds.
+         * The guest performs I/O on this device through the io_uring, see
+         * spt_module_io_uring.c.
          */
-        rc = seccomp_rule_add(
-            spt->sc_ctx, SCMP_ACT_ALLOW, SCMP_SYS(pread64), 3,
-            SCMP_A0(SCMP_CMP_EQ, mft->e[i].b.hostfd),
-            SCMP_A2(SCMP_CMP_EQ, mft->e[i].u.block_basic.block_size),
-            SCMP_A3(SCMP_CMP_LE, (mft->e[i].u.block_basic.capacity -
-                                  mft->e[i].u.block_basic.block_size)));
-        if (rc != 0)
-            errx(1, "seccomp_rule_add(pread64, fd=%d) failed: %s",
-                 mft->e[i].b.hostfd, strerror(-rc));
-        rc = seccomp_rule_add(
-            spt->sc_ctx, SCMP_ACT_ALLOW, SCMP_SYS(pwrite64), 3,
-            SCMP_A0(SCMP_CMP_EQ, mft->e[i].b.hostfd),
-            SCMP_A2(SCMP_CMP_EQ, mft->e[i].u.block_basic.block_size),
-            SCMP_A3(SCMP_CMP_LE, (mft->e[i].u.block_basic.capacity -
-                                  mft->e[i].u.block_basic.block_size)));
-        if (rc != 0)
-            errx(1, "seccomp_rule_add(pwrite64, fd=%d) failed: %s",
-                 mft->e[i].b.hostfd, strerror(-rc));
+        if (spt->io_uring.handles & (1ULL << i))
+            continue;
+
+        devs[nfds] = &mft->e[i];
+        fds[nfds++] = mft->e[i].b.hostfd;
+    }
+
+    /*
+     * When reading or writing to the file descriptor, enforce that the
+     * operation cannot be performed beyond the (detected) capacity,
+     * otherwise, when backed by a regular file, the guest could grow the
+     * file size arbitrarily.
+     *
+     * The Solo5 API mandates that reads/writes must be equal to
+     * block_size, so we implement the above by ensuring that (A2 ==
+     * block_size) && (A3 <= (capacity - block_size) holds.
+     *
+     * Devices with the same block_size and capacity share their rules.
+     */
+    bool done[MFT_MAX_ENTRIES] = { false };
+    for (unsigned i = 0; i != nfds; i++) {
+        if (done[i])
+            continue;
+        uint16_t block_size = devs[i]->u.block_basic.block_size;
+        uint64_t capacity = devs[i]->u.block_basic.capacity;
+        int group[MFT_MAX_ENTRIES];
+        unsigned ngroup = 0;
+        for (unsigned j = i; j != nfds; j++) {
+            if (devs[j]->u.block_basic.block_size == block_size &&
+                devs[j]->u.block_basic.capacity == capacity) {
+                group[ngroup++] = fds[j];
+                done[j] = true;
+            }
+        }
+
+        const struct scmp_arg_cmp cmps[] = {
+            SCMP_A2(SCMP_CMP_EQ, block_size),
+            SCMP_A3(SCMP_CMP_LE, (capacity - block_size)),
+        };
+        spt_seccomp_allow_fds(spt->sc_ctx, SCMP_SYS(pread64), "pread64",
+                              group, ngroup, cmps, 2);
+        spt_seccomp_allow_fds(spt->sc_ctx, SCMP_SYS(pwrite64), "pwrite64",
+                              group, ngroup, cmps, 2);
     }
 
     return 0;
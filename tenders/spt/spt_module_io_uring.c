@@ -0,0 +1,334 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * spt_module_io_uring.c: io_uring based network and block I/O.
+ *
+ * With --io-uring, the guest performs I/O on its devices by placing requests
+ * in an io_uring shared with it, which is polled by a kernel thread
+ * (IORING_SETUP_SQPOLL), instead of by system calls each checked by the
+ * seccomp filter. Before the ring is enabled, the devices' file descriptors
+ * are registered with it as fixed files, and it is restricted with
+ * IORING_REGISTER_RESTRICTIONS to reading and writing those, so the guest
+ * gains no access it would not have had through system calls. The seccomp
+ * filter only allows io_uring_enter() on the ring, to wake the polling
+ * thread and to wait for completions.
+ *
+ * Block devices backed by regular files keep using system calls, as the ring
+ * cannot enforce their capacity like the seccomp filter does (see
+ * spt_module_block.c), which would let the guest grow the file.
+ */
+
+#define _GNU_SOURCE
+#include <err.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#include <seccomp.h>
+#if defined(__has_include)
+#if __has_include(<linux/io_uring.h>)
+#include <linux/io_uring.h>
+#endif
+#endif
+
+#include "spt.h"
+
+/*
+ * Waiting for completions with a timeout needs IORING_ENTER_EXT_ARG (Linux
+ * 5.11), and libseccomp must know about io_uring_enter().
+ */
+#if defined(IORING_FEAT_EXT_ARG) && defined(__SNR_io_uring_enter)
+#define SPT_IO_URING_SUPPORTED 1
+#endif
+
+static bool module_in_use;
+static unsigned sq_thread_idle = 50; /* ms */
+
+#if defined(SPT_IO_URING_SUPPORTED)
+
+/*
+ * Room for the Ethernet header and a VLAN tag, in addition to the MTU.
+ */
+#define NET_HLEN 18
+
+static int sys_io_uring_setup(unsigned entries, struct io_uring_params *p)
+{
+    return syscall(SYS_io_uring_setup, entries, p);
+}
+
+static int sys_io_uring_register(int fd, unsigned opcode, void *arg,
+                                 unsigned nr_args)
+{
+    return syscall(SYS_io_uring_register, fd, opcode, arg, nr_args);
+}
+
+static void *map_ring(size_t size, int fd, off_t offset)
+{
+    void *p = mmap(NULL, size, PROT_READ | PROT_WRITE,
+                   MAP_SHARED | MAP_POPULATE, fd, offset);
+    if (p == MAP_FAILED)
+        err(1, "io_uring: Could not map ring");
+    return p;
+}
+
+void spt_io_uring_init(struct spt *spt, struct mft *mft, uint64_t p_end)
+{
+    if (!module_in_use)
+        return;
+
+    /*
+     * The fixed file index of each device is its handle, i.e. its index in
+     * the manifest.
+     */
+    int fds[MFT_MAX_ENTRIES];
+    uint64_t handles = 0;
+    unsigned nnet = 0, nblock = 0;
+    uint64_t mtu_max = 0;
+    for (unsigned i = 0; i != mft->entries; i++) {
+        struct mft_entry *e = &mft->e[i];
+        fds[i] = -1;
+        if (!e->attached)
+            continue;
+
+        if (e->type == MFT_DEV_NET_BASIC) {
+            /*
+             * A read on a non-blocking descriptor would complete at once
+             * with -EAGAIN, rather than when a packet arrives.
+             */
+            int flags = fcntl(e->b.hostfd, F_GETFL);
+            if (flags == -1 ||
+                fcntl(e->b.hostfd, F_SETFL, flags & ~O_NONBLOCK) == -1)
+                err(1, "io_uring: fcntl(hostfd=%d) failed", e->b.hostfd);
+            if (e->u.net_basic.mtu > mtu_max)
+                mtu_max = e->u.net_basic.mtu;
+            nnet++;
+        } else if (e->type == MFT_DEV_BLOCK_BASIC) {
+            struct stat sb;
+            if (fstat(e->b.hostfd, &sb) == -1)
+                err(1, "io_uring: fstat(hostfd=%d) failed", e->b.hostfd);
+            if (!S_ISBLK(sb.st_mode)) {
+                warnx("io_uring: %." XSTR(MFT_NAME_MAX) "s: Not a block "
+                      "device, using system calls",
+                      e->name);
+                continue;
+            }
+            nblock++;
+        } else {
+            continue;
+        }
+        fds[i] = e->b.hostfd;
+        handles |= 1ULL << i;
+    }
+    if (handles == 0)
+        return;
+
+    unsigned entries = nnet * 2 * SPT_IO_URING_NET_SLOTS +
+                       nblock * SPT_IO_URING_BLOCK_SLOTS;
+    unsigned sq_entries = 1;
+    while (sq_entries < entries)
+        sq_entries <<= 1;
+    unsigned cq_entries = 2 * sq_entries;
+
+    /*
+     * Reserve space at the top of guest memory for the packet buffers, the
+     * SQ and CQ (with room to spare for the kernel's header and alignment)
+     * and the SQ entries.
+     */
+    uint64_t page_size = sysconf(_SC_PAGESIZE);
+    uint64_t net_buf_size = (mtu_max + NET_HLEN + 63) & ~63ULL;
+    size_t bufs_size = nnet * 2 * SPT_IO_URING_NET_SLOTS * net_buf_size;
+    size_t rings_size = page_size + cq_entries * sizeof(struct io_uring_cqe) +
+                        sq_entries * sizeof(uint32_t);
+    size_t sqes_size = sq_entries * sizeof(struct io_uring_sqe);
+    bufs_size = (bufs_size + page_size - 1) & ~(page_size - 1);
+    rings_size = (rings_size + page_size - 1) & ~(page_size - 1);
+    sqes_size = (sqes_size + page_size - 1) & ~(page_size - 1);
+    size_t reserve = bufs_size + rings_size + sqes_size;
+    if (spt->mem_size < p_end || spt->mem_size - p_end < 2 * reserve)
+        errx(1, "io_uring: Not enough guest memory for the ring (%zu KB "
+                "needed)",
+             reserve >> 10);
+    uint64_t bufs_addr = spt->mem_size - reserve;
+    uint64_t rings_addr = bufs_addr + bufs_size;
+    uint64_t sqes_addr = rings_addr + rings_size;
+
+    /*
+     * The rings are placed in guest memory with IORING_SETUP_NO_MMAP (Linux
+     * 6.5, and 6.13 for rings larger than a page unless backed by a huge
+     * page), as io_uring does not allow mapping them at a given address.
+     * Failing that, they are mapped wherever the kernel chooses, which the
+     * guest can access just as well, sharing the tender's address space.
+     */
+    struct io_uring_params p = {
+        .flags = IORING_SETUP_SQPOLL | IORING_SETUP_R_DISABLED |
+                 IORING_SETUP_CQSIZE,
+        .sq_thread_idle = sq_thread_idle,
+        .cq_entries = cq_entries};
+    int fd = -1;
+#if defined(IORING_SETUP_NO_MMAP)
+    p.flags |= IORING_SETUP_NO_MMAP;
+    p.cq_off.user_addr = (uint64_t)(spt->mem + rings_addr);
+    p.sq_off.user_addr = (uint64_t)(spt->mem + sqes_addr);
+    fd = sys_io_uring_setup(sq_entries, &p);
+    if (fd == -1 && errno == EINVAL) {
+        memset(&p, 0, sizeof p);
+        p.flags = IORING_SETUP_SQPOLL | IORING_SETUP_R_DISABLED |
+                  IORING_SETUP_CQSIZE;
+        p.sq_thread_idle = sq_thread_idle;
+        p.cq_entries = cq_entries;
+    }
+#endif
+    bool in_guest_mem = (fd != -1);
+    if (fd == -1)
+        fd = sys_io_uring_setup(sq_entries, &p);
+    if (fd == -1)
+        err(1, "io_uring: io_uring_setup() failed");
+    if (!(p.features & IORING_FEAT_EXT_ARG) ||
+        !(p.features & IORING_FEAT_SINGLE_MMAP))
+        errx(1, "io_uring: Not supported by the host kernel (Linux 5.11 or "
+                "later is required)");
+    if (p.sq_entries != sq_entries || p.cq_entries != cq_entries)
+        errx(1, "io_uring: Ring size not supported by the host kernel");
+
+    uint8_t *rings, *sqes;
+    if (in_guest_mem) {
+        rings = spt->mem + rings_addr;
+        sqes = spt->mem + sqes_addr;
+        spt->mem_size = bufs_addr;
+    } else {
+        rings = map_ring(p.sq_off.array + sq_entries * sizeof(uint32_t) +
+                             cq_entries * sizeof(struct io_uring_cqe),
+                         fd, IORING_OFF_SQ_RING);
+        sqes = map_ring(sqes_size, fd, IORING_OFF_SQES);
+        bufs_addr = spt->mem_size - bufs_size;
+        spt->mem_size = bufs_addr;
+    }
+
+    uint32_t *array = (uint32_t *)(rings + p.sq_off.array);
+    for (uint32_t i = 0; i != sq_entries; i++)
+        array[i] = i;
+    struct spt_io_uring *ring = &spt->io_uring;
+    ring->fd = fd;
+    ring->sq_entries = sq_entries;
+    ring->cq_entries = cq_entries;
+    ring->sq_head = (uint32_t *)(rings + p.sq_off.head);
+    ring->sq_tail = (uint32_t *)(rings + p.sq_off.tail);
+    ring->sq_flags = (uint32_t *)(rings + p.sq_off.flags);
+    ring->sqes = sqes;
+    ring->cq_head = (uint32_t *)(rings + p.cq_off.head);
+    ring->cq_tail = (uint32_t *)(rings + p.cq_off.tail);
+    ring->cqes = rings + p.cq_off.cqes;
+    ring->handles = handles;
+    ring->net_bufs = spt->mem + bufs_addr;
+    ring->net_buf_size = net_buf_size;
+
+    if (sys_io_uring_register(fd, IORING_REGISTER_FILES, fds, mft->entries) ==
+        -1)
+        err(1, "io_uring: Could not register files");
+    struct io_uring_restriction res[] = {
+        {.opcode = IORING_RESTRICTION_SQE_OP, .sqe_op = IORING_OP_READ},
+        {.opcode = IORING_RESTRICTION_SQE_OP, .sqe_op = IORING_OP_WRITE},
+        {.opcode = IORING_RESTRICTION_SQE_FLAGS_ALLOWED,
+         .sqe_flags = IOSQE_FIXED_FILE},
+        {.opcode = IORING_RESTRICTION_SQE_FLAGS_REQUIRED,
+         .sqe_flags = IOSQE_FIXED_FILE}};
+    if (sys_io_uring_register(fd, IORING_REGISTER_RESTRICTIONS, res,
+                              sizeof res / sizeof res[0]) == -1)
+        err(1, "io_uring: Could not restrict ring");
+    if (sys_io_uring_register(fd, IORING_REGISTER_ENABLE_RINGS, NULL, 0) == -1)
+        err(1, "io_uring: Could not enable ring");
+
+    spt->features |= SPT_FEATURE_IO_URING;
+}
+
+static int setup(struct spt *spt, struct mft *mft)
+{
+    (void)mft;
+
+    if (!(spt->features & SPT_FEATURE_IO_URING))
+        return 0;
+
+    int rc = seccomp_rule_add(spt->sc_ctx, SCMP_ACT_ALLOW,
+                              SCMP_SYS(io_uring_enter), 1,
+                              SCMP_A0(SCMP_CMP_EQ, spt->io_uring.fd));
+    if (rc != 0)
+        errx(1, "seccomp_rule_add(io_uring_enter, fd=%d) failed: %s",
+             spt->io_uring.fd, strerror(-rc));
+
+    return 0;
+}
+
+#else /* !SPT_IO_URING_SUPPORTED */
+
+void spt_io_uring_init(struct spt *spt, struct mft *mft, uint64_t p_end)
+{
+    (void)spt;
+    (void)mft;
+    (void)p_end;
+
+    if (module_in_use)
+        errx(1, "--io-uring: Not supported by this build of solo5-spt");
+}
+
+static int setup(struct spt *spt, struct mft *mft)
+{
+    (void)spt;
+    (void)mft;
+
+    return 0;
+}
+
+#endif /* SPT_IO_URING_SUPPORTED */
+
+static int handle_cmdarg(char *cmdarg, struct mft *mft)
+{
+    (void)mft;
+    char *end;
+
+    if (strcmp("--io-uring", cmdarg) == 0) {
+        module_in_use = true;
+        return 0;
+    } else if (strncmp("--io-uring=", cmdarg, 11) == 0) {
+        unsigned long ms = strtoul(cmdarg + 11, &end, 10);
+        if (end == cmdarg + 11 || *end != '\0' || ms == 0 || ms > UINT32_MAX)
+            return -1;
+        sq_thread_idle = ms;
+        module_in_use = true;
+        return 0;
+    }
+    return -1;
+}
+
+static const char *usage(void)
+{
+    return "--io-uring[=MS] (perform network and block I/O through an "
+           "io_uring, whose polling thread sleeps after MS milliseconds "
+           "without requests; default 50)";
+}
+
+DECLARE_MODULE(io_uring, .setup = setup, .handle_cmdarg = handle_cmdarg,
+               .usage = usage)
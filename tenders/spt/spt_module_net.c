@@ -34,6 +34,7 @@
 
 #include "../common/tap_attach.h"
 #include "spt.h"
+#include "spt_seccomp.h"
 
 static bool module_in_use;
 
@@ -106,12 +107,20 @@ static int setup(struct spt *spt, struct mft *mft)
     if (!module_in_use)
         return 0;
 
+    int fds[MFT_MAX_ENTRIES];
+    unsigned nfds = 0;
     for (unsigned i = 0; i != mft->entries; i++) {
         if (mft->e[i].type != MFT_DEV_NET_BASIC || !mft->e[i].attached)
             continue;
         char no_mac[6] = {0};
         if (memcmp(mft->e[i].u.net_basic.mac, no_mac, sizeof no_mac) == 0)
             tap_attach_genmac(mft->e[i].u.net_basic.mac);
+        /*
+         * The guest performs I/O on this device through the io_uring, see
+         * spt_module_io_uring.c.
+         */
+        if (spt->io_uring.handles & (1ULL << i))
+            continue;
 
         int rc;
         struct epoll_event ev;
@@ -126,18 +135,14 @@ static int setup(struct spt *spt, struct mft *mft)
             err(1, "epoll_ctl(EPOLL_CTL_ADD, hostfd=%d) failed",
                 mft->e[i].b.hostfd);
 
-        rc = seccomp_rule_add(spt->sc_ctx, SCMP_ACT_ALLOW, SCMP_SYS(read), 1,
-                              SCMP_A0(SCMP_CMP_EQ, mft->e[i].b.hostfd));
-        if (rc != 0)
-            errx(1, "seccomp_rule_add(read, fd=%d) failed: %s",
-                 mft->e[i].b.hostfd, strerror(-rc));
-        rc = seccomp_rule_add(spt->sc_ctx, SCMP_ACT_ALLOW, SCMP_SYS(write), 1,
-                              SCMP_A0(SCMP_CMP_EQ, mft->e[i].b.hostfd));
-        if (rc != 0)
-            errx(1, "seccomp_rule_add(write, fd=%d) failed: %s",
-                 mft->e[i].b.hostfd, strerror(-rc));
+        fds[nfds++] = mft->e[i].b.hostfd;
     }
 
+    spt_seccomp_allow_fds(spt->sc_ctx, SCMP_SYS(read), "read", fds, nfds,
+                          NULL, 0);
+    spt_seccomp_allow_fds(spt->sc_ctx, SCMP_SYS(write), "write", fds, nfds,
+                          NULL, 0);
+
     return 0;
 }
 
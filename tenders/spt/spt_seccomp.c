@@ -0,0 +1,132 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * spt_seccomp.c: Helpers for generating the seccomp filter.
+ */
+
+#include <assert.h>
+#include <err.h>
+#include <inttypes.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <string.h>
+#include <seccomp.h>
+
+#include "spt_seccomp.h"
+
+/*
+ * System calls made by the guest on its I/O paths, in rough order of
+ * frequency: per packet, per block, and per solo5_yield().
+ */
+static const int hot_syscalls[] = {
+    SCMP_SYS(read),
+    SCMP_SYS(write),
+    SCMP_SYS(pread64),
+    SCMP_SYS(pwrite64),
+#if defined(__SNR_io_uring_enter)
+    SCMP_SYS(io_uring_enter),
+#endif
+#if defined(__SNR_epoll_pwait2)
+    SCMP_SYS(epoll_pwait2),
+#endif
+    SCMP_SYS(epoll_pwait),
+    SCMP_SYS(clock_gettime),
+    SCMP_SYS(timerfd_settime),
+};
+
+void spt_seccomp_optimize(void *sc_ctx, bool binary_tree)
+{
+    int rc;
+
+    /*
+     * libseccomp otherwise checks system calls one after the other, in order
+     * of priority.
+     */
+    if (binary_tree) {
+#if SCMP_VER_MAJOR > 2 || (SCMP_VER_MAJOR == 2 && SCMP_VER_MINOR >= 5)
+        rc = seccomp_attr_set(sc_ctx, SCMP_FLTATR_CTL_OPTIMIZE, 2);
+        if (rc != 0)
+            warnx("seccomp_attr_set(SCMP_FLTATR_CTL_OPTIMIZE) failed: %s",
+                  strerror(-rc));
+#endif
+    }
+
+    for (unsigned i = 0; i < sizeof hot_syscalls / sizeof hot_syscalls[0];
+         i++) {
+        rc = seccomp_syscall_priority(sc_ctx, hot_syscalls[i], 255 - i);
+        if (rc != 0)
+            errx(1, "seccomp_syscall_priority(%d) failed: %s", hot_syscalls[i],
+                 strerror(-rc));
+    }
+}
+
+void spt_seccomp_allow_fds(void *sc_ctx, int syscall, const char *name,
+                           const int *fds, unsigned nfds,
+                           const struct scmp_arg_cmp *cmps, unsigned ncmps)
+{
+    if (nfds == 0)
+        return;
+
+    /*
+     * Sort a copy of (fds), there are at most MFT_MAX_ENTRIES.
+     */
+    int sorted[nfds];
+    for (unsigned i = 0; i < nfds; i++) {
+        unsigned j = i;
+        for (; j > 0 && sorted[j - 1] > fds[i]; j--)
+            sorted[j] = sorted[j - 1];
+        sorted[j] = fds[i];
+    }
+
+    struct scmp_arg_cmp args[1 + ncmps];
+    memcpy(&args[1], cmps, ncmps * sizeof cmps[0]);
+
+    unsigned i = 0;
+    while (i < nfds) {
+        assert(sorted[i] >= 0);
+        uint64_t lo = sorted[i], hi = lo;
+        for (i++; i < nfds && (uint64_t)sorted[i] <= hi + 1; i++)
+            hi = sorted[i];
+
+        /*
+         * libseccomp allows only one comparison per argument, so cover the
+         * run [lo, hi] with naturally aligned power-of-two sized blocks, each
+         * matched with a single SCMP_CMP_MASKED_EQ.
+         */
+        while (lo <= hi) {
+            uint64_t size = (lo != 0) ? (lo & -lo) : (1ULL << 31);
+            while (lo + size - 1 > hi)
+                size >>= 1;
+            if (size == 1)
+                args[0] = SCMP_A0(SCMP_CMP_EQ, lo);
+            else
+                args[0] = SCMP_A0(SCMP_CMP_MASKED_EQ, ~(size - 1), lo);
+            int rc = seccomp_rule_add_array(sc_ctx, SCMP_ACT_ALLOW, syscall,
+                                            1 + ncmps, args);
+            if (rc != 0)
+                errx(1,
+                     "seccomp_rule_add(%s, fd=%" PRIu64 "-%" PRIu64
+                     ") failed: %s",
+                     name, lo, lo + size - 1, strerror(-rc));
+            lo += size;
+        }
+    }
+}
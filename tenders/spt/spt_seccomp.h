@@ -0,0 +1,49 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+/*
+ * spt_seccomp.h: Helpers for generating the seccomp filter.
+ *
+ * These are shared with solo5-spt-bench-seccomp, and so do not depend on
+ * struct spt.
+ */
+
+#ifndef SPT_SECCOMP_H
+#define SPT_SECCOMP_H
+
+#include <seccomp.h>
+
+/*
+ * Lay out the filter in (sc_ctx) so that the system calls made on the
+ * guest's I/O paths are checked first. Must be called before any rules are
+ * added.
+ */
+void spt_seccomp_optimize(void *sc_ctx, bool binary_tree);
+
+/*
+ * Allow (syscall) if its first argument is any of the (nfds) file descriptors
+ * in (fds), and the (ncmps) further comparisons in (cmps) hold. Runs of
+ * consecutive descriptors are matched by as few rules as possible.
+ */
+void spt_seccomp_allow_fds(void *sc_ctx, int syscall, const char *name,
+                           const int *fds, unsigned nfds,
+                           const struct scmp_arg_cmp *cmps, unsigned ncmps);
+
+#endif /* SPT_SECCOMP_H */
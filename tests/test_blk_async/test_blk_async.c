@@ -0,0 +1,172 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "solo5.h"
+#include "../../bindings/lib.c"
+
+static void puts(const char *s)
+{
+    solo5_console_write(s, strlen(s));
+}
+
+#define NREQS 16
+#define MAX_BLOCK_SIZE 4096
+
+static uint8_t bufs[NREQS][MAX_BLOCK_SIZE];
+
+static void fill(uint8_t *buf, size_t size, unsigned seed)
+{
+    for (size_t i = 0; i < size; i++)
+        buf[i] = (uint8_t)('A' + (seed + i) % 26);
+}
+
+static bool check(const uint8_t *buf, size_t size, unsigned seed)
+{
+    for (size_t i = 0; i < size; i++)
+        if (buf[i] != (uint8_t)('A' + (seed + i) % 26))
+            return false;
+    return true;
+}
+
+/*
+ * Submit (n) requests of (op), request i targeting block (i * 3), retrying
+ * on SOLO5_R_AGAIN after reaping, then wait for all completions. Returns
+ * false if any request or its completion failed.
+ */
+static bool run_batch(solo5_handle_t h, solo5_block_op_t op, size_t bsize,
+                      int n)
+{
+    struct solo5_block_completion c[NREQS];
+    int submitted = 0, completed = 0;
+    uint32_t done = 0;
+
+    while (completed < n) {
+        while (submitted < n) {
+            solo5_result_t rc = solo5_block_submit(h, op,
+                    (solo5_off_t)submitted * 3 * bsize, bufs[submitted],
+                    bsize, 0x1000 + submitted);
+            if (rc == SOLO5_R_AGAIN)
+                break;
+            if (rc != SOLO5_R_OK)
+                return false;
+            submitted++;
+        }
+
+        size_t reaped;
+        solo5_result_t rc = solo5_block_reap(h, c, NREQS, &reaped);
+        if (rc == SOLO5_R_AGAIN) {
+            solo5_handle_set_t ready;
+            solo5_yield(solo5_clock_monotonic() + 1000000000ULL, &ready);
+            continue;
+        }
+        if (rc != SOLO5_R_OK)
+            return false;
+        for (size_t i = 0; i < reaped; i++) {
+            uint64_t idx = c[i].tag - 0x1000;
+            if (idx >= (uint64_t)n || (done & (1U << idx)) ||
+                    c[i].result != SOLO5_R_OK)
+                return false;
+            done |= (1U << idx);
+            completed++;
+        }
+    }
+    return true;
+}
+
+int solo5_app_main(const struct solo5_start_info *si __attribute__((unused)))
+{
+    puts("\n**** Solo5 standalone test_blk_async ****\n\n");
+
+    solo5_handle_t h;
+    struct solo5_block_info bi;
+    if (solo5_block_acquire("storage", &h, &bi) != SOLO5_R_OK) {
+        puts("Could not acquire 'storage' block device\n");
+        return 99;
+    }
+    if (bi.block_size > MAX_BLOCK_SIZE ||
+            bi.capacity < NREQS * 3 * bi.block_size) {
+        puts("Block device geometry not supported by test\n");
+        return 98;
+    }
+
+    uint8_t buf[bi.block_size];
+    struct solo5_block_completion c;
+    size_t reaped;
+
+    /*
+     * Misaligned or out of range requests must be rejected at submit time.
+     */
+    if (solo5_block_submit(h, SOLO5_BLOCK_OP_READ, 1, buf, bi.block_size, 0)
+            == SOLO5_R_OK)
+        return 1;
+    if (solo5_block_submit(h, SOLO5_BLOCK_OP_READ, bi.capacity, buf,
+            bi.block_size, 0) == SOLO5_R_OK)
+        return 2;
+    if (solo5_block_reap(h, &c, 1, &reaped) != SOLO5_R_AGAIN)
+        return 3;
+
+    /*
+     * Write a distinct pattern to each of NREQS blocks, then read them back
+     * asynchronously and verify.
+     */
+    for (int i = 0; i < NREQS; i++)
+        fill(bufs[i], bi.block_size, i);
+    if (!run_batch(h, SOLO5_BLOCK_OP_WRITE, bi.block_size, NREQS))
+        return 4;
+
+    for (int i = 0; i < NREQS; i++)
+        memset(bufs[i], 0, bi.block_size);
+    if (!run_batch(h, SOLO5_BLOCK_OP_READ, bi.block_size, NREQS))
+        return 5;
+    for (int i = 0; i < NREQS; i++)
+        if (!check(bufs[i], bi.block_size, i))
+            return 6;
+
+    /*
+     * Synchronous I/O must still work while an asynchronous request is
+     * outstanding.
+     */
+    memset(bufs[0], 0, bi.block_size);
+    if (solo5_block_submit(h, SOLO5_BLOCK_OP_READ, 0, bufs[0], bi.block_size,
+            42) != SOLO5_R_OK)
+        return 7;
+    if (solo5_block_read(h, 3 * bi.block_size, buf, bi.block_size)
+            != SOLO5_R_OK)
+        return 8;
+    if (!check(buf, bi.block_size, 1))
+        return 9;
+    for (;;) {
+        solo5_result_t rc = solo5_block_reap(h, &c, 1, &reaped);
+        if (rc == SOLO5_R_OK)
+            break;
+        if (rc != SOLO5_R_AGAIN)
+            return 10;
+        solo5_handle_set_t ready;
+        solo5_yield(solo5_clock_monotonic() + 1000000000ULL, &ready);
+    }
+    if (reaped != 1 || c.tag != 42 || c.result != SOLO5_R_OK)
+        return 11;
+    if (!check(bufs[0], bi.block_size, 0))
+        return 12;
+
+    puts("SUCCESS\n");
+
+    return SOLO5_EXIT_SUCCESS;
+}
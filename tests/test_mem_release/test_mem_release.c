@@ -0,0 +1,78 @@
+/*
+ * Copyright (c) 2015-2019 Contributors as noted in the AUTHORS file
+ *
+ * This file is part of Solo5, a sandboxed execution environment.
+ *
+ * Permission to use, copy, modify, and/or distribute this software
+ * for any purpose with or without fee is hereby granted, provided
+ * that the above copyright notice and this permission notice appear
+ * in all copies.
+ *
+ * THE SOFTWARE IS PROVIDED "AS IS" AND THE AUTHOR DISCLAIMS ALL
+ * WARRANTIES WITH REGARD TO THIS SOFTWARE INCLUDING ALL IMPLIED
+ * WARRANTIES OF MERCHANTABILITY AND FITNESS. IN NO EVENT SHALL THE
+ * AUTHOR BE LIABLE FOR ANY SPECIAL, DIRECT, INDIRECT, OR
+ * CONSEQUENTIAL DAMAGES OR ANY DAMAGES WHATSOEVER RESULTING FROM LOSS
+ * OF USE, DATA OR PROFITS, WHETHER IN AN ACTION OF CONTRACT,
+ * NEGLIGENCE OR OTHER TORTIOUS ACTION, ARISING OUT OF OR IN
+ * CONNECTION WITH THE USE OR PERFORMANCE OF THIS SOFTWARE.
+ */
+
+#include "solo5.h"
+#include "../../bindings/lib.c"
+
+#define PAGE_SIZE 4096
+#define NPAGES    13 /* Not a power of two */
+
+static void puts(const char *s)
+{
+    solo5_console_write(s, strlen(s));
+}
+
+int solo5_app_main(const struct solo5_start_info *si)
+{
+    puts("\n**** Solo5 standalone test_mem_release ****\n\n");
+
+    uintptr_t start = (si->heap_start + PAGE_SIZE - 1) & ~(PAGE_SIZE - 1);
+    size_t size = NPAGES * PAGE_SIZE;
+    volatile uint8_t *p = (volatile uint8_t *)start;
+
+    if (start + size > si->heap_start + si->heap_size) {
+        puts("Heap too small\n");
+        return SOLO5_EXIT_FAILURE;
+    }
+    for (size_t i = 0; i < size; i++)
+        p[i] = 0xaa;
+
+    /*
+     * Requests outside the heap, or not page aligned, must be refused.
+     */
+    if (solo5_mem_release(start + 1, PAGE_SIZE) != SOLO5_R_EINVAL ||
+        solo5_mem_release(start, PAGE_SIZE + 1) != SOLO5_R_EINVAL ||
+        solo5_mem_release(start - PAGE_SIZE, size) != SOLO5_R_EINVAL ||
+        solo5_mem_release(start, si->heap_size + PAGE_SIZE) !=
+            SOLO5_R_EINVAL) {
+        puts("Invalid request not refused\n");
+        return SOLO5_EXIT_FAILURE;
+    }
+
+    if (solo5_mem_release(start, size) != SOLO5_R_OK) {
+        puts("solo5_mem_release() failed\n");
+        return SOLO5_EXIT_FAILURE;
+    }
+
+    /*
+     * The contents are now undefined, but the memory must remain usable.
+     */
+    for (size_t i = 0; i < size; i++)
+        p[i] = 0x55;
+    for (size_t i = 0; i < size; i++) {
+        if (p[i] != 0x55) {
+            puts("Released memory not usable\n");
+            return SOLO5_EXIT_FAILURE;
+        }
+    }
+
+    puts("SUCCESS\n");
+    return SOLO5_EXIT_SUCCESS;
+}
@@ -278,10 +278,191 @@ static const solo5_time_t NSEC_PER_SEC = 1000000000ULL;
 
 #define TARGET_PINGS 10000
 
-int solo5_app_main(const struct solo5_start_info *si)
+/*
+ * Returns true if (buf) was turned into a reply which should be sent.
+ */
+static bool handle_packet(uint8_t *buf)
+{
+    struct ether *p = (struct ether *)buf;
+
+    if (memcmp(p->target, net_info.mac_address, HLEN_ETHER) &&
+        memcmp(p->target, macaddr_brd, HLEN_ETHER))
+        return false;
+
+    switch (htons(p->type)) {
+    case ETHERTYPE_ARP:
+        return handle_arp(buf);
+    case ETHERTYPE_IP:
+        return handle_ip(buf);
+    default:
+        return false;
+    }
+}
+
+static bool check_corruption(void)
 {
-    (void)si;
+    if (n_corrupted > 0) {
+        puts("Data corruption detected after ");
+        put_uint(n_verified);
+        puts(" good packets, ");
+        put_uint(n_corrupted);
+        puts(" corrupted\n");
+        puts("FAILURE\n");
+        return true;
+    }
+    return false;
+}
+
+/*
+ * Serve using solo5_net_read_many() / solo5_net_write_many(), replying to a
+ * whole batch of requests at once.
+ */
+#define BATCH_SIZE     32
+#define BATCH_BUF_SIZE 2048
 
+static uint8_t batch_bufs[BATCH_SIZE][BATCH_BUF_SIZE];
+
+static int serve_batched(void)
+{
+    uint8_t *rx[BATCH_SIZE];
+    const uint8_t *tx[BATCH_SIZE];
+    size_t rx_sizes[BATCH_SIZE], tx_sizes[BATCH_SIZE];
+
+    if (net_info.mtu + SOLO5_NET_HLEN > BATCH_BUF_SIZE) {
+        puts("MTU too large for batched mode\n");
+        puts("FAILURE\n");
+        return SOLO5_EXIT_FAILURE;
+    }
+    for (unsigned i = 0; i < BATCH_SIZE; i++)
+        rx[i] = batch_bufs[i];
+
+    while (n_verified < TARGET_PINGS) {
+        solo5_handle_set_t ready_set = 0;
+        size_t nread, ntx = 0;
+
+        solo5_yield(solo5_clock_monotonic() + NSEC_PER_SEC, &ready_set);
+        if (!(ready_set & (1U << net_handle)))
+            continue;
+
+        if (solo5_net_read_many(net_handle, rx, BATCH_BUF_SIZE, rx_sizes,
+                                BATCH_SIZE, &nread) != SOLO5_R_OK)
+            continue;
+
+        for (size_t i = 0; i < nread; i++) {
+            if (handle_packet(rx[i])) {
+                tx[ntx] = rx[i];
+                tx_sizes[ntx] = rx_sizes[i];
+                ntx++;
+            }
+        }
+
+        size_t sent = 0;
+        while (sent < ntx) {
+            size_t written;
+            solo5_result_t result =
+                solo5_net_write_many(net_handle, &tx[sent], &tx_sizes[sent],
+                                     ntx - sent, &written);
+            sent += written;
+            if (result != SOLO5_R_OK && result != SOLO5_R_AGAIN) {
+                puts("Write error\n");
+                puts("FAILURE\n");
+                return SOLO5_EXIT_FAILURE;
+            }
+        }
+
+        if (check_corruption())
+            return SOLO5_EXIT_FAILURE;
+    }
+
+    puts("Verified ");
+    put_uint(n_verified);
+    puts(" packets in batched mode, 0 corrupted\n");
+    puts("SUCCESS\n");
+    return SOLO5_EXIT_SUCCESS;
+}
+
+/*
+ * Send more frames than the ring holds as fast as possible, reading in
+ * between. Run with a transmit rate limit, the ring fills up with frames the
+ * host has yet to send, as it does when the TAP queue is full; reads must
+ * still complete rather than wait for those, or fail. How quickly the ring
+ * fills up depends on the host, so keep sending (up to BURST_FRAMES_MAX)
+ * until it has.
+ */
+#define BURST_FRAMES     2048
+#define BURST_FRAMES_MAX (4 * BURST_FRAMES)
+#define BURST_FRAME_SIZE 256
+
+static int burst(void)
+{
+    static uint8_t frame[BURST_FRAME_SIZE];
+    struct ether *e = (struct ether *)frame;
+    uint8_t buf[net_info.mtu + SOLO5_NET_HLEN];
+    unsigned long sent = 0, nread = 0, nagain = 0;
+
+    memcpy(e->target, macaddr_brd, HLEN_ETHER);
+    memcpy(e->source, net_info.mac_address, HLEN_ETHER);
+    e->type = htons(0x88b5); /* IEEE 802 local experimental */
+
+    uint8_t *const bufs[1] = {buf};
+    size_t read_sizes[1], read_count;
+    if (solo5_net_read_many(net_handle + 1, bufs, sizeof buf, read_sizes, 1,
+                            &read_count) != SOLO5_R_EINVAL ||
+        solo5_net_read_many(net_handle, bufs, sizeof buf - 1, read_sizes, 1,
+                            &read_count) != SOLO5_R_EINVAL) {
+        puts("Invalid batched read accepted\n");
+        puts("FAILURE\n");
+        return SOLO5_EXIT_FAILURE;
+    }
+
+    while (sent < BURST_FRAMES ||
+           (nagain == 0 && sent < BURST_FRAMES_MAX)) {
+        solo5_result_t result =
+            solo5_net_write(net_handle, frame, sizeof frame);
+        if (result == SOLO5_R_OK) {
+            sent++;
+        } else if (result == SOLO5_R_AGAIN) {
+            nagain++;
+        } else {
+            puts("Write error\n");
+            puts("FAILURE\n");
+            return SOLO5_EXIT_FAILURE;
+        }
+        if (result == SOLO5_R_AGAIN) {
+            /*
+             * Alternate between single and batched reads, both of which must
+             * complete with the ring full.
+             */
+            if (nagain & 1) {
+                result = solo5_net_read_many(net_handle, bufs, sizeof buf,
+                                             read_sizes, 1, &read_count);
+            } else {
+                result = solo5_net_read(net_handle, buf, sizeof buf,
+                                        &read_sizes[0]);
+            }
+            if (result == SOLO5_R_OK) {
+                nread++;
+            } else if (result != SOLO5_R_AGAIN) {
+                puts("Read error\n");
+                puts("FAILURE\n");
+                return SOLO5_EXIT_FAILURE;
+            }
+        }
+    }
+
+    puts("Sent ");
+    put_uint(sent);
+    puts(" frames (");
+    put_uint(nagain);
+    puts(" retried), read ");
+    put_uint(nread);
+    puts("\n");
+    puts("SUCCESS\n");
+    return SOLO5_EXIT_SUCCESS;
+}
+
+int solo5_app_main(const struct solo5_start_info *si)
+{
     puts("\n**** Solo5 test_net_ring: ioeventfd data integrity ****\n\n");
 
     if (solo5_net_acquire("service0", &net_handle, &net_info) != SOLO5_R_OK) {
@@ -290,6 +471,9 @@ int solo5_app_main(const struct solo5_start_info *si)
         return SOLO5_EXIT_FAILURE;
     }
 
+    if (strcmp(si->cmdline, "burst") == 0)
+        return burst();
+
     send_garp();
 
     puts("Serving ping on 10.0.0.2, verifying payload pattern 0xdeadbeef\n");
@@ -297,6 +481,9 @@ int solo5_app_main(const struct solo5_start_info *si)
     put_uint(TARGET_PINGS);
     puts(" verified packets\n");
 
+    if (strcmp(si->cmdline, "batch") == 0)
+        return serve_batched();
+
     while (n_verified < TARGET_PINGS) {
         solo5_handle_set_t ready_set = 0;
         uint8_t buf[net_info.mtu + SOLO5_NET_HLEN];
@@ -311,25 +498,7 @@ int solo5_app_main(const struct solo5_start_info *si)
         if (result != SOLO5_R_OK)
             continue;
 
-        struct ether *p = (struct ether *)buf;
-
-        if (memcmp(p->target, net_info.mac_address, HLEN_ETHER) &&
-            memcmp(p->target, macaddr_brd, HLEN_ETHER))
-            continue;
-
-        bool handled = false;
-        switch (htons(p->type)) {
-        case ETHERTYPE_ARP:
-            handled = handle_arp(buf);
-            break;
-        case ETHERTYPE_IP:
-            handled = handle_ip(buf);
-            break;
-        default:
-            break;
-        }
-
-        if (handled) {
+        if (handle_packet(buf)) {
             if (solo5_net_write(net_handle, buf, len) != SOLO5_R_OK) {
                 puts("Write error\n");
                 puts("FAILURE\n");
@@ -337,15 +506,8 @@ int solo5_app_main(const struct solo5_start_info *si)
             }
         }
 
-        if (n_corrupted > 0) {
-            puts("Data corruption detected after ");
-            put_uint(n_verified);
-            puts(" good packets, ");
-            put_uint(n_corrupted);
-            puts(" corrupted\n");
-            puts("FAILURE\n");
+        if (check_corruption())
             return SOLO5_EXIT_FAILURE;
-        }
     }
 
     puts("Verified ");
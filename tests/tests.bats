@@ -262,6 +262,33 @@ xen_expect_abort() {
   [[ "$output" != *"Solo5:"* ]]
 }
 
+@test "mem_hugepages hvt" {
+  skip_unless_host_is Linux
+
+  hvt_run --mem-hugepages=thp -- test_hello/test_hello.hvt Hello_Solo5
+  expect_success
+  # Falls back to transparent huge pages if the hugetlbfs pool is empty.
+  hvt_run --mem-hugepages=2M -- test_hello/test_hello.hvt Hello_Solo5
+  expect_success
+}
+
+@test "mem_above_4gb hvt" {
+  skip_unless_host_is Linux
+
+  hvt_run --mem=4608 -- test_hello/test_hello.hvt Hello_Solo5
+  [[ "$output" == *"Host does not support 1GB pages"* ]] && \
+    skip "host does not support 1GB pages"
+  expect_success
+  [[ "$output" == *"stack < 0x120000000"* ]]
+}
+
+@test "mem_hugepages spt" {
+  spt_run --mem=64 --mem-hugepages=thp -- test_hello/test_hello.spt Hello_Solo5
+  expect_success
+  spt_run --mem=64 --mem-hugepages=2M -- test_hello/test_hello.spt Hello_Solo5
+  expect_success
+}
+
 # Don't run this for now, as we have a message that is always output in
 # console.c.
 # @test "quiet xen" {
@@ -310,6 +337,52 @@ xen_expect_abort() {
   expect_success
 }
 
+@test "mem_release hvt" {
+  hvt_run test_mem_release/test_mem_release.hvt
+  expect_success
+}
+
+@test "mem_release stats hvt" {
+  skip_unless_host_is Linux
+
+  hvt_run --stats -- test_mem_release/test_mem_release.hvt
+  expect_success
+  [[ "$output" == *"mem.release bytes=53248 failed_bytes=0"* ]]
+}
+
+@test "mem_release mem-lock hvt" {
+  skip_unless_host_is Linux
+  skip_unless_root
+
+  hvt_run --mem-lock --mem-prefault --numa-node=0 -- \
+      test_mem_release/test_mem_release.hvt
+  expect_success
+}
+
+@test "mem_release virtio" {
+  virtio_run test_mem_release/test_mem_release.virtio
+  virtio_expect_success
+}
+
+@test "mem_release spt" {
+  spt_run test_mem_release/test_mem_release.spt
+  expect_success
+}
+
+@test "mem_release mem-lock spt" {
+  # Locking 512 MB usually exceeds RLIMIT_MEMLOCK for other users.
+  skip_unless_root
+
+  spt_run --mem-lock --mem-prefault --numa-node=0 -- \
+      test_mem_release/test_mem_release.spt
+  expect_success
+}
+
+@test "mem_release xen" {
+  xen_run test_mem_release/test_mem_release.xen
+  expect_success
+}
+
 @test "exception hvt" {
   hvt_run test_exception/test_exception.hvt
   expect_abort
@@ -554,6 +627,32 @@ xen_expect_abort() {
   [ "$status" = 1 ] && [[ "$output" == *"Block size must be a multiple of 2 greater than or equal 512"* ]]
 }
 
+@test "blk stripe hvt" {
+  dd if=/dev/zero of=${BATS_TMPDIR}/storage0.img bs=4k count=512 status=none
+  dd if=/dev/zero of=${BATS_TMPDIR}/storage1.img bs=4k count=512 status=none
+  hvt_run --block:storage=stripe:4k:${BATS_TMPDIR}/storage0.img,${BATS_TMPDIR}/storage1.img \
+      -- test_blk/test_blk.hvt
+  expect_success
+}
+
+@test "blk stripe block-sector-size=4096 hvt" {
+  # A stripe unit smaller than the sector size makes every request span both
+  # members.
+  dd if=/dev/zero of=${BATS_TMPDIR}/storage0.img bs=4k count=512 status=none
+  dd if=/dev/zero of=${BATS_TMPDIR}/storage1.img bs=4k count=512 status=none
+  hvt_run --block:storage=stripe:1k:${BATS_TMPDIR}/storage0.img,${BATS_TMPDIR}/storage1.img \
+      --block-sector-size:storage=4096 -- test_blk/test_blk.hvt
+  expect_success
+}
+
+@test "blk iops and bandwidth limits hvt" {
+  setup_block
+  hvt_run --block:storage=${BLOCK} --block-iops:storage=2000 \
+      --block-bw:storage=1M -- test_blk/test_blk.hvt
+  expect_success
+  [[ "$output" == *"storage: throttled"* ]]
+}
+
 @test "blk virtio" {
   setup_block
   virtio_run -d ${BLOCK} -- test_blk/test_blk.virtio
@@ -572,6 +671,65 @@ xen_expect_abort() {
   expect_success
 }
 
+@test "blk async hvt" {
+  setup_block
+  hvt_run --block:storage=${BLOCK} -- test_blk_async/test_blk_async.hvt
+  expect_success
+}
+
+@test "blk async multicall hvt" {
+  skip_unless_host_is Linux
+  setup_block
+  hvt_run --stats --block:storage=${BLOCK} -- \
+      test_blk_async/test_blk_async.hvt
+  expect_success
+  [[ "$output" == *"hypercall.multicall count="* ]]
+}
+
+@test "blk async stripe hvt" {
+  dd if=/dev/zero of=${BATS_TMPDIR}/storage0.img bs=4k count=512 status=none
+  dd if=/dev/zero of=${BATS_TMPDIR}/storage1.img bs=4k count=512 status=none
+  hvt_run --block:storage=stripe:1k:${BATS_TMPDIR}/storage0.img,${BATS_TMPDIR}/storage1.img \
+      --block-sector-size:storage=4096 -- test_blk_async/test_blk_async.hvt
+  expect_success
+}
+
+@test "blk async virtio" {
+  setup_block
+  virtio_run -d ${BLOCK} -- test_blk_async/test_blk_async.virtio
+  virtio_expect_success
+}
+
+@test "blk async spt" {
+  setup_block
+  spt_run --block:storage=${BLOCK} -- test_blk_async/test_blk_async.spt
+  expect_success
+}
+
+@test "blk io_uring spt" {
+  skip_unless_root
+  setup_block
+  LOOP=$(losetup -f --show ${BLOCK}) || skip "could not set up loop device"
+  spt_run --io-uring --block:storage=${LOOP} -- test_blk/test_blk.spt
+  losetup -d ${LOOP}
+  expect_success
+}
+
+@test "blk async io_uring spt" {
+  skip_unless_root
+  setup_block
+  LOOP=$(losetup -f --show ${BLOCK}) || skip "could not set up loop device"
+  spt_run --io-uring --block:storage=${LOOP} -- test_blk_async/test_blk_async.spt
+  losetup -d ${LOOP}
+  expect_success
+}
+
+@test "blk io_uring regular file spt" {
+  setup_block
+  spt_run --io-uring --block:storage=${BLOCK} -- test_blk/test_blk.spt
+  expect_success && [[ "$output" == *"Not a block device, using system calls"* ]]
+}
+
 @test "blk misaligned spt" {
   dd if=/dev/zero of=${BATS_TMPDIR}/storage.img \
       bs=2k count=3 status=none
@@ -620,6 +778,14 @@ xen_expect_abort() {
   expect_success
 }
 
+@test "net io_uring spt" {
+  skip_unless_root
+
+  ( sleep 1; ${TIMEOUT} 60s ping -fq -c 100000 ${NET0_IP} ) &
+  spt_run --io-uring --net:service0=${NET0} -- test_net/test_net.spt limit
+  expect_success
+}
+
 @test "net_2if hvt" {
   skip_unless_root
   [ "${CONFIG_HOST}" = "OpenBSD" ] && skip "breaks on OpenBSD due to #374"
@@ -682,6 +848,35 @@ xen_expect_abort() {
   expect_success
 }
 
+@test "net_ring burst hvt" {
+  skip_unless_root
+  skip_unless_host_is Linux
+
+  # The rate limit keeps the ring full of frames waiting to be sent, as a
+  # full TAP queue would. Reads must still complete.
+  hvt_run --net:service0=${NET0} --net-rate:service0=128K -- \
+      test_net_ring/test_net_ring.hvt burst
+  expect_success
+  [[ "$output" != *"(0 retried)"* ]]
+}
+
+@test "net-rate hvt" {
+  skip_unless_root
+  skip_unless_host_is Linux
+
+  for rate in 0 -1 1X 1K2 bogus; do
+    hvt_run --net:service0=${NET0} --net-rate:service0=${rate} -- \
+        test_net_ring/test_net_ring.hvt burst
+    [ "$status" -eq 1 ] && [[ "$output" == *"Invalid rate: '${rate}'"* ]]
+  done
+
+  hvt_run --net:service0=${NET0} --net-rate:service0=128K -- \
+      test_net_ring/test_net_ring.hvt burst
+  expect_success
+  [[ "$output" == *"service0: throttled"* ]]
+  [[ "$output" != *"throttled 0 frames"* ]]
+}
+
 @test "net_ring spt" {
   skip_unless_root
 
@@ -690,6 +885,23 @@ xen_expect_abort() {
   expect_success
 }
 
+@test "net_ring batch hvt" {
+  skip_unless_root
+  skip_unless_host_is Linux
+
+  ( sleep 1; ${TIMEOUT} 60s ping -fq -c 10000 -p deadbeef ${NET0_IP} ) &
+  hvt_run --net:service0=${NET0} -- test_net_ring/test_net_ring.hvt batch
+  expect_success
+}
+
+@test "net_ring batch spt" {
+  skip_unless_root
+
+  ( sleep 1; ${TIMEOUT} 60s ping -fq -c 10000 -p deadbeef ${NET0_IP} ) &
+  spt_run --net:service0=${NET0} -- test_net_ring/test_net_ring.spt batch
+  expect_success
+}
+
 @test "dumpcore hvt" {
   [ "${CONFIG_HOST_ARCH}" = "x86_64" ] || skip "not implemented for ${CONFIG_HOST_ARCH}"
   skip_unless_host_is Linux FreeBSD
@@ -701,6 +913,163 @@ xen_expect_abort() {
   [ -f "$BATS_TMPDIR"/"$CORE" ]
 }
 
+@test "dumpcore compressed hvt" {
+  [ "${CONFIG_HOST_ARCH}" = "x86_64" ] || skip "not implemented for ${CONFIG_HOST_ARCH}"
+  skip_unless_host_is Linux FreeBSD
+  command -v gzip >/dev/null || skip "gzip not available"
+
+  run ${TIMEOUT} --foreground 60s ${HVT_TENDER_DEBUG} \
+     --dumpcore="$BATS_TMPDIR",compress=gzip,regions=image:stack \
+     test_dumpcore/test_dumpcore.hvt
+  [ "$status" -eq 255 ]
+  [[ "$output" == *"dumpcore: dumped "*" ms ("*" bytes on disk)"* ]]
+  CORE=`echo "$output" | grep -o "core\.solo5-hvt\.[0-9]*\.gz$"`
+  [ -f "$BATS_TMPDIR"/"$CORE" ]
+  gzip -dc "$BATS_TMPDIR"/"$CORE" | head -c 4 | grep -q ELF
+}
+
+@test "profile hvt" {
+  skip_unless_host_is Linux
+
+  # test_time spends most of its time in solo5_yield(), which is sampled on
+  # re-entry to the guest.
+  hvt_run --profile=${BATS_TMPDIR}/profile.folded,hz=1000 -- test_time/test_time.hvt
+  [[ "$output" == *"profile: "*" samples in "*" unique stacks written to "* ]]
+  grep -q "solo5_yield [0-9][0-9]*$" ${BATS_TMPDIR}/profile.folded
+}
+
+@test "stats hvt" {
+  skip_unless_host_is Linux
+
+  hvt_run --stats -- test_hello/test_hello.hvt Hello_Solo5
+  expect_success
+  [[ "$output" == *"guest count="*" hist="* ]]
+  [[ "$output" == *"exit.io count="* ]]
+  [[ "$output" == *"hypercall.puts count="*" max_ns="* ]]
+}
+
+@test "perf-counters hvt" {
+  skip_unless_host_is Linux
+
+  hvt_run --perf-counters=cycles,page-faults -- \
+      test_hello/test_hello.hvt Hello_Solo5
+  expect_success
+  # Hosts without a PMU count task-clock in place of cycles.
+  [[ "$output" == *"perf.cycles guest="*" host="* ]] || \
+      [[ "$output" == *"perf.task-clock count="* ]]
+  [[ "$output" == *"perf.page-faults count="* ]]
+}
+
+@test "boot-trace hvt" {
+  skip_unless_host_is Linux
+
+  hvt_run --boot-trace -- test_hello/test_hello.hvt Hello_Solo5
+  expect_success
+  [[ "$output" == *"tender.vcpu_run ns="*" mono_ns="* ]]
+  [[ "$output" == *"guest._start ns="* ]]
+  [[ "$output" == *"guest.solo5_app_main ns="* ]]
+  [[ "$output" == *"tender.rss max_kb="* ]]
+}
+
+@test "cpu hvt" {
+  skip_unless_host_is Linux
+
+  hvt_run --vcpu-cpu=0 -- test_hello/test_hello.hvt Hello_Solo5
+  expect_success
+  # The vCPU and the I/O threads spin waiting for each other.
+  hvt_run --vcpu-cpu=0 --io-cpus=0 -- test_hello/test_hello.hvt Hello_Solo5
+  [ "$status" -eq 1 ]
+  [[ "$output" == *"must not share a CPU with the I/O threads"* ]]
+  hvt_run --sched=fifo:10 -- test_hello/test_hello.hvt Hello_Solo5
+  [ "$status" -eq 1 ]
+  [[ "$output" == *"--sched requires --vcpu-cpu and --io-cpus"* ]]
+}
+
+@test "dedicated-cpu hvt" {
+  skip_unless_host_is Linux
+  [ "${CONFIG_HOST_ARCH}" = "x86_64" ] || skip "not implemented for ${CONFIG_HOST_ARCH}"
+
+  hvt_run --vcpu-cpu=0 --dedicated-cpu=hlt --stats -- \
+      test_hello/test_hello.hvt Hello_Solo5
+  expect_success
+  [[ "$output" == *"kvm.exits count="* ]]
+  hvt_run --dedicated-cpu -- test_hello/test_hello.hvt Hello_Solo5
+  [ "$status" -eq 1 ]
+  [[ "$output" == *"--dedicated-cpu requires --vcpu-cpu"* ]]
+}
+
+@test "pool hvt" {
+  skip_unless_host_is Linux
+
+  POOL=${BATS_TMPDIR}/solo5-hvt-pool.sock
+  "${HVT_TENDER}" --pool-serve=${POOL},shells=1,mem=32 \
+      >${BATS_TMPDIR}/pool.log 2>&1 3>&- &
+  POOL_PID=$!
+  sleep 1
+  # Served by a shell created in advance, and by one started from scratch.
+  run ${TIMEOUT} --foreground 60s "${HVT_TENDER}" --pool=${POOL} --mem=8 -- \
+      test_hello/test_hello.hvt Hello_Solo5
+  expect_success
+  run ${TIMEOUT} --foreground 60s "${HVT_TENDER}" --pool=${POOL} --mem=64 -- \
+      test_hello/test_hello.hvt Hello_Solo5
+  expect_success
+  # The exit status of the tender is passed back.
+  run ${TIMEOUT} --foreground 60s "${HVT_TENDER}" --pool=${POOL} --mem=8 -- \
+      test_exception/test_exception.hvt
+  expect_abort
+  kill ${POOL_PID}
+  wait ${POOL_PID} || true
+  [ ! -e ${POOL} ]
+}
+
+@test "snapshot hvt" {
+  skip_unless_host_is Linux
+
+  hvt_run --snapshot=${BATS_TMPDIR}/test_hello.snap --snapshot-at=puts:2 -- \
+      test_hello/test_hello.hvt Hello_Solo5
+  expect_success
+  [[ "$output" == *"snapshot: wrote "* ]]
+  # The command line is part of the restored guest state.
+  hvt_run --restore=${BATS_TMPDIR}/test_hello.snap -- test_hello/test_hello.hvt
+  expect_success
+  [[ "$output" == *"Command line is: 'Hello_Solo5'"* ]]
+  rm -f ${BATS_TMPDIR}/test_hello.snap
+}
+
+@test "snapshot multicall hvt" {
+  skip_unless_host_is Linux
+  setup_block
+
+  # Submits are batched, the snapshot is taken once the batch is done, when
+  # the requests are outstanding and a restored guest could not reap them.
+  hvt_run --block:storage=${BLOCK} \
+      --snapshot=${BATS_TMPDIR}/test_blk_async.snap \
+      --snapshot-at=block_submit:2 -- test_blk_async/test_blk_async.hvt
+  [ "$status" -eq 1 ]
+  [[ "$output" == *"asynchronous requests outstanding"* ]]
+  rm -f ${BATS_TMPDIR}/test_blk_async.snap
+}
+
+@test "clone hvt" {
+  skip_unless_host_is Linux
+
+  local SOCK=${BATS_TMPDIR}/clone.sock
+  rm -f ${SOCK}
+  ${TIMEOUT} --foreground 60s "${HVT_TENDER}" --mem=4096 \
+      --clone-socket=${SOCK} --snapshot-at=poll:1 -- \
+      test_time/test_time.hvt >${BATS_TMPDIR}/clone.log 2>&1 &
+  local parent=$!
+  for i in $(${SEQ} 1 50); do
+    [ -S ${SOCK} ] && break
+    sleep 0.1
+  done
+  hvt_run --clone=${SOCK} -- test_time/test_time.hvt
+  expect_success
+  wait ${parent}
+  grep -q SUCCESS ${BATS_TMPDIR}/clone.log
+  rm -f ${SOCK} ${BATS_TMPDIR}/clone.log
+}
+
 @test "mft_maxdevices hvt" {
   for num in $(${SEQ} 0 62); do
       dd if=/dev/zero of=${BATS_TMPDIR}/storage${num}.img \